@@ -3,14 +3,58 @@
 
 include_guard(DIRECTORY)
 
-find_package(PythonInterp REQUIRED)
+# The native packing tool (twpack) is built and run at build time. Turn it off
+# to pack with tool/pack.py at configure time, e.g. when cross-compiling
+option(TW_NATIVE_PACKER "Pack files with the native packing tool" ON)
+# Block-compressed archives (.twa) decompress only the blocks touched by
+# seeking and partial reads. Only the native packing tool can build them
+option(TW_PACK_TWA "Pack files into block-compressed archives instead of zip files" OFF)
+
+if(NOT TW_NATIVE_PACKER)
+    find_package(PythonInterp REQUIRED)
+endif()
 
 function(tw_pack_files output basepath)
-    execute_process(
-        COMMAND ${PYTHON_EXECUTABLE}
-        "${CMAKE_SOURCE_DIR}/tool/pack.py"
-        "-o" ${output}
-        "-b" ${basepath}
-        "-i" ${ARGN}
-    )
+    # Missing inputs, e.g. fonts which are not distributed with the sources,
+    # are skipped instead of breaking the build
+    set(inputs)
+    foreach(input ${ARGN})
+        if(EXISTS ${input})
+            list(APPEND inputs ${input})
+        else()
+            message(WARNING "Skip missing file ${input} when packing ${output}")
+        endif()
+    endforeach()
+
+    if(TW_NATIVE_PACKER)
+        if(TW_PACK_TWA)
+            string(REGEX REPLACE "\\.pak$" ".twa" output ${output})
+        endif()
+        get_filename_component(output_dir ${output} DIRECTORY)
+        file(MAKE_DIRECTORY ${output_dir})
+        file(RELATIVE_PATH output_name ${CMAKE_BINARY_DIR} ${output})
+        string(MAKE_C_IDENTIFIER ${output_name} target_suffix)
+
+        # Packages are updated incrementally with the manifest of content hashes
+        add_custom_command(
+            OUTPUT ${output}
+            BYPRODUCTS "${output}.manifest"
+            COMMAND twpack
+            "-o" ${output}
+            "-b" ${basepath}
+            "-i" ${inputs}
+            DEPENDS twpack ${inputs}
+            COMMENT "Packing ${output_name}"
+            VERBATIM
+        )
+        add_custom_target(pack_${target_suffix} ALL DEPENDS ${output})
+    else()
+        execute_process(
+            COMMAND ${PYTHON_EXECUTABLE}
+            "${CMAKE_SOURCE_DIR}/tool/pack.py"
+            "-o" ${output}
+            "-b" ${basepath}
+            "-i" ${inputs}
+        )
+    endif()
 endfunction()
@@ -0,0 +1,44 @@
+#version 330 core
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+// Sampling of virtual textures through the page table
+
+in vec2 coord;
+out vec4 frag;
+uniform sampler2D page_table;
+uniform sampler2D tile_cache;
+uniform vec2 vt_size; // Size of level 0 in pixels
+uniform float tile_size;
+uniform float tile_border;
+uniform vec2 cache_size; // Size of the tile cache in tiles
+uniform int levels;
+
+vec4 SampleVirtual(vec2 uv)
+{
+    vec2 px = uv * vt_size;
+    vec2 dx = dFdx(px);
+    vec2 dy = dFdy(px);
+    float lod = 0.5f * log2(max(dot(dx, dx), dot(dy, dy)));
+    int level = clamp(int(floor(lod)), 0, levels - 1);
+
+    // Entry: position in the cache (xy), level of the resident tile (z)
+    ivec2 page = ivec2(clamp(px, vec2(0.0f), vt_size - 1.0f) / tile_size) >> level;
+    vec4 entry = texelFetch(page_table, page, level) * 255.0f;
+    float scale = exp2(-entry.z);
+
+    vec2 in_tile = mod(px * scale, tile_size);
+    float padded = tile_size + 2.0f * tile_border;
+    vec2 cache_px = entry.xy * padded + tile_border + in_tile;
+    return textureGrad(
+        tile_cache,
+        cache_px / (cache_size * padded),
+        dFdx(uv) * scale * vt_size / (cache_size * padded),
+        dFdy(uv) * scale * vt_size / (cache_size * padded)
+    );
+}
+
+void main()
+{
+    frag = SampleVirtual(coord);
+}
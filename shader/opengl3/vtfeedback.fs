@@ -0,0 +1,31 @@
+#version 330 core
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+// Feedback pass of virtual textures
+// Output the tile required by each fragment, see VirtualTexture::ProcessFeedback()
+
+in vec2 coord;
+out vec4 frag;
+uniform vec2 vt_size; // Size of level 0 in pixels
+uniform float tile_size;
+uniform int levels;
+// log2 of the downscaling of the feedback buffer relative to the screen
+uniform float feedback_bias;
+
+void main()
+{
+    vec2 px = coord * vt_size;
+    vec2 dx = dFdx(px);
+    vec2 dy = dFdy(px);
+    float lod = 0.5f * log2(max(dot(dx, dx), dot(dy, dy))) - feedback_bias;
+    int level = clamp(int(floor(lod)), 0, levels - 1);
+
+    ivec2 tile = ivec2(clamp(px, vec2(0.0f), vt_size - 1.0f) / tile_size) >> level;
+    frag = vec4(
+        float(tile.x & 0xFF),
+        float(tile.y & 0xFF),
+        float(((tile.x >> 8) & 0x0F) | (((tile.y >> 8) & 0x0F) << 4)),
+        float(level + 1)
+    ) / 255.0f;
+}
@@ -3,12 +3,15 @@
 
 #include <glad/glad.h>
 #include "app.hpp"
+#include <chrono>
 #include <stdexcept>
 #include <stb_image.h> // set flip
 #include <imgui_impl_sdl.h>
 #include "editor/editor.hpp"
 #include "graphic/graphic.hpp"
+#include "res/assetcache.hpp"
 #include "res/vfs.hpp"
+#include "script/bytecode.hpp"
 #include "script/script.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 #include <imgui_impl_opengl3.h>
@@ -16,6 +19,13 @@
 
 namespace awe
 {
+    // Time of a frame given to script coroutines
+    constexpr std::chrono::microseconds SCRIPT_FRAME_BUDGET(4000);
+    // Time of a frame given to incremental garbage collection
+    constexpr std::chrono::microseconds SCRIPT_GC_BUDGET(1000);
+    // VRAM budget of streamed textures
+    constexpr std::size_t TEXTURE_STREAMING_BUDGET = 256 * 1024 * 1024;
+
     App::App() = default;
     App::~App() = default;
 
@@ -27,6 +37,31 @@ namespace awe
 
     void App::Initialize(const AppInitData& initdata)
     {
+        // Prefetch the resources required by initialization, so they are
+        // read while the window and the renderer are being created
+        m_io = std::make_unique<vfs::IoService>();
+        // Changes of loose files are published in the main loop
+        m_watcher = std::make_unique<vfs::FileWatcher>();
+        m_watcher->WatchSearchPath();
+        m_script_watch = m_watcher->Subscribe(
+            "script/",
+            [this](const vfs::FileChange&) { m_script_changed = true; }
+        );
+        vfs::IoHandle font_data;
+        if(m_lang.HasFont())
+            font_data = m_io->Read(m_lang.GetFontVfsPath(), vfs::IoPriority::CRITICAL);
+        PrefetchList script_srcs;
+        {
+            std::vector<std::string> files;
+            vfs::EnumFiles("script", std::back_inserter(files));
+            for(auto& f : files)
+            {
+                std::string path = "script/" + f;
+                vfs::IoHandle handle = m_io->Read(path, vfs::IoPriority::HIGH);
+                script_srcs.emplace_back(std::move(path), std::move(handle));
+            }
+        }
+
         m_window = std::make_shared<window::Window>(
             "Testworld",
             640, 480,
@@ -36,6 +71,9 @@ namespace awe
         m_imgui_ctx = ImGui::CreateContext();
         m_renderer = graphic::CreateRenderer(initdata, *m_window);
         m_renderer->Initialize();
+        m_streamer = std::make_unique<graphic::TextureStreamer>(*m_renderer, TEXTURE_STREAMING_BUDGET);
+        m_streamer->Watch(*m_watcher);
+        LoadShaderPrograms();
         auto renderer_info = m_renderer->QueryRendererInfo();
         auto& io = ImGui::GetIO();
         SDL_LogInfo(
@@ -57,15 +95,16 @@ namespace awe
         // Create ImGui window
         m_console = std::make_unique<imgui::Console>();
         m_editor = std::make_unique<Editor>();
-        m_console->Write("Testworld Angelscript Console");
+        m_console->WriteStatic("Testworld Angelscript Console");
 
         // ImGui fonts
         auto& fonts = io.Fonts;
-        GetLanguagePak().AddFont();
+        if(font_data.IsValid())
+            GetLanguagePak().AddFont(font_data.GetFuture().get());
         fonts->AddFontDefault();
         fonts->Build();
 
-        PrepareScriptEnv();
+        PrepareScriptEnv(script_srcs);
     }
 
     void App::Deinitialize()
@@ -75,6 +114,12 @@ namespace awe
         m_editor.reset();
         m_console.reset();
 
+        m_shaders.clear();
+        m_streamer.reset();
+        m_script_watch.Reset();
+        m_watcher.reset();
+        m_io.reset();
+
         m_renderer->Deinitialize();
         ImGui_ImplSDL2_Shutdown();
         ImGui::DestroyContext(m_imgui_ctx);
@@ -100,16 +145,14 @@ namespace awe
             "Begin mainloop"
         );
 
-        asIScriptModule* testworld = m_as_engine->GetModule("Testworld");
-
-        asIScriptContext* main_ctx = m_as_engine->CreateContext();
-        
-        auto Preload = script::GenCallerByDecl<void()>(testworld, "void Preload()", main_ctx);
+        auto Preload = m_testworld->GetFunction<void()>("void Preload()");
         if(Preload) Preload();
 
-        auto EditorBeginMainloop = script::GenCallerByDecl<void()>(testworld, "void EditorBeginMainloop()", main_ctx);
+        auto EditorBeginMainloop = m_testworld->GetFunction<void()>("void EditorBeginMainloop()");
         if(EditorBeginMainloop) EditorBeginMainloop();
-        auto EditorNewFrame = script::GenCallerByDecl<void()>(testworld, "void EditorNewFrame()", main_ctx);
+        // Resolved again when the scripts are reloaded
+        auto EditorNewFrame = m_testworld->GetFunction<void()>("void EditorNewFrame()");
+        m_script_changed = false;
 
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -137,6 +180,16 @@ namespace awe
                 }
             }
 
+            // Completion callbacks of asynchronous reading
+            m_io->Poll();
+            // Changed files
+            m_watcher->Poll();
+            if(m_script_changed)
+            {
+                m_script_changed = false;
+                ReloadScripts();
+            }
+
             // UI Processing
             ImGui_ImplSDL2_NewFrame(m_window->GetHandle());
             ImGui::NewFrame();
@@ -145,24 +198,71 @@ namespace awe
 
             m_editor->NewFrame();
             if(EditorNewFrame) EditorNewFrame();
+            m_scheduler->Update(SCRIPT_FRAME_BUDGET);
+            // Join point of the script jobs submitted in this frame
+            m_jobs->Wait();
+            m_gc->Update(SCRIPT_GC_BUDGET);
 
             // Rendering
+            m_streamer->Update();
             ImGui::Render();
 
             m_renderer->Present();
         }
         m_renderer->QuitMainloop();
 
-        main_ctx->Release();
-
         SDL_LogInfo(
             SDL_LOG_CATEGORY_APPLICATION,
             "Quit mainloop"
         );
     }
 
-    void App::PrepareScriptEnv()
+    void App::LoadShaderPrograms()
     {
+        struct ProgramSources
+        {
+            const char* name;
+            const char* vs;
+            const char* fs;
+        };
+        const ProgramSources programs[] =
+        {
+            { "screen", "shader/opengl3/rect2D.vs", "shader/opengl3/screen.fs" },
+            { "fontatlas", "shader/opengl3/rect2D.vs", "shader/opengl3/fontatlas.fs" },
+            { "text", "shader/opengl3/text.vs", "shader/opengl3/text.fs" },
+            { "vtexture", "shader/opengl3/rect2D.vs", "shader/opengl3/vtexture.fs" },
+            { "vtfeedback", "shader/opengl3/rect2D.vs", "shader/opengl3/vtfeedback.fs" }
+        };
+
+        for(auto& i : programs)
+        {
+            try
+            {
+                auto program = m_renderer->CreateShaderProgram();
+                program->AddShaderSrcVfs(graphic::ShaderType::VERTEX, i.vs);
+                program->AddShaderSrcVfs(graphic::ShaderType::FRAGMENT, i.fs);
+                program->Submit();
+                program->Watch(*m_watcher);
+                m_shaders[i.name] = std::move(program);
+            }
+            catch(const std::exception& e)
+            {
+                SDL_LogError(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to load shader program \"%s\": %s",
+                    i.name,
+                    e.what()
+                );
+            }
+        }
+    }
+
+    void App::PrepareScriptEnv(const PrefetchList& script_srcs)
+    {
+        // Must be installed before the library allocates anything
+        script::InstallScriptAllocator();
+        // Scripts may be run by the workers of the job system
+        asPrepareMultithread();
         m_as_engine = asCreateScriptEngine();
         int r = 0;
         r = m_as_engine->SetMessageCallback(
@@ -171,37 +271,143 @@ namespace awe
             asCALL_THISCALL
         );
 
+        m_ctx_pool = std::make_unique<script::ContextPool>(m_as_engine);
         script::InitScriptEnv(m_as_engine);
 
         awe::script::RegisterEditor(m_as_engine, m_editor.get());
+        m_jobs = std::make_unique<script::JobSystem>(m_as_engine);
+        script::RegisterJobSystem(m_as_engine, m_jobs.get());
+        m_gc = std::make_unique<script::GarbageCollector>(m_as_engine);
+        script::RegisterGarbageCollector(m_as_engine, m_gc.get());
+        m_profiler = std::make_unique<script::Profiler>(m_ctx_pool.get());
+        script::RegisterProfiler(m_as_engine, m_profiler.get());
+        m_scheduler = std::make_unique<script::Scheduler>(m_as_engine, m_io.get());
+        script::RegisterScheduler(m_as_engine, m_scheduler.get());
 
         m_as_builder = std::make_unique<CScriptBuilder>();
         r = m_console->SetScriptEngine(m_as_engine, m_as_builder.get());
         assert(r >= 0);
 
         // Build internal script
-        m_as_builder->StartNewModule(m_as_engine, "Testworld");
-        std::vector<std::string> script_srcs;
-        vfs::EnumFiles("script", std::back_inserter(script_srcs));
-        for(const auto& f : script_srcs)
-        {
-            r = script::AddSectionFromVfs(m_as_builder.get(), "script/" + f);
-        }
-        r = m_as_builder->BuildModule();
-        assert(r >= 0);
+        script::ScriptSources sources;
+        sources.reserve(script_srcs.size());
+        for(const auto& [path, handle] : script_srcs)
+            sources.emplace_back(path, handle.GetFuture().get());
+        m_testworld = std::make_unique<script::ScriptModule>(
+            m_as_engine,
+            "Testworld",
+            res::GetAssetCache()
+        );
+        auto result = m_testworld->Build(sources);
+        assert(result.r >= 0);
+        SDL_LogInfo(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Module \"Testworld\" %s (%zu file(s))",
+            result.from_cache ? "loaded from the bytecode cache" : "compiled",
+            sources.size()
+        );
     }
     void App::ClearScriptEnv()
     {
+        m_scheduler.reset();
+        m_jobs.reset();
+        m_gc.reset();
+        m_profiler.reset();
+        m_testworld.reset();
         m_console->ReleaseScriptEngine();
         script::ClearScriptEnv(m_as_engine);
         m_as_builder.reset();
+        m_ctx_pool.reset();
         m_as_engine->ShutDownAndRelease();
+        asUnprepareMultithread();
+    }
+
+    void App::ReloadScripts()
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::string> files;
+        vfs::EnumFiles("script", std::back_inserter(files));
+
+        script::ScriptSources sources;
+        sources.reserve(files.size());
+        try
+        {
+            for(auto& f : files)
+            {
+                std::string path = "script/" + f;
+                vfs::MappedData data = vfs::MapData(path);
+                sources.emplace_back(std::move(path), std::move(data));
+            }
+        }
+        catch(const std::exception& e)
+        {
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Failed to reload scripts, the previous module is kept: %s",
+                e.what()
+            );
+            return;
+        }
+
+        // Coroutines cannot be moved to the new module
+        const std::size_t coroutines = m_scheduler->Size();
+        auto result = m_testworld->Build(sources);
+        if(result.r < 0)
+        {
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Failed to reload scripts, the previous module is kept"
+            );
+            return;
+        }
+        if(!result.rebuilt)
+            return;
+
+        if(coroutines != 0)
+        {
+            SDL_LogWarn(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "%zu coroutine(s) aborted by reloading scripts",
+                coroutines
+            );
+            m_scheduler->Clear();
+        }
+        // Idle contexts still reference functions of the previous module
+        m_ctx_pool->UnprepareIdle();
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        SDL_LogInfo(
+            SDL_LOG_CATEGORY_APPLICATION,
+            "Scripts reloaded in %.2f ms (%zu file(s), %zu global(s) restored, %zu reinitialized)",
+            elapsed.count(),
+            files.size(),
+            result.restored,
+            result.dropped
+        );
     }
 
     LangPak& App::GetLanguagePak()
     {
         return m_lang;
     }
+    vfs::IoService& App::GetIoService()
+    {
+        return *m_io;
+    }
+    vfs::FileWatcher& App::GetFileWatcher()
+    {
+        return *m_watcher;
+    }
+    graphic::TextureStreamer& App::GetTextureStreamer()
+    {
+        return *m_streamer;
+    }
+    graphic::IShaderProgram* App::GetShaderProgram(const std::string& name)
+    {
+        auto it = m_shaders.find(name);
+        return it == m_shaders.end() ? nullptr : it->second.get();
+    }
 
     void App::MessageCallback(const asSMessageInfo* msg)
     {
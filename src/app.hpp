@@ -5,14 +5,27 @@
 #define TESTWORLD_APP_HPP
 
 #include <functional>
+#include <map>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 #include <angelscript.h>
 #include <scriptbuilder/scriptbuilder.h>
 #include <imgui.h>
 #include "sys/init.hpp"
 #include "editor/editor.hpp"
 #include "res/lang/lang.hpp"
+#include "res/ioservice.hpp"
+#include "res/watcher.hpp"
+#include "script/context.hpp"
+#include "script/job.hpp"
+#include "script/memory.hpp"
+#include "script/module.hpp"
+#include "script/profiler.hpp"
+#include "script/scheduler.hpp"
 #include "graphic/renderer.hpp"
+#include "graphic/streaming.hpp"
 #include "ui/console.hpp"
 #include "window/window.hpp"
 
@@ -37,22 +50,49 @@ namespace awe
 
 
         LangPak& GetLanguagePak();
+        vfs::IoService& GetIoService();
+        vfs::FileWatcher& GetFileWatcher();
+        graphic::TextureStreamer& GetTextureStreamer();
+        // Return nullptr if the program is not loaded
+        graphic::IShaderProgram* GetShaderProgram(const std::string& name);
 
         std::function<bool()> BeforeQuit;
 
     private:
-        void PrepareScriptEnv();
+        typedef std::vector<std::pair<std::string, vfs::IoHandle>> PrefetchList;
+
+        // Build the shader programs from the virtual filesystem. Programs are
+        // reloaded when their sources are changed
+        void LoadShaderPrograms();
+
+        void PrepareScriptEnv(const PrefetchList& script_srcs);
         void ClearScriptEnv();
+        // Rebuild the script module from the virtual filesystem if the
+        // sources are changed. The previous module is kept if the new one
+        // cannot be built
+        void ReloadScripts();
 
         std::shared_ptr<window::Window> m_window;
         std::shared_ptr<graphic::IRenderer> m_renderer;
         ImGuiContext* m_imgui_ctx = nullptr;
+        std::unique_ptr<graphic::TextureStreamer> m_streamer;
+        std::map<std::string, std::unique_ptr<graphic::IShaderProgram>> m_shaders;
 
         LangPak m_lang;
+        std::unique_ptr<vfs::IoService> m_io;
+        std::unique_ptr<vfs::FileWatcher> m_watcher;
+        vfs::WatchSubscription m_script_watch;
+        bool m_script_changed = false;
 
         std::unique_ptr<Editor> m_editor;
 
         asIScriptEngine* m_as_engine;
+        std::unique_ptr<script::ContextPool> m_ctx_pool;
+        std::unique_ptr<script::JobSystem> m_jobs;
+        std::unique_ptr<script::GarbageCollector> m_gc;
+        std::unique_ptr<script::Profiler> m_profiler;
+        std::unique_ptr<script::Scheduler> m_scheduler;
+        std::unique_ptr<script::ScriptModule> m_testworld;
         std::unique_ptr<CScriptBuilder> m_as_builder;
 
         void MessageCallback(const asSMessageInfo* msg);
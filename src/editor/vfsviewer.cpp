@@ -7,87 +7,25 @@
 #include <vector>
 #include <physfs.h>
 #include <fmt/core.h>
+#include "../res/listing.hpp"
+#include "../res/vfs.hpp"
 
 
 namespace awe
 {
     namespace detailed
     {
-        struct CacheNode
+        struct ListingCache
         {
-            CacheNode() {}
-            CacheNode(const CacheNode&) = default;
-            CacheNode(CacheNode&& move)
-                : name(move.name),
-                fullpath(move.fullpath),
-                children(std::move(move.children)),
-                info(std::move(move.info))
-            {
-                std::memcpy(&stat, &move.stat, sizeof(stat));
-                std::memset(&move.stat, 0, sizeof(stat));
-            }
-
-            CacheNode& operator=(CacheNode&&) = default;
-
-            std::string name;
-            std::string fullpath;
-            PHYSFS_Stat stat;
-
-            std::vector<CacheNode> children;
-
-            std::optional<std::string> info;
-
-            void BuildChildren(const char* const* files)
-            {
-                for(int i = 0; files[i]; ++i)
-                {
-                    CacheNode child;
-                    child.name = files[i];
-                    child.fullpath.reserve(
-                        fullpath.size() +
-                        1 + child.name.size()
-                    );
-                    child.fullpath = fullpath;
-                    if(name != "/" && fullpath != "")
-                        child.fullpath.push_back('/');
-                    child.fullpath.append(
-                        child.name
-                    );
-                    PHYSFS_stat(
-                        child.fullpath.c_str(),
-                        &child.stat
-                    );
-
-                    if(child.stat.filetype == PHYSFS_FILETYPE_DIRECTORY)
-                    {
-                        auto subfiles = PHYSFS_enumerateFiles(
-                            child.fullpath.c_str()
-                        );
-                        if(subfiles)
-                        {
-                            try
-                            {
-                                child.BuildChildren(subfiles);
-                            }
-                            catch(...)
-                            {
-                                PHYSFS_freeList(subfiles);
-                                throw;
-                            }
-                            PHYSFS_freeList(subfiles);
-                        }
-                    }
-
-                    children.emplace_back(
-                        std::move(child)
-                    );
-                }
-            }
+            vfs::DirectoryListing listing;
+            // Tooltips, created when first shown
+            std::vector<std::optional<std::string>> info;
 
-            const std::string& GetInfo()
+            const std::string& GetInfo(std::uint32_t idx)
             {
-                if(info)
-                    return *info;
+                auto& result = info[idx];
+                if(result)
+                    return *result;
 
                 const char* type_name[] =
                 {
@@ -106,31 +44,35 @@ namespace awe
                     std::strftime(buf, 32, "%Y/%m/%d %H:%M:%S", tm);
                     return buf;
                 };
-                info = fmt::format(
+                const auto& entry = listing[idx];
+                const auto& stat = entry.stat;
+                result = fmt::format(
                     "File type: {} ({})\n"
                     "Full path: {}\n"
+                    "Size: {}\n"
                     "Last modified time: {}\n"
                     "Creation time: {}\n"
                     "Last access time: {}\n"
                     "Readonly: {}",
                     type_name[stat.filetype], stat.filetype,
-                    fullpath,
+                    listing.GetPath(entry),
+                    stat.filesize,
                     time_util(stat.modtime),
                     time_util(stat.createtime),
                     time_util(stat.accesstime),
                     stat.readonly ? 'Y' : 'N'
                 );
 
-                return *info;
+                return *result;
             }
         };
 
-        void Tooltip(CacheNode& node)
+        void Tooltip(ListingCache& cache, std::uint32_t idx)
         {
             if(ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
             {
                 ImGui::BeginTooltip();
-                const auto& info = node.GetInfo();
+                const auto& info = cache.GetInfo(idx);
                 ImGui::TextUnformatted(
                     info.c_str(),
                     info.c_str() + info.size()
@@ -139,23 +81,29 @@ namespace awe
             }
         }
 
-        void RenderTree(CacheNode& node)
+        void RenderTree(ListingCache& cache, std::uint32_t first, std::uint32_t count)
         {
-            if(node.children.empty())
-            {
-                ImGui::Text(node.name.c_str());
-                Tooltip(node);
-            }
-            else
+            for(std::uint32_t i = first; i < first + count; ++i)
             {
-                bool opened = ImGui::TreeNode(node.name.c_str());
-                Tooltip(node);
-                if(opened)
+                const auto& entry = cache.listing[i];
+                const auto name = cache.listing.GetName(entry);
+                ImGui::PushID(static_cast<int>(i));
+                if(entry.child_count == 0)
                 {
-                    for(auto& v : node.children)
-                        RenderTree(v);
-                    ImGui::TreePop();
+                    ImGui::TextUnformatted(name.data(), name.data() + name.size());
+                    Tooltip(cache, i);
                 }
+                else
+                {
+                    bool opened = ImGui::TreeNode("", "%.*s", static_cast<int>(name.size()), name.data());
+                    Tooltip(cache, i);
+                    if(opened)
+                    {
+                        RenderTree(cache, entry.first_child, entry.child_count);
+                        ImGui::TreePop();
+                    }
+                }
+                ImGui::PopID();
             }
         }
     }
@@ -166,12 +114,31 @@ namespace awe
     {
         if(ImGui::Begin("Virtual Filesystem Viewer"))
         {
-            if(!m_root)
+            if(!m_cache || ImGui::Button("Refresh"))
             {
-                BuildNode();
+                BuildCache();
             }
 
-            detailed::RenderTree(*m_root);
+            auto stats = vfs::GetPathIndexStats();
+            ImGui::Text(
+                "Path index: %zu entries, %llu hit(s), %llu miss(es), %llu bypassed",
+                stats.entries,
+                static_cast<unsigned long long>(stats.hits),
+                static_cast<unsigned long long>(stats.misses),
+                static_cast<unsigned long long>(stats.bypassed)
+            );
+            ImGui::Text(
+                "Listing: %zu entries, %zu bytes",
+                m_cache->listing.Size(),
+                m_cache->listing.MemoryUsage()
+            );
+            ImGui::Separator();
+
+            if(ImGui::TreeNode("/"))
+            {
+                detailed::RenderTree(*m_cache, 0, m_cache->listing.RootCount());
+                ImGui::TreePop();
+            }
         }
         ImGui::End();
     }
@@ -185,20 +152,11 @@ namespace awe
         m_open = false;
     }
 
-    void VfsViewer::BuildNode()
+    void VfsViewer::BuildCache()
     {
-        assert(!m_root);
-        m_root = std::make_shared<detailed::CacheNode>();
-
-        constexpr auto dir = "/";
-        auto files = PHYSFS_enumerateFiles(dir);
-
-        auto& root = *m_root; // For convenience
-        root.name = "/";
-        root.fullpath = "";
-        PHYSFS_stat(dir, &root.stat);
-        root.BuildChildren(files);
-
-        PHYSFS_freeList(files);
+        auto cache = std::make_shared<detailed::ListingCache>();
+        cache->listing = vfs::DirectoryListing("/");
+        cache->info.resize(cache->listing.Size());
+        m_cache = std::move(cache);
     }
 }
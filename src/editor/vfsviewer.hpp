@@ -13,7 +13,7 @@ namespace awe
 {
     namespace detailed
     {
-        struct CacheNode;
+        struct ListingCache;
     }
 
     class VfsViewer
@@ -30,9 +30,9 @@ namespace awe
 
     private:
         bool m_open = true;
-        std::shared_ptr<detailed::CacheNode> m_root;
+        std::shared_ptr<detailed::ListingCache> m_cache;
 
-        void BuildNode();
+        void BuildCache();
     };
 }
 
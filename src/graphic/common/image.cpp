@@ -2,25 +2,49 @@
 // License: The 3-clause BSD License
 
 #include "image.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <istream>
 #include <stb_image.h>
 #include <stb_image_write.h>
+#include "../../res/assetcache.hpp"
+#include "../../res/vfs.hpp"
 
 
 namespace awe::graphic::common
 {
     namespace detailed
     {
+        // Increase when the output of the decoder changes, e.g. after
+        // updating stb_image or changing the vertical flipping setting
+        constexpr std::uint32_t IMAGE_DECODER_VERSION = 2;
+
+        // Followed by the decoded pixels in the cache entry. Padded to keep
+        // the pixels at the 64-byte alignment of the payload
+        struct ImageCacheHeader
+        {
+            std::int32_t width;
+            std::int32_t height;
+            std::int32_t channel; // Channels of the source image
+            std::int32_t desired_channels;
+            std::int32_t reserved[12];
+        };
+        static_assert(sizeof(ImageCacheHeader) == 64);
+
         ImageBase::ImageBase() noexcept = default;
         ImageBase::ImageBase(ImageBase&& move) noexcept
             : m_size(std::exchange(move.m_size, glm::ivec2(0))),
-            m_raw_data(std::exchange(move.m_raw_data, nullptr)) {}
+            m_raw_data(std::exchange(move.m_raw_data, nullptr)),
+            m_adopted(std::exchange(move.m_adopted, false)),
+            m_deleter(std::exchange(move.m_deleter, nullptr)),
+            m_user(std::exchange(move.m_user, nullptr)) {}
 
         ImageBase::~ImageBase() noexcept
         {
             Release();
         }
 
-        void ImageBase::Copy(ImageBase& src, int channel)
+        void ImageBase::Copy(const ImageBase& src, int channel)
         {
             if(!src.m_raw_data)
                 return;
@@ -31,10 +55,44 @@ namespace awe::graphic::common
             memcpy(m_raw_data, src.m_raw_data, bufsize);
             m_size = src.m_size;
         }
+        bool ImageBase::Allocate(glm::ivec2 size, int channel)
+        {
+            if(size[0] <= 0 || size[1] <= 0)
+                return false;
+            std::size_t bufsize = static_cast<std::size_t>(size[0]) * size[1] * channel;
+            // Use calloc() so the buffer can be released by stbi_image_free()
+            void* tmp = calloc(bufsize, 1);
+            if(!tmp)
+                return false;
+
+            Release();
+            m_raw_data = tmp;
+            m_size = size;
+
+            return true;
+        }
+        void ImageBase::AdoptMemory(void* data, glm::ivec2 size, Deleter deleter, void* user) noexcept
+        {
+            Release();
+            if(!data)
+            {
+                if(deleter)
+                    deleter(data, user);
+                return;
+            }
+            m_raw_data = data;
+            m_size = size;
+            m_adopted = true;
+            m_deleter = deleter;
+            m_user = user;
+        }
         void ImageBase::Swap(ImageBase& other) noexcept
         {
             std::swap(m_raw_data, other.m_raw_data);
             std::swap(m_size, other.m_size);
+            std::swap(m_adopted, other.m_adopted);
+            std::swap(m_deleter, other.m_deleter);
+            std::swap(m_user, other.m_user);
         }
 
         bool ImageBase::LoadFile(const char* file, int desired_channels, int* channel)
@@ -87,17 +145,30 @@ namespace awe::graphic::common
             stbi_io_callbacks cb;
             cb.read = [](void* user, char* data, int size)->int
             {
-                return static_cast<int>(
-                    static_cast<std::istream*>(user)->readsome(data, size)
-                );
+                // Unlike readsome(), read() won't stop at the end of the
+                // buffered data of the stream buffer
+                auto& is = *static_cast<std::istream*>(user);
+                is.read(data, size);
+                auto count = is.gcount();
+                if(is.eof())
+                    is.clear(std::ios_base::eofbit); // Keep the stream seekable
+                return static_cast<int>(count);
             };
             cb.skip = [](void* user, int n)
             {
-                static_cast<std::istream*>(user)->seekg(n, std::ios_base::cur);
+                auto& is = *static_cast<std::istream*>(user);
+                is.clear();
+                is.seekg(n, std::ios_base::cur);
             };
             cb.eof = [](void* user)->int
             {
-                return static_cast<std::istream*>(user)->eof();
+                auto& is = *static_cast<std::istream*>(user);
+                if(is.fail())
+                    return 1;
+                return std::istream::traits_type::eq_int_type(
+                    is.peek(),
+                    std::istream::traits_type::eof()
+                );
             };
 
             glm::ivec2 size(0);
@@ -116,11 +187,136 @@ namespace awe::graphic::common
 
             return true;
         }
+        bool ImageBase::LoadVfs(
+            const std::string& path,
+            int desired_channels,
+            int* channel
+        ) {
+            // Decode in place if the file can be mapped
+            if(auto mapped = vfs::TryMapData(path))
+                return LoadMemory(mapped->Data(), mapped->Size(), desired_channels, channel);
+
+            vfs::File file;
+            if(!file.OpenRead(path))
+                return false;
+
+            stbi_io_callbacks cb;
+            cb.read = [](void* user, char* data, int size)->int
+            {
+                try
+                {
+                    return static_cast<int>(
+                        static_cast<vfs::File*>(user)->Read(data, size)
+                    );
+                }
+                catch(...)
+                { // Never propagate exceptions through the decoder
+                    return 0;
+                }
+            };
+            cb.skip = [](void* user, int n)
+            {
+                static_cast<vfs::File*>(user)->Skip(n);
+            };
+            cb.eof = [](void* user)->int
+            {
+                return static_cast<vfs::File*>(user)->Eof();
+            };
+
+            glm::ivec2 size(0);
+            stbi_uc* tmp = stbi_load_from_callbacks(
+                &cb, &file,
+                &size[0], &size[1], channel, desired_channels
+            );
+            if(!tmp)
+            {
+                return false;
+            }
+
+            Release();
+            m_raw_data = tmp;
+            m_size = size;
+
+            return true;
+        }
+        bool ImageBase::LoadVfs(
+            const std::string& path,
+            res::AssetCache& cache,
+            int desired_channels,
+            int* channel
+        ) {
+            vfs::MappedData source;
+            try
+            {
+                source = vfs::MapData(path);
+            }
+            catch(const std::runtime_error&)
+            {
+                return false;
+            }
+
+            const auto key = res::AssetCache::MakeKey(
+                "image",
+                (IMAGE_DECODER_VERSION << 8) | static_cast<std::uint32_t>(desired_channels),
+                source.Data(), source.Size()
+            );
+            // Copy-on-write, so the image can be modified as usual
+            if(auto cached = cache.Load(key, true))
+            {
+                ImageCacheHeader header;
+                if(cached->Size() >= sizeof(header))
+                {
+                    std::memcpy(&header, cached->Data(), sizeof(header));
+                    const int out_channels = desired_channels != 0 ? desired_channels : header.channel;
+                    const std::size_t bytes =
+                        static_cast<std::size_t>(header.width) * header.height * out_channels;
+                    if(header.desired_channels == desired_channels && cached->Size() == sizeof(header) + bytes)
+                    {
+                        auto* owner = new vfs::MappedData(std::move(*cached));
+                        auto* data = const_cast<std::byte*>(owner->Data()) + sizeof(header);
+                        AdoptMemory(
+                            data,
+                            glm::ivec2(header.width, header.height),
+                            [](void*, void* user) noexcept { delete static_cast<vfs::MappedData*>(user); },
+                            owner
+                        );
+                        if(channel)
+                            *channel = header.channel;
+                        return true;
+                    }
+                }
+            }
+
+            int source_channel = 0;
+            if(!LoadMemory(source.Data(), source.Size(), desired_channels, &source_channel))
+                return false;
+            if(channel)
+                *channel = source_channel;
+
+            ImageCacheHeader header{};
+            header.width = m_size[0];
+            header.height = m_size[1];
+            header.channel = source_channel;
+            header.desired_channels = desired_channels;
+            const int out_channels = desired_channels != 0 ? desired_channels : source_channel;
+            cache.Store(key, {
+                { &header, sizeof(header) },
+                { m_raw_data, static_cast<std::size_t>(m_size[0]) * m_size[1] * out_channels }
+            });
+
+            return true;
+        }
         void ImageBase::Release() noexcept
         {
-            stbi_image_free(m_raw_data);
+            if(!m_adopted)
+                stbi_image_free(m_raw_data);
+            else if(m_deleter)
+                m_deleter(m_raw_data, m_user);
             m_raw_data = nullptr;
             m_size = glm::ivec2(0);
+            m_adopted = false;
+            m_deleter = nullptr;
+            m_user = nullptr;
         }
     }
 }
@@ -4,12 +4,22 @@
 #ifndef TESTWORLD_GRAPHIC_COMMON_IMAGE_HPP
 #define TESTWORLD_GRAPHIC_COMMON_IMAGE_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <iosfwd>
+#include <string>
 #include <utility>
+#include <vector>
 #include <glm/vec2.hpp>
 
 
+namespace awe::res
+{
+    class AssetCache;
+}
+
 namespace awe::graphic::common
 {
     namespace detailed
@@ -23,16 +33,25 @@ namespace awe::graphic::common
 
             ~ImageBase() noexcept;
 
+            // Release callback for adopted memory
+            typedef void(*Deleter)(void* data, void* user) noexcept;
+
             [[nodiscard]]
             glm::ivec2 Size() const noexcept { return m_size; }
             [[nodiscard]]
             constexpr bool IsEmpty() const noexcept
             {
-                return !m_raw_data || m_size[0] == 0 || m_size[1] == 1;
+                return !m_raw_data || m_size[0] == 0 || m_size[1] == 0;
             }
 
         protected:
-            void Copy(ImageBase& src, int channel);
+            void Copy(const ImageBase& src, int channel);
+            // Allocate zero-initialized pixel data
+            bool Allocate(glm::ivec2 size, int channel);
+            // Take the ownership of external memory, e.g. from an arena, a pool
+            // or a memory-mapped file. The deleter will be called with the user
+            // pointer on release, nullptr means the memory needs no release
+            void AdoptMemory(void* data, glm::ivec2 size, Deleter deleter, void* user) noexcept;
 
             void Swap(ImageBase& other) noexcept;
 
@@ -52,6 +71,21 @@ namespace awe::graphic::common
                 int desired_channels,
                 int* channel = nullptr
             );
+            // Decode directly from a file in the virtual filesystem without
+            // reading the whole encoded file into memory first
+            bool LoadVfs(
+                const std::string& path,
+                int desired_channels,
+                int* channel = nullptr
+            );
+            // Decoded pixels are stored in the asset cache. Later loading of
+            // the same content maps the cached pixels without decoding
+            bool LoadVfs(
+                const std::string& path,
+                res::AssetCache& cache,
+                int desired_channels,
+                int* channel = nullptr
+            );
             void Release() noexcept;
 
             [[nodiscard]]
@@ -60,9 +94,87 @@ namespace awe::graphic::common
         private:
             glm::ivec2 m_size = glm::ivec2(0);
             void* m_raw_data = nullptr;
+            // Memory from stb_image or malloc() if not adopted
+            bool m_adopted = false;
+            Deleter m_deleter = nullptr;
+            void* m_user = nullptr;
         };
     }
 
+    // Read-only non-owning view of pixel data
+    template <uint8_t Channel = 4>
+    class Image2DView
+    {
+    public:
+        typedef std::byte DataType;
+        typedef const DataType ConstDataType;
+
+        static constexpr uint8_t CHANNEL = Channel;
+
+        constexpr Image2DView() noexcept = default;
+        // Zero stride means tightly packed rows
+        constexpr Image2DView(ConstDataType* data, glm::ivec2 size, std::size_t stride = 0) noexcept
+            : m_data(data),
+            m_size(size),
+            m_stride(stride != 0 ? stride : static_cast<std::size_t>(size[0]) * Channel) {}
+        constexpr Image2DView(const Image2DView&) noexcept = default;
+
+        constexpr Image2DView& operator=(const Image2DView&) noexcept = default;
+
+        [[nodiscard]]
+        constexpr glm::ivec2 Size() const noexcept { return m_size; }
+        // Distance between the beginnings of two adjacent rows in bytes
+        [[nodiscard]]
+        constexpr std::size_t Stride() const noexcept { return m_stride; }
+        [[nodiscard]]
+        constexpr bool IsEmpty() const noexcept
+        {
+            return !m_data || m_size[0] == 0 || m_size[1] == 0;
+        }
+        [[nodiscard]]
+        constexpr bool IsContiguous() const noexcept
+        {
+            return m_stride == static_cast<std::size_t>(m_size[0]) * Channel;
+        }
+
+        [[nodiscard]]
+        constexpr ConstDataType* Data() const noexcept { return m_data; }
+        [[nodiscard]]
+        constexpr ConstDataType* Row(int y) const noexcept
+        {
+            return m_data + static_cast<std::size_t>(y) * m_stride;
+        }
+        [[nodiscard]]
+        constexpr ConstDataType& operator[](glm::uvec2 coord) const noexcept
+        {
+            return Row(coord[1])[static_cast<std::size_t>(coord[0]) * Channel];
+        }
+
+        // View of a rectangle inside this view, the rectangle will be clipped
+        [[nodiscard]]
+        constexpr Image2DView SubView(glm::ivec2 offset, glm::ivec2 size) const noexcept
+        {
+            for(int i = 0; i < 2; ++i)
+            {
+                offset[i] = offset[i] < 0 ? 0 : (offset[i] > m_size[i] ? m_size[i] : offset[i]);
+                if(size[i] > m_size[i] - offset[i])
+                    size[i] = m_size[i] - offset[i];
+                if(size[i] < 0)
+                    size[i] = 0;
+            }
+            return Image2DView(
+                Row(offset[1]) + static_cast<std::size_t>(offset[0]) * Channel,
+                size,
+                m_stride
+            );
+        }
+
+    private:
+        ConstDataType* m_data = nullptr;
+        glm::ivec2 m_size = glm::ivec2(0);
+        std::size_t m_stride = 0;
+    };
+
     template <uint8_t Channel = 4>
     class Image2D : public detailed::ImageBase
     {
@@ -79,6 +191,16 @@ namespace awe::graphic::common
         {
             Copy(rhs, Channel);
         }
+        // Deep copy of the pixels in a view
+        explicit Image2D(Image2DView<Channel> view)
+            : ImageBase()
+        {
+            if(view.IsEmpty() || !Create(view.Size()))
+                return;
+            const std::size_t row_bytes = static_cast<std::size_t>(view.Size()[0]) * Channel;
+            for(int y = 0; y < view.Size()[1]; ++y)
+                std::memcpy(Row(y), view.Row(y), row_bytes);
+        }
 
         Image2D& operator=(Image2D&& rhs) noexcept
         {
@@ -100,6 +222,25 @@ namespace awe::graphic::common
         {
             return LoadStream(is, Channel);
         }
+        bool LoadVfs(const std::string& path)
+        {
+            return Super::LoadVfs(path, Channel);
+        }
+        bool LoadVfs(const std::string& path, res::AssetCache& cache)
+        {
+            return Super::LoadVfs(path, cache, Channel);
+        }
+        // Create an image filled with zero
+        bool Create(glm::ivec2 size)
+        {
+            return Allocate(size, Channel);
+        }
+        // Take the ownership of tightly packed pixel data without copying.
+        // See ImageBase::AdoptMemory() for details
+        void Adopt(void* data, glm::ivec2 size, Deleter deleter = nullptr, void* user = nullptr) noexcept
+        {
+            AdoptMemory(data, size, deleter, user);
+        }
 
         [[nodiscard]]
         DataType& operator[](glm::uvec2 coord)
@@ -112,11 +253,48 @@ namespace awe::graphic::common
             return Data()[Index(coord)];
         }
 
+        [[nodiscard]]
+        DataType* Data() noexcept
+        {
+            return static_cast<DataType*>(RawData());
+        }
         [[nodiscard]]
         ConstDataType* Data() const noexcept
         {
             return static_cast<ConstDataType*>(RawData());
         }
+        [[nodiscard]]
+        DataType* Row(int y) noexcept
+        {
+            return Data() + static_cast<std::size_t>(y) * Size()[0] * CHANNEL;
+        }
+        [[nodiscard]]
+        ConstDataType* Row(int y) const noexcept
+        {
+            return Data() + static_cast<std::size_t>(y) * Size()[0] * CHANNEL;
+        }
+        // Size of pixel data in bytes
+        [[nodiscard]]
+        std::size_t ByteSize() const noexcept
+        {
+            return static_cast<std::size_t>(Size()[0]) * Size()[1] * CHANNEL;
+        }
+
+        [[nodiscard]]
+        Image2DView<Channel> View() const noexcept
+        {
+            return Image2DView<Channel>(Data(), Size());
+        }
+        [[nodiscard]]
+        Image2DView<Channel> SubView(glm::ivec2 offset, glm::ivec2 size) const noexcept
+        {
+            return View().SubView(offset, size);
+        }
+        [[nodiscard]]
+        operator Image2DView<Channel>() const noexcept
+        {
+            return View();
+        }
 
         void Swap(Image2D& other) noexcept
         {
@@ -131,7 +309,7 @@ namespace awe::graphic::common
         }
 
     private:
-        std::size_t Index(glm::uvec2 coord)
+        std::size_t Index(glm::uvec2 coord) const noexcept
         {
             return CHANNEL * (coord[1] * Size()[0] + coord[0]);
         }
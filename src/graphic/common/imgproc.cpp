@@ -0,0 +1,533 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "imgproc.hpp"
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <SDL.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define TW_IMGPROC_SSE2 1
+#   include <emmintrin.h>
+#   include <immintrin.h>
+#   if defined(__GNUC__)
+#       define TW_IMGPROC_AVX2 1
+#       define TW_TARGET_AVX2 __attribute__((target("avx2")))
+#   elif defined(_MSC_VER)
+#       define TW_IMGPROC_AVX2 1
+#       define TW_TARGET_AVX2
+#   endif
+#endif
+
+
+namespace awe::graphic::common
+{
+    namespace scalar
+    {
+        void ExpandRGBToRGBA(
+            std::byte* dst,
+            const std::byte* src,
+            std::size_t count,
+            std::uint8_t alpha
+        ) noexcept {
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                dst[i * 4 + 0] = src[i * 3 + 0];
+                dst[i * 4 + 1] = src[i * 3 + 1];
+                dst[i * 4 + 2] = src[i * 3 + 2];
+                dst[i * 4 + 3] = static_cast<std::byte>(alpha);
+            }
+        }
+        void PremultiplyAlpha(std::byte* row, std::size_t count) noexcept
+        {
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                std::byte* px = row + i * 4;
+                unsigned a = std::to_integer<unsigned>(px[3]);
+                for(int c = 0; c < 3; ++c)
+                {
+                    // Exact rounding of c * a / 255
+                    unsigned t = std::to_integer<unsigned>(px[c]) * a + 128;
+                    px[c] = static_cast<std::byte>((t + (t >> 8)) >> 8);
+                }
+            }
+        }
+        void DownsampleBoxRow(
+            std::byte* dst,
+            const std::byte* row0,
+            const std::byte* row1,
+            int src_width,
+            int channel
+        ) noexcept {
+            const int dst_width = std::max(src_width / 2, 1);
+            for(int x = 0; x < dst_width; ++x)
+            {
+                int x0 = std::min(x * 2, src_width - 1) * channel;
+                int x1 = std::min(x * 2 + 1, src_width - 1) * channel;
+                for(int c = 0; c < channel; ++c)
+                {
+                    unsigned sum =
+                        std::to_integer<unsigned>(row0[x0 + c]) +
+                        std::to_integer<unsigned>(row0[x1 + c]) +
+                        std::to_integer<unsigned>(row1[x0 + c]) +
+                        std::to_integer<unsigned>(row1[x1 + c]);
+                    dst[x * channel + c] = static_cast<std::byte>((sum + 2) >> 2);
+                }
+            }
+        }
+
+        // acc[i] += weight * src[i]
+        void AccumulateRow(float* acc, const std::byte* src, std::size_t n, float weight) noexcept
+        {
+            for(std::size_t i = 0; i < n; ++i)
+                acc[i] += weight * static_cast<float>(std::to_integer<unsigned>(src[i]));
+        }
+    }
+
+    namespace detailed
+    {
+#ifdef TW_IMGPROC_SSE2
+        namespace sse2
+        {
+            void PremultiplyAlpha(std::byte* row, std::size_t count) noexcept
+            {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i bias = _mm_set1_epi16(128);
+                const __m128i alpha_mask = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+                auto mul = [&](__m128i px)
+                {
+                    // Broadcast alpha to the 4 words of each pixel
+                    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(px, 0xFF), 0xFF);
+                    __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), bias);
+                    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+                };
+
+                std::size_t i = 0;
+                for(; i + 4 <= count; i += 4)
+                {
+                    __m128i* ptr = reinterpret_cast<__m128i*>(row + i * 4);
+                    __m128i v = _mm_loadu_si128(ptr);
+                    __m128i lo = mul(_mm_unpacklo_epi8(v, zero));
+                    __m128i hi = mul(_mm_unpackhi_epi8(v, zero));
+                    __m128i res = _mm_packus_epi16(lo, hi);
+                    res = _mm_or_si128(_mm_and_si128(alpha_mask, v), _mm_andnot_si128(alpha_mask, res));
+                    _mm_storeu_si128(ptr, res);
+                }
+                scalar::PremultiplyAlpha(row + i * 4, count - i);
+            }
+
+            void DownsampleBoxRow(
+                std::byte* dst,
+                const std::byte* row0,
+                const std::byte* row1,
+                int src_width,
+                int channel
+            ) noexcept {
+                if(channel != 4 || src_width < 2)
+                {
+                    scalar::DownsampleBoxRow(dst, row0, row1, src_width, channel);
+                    return;
+                }
+
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i bias = _mm_set1_epi16(2);
+                // Sum of two horizontally adjacent RGBA pixels in 16-bit words
+                auto hsum = [](__m128i v) { return _mm_add_epi16(v, _mm_srli_si128(v, 8)); };
+
+                const int dst_width = src_width / 2;
+                int x = 0;
+                // 4 source pixels to 2 destination pixels per step
+                for(; x + 2 <= dst_width; x += 2)
+                {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+                    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                    __m128i sum = _mm_unpacklo_epi64(hsum(lo), hsum(hi));
+                    sum = _mm_srli_epi16(_mm_add_epi16(sum, bias), 2);
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(sum, sum));
+                }
+                if(x < dst_width)
+                {
+                    scalar::DownsampleBoxRow(
+                        dst + x * 4,
+                        row0 + x * 8,
+                        row1 + x * 8,
+                        src_width - x * 2,
+                        4
+                    );
+                }
+            }
+
+            void AccumulateRow(float* acc, const std::byte* src, std::size_t n, float weight) noexcept
+            {
+                const __m128i zero = _mm_setzero_si128();
+                const __m128 w = _mm_set1_ps(weight);
+                std::size_t i = 0;
+                for(; i + 16 <= n; i += 16)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                    __m128i lo = _mm_unpacklo_epi8(v, zero);
+                    __m128i hi = _mm_unpackhi_epi8(v, zero);
+                    __m128i words[4] =
+                    {
+                        _mm_unpacklo_epi16(lo, zero),
+                        _mm_unpackhi_epi16(lo, zero),
+                        _mm_unpacklo_epi16(hi, zero),
+                        _mm_unpackhi_epi16(hi, zero)
+                    };
+                    for(int j = 0; j < 4; ++j)
+                    {
+                        float* p = acc + i + j * 4;
+                        __m128 f = _mm_cvtepi32_ps(words[j]);
+                        _mm_storeu_ps(p, _mm_add_ps(_mm_loadu_ps(p), _mm_mul_ps(f, w)));
+                    }
+                }
+                scalar::AccumulateRow(acc + i, src + i, n - i, weight);
+            }
+        }
+#endif
+
+#ifdef TW_IMGPROC_AVX2
+        namespace avx2
+        {
+            TW_TARGET_AVX2
+            void ExpandRGBToRGBA(
+                std::byte* dst,
+                const std::byte* src,
+                std::size_t count,
+                std::uint8_t alpha
+            ) noexcept {
+                const __m128i shuffle = _mm_setr_epi8(
+                    0, 1, 2, -1,
+                    3, 4, 5, -1,
+                    6, 7, 8, -1,
+                    9, 10, 11, -1
+                );
+                const __m128i a = _mm_set1_epi32(static_cast<int>(static_cast<std::uint32_t>(alpha) << 24));
+                std::size_t i = 0;
+                // Each load reads 16 bytes for 4 pixels (12 bytes), so stop
+                // early to avoid reading past the end of the source
+                for(; i + 6 <= count; i += 4)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+                    v = _mm_or_si128(_mm_shuffle_epi8(v, shuffle), a);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+                }
+                scalar::ExpandRGBToRGBA(dst + i * 4, src + i * 3, count - i, alpha);
+            }
+
+            TW_TARGET_AVX2
+            void PremultiplyAlpha(std::byte* row, std::size_t count) noexcept
+            {
+                const __m256i zero = _mm256_setzero_si256();
+                const __m256i bias = _mm256_set1_epi16(128);
+                const __m256i alpha_mask = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+                // Broadcast alpha to the 4 words of each pixel
+                const __m256i alpha_shuffle = _mm256_setr_epi8(
+                    6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+                    6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15
+                );
+
+                std::size_t i = 0;
+                for(; i + 8 <= count; i += 8)
+                {
+                    __m256i* ptr = reinterpret_cast<__m256i*>(row + i * 4);
+                    __m256i v = _mm256_loadu_si256(ptr);
+                    __m256i res[2] = { _mm256_unpacklo_epi8(v, zero), _mm256_unpackhi_epi8(v, zero) };
+                    for(auto& px : res)
+                    {
+                        __m256i a = _mm256_shuffle_epi8(px, alpha_shuffle);
+                        __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, a), bias);
+                        px = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+                    }
+                    __m256i packed = _mm256_packus_epi16(res[0], res[1]);
+                    _mm256_storeu_si256(ptr, _mm256_blendv_epi8(packed, v, alpha_mask));
+                }
+                sse2::PremultiplyAlpha(row + i * 4, count - i);
+            }
+
+            TW_TARGET_AVX2
+            void DownsampleBoxRow(
+                std::byte* dst,
+                const std::byte* row0,
+                const std::byte* row1,
+                int src_width,
+                int channel
+            ) noexcept {
+                if(channel != 4 || src_width < 2)
+                {
+                    scalar::DownsampleBoxRow(dst, row0, row1, src_width, channel);
+                    return;
+                }
+
+                const __m256i zero = _mm256_setzero_si256();
+                const __m256i bias = _mm256_set1_epi16(2);
+
+                const int dst_width = src_width / 2;
+                int x = 0;
+                // 8 source pixels to 4 destination pixels per step
+                for(; x + 4 <= dst_width; x += 4)
+                {
+                    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8));
+                    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8));
+                    // Lane 0: p0 p1 / p2 p3, lane 1: p4 p5 / p6 p7
+                    __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+                    __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+                    lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+                    hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+                    __m256i sum = _mm256_unpacklo_epi64(lo, hi);
+                    sum = _mm256_srli_epi16(_mm256_add_epi16(sum, bias), 2);
+                    __m256i packed = _mm256_packus_epi16(sum, sum);
+                    packed = _mm256_permute4x64_epi64(packed, 0xD8); // 0, 2, 1, 3
+                    _mm_storeu_si128(
+                        reinterpret_cast<__m128i*>(dst + x * 4),
+                        _mm256_castsi256_si128(packed)
+                    );
+                }
+                if(x < dst_width)
+                {
+                    sse2::DownsampleBoxRow(
+                        dst + x * 4,
+                        row0 + x * 8,
+                        row1 + x * 8,
+                        src_width - x * 2,
+                        4
+                    );
+                }
+            }
+
+            TW_TARGET_AVX2
+            void AccumulateRow(float* acc, const std::byte* src, std::size_t n, float weight) noexcept
+            {
+                const __m256 w = _mm256_set1_ps(weight);
+                std::size_t i = 0;
+                for(; i + 8 <= n; i += 8)
+                {
+                    __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i));
+                    __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v));
+                    _mm256_storeu_ps(acc + i, _mm256_add_ps(_mm256_loadu_ps(acc + i), _mm256_mul_ps(f, w)));
+                }
+                scalar::AccumulateRow(acc + i, src + i, n - i, weight);
+            }
+        }
+#endif
+
+        struct KernelTable
+        {
+            const char* isa;
+            void(*expand_rgb)(std::byte*, const std::byte*, std::size_t, std::uint8_t) noexcept;
+            void(*premultiply)(std::byte*, std::size_t) noexcept;
+            void(*box_row)(std::byte*, const std::byte*, const std::byte*, int, int) noexcept;
+            void(*accumulate)(float*, const std::byte*, std::size_t, float) noexcept;
+        };
+
+        KernelTable SelectKernels() noexcept
+        {
+#ifdef TW_IMGPROC_AVX2
+            if(SDL_HasAVX2())
+            {
+                return KernelTable{
+                    "AVX2",
+                    &avx2::ExpandRGBToRGBA,
+                    &avx2::PremultiplyAlpha,
+                    &avx2::DownsampleBoxRow,
+                    &avx2::AccumulateRow
+                };
+            }
+#endif
+#ifdef TW_IMGPROC_SSE2
+            if(SDL_HasSSE2())
+            {
+                return KernelTable{
+                    "SSE2",
+                    &scalar::ExpandRGBToRGBA, // Requires SSSE3 shuffle
+                    &sse2::PremultiplyAlpha,
+                    &sse2::DownsampleBoxRow,
+                    &sse2::AccumulateRow
+                };
+            }
+#endif
+            return KernelTable{
+                "scalar",
+                &scalar::ExpandRGBToRGBA,
+                &scalar::PremultiplyAlpha,
+                &scalar::DownsampleBoxRow,
+                &scalar::AccumulateRow
+            };
+        }
+        const KernelTable& GetKernels() noexcept
+        {
+            static const KernelTable table = SelectKernels();
+            return table;
+        }
+
+        // Conversion tables between 8-bit sRGB and linear values
+        struct SrgbTables
+        {
+            std::array<std::uint8_t, 256> to_linear;
+            std::array<std::uint8_t, 256> to_srgb;
+
+            SrgbTables() noexcept
+            {
+                for(int i = 0; i < 256; ++i)
+                {
+                    float c = static_cast<float>(i) / 255.0f;
+                    float linear = c <= 0.04045f ?
+                        c / 12.92f :
+                        std::pow((c + 0.055f) / 1.055f, 2.4f);
+                    float srgb = c <= 0.0031308f ?
+                        c * 12.92f :
+                        1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                    to_linear[i] = static_cast<std::uint8_t>(linear * 255.0f + 0.5f);
+                    to_srgb[i] = static_cast<std::uint8_t>(srgb * 255.0f + 0.5f);
+                }
+            }
+        };
+        const SrgbTables& GetSrgbTables() noexcept
+        {
+            static const SrgbTables tables;
+            return tables;
+        }
+
+        void ApplyTable(
+            std::byte* row,
+            std::size_t count,
+            int channel,
+            const std::array<std::uint8_t, 256>& table
+        ) noexcept {
+            // Keep the alpha channel of RGBA
+            const int color_channel = channel == 4 ? 3 : channel;
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                std::byte* px = row + i * channel;
+                for(int c = 0; c < color_channel; ++c)
+                    px[c] = static_cast<std::byte>(table[std::to_integer<std::size_t>(px[c])]);
+            }
+        }
+
+        double BesselI0(double x) noexcept
+        {
+            double sum = 1.0;
+            double term = 1.0;
+            for(int k = 1; k < 32; ++k)
+            {
+                double t = x / (2.0 * k);
+                term *= t * t;
+                sum += term;
+                if(term < sum * 1e-12)
+                    break;
+            }
+            return sum;
+        }
+
+        void DownsampleKaiser(
+            std::byte* dst,
+            const std::byte* src,
+            glm::ivec2 src_size,
+            int channel,
+            float beta
+        ) {
+            // Taps at source offsets [1 - TAPS, TAPS] around the center of
+            // the destination pixel, i.e. between source pixels 2x and 2x+1
+            constexpr int TAPS = 4;
+            constexpr double PI = 3.14159265358979323846;
+            std::array<float, TAPS * 2> weights;
+            double total = 0.0;
+            for(int k = 0; k < TAPS * 2; ++k)
+            {
+                double d = (k - TAPS + 1) - 0.5;
+                double x = d / 2.0;
+                double sinc = x == 0.0 ? 1.0 : std::sin(PI * x) / (PI * x);
+                double t = d / (TAPS + 0.5);
+                double window = BesselI0(beta * std::sqrt(std::max(0.0, 1.0 - t * t))) / BesselI0(beta);
+                weights[k] = static_cast<float>(sinc * window);
+                total += weights[k];
+            }
+            for(auto& w : weights)
+                w = static_cast<float>(w / total);
+
+            const glm::ivec2 dst_size = glm::max(src_size / 2, glm::ivec2(1));
+            const std::size_t src_stride = static_cast<std::size_t>(src_size[0]) * channel;
+            const auto& kernels = GetKernels();
+            std::vector<float> acc(src_stride);
+            for(int y = 0; y < dst_size[1]; ++y)
+            {
+                // Vertical pass into the accumulation row
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                for(int k = 0; k < TAPS * 2; ++k)
+                {
+                    int sy = std::clamp(y * 2 + k - TAPS + 1, 0, src_size[1] - 1);
+                    kernels.accumulate(acc.data(), src + sy * src_stride, src_stride, weights[k]);
+                }
+
+                // Horizontal pass
+                std::byte* out = dst + static_cast<std::size_t>(y) * dst_size[0] * channel;
+                for(int x = 0; x < dst_size[0]; ++x)
+                {
+                    for(int c = 0; c < channel; ++c)
+                    {
+                        float sum = 0.0f;
+                        for(int k = 0; k < TAPS * 2; ++k)
+                        {
+                            int sx = std::clamp(x * 2 + k - TAPS + 1, 0, src_size[0] - 1);
+                            sum += weights[k] * acc[sx * channel + c];
+                        }
+                        out[x * channel + c] = static_cast<std::byte>(
+                            std::clamp(static_cast<int>(sum + 0.5f), 0, 255)
+                        );
+                    }
+                }
+            }
+        }
+
+        void FlipRows(std::byte* data, int rows, std::size_t stride)
+        {
+            std::vector<std::byte> tmp(stride);
+            for(int top = 0, bottom = rows - 1; top < bottom; ++top, --bottom)
+            {
+                std::byte* a = data + top * stride;
+                std::byte* b = data + bottom * stride;
+                std::memcpy(tmp.data(), a, stride);
+                std::memcpy(a, b, stride);
+                std::memcpy(b, tmp.data(), stride);
+            }
+        }
+    }
+
+    const char* GetKernelIsa() noexcept
+    {
+        return detailed::GetKernels().isa;
+    }
+
+    void ExpandRGBToRGBA(
+        std::byte* dst,
+        const std::byte* src,
+        std::size_t count,
+        std::uint8_t alpha
+    ) noexcept {
+        detailed::GetKernels().expand_rgb(dst, src, count, alpha);
+    }
+    void PremultiplyAlpha(std::byte* row, std::size_t count) noexcept
+    {
+        detailed::GetKernels().premultiply(row, count);
+    }
+    void SrgbToLinear(std::byte* row, std::size_t count, int channel) noexcept
+    {
+        detailed::ApplyTable(row, count, channel, detailed::GetSrgbTables().to_linear);
+    }
+    void LinearToSrgb(std::byte* row, std::size_t count, int channel) noexcept
+    {
+        detailed::ApplyTable(row, count, channel, detailed::GetSrgbTables().to_srgb);
+    }
+    void DownsampleBoxRow(
+        std::byte* dst,
+        const std::byte* row0,
+        const std::byte* row1,
+        int src_width,
+        int channel
+    ) noexcept {
+        detailed::GetKernels().box_row(dst, row0, row1, src_width, channel);
+    }
+}
@@ -0,0 +1,213 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+// Image processing kernels
+// The row kernels are dispatched at runtime to AVX2, SSE2 or scalar code
+
+#ifndef TESTWORLD_GRAPHIC_COMMON_IMGPROC_HPP
+#define TESTWORLD_GRAPHIC_COMMON_IMGPROC_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <glm/common.hpp>
+#include "image.hpp"
+
+
+namespace awe::graphic::common
+{
+    // Name of the instruction set used by the kernels, e.g. "AVX2"
+    [[nodiscard]]
+    const char* GetKernelIsa() noexcept;
+
+    /* Row kernels, "count" is the number of pixels */
+
+    // RGB888 to RGBA8888 with a constant alpha
+    void ExpandRGBToRGBA(
+        std::byte* dst,
+        const std::byte* src,
+        std::size_t count,
+        std::uint8_t alpha = 255
+    ) noexcept;
+    // In-place RGBA8888 alpha premultiplication
+    void PremultiplyAlpha(std::byte* row, std::size_t count) noexcept;
+    // In-place sRGB/linear conversion, the alpha channel of RGBA is left untouched
+    void SrgbToLinear(std::byte* row, std::size_t count, int channel) noexcept;
+    void LinearToSrgb(std::byte* row, std::size_t count, int channel) noexcept;
+    // 2x2 box filter of two source rows. The destination row has
+    // max(src_width / 2, 1) pixels
+    void DownsampleBoxRow(
+        std::byte* dst,
+        const std::byte* row0,
+        const std::byte* row1,
+        int src_width,
+        int channel
+    ) noexcept;
+
+    // Reference implementations without SIMD
+    namespace scalar
+    {
+        void ExpandRGBToRGBA(
+            std::byte* dst,
+            const std::byte* src,
+            std::size_t count,
+            std::uint8_t alpha = 255
+        ) noexcept;
+        void PremultiplyAlpha(std::byte* row, std::size_t count) noexcept;
+        void DownsampleBoxRow(
+            std::byte* dst,
+            const std::byte* row0,
+            const std::byte* row1,
+            int src_width,
+            int channel
+        ) noexcept;
+    }
+
+    namespace detailed
+    {
+        void DownsampleKaiser(
+            std::byte* dst,
+            const std::byte* src,
+            glm::ivec2 src_size,
+            int channel,
+            float beta
+        );
+        void FlipRows(std::byte* data, int rows, std::size_t stride);
+    }
+
+    /* Image functions */
+
+    inline Image2D<4> ExpandToRGBA(Image2DView<3> src, std::uint8_t alpha = 255)
+    {
+        Image2D<4> dst;
+        if(src.IsEmpty())
+            return dst;
+        if(!dst.Create(src.Size()))
+            throw std::bad_alloc();
+        for(int y = 0; y < src.Size()[1]; ++y)
+            ExpandRGBToRGBA(dst.Row(y), src.Row(y), src.Size()[0], alpha);
+        return dst;
+    }
+    inline Image2D<4> ExpandToRGBA(const Image2D<3>& src, std::uint8_t alpha = 255)
+    {
+        return ExpandToRGBA(src.View(), alpha);
+    }
+
+    inline void PremultiplyAlpha(Image2D<4>& image) noexcept
+    {
+        if(image.IsEmpty())
+            return;
+        PremultiplyAlpha(
+            image.Data(),
+            static_cast<std::size_t>(image.Size()[0]) * image.Size()[1]
+        );
+    }
+
+    template <std::uint8_t Channel>
+    void SrgbToLinear(Image2D<Channel>& image) noexcept
+    {
+        if(image.IsEmpty())
+            return;
+        SrgbToLinear(
+            image.Data(),
+            static_cast<std::size_t>(image.Size()[0]) * image.Size()[1],
+            Channel
+        );
+    }
+    template <std::uint8_t Channel>
+    void LinearToSrgb(Image2D<Channel>& image) noexcept
+    {
+        if(image.IsEmpty())
+            return;
+        LinearToSrgb(
+            image.Data(),
+            static_cast<std::size_t>(image.Size()[0]) * image.Size()[1],
+            Channel
+        );
+    }
+
+    // Half-size image using 2x2 box filter
+    template <std::uint8_t Channel>
+    Image2D<Channel> DownsampleBox(Image2DView<Channel> src)
+    {
+        Image2D<Channel> dst;
+        if(src.IsEmpty())
+            return dst;
+        const glm::ivec2 src_size = src.Size();
+        if(!dst.Create(glm::max(src_size / 2, glm::ivec2(1))))
+            throw std::bad_alloc();
+        for(int y = 0; y < dst.Size()[1]; ++y)
+        {
+            DownsampleBoxRow(
+                dst.Row(y),
+                src.Row(std::min(y * 2, src_size[1] - 1)),
+                src.Row(std::min(y * 2 + 1, src_size[1] - 1)),
+                src_size[0],
+                Channel
+            );
+        }
+        return dst;
+    }
+    template <std::uint8_t Channel>
+    Image2D<Channel> DownsampleBox(const Image2D<Channel>& src)
+    {
+        return DownsampleBox(src.View());
+    }
+    // Half-size image using Kaiser-windowed sinc filter, which keeps sharper
+    // details than the box filter for mipmap generation
+    template <std::uint8_t Channel>
+    Image2D<Channel> DownsampleKaiser(const Image2D<Channel>& src, float beta = 4.0f)
+    {
+        Image2D<Channel> dst;
+        if(src.IsEmpty())
+            return dst;
+        if(!dst.Create(glm::max(src.Size() / 2, glm::ivec2(1))))
+            throw std::bad_alloc();
+        detailed::DownsampleKaiser(dst.Data(), src.Data(), src.Size(), Channel, beta);
+        return dst;
+    }
+
+    // Copy the source into the destination at the given position, e.g. for
+    // packing an atlas. Pixels outside the destination are clipped
+    template <std::uint8_t Channel>
+    void Blit(Image2D<Channel>& dst, glm::ivec2 pos, Image2DView<Channel> src) noexcept
+    {
+        if(dst.IsEmpty() || src.IsEmpty())
+            return;
+        const glm::ivec2 begin = glm::max(pos, glm::ivec2(0));
+        const glm::ivec2 end = glm::min(pos + src.Size(), dst.Size());
+        if(begin[0] >= end[0] || begin[1] >= end[1])
+            return;
+        src = src.SubView(begin - pos, end - begin);
+        const std::size_t row_bytes = static_cast<std::size_t>(src.Size()[0]) * Channel;
+        for(int y = 0; y < src.Size()[1]; ++y)
+        {
+            std::memcpy(
+                dst.Row(begin[1] + y) + static_cast<std::size_t>(begin[0]) * Channel,
+                src.Row(y),
+                row_bytes
+            );
+        }
+    }
+    template <std::uint8_t Channel>
+    void Blit(Image2D<Channel>& dst, glm::ivec2 pos, const Image2D<Channel>& src) noexcept
+    {
+        Blit(dst, pos, src.View());
+    }
+
+    template <std::uint8_t Channel>
+    void FlipVertical(Image2D<Channel>& image)
+    {
+        if(image.IsEmpty())
+            return;
+        detailed::FlipRows(
+            image.Data(),
+            image.Size()[1],
+            static_cast<std::size_t>(image.Size()[0]) * Channel
+        );
+    }
+}
+
+#endif
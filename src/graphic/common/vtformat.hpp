@@ -0,0 +1,110 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+// File format of tiled virtual textures, shared with the tiling tool
+//
+// Layout (little-endian):
+//   VirtualTextureHeader
+//   Tiles of level 0, ..., tiles of the coarsest level
+// Tiles of a level are stored row by row, starting from the bottom-left tile.
+// Each tile is raw RGBA8888 data of PaddedTileSize() pixels in both
+// dimensions. The border pixels are copied from the neighboring tiles, or
+// clamped to the edge of the image, so the tiles can be filtered linearly.
+
+#ifndef TESTWORLD_GRAPHIC_COMMON_VTFORMAT_HPP
+#define TESTWORLD_GRAPHIC_COMMON_VTFORMAT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+
+
+namespace awe::graphic::common
+{
+    struct VirtualTextureHeader
+    {
+        static constexpr char MAGIC[4] = { 'T', 'W', 'V', 'T' };
+        static constexpr std::uint32_t VERSION = 1;
+
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t width; // Size of level 0 in pixels
+        std::uint32_t height;
+        std::uint32_t tile_size; // Size of the content of a tile in pixels
+        std::uint32_t border; // Border pixels on each side of a tile
+        std::uint32_t levels;
+        std::uint32_t channel; // Always 4
+
+        [[nodiscard]]
+        bool IsValid() const noexcept
+        {
+            return
+                std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                version == VERSION &&
+                width != 0 && height != 0 &&
+                tile_size != 0 &&
+                levels != 0 &&
+                channel == 4;
+        }
+
+        [[nodiscard]]
+        glm::ivec2 Size() const noexcept
+        {
+            return glm::ivec2(width, height);
+        }
+        [[nodiscard]]
+        glm::ivec2 LevelSize(int level) const noexcept
+        {
+            return glm::max(Size() >> level, glm::ivec2(1));
+        }
+        // Number of tiles of a level in both dimensions
+        [[nodiscard]]
+        glm::ivec2 TileCount(int level) const noexcept
+        {
+            const int ts = static_cast<int>(tile_size);
+            return (LevelSize(level) + ts - 1) / ts;
+        }
+        [[nodiscard]]
+        int PaddedTileSize() const noexcept
+        {
+            return static_cast<int>(tile_size + border * 2);
+        }
+        [[nodiscard]]
+        std::size_t TileBytes() const noexcept
+        {
+            const std::size_t padded = PaddedTileSize();
+            return padded * padded * channel;
+        }
+        // Offset of a tile from the beginning of the file
+        [[nodiscard]]
+        std::uint64_t TileOffset(int level, glm::ivec2 tile) const noexcept
+        {
+            std::uint64_t index = 0;
+            for(int i = 0; i < level; ++i)
+            {
+                glm::ivec2 count = TileCount(i);
+                index += static_cast<std::uint64_t>(count[0]) * count[1];
+            }
+            index += static_cast<std::uint64_t>(tile[1]) * TileCount(level)[0] + tile[0];
+            return sizeof(VirtualTextureHeader) + index * TileBytes();
+        }
+    };
+    static_assert(sizeof(VirtualTextureHeader) == 32);
+
+    // Number of levels until the whole image fits in a single tile
+    inline int VirtualTextureLevels(glm::ivec2 size, int tile_size) noexcept
+    {
+        int levels = 1;
+        while(
+            ((size[0] >> (levels - 1)) > tile_size || (size[1] >> (levels - 1)) > tile_size) &&
+            levels < 31
+        ) {
+            ++levels;
+        }
+        return levels;
+    }
+}
+
+#endif
@@ -129,6 +129,10 @@ namespace awe::graphic::opengl3
     {
         return true;
     }
+    int Renderer::GetMaxTextureSize() const
+    {
+        return opengl3::GetInteger(GL_MAX_TEXTURE_SIZE);
+    }
 
     std::unique_ptr<Mesh> Renderer::CreateMesh(bool dynamic)
     {
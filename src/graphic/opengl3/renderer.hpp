@@ -67,6 +67,7 @@ namespace awe::graphic::opengl3
 
         glm::ivec2 GetDrawableSize() const override;
         bool IsRuntimeShaderCompilationSupported() const override;
+        int GetMaxTextureSize() const override;
 
         // Resources generator
         std::unique_ptr<Mesh> CreateMesh(bool dynamic = false);
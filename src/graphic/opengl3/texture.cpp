@@ -61,14 +61,37 @@ namespace awe::graphic::opengl3
                 glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, &color[0]);
             }
         }
+        // Set the unpacking state for the row stride of the view and restore
+        // the default state on destruction
+        class UnpackGuard
+        {
+        public:
+            template <uint8_t Channel>
+            UnpackGuard(const common::Image2DView<Channel>& image) noexcept
+            {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                if(!image.IsContiguous())
+                    glPixelStorei(GL_UNPACK_ROW_LENGTH, static_cast<GLint>(image.Stride() / Channel));
+            }
+            UnpackGuard(const UnpackGuard&) = delete;
+
+            ~UnpackGuard() noexcept
+            {
+                glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            }
+        };
+
         template <uint8_t Channel>
         void TexImage(
-            const common::Image2D<Channel>& image,
-            const TextureDescription& desc
+            const common::Image2DView<Channel>& image,
+            const TextureDescription& desc,
+            GLint level = 0
         ) {
+            UnpackGuard guard(image);
             glTexImage2D(
                 GL_TEXTURE_2D,
-                0,
+                level,
                 TranslateFormat(desc.internal_format),
                 image.Size()[0],
                 image.Size()[1],
@@ -78,6 +101,25 @@ namespace awe::graphic::opengl3
                 image.Data()
             );
         }
+        template <uint8_t Channel>
+        void TexSubImage(
+            const common::Image2DView<Channel>& image,
+            glm::ivec2 offset,
+            GLint level
+        ) {
+            UnpackGuard guard(image);
+            glTexSubImage2D(
+                GL_TEXTURE_2D,
+                level,
+                offset[0],
+                offset[1],
+                image.Size()[0],
+                image.Size()[1],
+                TranslateFormat(GetDefaultFormat(image.CHANNEL)),
+                GL_UNSIGNED_BYTE,
+                image.Data()
+            );
+        }
     }
 
     Texture2D::Texture2D(Renderer& renderer)
@@ -97,7 +139,11 @@ namespace awe::graphic::opengl3
         glBindTexture(GL_TEXTURE_2D, m_handle);
         detailed::ApplyDesc(data.desc);
         std::visit(
-            [&data](auto&& arg){ detailed::TexImage(arg, data.desc); },
+            [this, &data](auto&& arg)
+            {
+                detailed::TexImage(arg.View(), data.desc);
+                m_size = arg.Size();
+            },
             data.image_data
         );
         if(data.desc.IsMipmapRequired())
@@ -107,6 +153,76 @@ namespace awe::graphic::opengl3
         DataSubmitted();
     }
 
+    void Texture2D::SubmitLevel(int level, const TextureImageView& image)
+    {
+        auto& data = GetTextureData();
+        bool init = !m_handle;
+        if(init)
+            Initialize();
+
+        glBindTexture(GL_TEXTURE_2D, m_handle);
+        if(init)
+            detailed::ApplyDesc(data.desc);
+        std::visit(
+            [this, &data, level](auto&& arg)
+            {
+                detailed::TexImage(arg, data.desc, level);
+                if(level == 0)
+                    m_size = arg.Size();
+            },
+            image
+        );
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    void Texture2D::SubmitSubImage(int level, glm::ivec2 offset, const TextureImageView& image)
+    {
+        if(!m_handle)
+            return;
+        glBindTexture(GL_TEXTURE_2D, m_handle);
+        std::visit(
+            [offset, level](auto&& arg)
+            {
+                if(!arg.IsEmpty())
+                    detailed::TexSubImage(arg, offset, level);
+            },
+            image
+        );
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    void Texture2D::DiscardLevel(int level)
+    {
+        if(!m_handle)
+            return;
+        auto& data = GetTextureData();
+        glBindTexture(GL_TEXTURE_2D, m_handle);
+        // Respecify the level with zero size to release its storage
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            level,
+            detailed::TranslateFormat(data.desc.internal_format),
+            0, 0,
+            0,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            nullptr
+        );
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    void Texture2D::SetLevelRange(int base_level, int max_level)
+    {
+        if(!m_handle)
+            return;
+        glBindTexture(GL_TEXTURE_2D, m_handle);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, base_level);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, max_level);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void Texture2D::SetBaseSize(glm::ivec2 size)
+    {
+        m_size = size;
+    }
+
     glm::ivec2 Texture2D::GetSize() const
     {
         return m_size;
@@ -34,6 +34,12 @@ namespace awe::graphic::opengl3
 
         void Submit() override;
 
+        void SubmitLevel(int level, const TextureImageView& image) override;
+        void SubmitSubImage(int level, glm::ivec2 offset, const TextureImageView& image) override;
+        void DiscardLevel(int level) override;
+        void SetLevelRange(int base_level, int max_level) override;
+        void SetBaseSize(glm::ivec2 size) override;
+
         [[nodiscard]]
         glm::ivec2 GetSize() const override;
         [[nodiscard]]
@@ -73,6 +73,10 @@ namespace awe::graphic
     {
         return false;
     }
+    int IRenderer::GetMaxTextureSize() const
+    {
+        return 1024;
+    }
 
     void IRenderer::NewData() {}
     void IRenderer::DeleteData() noexcept {}
@@ -54,6 +54,9 @@ namespace awe::graphic
         virtual glm::ivec2 GetDrawableSize() const;
         virtual std::string GetRendererName() = 0;
         virtual bool IsRuntimeShaderCompilationSupported() const;
+        // Maximum width and height of a texture
+        // Thread safety: Can only be called in rendering thread
+        virtual int GetMaxTextureSize() const;
 
         // Data
         [[nodiscard]]
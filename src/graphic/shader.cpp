@@ -2,7 +2,10 @@
 // License: The 3-clause BSD License
 
 #include "shader.hpp"
+#include <algorithm>
 #include <sstream>
+#include <SDL.h>
+#include "../res/vfs.hpp"
 
 
 namespace awe::graphic
@@ -16,11 +19,8 @@ namespace awe::graphic
         ShaderType type,
         std::unique_ptr<std::istream> is
     ) {
-        m_src.emplace_back(std::pair(
-            type,
-            std::move(is)
-        ));
-        m_is_submitted = false;
+        PushSrc(type, std::move(is));
+        m_non_vfs_src = true;
     }
     void IShaderProgram::AddShaderSrc(
         ShaderType type,
@@ -30,6 +30,68 @@ namespace awe::graphic
         AddShaderSrc(type, std::move(ss));
     }
 
+    void IShaderProgram::AddShaderSrcVfs(
+        ShaderType type,
+        std::string vfs_path
+    ) {
+        PushSrc(type, std::make_unique<std::stringstream>(vfs::GetString(vfs_path)));
+        m_vfs_src.emplace_back(type, std::move(vfs_path));
+    }
+
+    bool IShaderProgram::Reload(std::string_view changed)
+    {
+        if(m_non_vfs_src)
+            return false;
+        auto it = std::find_if(
+            m_vfs_src.begin(), m_vfs_src.end(),
+            [changed](const auto& src) { return src.second == changed; }
+        );
+        if(it == m_vfs_src.end())
+            return false;
+
+        // Read every source before replacing, so a failure keeps the current ones
+        std::vector<std::string> sources;
+        sources.reserve(m_vfs_src.size());
+        for(auto& src : m_vfs_src)
+            sources.push_back(vfs::GetString(src.second));
+        ClearShaderSrc();
+        for(std::size_t i = 0; i < sources.size(); ++i)
+            PushSrc(m_vfs_src[i].first, std::make_unique<std::stringstream>(std::move(sources[i])));
+        return true;
+    }
+    void IShaderProgram::Watch(vfs::FileWatcher& watcher)
+    {
+        m_watch = watcher.Subscribe(
+            std::string(),
+            [this](const vfs::FileChange& change)
+            {
+                if(change.type != vfs::FileChangeType::MODIFIED)
+                    return;
+                try
+                {
+                    if(!Reload(change.path))
+                        return;
+                }
+                catch(const std::exception& e)
+                {
+                    SDL_LogError(
+                        SDL_LOG_CATEGORY_APPLICATION,
+                        "Failed to reload shader program for \"%s\": %s",
+                        change.path.c_str(),
+                        e.what()
+                    );
+                    return;
+                }
+                SDL_LogInfo(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Reloading shader program for \"%s\"",
+                    change.path.c_str()
+                );
+                Submit();
+            }
+        );
+    }
+
     IShaderProgram::ShaderSrc& IShaderProgram::GetSrc(std::size_t idx)
     {
         return m_src[idx];
@@ -43,6 +105,15 @@ namespace awe::graphic
         std::vector<ShaderSrc>().swap(m_src);
     }
 
+    void IShaderProgram::PushSrc(ShaderType type, std::unique_ptr<std::istream> is)
+    {
+        m_src.emplace_back(std::pair(
+            type,
+            std::move(is)
+        ));
+        m_is_submitted = false;
+    }
+
     void IShaderProgram::DataSubmitted()
     {
         ClearShaderSrc();
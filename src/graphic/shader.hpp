@@ -6,9 +6,12 @@
 
 #include <iostream>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 #include "interface.hpp"
+#include "../res/watcher.hpp"
 
 
 namespace awe::graphic
@@ -48,6 +51,22 @@ namespace awe::graphic
             );
         }
 
+        // Read the source from the virtual filesystem. The path is recorded
+        // for reloading
+        void AddShaderSrcVfs(
+            ShaderType type,
+            std::string vfs_path
+        );
+
+        // Read the sources again if the changed file is one of them. Return
+        // true if reloaded, then the program should be submitted again.
+        // Sources not from the virtual filesystem are released after
+        // submitted, so programs having such sources cannot be reloaded
+        bool Reload(std::string_view changed);
+        // Reload and submit the program when its sources are changed
+        // Thread safety: The watcher must be polled in rendering thread
+        void Watch(vfs::FileWatcher& watcher);
+
         // Thread safety: Can only be called in rendering thread
         virtual void Submit() = 0;
 
@@ -69,6 +88,12 @@ namespace awe::graphic
     private:
         std::vector<ShaderSrc> m_src;
         bool m_is_submitted = false;
+
+        std::vector<std::pair<ShaderType, std::string>> m_vfs_src;
+        bool m_non_vfs_src = false;
+        vfs::WatchSubscription m_watch;
+
+        void PushSrc(ShaderType type, std::unique_ptr<std::istream> is);
     };
 }
 
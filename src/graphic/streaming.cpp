@@ -0,0 +1,470 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "streaming.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+#include <SDL.h>
+#include <glm/common.hpp>
+#include "renderer.hpp"
+#include "common/imgproc.hpp"
+#include "../res/assetcache.hpp"
+
+
+namespace awe::graphic
+{
+    namespace detailed
+    {
+        glm::ivec2 LevelSize(glm::ivec2 size, int level) noexcept
+        {
+            return glm::max(size >> level, glm::ivec2(1));
+        }
+        std::size_t LevelBytes(glm::ivec2 size, int level) noexcept
+        {
+            glm::ivec2 lvsize = LevelSize(size, level);
+            return static_cast<std::size_t>(lvsize[0]) * lvsize[1] * 4;
+        }
+        int LevelCount(glm::ivec2 size) noexcept
+        {
+            int levels = 1;
+            while((size[0] >> levels) > 0 || (size[1] >> levels) > 0)
+                ++levels;
+            return levels;
+        }
+    }
+
+    struct TextureStreamer::Entry
+    {
+        std::string path;
+        TextureDescription desc;
+        std::unique_ptr<ITexture2D> texture;
+
+        glm::ivec2 size = glm::ivec2(0);
+        int levels = 0; // Zero if the image has never been decoded
+        int tail = 0; // Finest level of the mip tail
+        int resident = 0; // Finest resident level, equals to levels if nothing is resident
+        int requested = INT_MAX; // Finest level requested in the current frame
+        std::uint64_t last_used = 0;
+        bool failed = false;
+
+        // Decoded levels indexed by level, the others are left empty. Only
+        // the level of the next promotion step is kept after uploading, so
+        // textures sitting at their mip tails do not hold the whole chain.
+        // Finer levels are decoded again, which is cheap with the asset cache
+        std::vector<common::Image2D<4>> chain;
+
+        [[nodiscard]]
+        std::size_t ResidentBytes() const noexcept
+        {
+            std::size_t bytes = 0;
+            for(int i = resident; i < levels; ++i)
+                bytes += detailed::LevelBytes(size, i);
+            return bytes;
+        }
+    };
+
+    TextureStreamer::TextureStreamer(IRenderer& renderer, std::size_t budget)
+        : m_renderer(renderer)
+    {
+        m_stats.budget = budget;
+    }
+
+    TextureStreamer::~TextureStreamer() noexcept = default;
+
+    TextureStreamer::TextureId TextureStreamer::Register(
+        std::string vfs_path,
+        const TextureDescription& desc
+    ) {
+        auto entry = std::make_unique<Entry>();
+        entry->path = std::move(vfs_path);
+        entry->desc = desc;
+        entry->desc.internal_format = TextureFormat::RGBA;
+        entry->desc.mipmap = true;
+        entry->last_used = m_frame;
+
+        ++m_stats.registered_textures;
+        if(!m_free_ids.empty())
+        {
+            TextureId id = m_free_ids.back();
+            m_free_ids.pop_back();
+            m_entries[id] = std::move(entry);
+            return id;
+        }
+        m_entries.push_back(std::move(entry));
+        return m_entries.size() - 1;
+    }
+    void TextureStreamer::Unregister(TextureId id)
+    {
+        Entry* entry = GetEntry(id);
+        if(!entry)
+            return;
+        m_stats.resident_bytes -= entry->ResidentBytes();
+        m_entries[id].reset();
+        m_free_ids.push_back(id);
+        --m_stats.registered_textures;
+    }
+
+    void TextureStreamer::RequestLevel(TextureId id, int level)
+    {
+        std::lock_guard lock(m_request_mutex);
+        m_requests.push_back({ id, std::max(level, 0) });
+    }
+    void TextureStreamer::RequestSize(TextureId id, glm::ivec2 screen_size)
+    {
+        // Encode the screen size as a negative level, it will be resolved
+        // in Update() where the size of the image is known
+        int extent = std::max(screen_size[0], screen_size[1]);
+        std::lock_guard lock(m_request_mutex);
+        m_requests.push_back({ id, -std::max(extent, 1) });
+    }
+
+    void TextureStreamer::Update()
+    {
+        ++m_frame;
+
+        std::vector<std::pair<TextureId, int>> requests;
+        {
+            std::lock_guard lock(m_request_mutex);
+            requests.swap(m_requests);
+        }
+        for(auto& [id, level] : requests)
+        {
+            Entry* entry = GetEntry(id);
+            if(!entry)
+                continue;
+            if(level < 0 && entry->levels != 0)
+            { // Resolve the level from the size on screen
+                int extent = std::max(entry->size[0], entry->size[1]);
+                float ratio = static_cast<float>(extent) / static_cast<float>(-level);
+                level = ratio > 1.0f ? static_cast<int>(std::floor(std::log2(ratio))) : 0;
+            }
+            else if(level < 0)
+                level = 0;
+            entry->requested = std::min(entry->requested, level);
+            entry->last_used = m_frame;
+        }
+
+        // The budget may have been lowered
+        if(m_stats.resident_bytes > m_stats.budget)
+            Evict(m_stats.resident_bytes - m_stats.budget, nullptr);
+
+        std::size_t uploaded = 0;
+        // Load the mip tails of new textures. The size is unknown before
+        // decoding, the remaining textures are loaded in the next frames
+        // once the limit is reached
+        for(auto& i : m_entries)
+        {
+            if(uploaded >= m_upload_limit)
+                break;
+            if(!i || i->failed || i->levels != 0)
+                continue;
+            uploaded += Promote(*i, INT_MAX);
+        }
+
+        // Promote requested textures, the largest deficit first
+        std::vector<Entry*> candidates;
+        for(auto& i : m_entries)
+        {
+            if(!i || i->failed || i->levels == 0)
+                continue;
+            if(std::min(i->requested, i->levels - 1) < i->resident)
+                candidates.push_back(i.get());
+        }
+        std::sort(
+            candidates.begin(), candidates.end(),
+            [](const Entry* lhs, const Entry* rhs)
+            {
+                return lhs->resident - lhs->requested > rhs->resident - rhs->requested;
+            }
+        );
+        for(Entry* entry : candidates)
+        {
+            if(uploaded >= m_upload_limit)
+                break;
+            if(!entry->texture)
+            { // Released completely by eviction, reload the mip tail first
+                std::size_t tail_bytes = 0;
+                for(int i = entry->tail; i < entry->levels; ++i)
+                    tail_bytes += detailed::LevelBytes(entry->size, i);
+                if(uploaded + tail_bytes > m_upload_limit && uploaded != 0)
+                    continue;
+                uploaded += Promote(*entry, INT_MAX);
+                if(entry->failed)
+                    continue;
+            }
+
+            int target = std::min(entry->requested, entry->levels - 1);
+            int fit = entry->resident;
+            std::size_t bytes = 0;
+            for(int i = entry->resident - 1; i >= target; --i)
+            {
+                std::size_t lvbytes = detailed::LevelBytes(entry->size, i);
+                // Always allow a single level to be uploaded in an idle frame
+                if(uploaded + bytes + lvbytes > m_upload_limit && (fit != entry->resident || uploaded != 0))
+                    break;
+                bytes += lvbytes;
+                fit = i;
+            }
+            if(bytes > Available() && !Evict(bytes - Available(), entry))
+            { // Cannot free enough memory, fall back to the coarser levels
+                while(fit < entry->resident && bytes > Available())
+                {
+                    bytes -= detailed::LevelBytes(entry->size, fit);
+                    ++fit;
+                }
+            }
+            if(fit < entry->resident)
+                uploaded += Promote(*entry, fit);
+        }
+
+        std::size_t resident_textures = 0;
+        for(auto& i : m_entries)
+        {
+            if(!i)
+                continue;
+            i->requested = INT_MAX;
+            if(i->texture)
+                ++resident_textures;
+        }
+        m_stats.resident_textures = resident_textures;
+    }
+
+    ITexture2D* TextureStreamer::GetTexture(TextureId id) noexcept
+    {
+        Entry* entry = GetEntry(id);
+        return entry ? entry->texture.get() : nullptr;
+    }
+
+    void TextureStreamer::SetBudget(std::size_t bytes) noexcept
+    {
+        m_stats.budget = bytes;
+    }
+    void TextureStreamer::SetUploadLimit(std::size_t bytes) noexcept
+    {
+        m_upload_limit = bytes;
+    }
+    void TextureStreamer::SetTailSize(int size) noexcept
+    {
+        m_tail_size = std::max(size, 1);
+    }
+
+    void TextureStreamer::Reload(std::string_view vfs_path)
+    {
+        for(auto& i : m_entries)
+        {
+            if(!i || i->path != vfs_path)
+                continue;
+            if(i->texture)
+            {
+                m_stats.resident_bytes -= i->ResidentBytes();
+                i->texture.reset();
+            }
+            // The size may have been changed
+            i->size = glm::ivec2(0);
+            i->levels = 0;
+            i->resident = 0;
+            i->tail = 0;
+            i->failed = false;
+            std::vector<common::Image2D<4>>().swap(i->chain);
+        }
+    }
+    void TextureStreamer::Watch(vfs::FileWatcher& watcher)
+    {
+        m_watch = watcher.Subscribe(
+            std::string(),
+            [this](const vfs::FileChange& change)
+            {
+                if(change.type == vfs::FileChangeType::MODIFIED)
+                    Reload(change.path);
+            }
+        );
+    }
+
+    TextureStreamer::Entry* TextureStreamer::GetEntry(TextureId id) noexcept
+    {
+        if(id >= m_entries.size())
+            return nullptr;
+        return m_entries[id].get();
+    }
+
+    bool TextureStreamer::Decode(Entry& entry)
+    {
+        common::Image2D<4> image;
+        try
+        {
+            res::AssetCache* cache = res::GetAssetCache();
+            bool loaded = cache ? image.LoadVfs(entry.path, *cache) : image.LoadVfs(entry.path);
+            if(!loaded)
+                throw std::runtime_error("unsupported image format");
+            if(entry.levels != 0 && image.Size() != entry.size)
+                throw std::runtime_error("size changed without reloading");
+        }
+        catch(const std::exception& e)
+        {
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Failed to stream texture \"%s\": %s",
+                entry.path.c_str(),
+                e.what()
+            );
+            entry.failed = true;
+            return false;
+        }
+
+        if(entry.levels == 0)
+        { // First decoding
+            entry.size = image.Size();
+            entry.levels = detailed::LevelCount(entry.size);
+            entry.resident = entry.levels;
+            entry.tail = entry.levels - 1;
+            while(entry.tail > 0)
+            {
+                glm::ivec2 lvsize = detailed::LevelSize(entry.size, entry.tail - 1);
+                if(lvsize[0] > m_tail_size || lvsize[1] > m_tail_size)
+                    break;
+                --entry.tail;
+            }
+        }
+
+        // Generate the whole chain, every level is derived from the finer one
+        entry.chain.clear();
+        entry.chain.reserve(entry.levels);
+        entry.chain.push_back(std::move(image));
+        for(int i = 1; i < entry.levels; ++i)
+            entry.chain.push_back(common::DownsampleBox(entry.chain.back()));
+        return true;
+    }
+    std::size_t TextureStreamer::Promote(Entry& entry, int target)
+    {
+        if(entry.levels == 0 && !Decode(entry))
+            return 0;
+        if(!entry.texture)
+        {
+            entry.texture = m_renderer.CreateTexture2D();
+            entry.texture->SetTextureDesc(entry.desc);
+            entry.texture->SetBaseSize(entry.size);
+            entry.resident = entry.levels;
+        }
+
+        // The mip tail is always required
+        target = std::clamp(target, 0, entry.levels - 1);
+        if(entry.resident == entry.levels)
+            target = std::min(target, entry.tail);
+        if(target >= entry.resident)
+            return 0;
+
+        // Uploaded levels are dropped from the chain, decode again if any
+        // of them is required after eviction
+        for(int i = target; i < entry.resident; ++i)
+        {
+            if(i < static_cast<int>(entry.chain.size()) && !entry.chain[i].IsEmpty())
+                continue;
+            if(!Decode(entry))
+                return 0;
+            break;
+        }
+
+        // Upload the coarsest level first
+        std::size_t bytes = 0;
+        for(int i = entry.resident - 1; i >= target; --i)
+        {
+            auto& level = entry.chain[i];
+            bytes += level.ByteSize();
+            entry.texture->SubmitLevel(i, level.View());
+            level = common::Image2D<4>();
+            ++m_stats.uploaded_levels;
+        }
+        entry.resident = target;
+        entry.texture->SetLevelRange(entry.resident, entry.levels - 1);
+        if(entry.resident == 0)
+            std::vector<common::Image2D<4>>().swap(entry.chain);
+        else
+        { // Finer levels are decoded again on promotion
+            const int next = entry.resident - 1;
+            for(int i = 0; i < next && i < static_cast<int>(entry.chain.size()); ++i)
+                entry.chain[i] = common::Image2D<4>();
+        }
+
+        m_stats.uploaded_bytes += bytes;
+        m_stats.resident_bytes += bytes;
+        return bytes;
+    }
+    void TextureStreamer::Demote(Entry& entry, int level)
+    {
+        if(!entry.texture || level <= entry.resident)
+            return;
+        level = std::min(level, entry.levels);
+        for(int i = entry.resident; i < level; ++i)
+        {
+            entry.texture->DiscardLevel(i);
+            std::size_t bytes = detailed::LevelBytes(entry.size, i);
+            m_stats.resident_bytes -= bytes;
+            m_stats.evicted_bytes += bytes;
+            ++m_stats.evicted_levels;
+        }
+        entry.resident = level;
+        if(entry.resident < entry.levels)
+            entry.texture->SetLevelRange(entry.resident, entry.levels - 1);
+    }
+    void TextureStreamer::Release(Entry& entry) noexcept
+    {
+        if(!entry.texture)
+            return;
+        std::size_t bytes = entry.ResidentBytes();
+        m_stats.resident_bytes -= bytes;
+        m_stats.evicted_bytes += bytes;
+        m_stats.evicted_levels += entry.levels - entry.resident;
+        ++m_stats.evicted_textures;
+        entry.texture.reset();
+        std::vector<common::Image2D<4>>().swap(entry.chain);
+        entry.resident = entry.levels;
+    }
+
+    bool TextureStreamer::Evict(std::size_t required, const Entry* exclude)
+    {
+        std::vector<Entry*> candidates;
+        for(auto& i : m_entries)
+        {
+            if(!i || !i->texture || i.get() == exclude)
+                continue;
+            if(i->last_used >= m_frame)
+                continue; // In use
+            candidates.push_back(i.get());
+        }
+        std::sort(
+            candidates.begin(), candidates.end(),
+            [](const Entry* lhs, const Entry* rhs) { return lhs->last_used < rhs->last_used; }
+        );
+
+        std::size_t freed = 0;
+        // Drop the finest levels of the coldest textures first
+        for(Entry* entry : candidates)
+        {
+            while(freed < required && entry->resident < entry->tail)
+            {
+                freed += detailed::LevelBytes(entry->size, entry->resident);
+                Demote(*entry, entry->resident + 1);
+            }
+            if(freed >= required)
+                return true;
+        }
+        // Release whole textures including the mip tails
+        for(Entry* entry : candidates)
+        {
+            freed += entry->ResidentBytes();
+            Release(*entry);
+            if(freed >= required)
+                return true;
+        }
+
+        return false;
+    }
+    std::size_t TextureStreamer::Available() const noexcept
+    {
+        if(m_stats.resident_bytes >= m_stats.budget)
+            return 0;
+        return m_stats.budget - m_stats.resident_bytes;
+    }
+}
@@ -0,0 +1,135 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_GRAPHIC_STREAMING_HPP
+#define TESTWORLD_GRAPHIC_STREAMING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glm/vec2.hpp>
+#include "texture.hpp"
+#include "../res/watcher.hpp"
+
+
+namespace awe::graphic
+{
+    class IRenderer;
+
+    struct TextureStreamingStats
+    {
+        std::size_t budget = 0; // VRAM budget in bytes
+        std::size_t resident_bytes = 0;
+        std::size_t resident_textures = 0;
+        std::size_t registered_textures = 0;
+
+        // Accumulated counters
+        std::uint64_t uploaded_levels = 0;
+        std::uint64_t uploaded_bytes = 0;
+        std::uint64_t evicted_levels = 0;
+        std::uint64_t evicted_bytes = 0;
+        std::uint64_t evicted_textures = 0; // Textures released completely
+    };
+
+    /*
+     * Texture streaming manager
+     *
+     * Textures are uploaded level by level with the lowest resolution first.
+     * Finer levels are only uploaded when requested by the usage feedback
+     * (RequestLevel() / RequestSize()). When the VRAM budget is exceeded, the
+     * finest levels of the least recently used textures are evicted.
+     */
+    class TextureStreamer
+    {
+    public:
+        typedef std::size_t TextureId;
+        static constexpr TextureId INVALID_ID = static_cast<TextureId>(-1);
+
+        TextureStreamer(IRenderer& renderer, std::size_t budget);
+        TextureStreamer(const TextureStreamer&) = delete;
+
+        ~TextureStreamer() noexcept;
+
+        // Register an image in the virtual filesystem.
+        // The texture will be loaded in the next call of Update()
+        TextureId Register(
+            std::string vfs_path,
+            const TextureDescription& desc = TextureDescription()
+        );
+        void Unregister(TextureId id);
+
+        // Usage feedback. The finest level required in this frame
+        // Thread safety: Can be called in any thread
+        void RequestLevel(TextureId id, int level);
+        // Usage feedback. Select the level by the size on screen in pixels
+        // Thread safety: Can be called in any thread
+        void RequestSize(TextureId id, glm::ivec2 screen_size);
+
+        // Process feedback, upload requested levels and evict cold textures.
+        // Should be called once per frame
+        // Thread safety: Can only be called in rendering thread
+        void Update();
+
+        // Return nullptr if nothing of the texture is resident
+        [[nodiscard]]
+        ITexture2D* GetTexture(TextureId id) noexcept;
+
+        void SetBudget(std::size_t bytes) noexcept;
+        // Maximum bytes uploaded in a single frame
+        void SetUploadLimit(std::size_t bytes) noexcept;
+        // Levels whose width and height are not greater than this size are
+        // always kept resident while the texture is registered
+        void SetTailSize(int size) noexcept;
+
+        // Decode the image again in the next call of Update().
+        // Textures that failed to load are retried
+        void Reload(std::string_view vfs_path);
+        // Reload textures when their files are changed
+        void Watch(vfs::FileWatcher& watcher);
+
+        [[nodiscard]]
+        const TextureStreamingStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        struct Entry;
+
+        IRenderer& m_renderer;
+        std::vector<std::unique_ptr<Entry>> m_entries;
+        std::vector<TextureId> m_free_ids;
+
+        std::mutex m_request_mutex;
+        std::vector<std::pair<TextureId, int>> m_requests;
+
+        std::uint64_t m_frame = 0;
+        std::size_t m_upload_limit = 8 * 1024 * 1024;
+        int m_tail_size = 64;
+
+        TextureStreamingStats m_stats;
+
+        vfs::WatchSubscription m_watch;
+
+        Entry* GetEntry(TextureId id) noexcept;
+
+        // Decode the image and generate the whole mip chain.
+        // Return false and mark the entry as failed on error
+        bool Decode(Entry& entry);
+        // Upload levels in [target, entry.resident) with the coarsest first.
+        // Return the bytes uploaded
+        std::size_t Promote(Entry& entry, int target);
+        // Drop levels finer than the given level
+        void Demote(Entry& entry, int level);
+        void Release(Entry& entry) noexcept;
+
+        // Try to free at least the required bytes by evicting textures
+        // not used in the current frame. Return true if succeeded
+        bool Evict(std::size_t required, const Entry* exclude);
+        [[nodiscard]]
+        std::size_t Available() const noexcept;
+    };
+}
+
+#endif
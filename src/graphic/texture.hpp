@@ -56,6 +56,18 @@ namespace awe::graphic
     {
         typedef InterfaceBase Super;
     public:
+        typedef std::variant<
+            common::Image2D<1>,
+            common::Image2D<3>,
+            common::Image2D<4>
+        > TextureImageData;
+        // Non-owning pixel data for uploading without intermediate copies
+        typedef std::variant<
+            common::Image2DView<1>,
+            common::Image2DView<3>,
+            common::Image2DView<4>
+        > TextureImageView;
+
         ITexture2D(IRenderer& renderer);
 
         ~ITexture2D() noexcept;
@@ -68,20 +80,36 @@ namespace awe::graphic
 
         void SetTextureDesc(const TextureDescription& desc);
 
+        // Thread safety: Can only be called in rendering thread
         virtual void Submit() = 0;
 
+        // Level-wise uploading for texture streaming. The description set by
+        // SetTextureDesc() is applied on the first uploaded level, mipmaps
+        // will never be generated automatically in this mode. A view without
+        // data allocates uninitialized storage of the view size.
+        // Thread safety: Can only be called in rendering thread
+        virtual void SubmitLevel(int level, const TextureImageView& image) = 0;
+        // Update a rectangle of an uploaded level, e.g. a region of an atlas.
+        // The row stride of the view is respected
+        // Thread safety: Can only be called in rendering thread
+        virtual void SubmitSubImage(int level, glm::ivec2 offset, const TextureImageView& image) = 0;
+        // Release the storage of a single level
+        // Thread safety: Can only be called in rendering thread
+        virtual void DiscardLevel(int level) = 0;
+        // Limit sampling to the levels in [base_level, max_level]
+        // Thread safety: Can only be called in rendering thread
+        virtual void SetLevelRange(int base_level, int max_level) = 0;
+        // Size of level 0 for level-wise uploading. The size cannot be
+        // derived from coarser levels of non-power-of-two textures, it is
+        // only taken from level 0 when that level is uploaded
+        virtual void SetBaseSize(glm::ivec2 size) = 0;
+
         virtual glm::ivec2 GetSize() const = 0;
 
         [[nodiscard]]
         bool IsSubmitted() const noexcept;
 
     protected:
-        typedef std::variant<
-            common::Image2D<1>,
-            common::Image2D<3>,
-            common::Image2D<4>
-        > TextureImageData;
-
         struct TextureData
         {
             TextureImageData image_data;
@@ -0,0 +1,355 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "vtexture.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <SDL.h>
+#include <fmt/format.h>
+#include "renderer.hpp"
+
+
+namespace awe::graphic
+{
+    namespace detailed
+    {
+        int CeilPowerOfTwo(int value) noexcept
+        {
+            int result = 1;
+            while(result < value)
+                result <<= 1;
+            return result;
+        }
+    }
+
+    VirtualTexture::VirtualTexture(IRenderer& renderer, const std::string& vfs_path, std::size_t budget)
+    {
+        if(!m_file.OpenRead(vfs_path))
+            throw std::runtime_error(fmt::format("Failed to open virtual texture \"{}\"", vfs_path));
+        if(m_file.Read(&m_header, sizeof(m_header)) != sizeof(m_header) || !m_header.IsValid())
+            throw std::runtime_error(fmt::format("Invalid virtual texture \"{}\"", vfs_path));
+        const int last = static_cast<int>(m_header.levels) - 1;
+        const glm::ivec2 top_count = m_header.TileCount(last);
+        if(m_file.Length() < m_header.TileOffset(last, top_count - 1) + m_header.TileBytes())
+            throw std::runtime_error(fmt::format("Truncated virtual texture \"{}\"", vfs_path));
+
+        // Layout of the tile cache. The page table stores the position of a
+        // tile in the cache as 8-bit integers
+        const int padded = m_header.PaddedTileSize();
+        const int max_side = std::min(renderer.GetMaxTextureSize() / padded, 256);
+        const std::size_t pinned = static_cast<std::size_t>(top_count[0]) * top_count[1];
+        std::size_t capacity = std::max(budget / m_header.TileBytes(), pinned + 1);
+        m_cache_size[0] = std::min(
+            static_cast<int>(std::ceil(std::sqrt(static_cast<double>(capacity)))),
+            max_side
+        );
+        m_cache_size[1] = std::min(
+            static_cast<int>((capacity + m_cache_size[0] - 1) / m_cache_size[0]),
+            max_side
+        );
+        capacity = static_cast<std::size_t>(m_cache_size[0]) * m_cache_size[1];
+        if(capacity <= pinned)
+            throw std::runtime_error(fmt::format("Tiles of \"{}\" are too large for the cache", vfs_path));
+        m_slots.resize(capacity);
+        m_stats.cache_capacity = capacity;
+
+        TextureDescription cache_desc;
+        cache_desc.wrapping = { TextureWrapping::CLAMP_TO_EDGE, TextureWrapping::CLAMP_TO_EDGE };
+        cache_desc.internal_format = TextureFormat::RGBA;
+        cache_desc.mipmap = false;
+        m_cache = renderer.CreateTexture2D();
+        m_cache->SetTextureDesc(cache_desc);
+        m_cache->SubmitLevel(0, common::Image2DView<4>(nullptr, m_cache_size * padded));
+
+        // Levels of the page table follow the size rule of mipmaps
+        const glm::ivec2 table_size(
+            detailed::CeilPowerOfTwo(m_header.TileCount(0)[0]),
+            detailed::CeilPowerOfTwo(m_header.TileCount(0)[1])
+        );
+        m_table.resize(m_header.levels);
+        for(int i = 0; i <= last; ++i)
+        {
+            if(!m_table[i].Create(glm::max(table_size >> i, glm::ivec2(1))))
+                throw std::bad_alloc();
+        }
+        TextureDescription table_desc;
+        table_desc.wrapping = { TextureWrapping::CLAMP_TO_EDGE, TextureWrapping::CLAMP_TO_EDGE };
+        table_desc.filter = { TextureFilter::NEAREST, TextureFilter::NEAREST };
+        table_desc.internal_format = TextureFormat::RGBA;
+        table_desc.mipmap = true;
+        m_page_table = renderer.CreateTexture2D();
+        m_page_table->SetTextureDesc(table_desc);
+
+        if(!m_staging.Create(glm::ivec2(padded)))
+            throw std::bad_alloc();
+
+        // The coarsest level is always resident as the last fallback
+        for(int y = 0; y < top_count[1]; ++y)
+        {
+            for(int x = 0; x < top_count[0]; ++x)
+            {
+                std::size_t slot = AcquireSlot();
+                if(!LoadTile(MakeKey(last, glm::ivec2(x, y)), slot))
+                    throw std::runtime_error(fmt::format("Failed to load tiles of \"{}\"", vfs_path));
+                m_slots[slot].pinned = true;
+            }
+        }
+        RebuildPageTable();
+    }
+
+    VirtualTexture::~VirtualTexture() noexcept = default;
+
+    void VirtualTexture::ProcessFeedback(const common::Image2DView<4>& feedback)
+    {
+        std::unordered_set<TileKey> requests;
+        for(int y = 0; y < feedback.Size()[1]; ++y)
+        {
+            auto* row = reinterpret_cast<const std::uint8_t*>(feedback.Row(y));
+            for(int x = 0; x < feedback.Size()[0]; ++x)
+            {
+                const std::uint8_t* px = row + x * 4;
+                if(px[3] == 0)
+                    continue;
+                int level = px[3] - 1;
+                glm::ivec2 tile(
+                    px[0] | ((px[2] & 0x0F) << 8),
+                    px[1] | ((px[2] >> 4) << 8)
+                );
+                if(level >= static_cast<int>(m_header.levels))
+                    continue;
+                glm::ivec2 count = m_header.TileCount(level);
+                if(tile[0] >= count[0] || tile[1] >= count[1])
+                    continue;
+                requests.insert(MakeKey(level, tile));
+            }
+        }
+
+        std::lock_guard lock(m_request_mutex);
+        m_requests.merge(requests);
+    }
+    void VirtualTexture::RequestTile(int level, glm::ivec2 tile)
+    {
+        if(level < 0 || level >= static_cast<int>(m_header.levels))
+            return;
+        glm::ivec2 count = m_header.TileCount(level);
+        if(tile[0] < 0 || tile[1] < 0 || tile[0] >= count[0] || tile[1] >= count[1])
+            return;
+        std::lock_guard lock(m_request_mutex);
+        m_requests.insert(MakeKey(level, tile));
+    }
+
+    void VirtualTexture::Update()
+    {
+        ++m_frame;
+
+        std::unordered_set<TileKey> requests;
+        {
+            std::lock_guard lock(m_request_mutex);
+            requests.swap(m_requests);
+        }
+        m_stats.requested_tiles = requests.size();
+
+        // Keep the ancestors of the requested tiles resident as fallbacks
+        std::unordered_set<TileKey> missing;
+        for(TileKey key : requests)
+        {
+            int level = static_cast<int>(key >> 48);
+            glm::ivec2 tile(key & 0xFFFFFF, (key >> 24) & 0xFFFFFF);
+            for(; level < static_cast<int>(m_header.levels); ++level, tile >>= 1)
+            {
+                tile = glm::min(tile, m_header.TileCount(level) - 1);
+                TileKey ancestor = MakeKey(level, tile);
+                auto it = m_resident.find(ancestor);
+                if(it != m_resident.end())
+                    m_slots[it->second].last_used = m_frame;
+                else
+                    missing.insert(ancestor);
+            }
+        }
+
+        // Load the coarser tiles first, so the fallback is refined progressively
+        std::vector<TileKey> queue(missing.begin(), missing.end());
+        std::sort(queue.begin(), queue.end(), std::greater<TileKey>());
+        std::size_t uploaded = 0;
+        for(TileKey key : queue)
+        {
+            if(uploaded >= m_upload_limit)
+                break;
+            std::size_t slot = AcquireSlot();
+            if(slot == m_slots.size())
+                break; // The cache is full of tiles in use
+            if(LoadTile(key, slot))
+                ++uploaded;
+        }
+        m_stats.pending_tiles = queue.size() - uploaded;
+
+        UpdatePageTable();
+        m_stats.resident_tiles = m_resident.size();
+    }
+
+    VirtualTextureParams VirtualTexture::GetParams() const noexcept
+    {
+        VirtualTextureParams params;
+        params.size = m_header.Size();
+        params.tile_size = static_cast<float>(m_header.tile_size);
+        params.border = static_cast<float>(m_header.border);
+        params.cache_size = m_cache_size;
+        params.levels = static_cast<int>(m_header.levels);
+        return params;
+    }
+
+    void VirtualTexture::SetUploadLimit(std::size_t tiles) noexcept
+    {
+        m_upload_limit = std::max<std::size_t>(tiles, 1);
+    }
+
+    VirtualTexture::TileKey VirtualTexture::MakeKey(int level, glm::ivec2 tile) noexcept
+    {
+        return
+            (static_cast<TileKey>(level) << 48) |
+            (static_cast<TileKey>(tile[1] & 0xFFFFFF) << 24) |
+            static_cast<TileKey>(tile[0] & 0xFFFFFF);
+    }
+
+    bool VirtualTexture::LoadTile(TileKey key, std::size_t slot)
+    {
+        const int level = static_cast<int>(key >> 48);
+        const glm::ivec2 tile(key & 0xFFFFFF, (key >> 24) & 0xFFFFFF);
+        try
+        {
+            if(!m_file.Seek(m_header.TileOffset(level, tile)))
+                throw vfs::VfsError(PHYSFS_getLastErrorCode());
+            if(m_file.Read(m_staging.Data(), m_staging.ByteSize()) != m_staging.ByteSize())
+                throw std::runtime_error("unexpected end of file");
+        }
+        catch(const std::exception& e)
+        {
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Failed to load virtual texture tile (%d, %d) of level %d: %s",
+                tile[0], tile[1], level,
+                e.what()
+            );
+            return false;
+        }
+
+        const glm::ivec2 pos(slot % m_cache_size[0], slot / m_cache_size[0]);
+        m_cache->SubmitSubImage(0, pos * m_header.PaddedTileSize(), m_staging.View());
+
+        Slot& s = m_slots[slot];
+        s.key = key;
+        s.last_used = m_frame;
+        s.used = true;
+        m_resident[key] = slot;
+        m_dirty_tiles.insert(key);
+        ++m_stats.uploaded_tiles;
+
+        return true;
+    }
+    std::size_t VirtualTexture::AcquireSlot()
+    {
+        std::size_t lru = m_slots.size();
+        for(std::size_t i = 0; i < m_slots.size(); ++i)
+        {
+            const Slot& s = m_slots[i];
+            if(!s.used)
+                return i;
+            if(s.pinned || s.last_used >= m_frame)
+                continue;
+            if(lru == m_slots.size() || s.last_used < m_slots[lru].last_used)
+                lru = i;
+        }
+        if(lru != m_slots.size())
+        {
+            m_resident.erase(m_slots[lru].key);
+            m_dirty_tiles.insert(m_slots[lru].key);
+            m_slots[lru] = Slot();
+            ++m_stats.evicted_tiles;
+        }
+        return lru;
+    }
+    void VirtualTexture::UpdateTableEntry(int level, glm::ivec2 pos) noexcept
+    {
+        const int last = static_cast<int>(m_header.levels) - 1;
+        std::uint8_t* entry = reinterpret_cast<std::uint8_t*>(m_table[level].Row(pos[1])) + pos[0] * 4;
+        auto it = m_resident.find(MakeKey(level, pos));
+        if(it != m_resident.end())
+        {
+            entry[0] = static_cast<std::uint8_t>(it->second % m_cache_size[0]);
+            entry[1] = static_cast<std::uint8_t>(it->second / m_cache_size[0]);
+            entry[2] = static_cast<std::uint8_t>(level);
+            entry[3] = 255;
+        }
+        else if(level < last)
+        { // Fall back to the parent
+            const auto& parent = m_table[level + 1];
+            glm::ivec2 parent_pos = glm::min(pos >> 1, parent.Size() - 1);
+            std::memcpy(entry, parent.Row(parent_pos[1]) + parent_pos[0] * 4, 4);
+        }
+        else
+            std::memset(entry, 0, 4);
+    }
+    void VirtualTexture::RebuildPageTable()
+    {
+        const int last = static_cast<int>(m_header.levels) - 1;
+        for(int level = last; level >= 0; --level)
+        {
+            const auto& table = m_table[level];
+            for(int y = 0; y < table.Size()[1]; ++y)
+            {
+                for(int x = 0; x < table.Size()[0]; ++x)
+                    UpdateTableEntry(level, glm::ivec2(x, y));
+            }
+        }
+
+        for(int level = 0; level <= last; ++level)
+            m_page_table->SubmitLevel(level, m_table[level].View());
+        m_page_table->SetLevelRange(0, last);
+        m_dirty_tiles.clear();
+    }
+    void VirtualTexture::UpdatePageTable()
+    {
+        if(m_dirty_tiles.empty())
+            return;
+        const int last = static_cast<int>(m_header.levels) - 1;
+        std::unordered_set<TileKey> dirty_set;
+        dirty_set.swap(m_dirty_tiles);
+
+        // Coarser tiles first, so the parents are up to date when the finer
+        // entries fall back to them
+        std::vector<TileKey> dirty(dirty_set.begin(), dirty_set.end());
+        std::sort(dirty.begin(), dirty.end(), std::greater<TileKey>());
+        for(TileKey key : dirty)
+        {
+            const int level = static_cast<int>(key >> 48);
+            const glm::ivec2 tile(key & 0xFFFFFF, (key >> 24) & 0xFFFFFF);
+
+            // The region of a dirty ancestor covers this tile
+            bool covered = false;
+            for(int i = level + 1; i <= last && !covered; ++i)
+                covered = dirty_set.count(MakeKey(i, tile >> (i - level))) != 0;
+            if(covered)
+                continue;
+
+            // The entry of the tile and the entries of its descendants
+            for(int i = level; i >= 0; --i)
+            {
+                const auto& table = m_table[i];
+                const int shift = level - i;
+                const glm::ivec2 offset = tile << shift;
+                const glm::ivec2 end = glm::min(offset + (1 << shift), table.Size());
+                if(end[0] <= offset[0] || end[1] <= offset[1])
+                    break;
+                for(int y = offset[1]; y < end[1]; ++y)
+                {
+                    for(int x = offset[0]; x < end[0]; ++x)
+                        UpdateTableEntry(i, glm::ivec2(x, y));
+                }
+                m_page_table->SubmitSubImage(i, offset, table.View().SubView(offset, end - offset));
+            }
+        }
+    }
+}
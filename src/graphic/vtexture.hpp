@@ -0,0 +1,142 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_GRAPHIC_VTEXTURE_HPP
+#define TESTWORLD_GRAPHIC_VTEXTURE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <glm/vec2.hpp>
+#include "texture.hpp"
+#include "common/vtformat.hpp"
+#include "../res/vfs.hpp"
+
+
+namespace awe::graphic
+{
+    class IRenderer;
+
+    struct VirtualTextureStats
+    {
+        std::size_t cache_capacity = 0; // In tiles
+        std::size_t resident_tiles = 0;
+        std::size_t requested_tiles = 0; // Distinct tiles requested in the last update
+        std::size_t pending_tiles = 0; // Requested tiles not resident after the last update
+
+        // Accumulated counters
+        std::uint64_t uploaded_tiles = 0;
+        std::uint64_t evicted_tiles = 0;
+    };
+
+    // Values required by the sampling shader (shader/opengl3/vtexture.fs)
+    struct VirtualTextureParams
+    {
+        glm::vec2 size; // Size of level 0 in pixels
+        float tile_size;
+        float border;
+        glm::vec2 cache_size; // Size of the tile cache in tiles
+        int levels;
+    };
+
+    /*
+     * Tiled virtual texture
+     *
+     * The source image is cut into tiles by the tiling tool (twvtiler). Only
+     * the tiles requested by the feedback pass are loaded into a physical tile
+     * cache texture of fixed size. A page table texture with one texel per
+     * tile and one level per mipmap level maps the virtual tiles to the cache.
+     * Missing tiles fall back to the finest resident ancestor. The tiles of
+     * the coarsest level are always resident.
+     */
+    class VirtualTexture
+    {
+    public:
+        // The cache budget is in bytes and limited by the maximum texture size.
+        // Throw std::runtime_error if the file is invalid
+        // Thread safety: Can only be called in rendering thread
+        VirtualTexture(IRenderer& renderer, const std::string& vfs_path, std::size_t budget);
+        VirtualTexture(const VirtualTexture&) = delete;
+
+        ~VirtualTexture() noexcept;
+
+        // Read back result of the feedback pass (shader/opengl3/vtfeedback.fs).
+        // Each pixel encodes a requested tile, pixels with zero alpha are ignored
+        // Thread safety: Can be called in any thread
+        void ProcessFeedback(const common::Image2DView<4>& feedback);
+        // Thread safety: Can be called in any thread
+        void RequestTile(int level, glm::ivec2 tile);
+
+        // Load requested tiles, evict unused tiles and update the page table.
+        // Should be called once per frame
+        // Thread safety: Can only be called in rendering thread
+        void Update();
+
+        [[nodiscard]]
+        ITexture2D* GetPageTable() noexcept { return m_page_table.get(); }
+        [[nodiscard]]
+        ITexture2D* GetCache() noexcept { return m_cache.get(); }
+        [[nodiscard]]
+        VirtualTextureParams GetParams() const noexcept;
+        [[nodiscard]]
+        const common::VirtualTextureHeader& GetHeader() const noexcept { return m_header; }
+
+        // Maximum tiles loaded in a single frame
+        void SetUploadLimit(std::size_t tiles) noexcept;
+
+        [[nodiscard]]
+        const VirtualTextureStats& GetStats() const noexcept { return m_stats; }
+
+    private:
+        typedef std::uint64_t TileKey;
+
+        struct Slot
+        {
+            TileKey key = 0;
+            std::uint64_t last_used = 0;
+            bool used = false;
+            bool pinned = false; // Tiles of the coarsest level
+        };
+
+        static TileKey MakeKey(int level, glm::ivec2 tile) noexcept;
+
+        vfs::File m_file;
+        common::VirtualTextureHeader m_header{};
+
+        std::unique_ptr<ITexture2D> m_page_table;
+        std::unique_ptr<ITexture2D> m_cache;
+        glm::ivec2 m_cache_size = glm::ivec2(0); // In tiles
+        std::vector<Slot> m_slots;
+        std::unordered_map<TileKey, std::size_t> m_resident; // Key to slot index
+        std::vector<common::Image2D<4>> m_table; // CPU copy of the page table
+        common::Image2D<4> m_staging;
+        // Tiles loaded or evicted since the last update of the page table
+        std::unordered_set<TileKey> m_dirty_tiles;
+
+        std::mutex m_request_mutex;
+        std::unordered_set<TileKey> m_requests;
+
+        std::uint64_t m_frame = 0;
+        std::size_t m_upload_limit = 16;
+
+        VirtualTextureStats m_stats;
+
+        bool LoadTile(TileKey key, std::size_t slot);
+        // Return the index of a free slot or the least recently used slot not
+        // used in the current frame. Return the size of slots if failed
+        std::size_t AcquireSlot();
+        void UpdateTableEntry(int level, glm::ivec2 pos) noexcept;
+        // Rebuild and upload all levels of the page table
+        void RebuildPageTable();
+        // Update the entries of the dirty tiles and the finer entries falling
+        // back to them, only the changed regions are uploaded
+        void UpdatePageTable();
+    };
+}
+
+#endif
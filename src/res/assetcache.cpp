@@ -0,0 +1,289 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "assetcache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include <SDL.h>
+#include <fmt/format.h>
+#include "../sys/mmap.hpp"
+#include "../util/hash.hpp"
+
+
+namespace awe::res
+{
+    namespace detailed
+    {
+        constexpr char CACHE_MAGIC[4] = { 'T', 'W', 'A', 'C' };
+        constexpr std::uint32_t CACHE_VERSION = 1;
+        constexpr std::size_t PAYLOAD_OFFSET = 64;
+
+        struct AssetCacheHeader
+        {
+            char magic[4];
+            std::uint32_t version;
+            std::uint64_t key;
+            std::uint64_t size; // Size of the payload
+            std::byte reserved[PAYLOAD_OFFSET - 24];
+        };
+        static_assert(sizeof(AssetCacheHeader) == PAYLOAD_OFFSET);
+
+        static bool IsEntry(const std::filesystem::path& path)
+        {
+            return path.extension() == ".twc";
+        }
+        // Left by interrupted writing
+        static bool IsTemporary(const std::filesystem::path& path)
+        {
+            return path.extension() == ".tmp";
+        }
+
+        static std::atomic<AssetCache*> global_cache = nullptr;
+    }
+
+    AssetCache::AssetCache(std::filesystem::path dir, std::uint64_t capacity)
+        : m_dir(std::move(dir))
+    {
+        namespace fs = std::filesystem;
+
+        m_stats.capacity = capacity;
+        std::error_code ec;
+        fs::create_directories(m_dir, ec);
+        if(ec)
+        {
+            throw std::runtime_error(fmt::format(
+                "Failed to create asset cache directory \"{}\": {}",
+                m_dir.u8string(),
+                ec.message()
+            ));
+        }
+
+        for(fs::directory_iterator it(m_dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::error_code entry_ec;
+            if(!it->is_regular_file(entry_ec))
+                continue;
+            if(detailed::IsEntry(it->path()))
+                m_stats.total_size += it->file_size(entry_ec);
+            else if(detailed::IsTemporary(it->path()))
+                fs::remove(it->path(), entry_ec);
+        }
+        TrimLocked();
+    }
+
+    AssetCache::Key AssetCache::MakeKey(std::string_view kind, std::uint32_t version, std::uint64_t content_hash) noexcept
+    {
+        std::uint64_t key = util::Hash64(kind);
+        key = util::HashCombine(key, version);
+        return util::HashCombine(key, content_hash);
+    }
+    AssetCache::Key AssetCache::MakeKey(std::string_view kind, std::uint32_t version, const void* content, std::size_t size) noexcept
+    {
+        return MakeKey(kind, version, util::Hash64(content, size));
+    }
+
+    std::optional<vfs::MappedData> AssetCache::Load(Key key, bool copy_on_write)
+    {
+        namespace fs = std::filesystem;
+
+        const fs::path path = GetPath(key);
+        auto file = std::make_shared<MemoryMappedFile>();
+        if(!file->Open(path, copy_on_write))
+        {
+            std::lock_guard lock(m_mutex);
+            ++m_stats.misses;
+            return std::nullopt;
+        }
+
+        detailed::AssetCacheHeader header;
+        bool valid = file->Size() >= sizeof(header);
+        if(valid)
+        {
+            std::memcpy(&header, file->Data(), sizeof(header));
+            valid =
+                std::memcmp(header.magic, detailed::CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+                header.version == detailed::CACHE_VERSION &&
+                header.key == key &&
+                header.size == file->Size() - sizeof(header);
+        }
+        if(!valid)
+        {
+            SDL_LogWarn(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Invalid asset cache entry \"%s\" removed",
+                path.u8string().c_str()
+            );
+            const std::uint64_t size = file->Size();
+            file.reset();
+            std::error_code ec;
+            fs::remove(path, ec);
+
+            std::lock_guard lock(m_mutex);
+            ++m_stats.misses;
+            if(!ec)
+                m_stats.total_size -= std::min(m_stats.total_size, size);
+            return std::nullopt;
+        }
+
+        // The modification time is used as the time of last use
+        std::error_code ec;
+        fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+        {
+            std::lock_guard lock(m_mutex);
+            ++m_stats.hits;
+        }
+        const std::byte* data = file->Data() + sizeof(header);
+        return vfs::MappedData(std::move(file), data, header.size, true);
+    }
+    bool AssetCache::Store(Key key, std::initializer_list<Chunk> chunks)
+    {
+        namespace fs = std::filesystem;
+
+        detailed::AssetCacheHeader header{};
+        std::memcpy(header.magic, detailed::CACHE_MAGIC, sizeof(header.magic));
+        header.version = detailed::CACHE_VERSION;
+        header.key = key;
+        header.size = 0;
+        for(auto& i : chunks)
+            header.size += i.size;
+
+        std::uint64_t seq;
+        {
+            std::lock_guard lock(m_mutex);
+            seq = m_tmp_seq++;
+        }
+        // Write to a temporary file first, so an entry is either complete or absent
+        const fs::path tmp = m_dir / fmt::format("{:016x}.{}.tmp", key, seq);
+        {
+            std::ofstream ofs(tmp, std::ios_base::binary | std::ios_base::trunc);
+            ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for(auto& i : chunks)
+                ofs.write(static_cast<const char*>(i.data), static_cast<std::streamsize>(i.size));
+            ofs.close();
+            if(!ofs)
+            {
+                SDL_LogError(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to write asset cache entry \"%s\"",
+                    tmp.u8string().c_str()
+                );
+                std::error_code ec;
+                fs::remove(tmp, ec);
+                return false;
+            }
+        }
+
+        const fs::path path = GetPath(key);
+        std::error_code ec;
+        std::uint64_t replaced = fs::exists(path, ec) ? fs::file_size(path, ec) : 0;
+        if(ec)
+            replaced = 0;
+        fs::rename(tmp, path, ec);
+        if(ec)
+        { // The entry may be in use on some platforms
+            fs::remove(tmp, ec);
+            return false;
+        }
+
+        std::lock_guard lock(m_mutex);
+        m_stats.total_size -= std::min(m_stats.total_size, replaced);
+        m_stats.total_size += sizeof(header) + header.size;
+        ++m_stats.stores;
+        if(m_stats.total_size > m_stats.capacity)
+            TrimLocked();
+
+        return true;
+    }
+
+    void AssetCache::SetCapacity(std::uint64_t capacity)
+    {
+        std::lock_guard lock(m_mutex);
+        m_stats.capacity = capacity;
+        if(m_stats.total_size > m_stats.capacity)
+            TrimLocked();
+    }
+    void AssetCache::Trim()
+    {
+        std::lock_guard lock(m_mutex);
+        TrimLocked();
+    }
+    void AssetCache::Clear()
+    {
+        namespace fs = std::filesystem;
+
+        std::lock_guard lock(m_mutex);
+        std::error_code ec;
+        std::uint64_t remaining = 0;
+        for(fs::directory_iterator it(m_dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::error_code entry_ec;
+            if(!detailed::IsEntry(it->path()))
+                continue;
+            std::uint64_t size = it->file_size(entry_ec);
+            if(!fs::remove(it->path(), entry_ec))
+                remaining += size;
+        }
+        m_stats.total_size = remaining;
+    }
+
+    AssetCacheStats AssetCache::GetStats()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_stats;
+    }
+
+    std::filesystem::path AssetCache::GetPath(Key key) const
+    {
+        return m_dir / fmt::format("{:016x}.twc", key);
+    }
+    void AssetCache::TrimLocked()
+    {
+        namespace fs = std::filesystem;
+
+        // (last use, size, path)
+        std::vector<std::tuple<fs::file_time_type, std::uint64_t, fs::path>> entries;
+        std::uint64_t total = 0;
+        std::error_code ec;
+        for(fs::directory_iterator it(m_dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            std::error_code entry_ec;
+            if(!detailed::IsEntry(it->path()) || !it->is_regular_file(entry_ec))
+                continue;
+            auto time = it->last_write_time(entry_ec);
+            auto size = it->file_size(entry_ec);
+            if(entry_ec)
+                continue;
+            entries.emplace_back(time, size, it->path());
+            total += size;
+        }
+
+        std::sort(entries.begin(), entries.end());
+        for(auto& [time, size, path] : entries)
+        {
+            if(total <= m_stats.capacity)
+                break;
+            std::error_code remove_ec;
+            if(fs::remove(path, remove_ec))
+            {
+                total -= size;
+                ++m_stats.evictions;
+            }
+        }
+        m_stats.total_size = total;
+    }
+
+    AssetCache* GetAssetCache() noexcept
+    {
+        return detailed::global_cache;
+    }
+    void SetAssetCache(AssetCache* cache) noexcept
+    {
+        detailed::global_cache = cache;
+    }
+}
@@ -0,0 +1,100 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_RES_ASSETCACHE_HPP
+#define TESTWORLD_RES_ASSETCACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <initializer_list>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include "vfs.hpp"
+
+
+namespace awe::res
+{
+    struct AssetCacheStats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t stores = 0;
+        std::uint64_t evictions = 0;
+        std::uint64_t total_size = 0; // In bytes, including headers
+        std::uint64_t capacity = 0;
+    };
+
+    /*
+     * Content-addressed cache of processed assets on the local disk
+     *
+     * Each entry is a file named by its key, which combines the hash of the
+     * source content with the kind of the asset and the version of the
+     * decoder. Payloads start at a 64-byte boundary of the file and are mapped
+     * into memory when loaded. Loading an entry marks it as recently used,
+     * and the least recently used entries are removed when the total size
+     * exceeds the capacity.
+     */
+    class AssetCache
+    {
+    public:
+        typedef std::uint64_t Key;
+
+        struct Chunk
+        {
+            const void* data;
+            std::size_t size;
+        };
+
+        static constexpr std::uint64_t DEFAULT_CAPACITY = 512ull * 1024 * 1024;
+
+        // The directory will be created if not exists
+        explicit AssetCache(std::filesystem::path dir, std::uint64_t capacity = DEFAULT_CAPACITY);
+        AssetCache(const AssetCache&) = delete;
+
+        [[nodiscard]]
+        static Key MakeKey(std::string_view kind, std::uint32_t version, std::uint64_t content_hash) noexcept;
+        [[nodiscard]]
+        static Key MakeKey(std::string_view kind, std::uint32_t version, const void* content, std::size_t size) noexcept;
+
+        // Return std::nullopt if the entry doesn't exist or is invalid.
+        // The memory of a copy-on-write entry can be modified by the caller
+        // Thread safety: Can be called in any thread
+        std::optional<vfs::MappedData> Load(Key key, bool copy_on_write = false);
+        // The chunks are written as a single payload. Return false on failure
+        // Thread safety: Can be called in any thread
+        bool Store(Key key, std::initializer_list<Chunk> chunks);
+        bool Store(Key key, const void* data, std::size_t size)
+        {
+            return Store(key, { Chunk{ data, size } });
+        }
+
+        void SetCapacity(std::uint64_t capacity);
+        // Remove the least recently used entries until the total size fits the capacity
+        void Trim();
+        void Clear();
+
+        [[nodiscard]]
+        const std::filesystem::path& GetDirectory() const noexcept { return m_dir; }
+        [[nodiscard]]
+        AssetCacheStats GetStats();
+
+    private:
+        std::filesystem::path m_dir;
+        std::mutex m_mutex;
+        AssetCacheStats m_stats;
+        std::uint64_t m_tmp_seq = 0;
+
+        [[nodiscard]]
+        std::filesystem::path GetPath(Key key) const;
+        void TrimLocked();
+    };
+
+    // Default cache created by res::Initialize(), nullptr if not available
+    [[nodiscard]]
+    AssetCache* GetAssetCache() noexcept;
+    void SetAssetCache(AssetCache* cache) noexcept;
+}
+
+#endif
@@ -0,0 +1,341 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "ioservice.hpp"
+#include <algorithm>
+#include <chrono>
+
+
+namespace awe::vfs
+{
+    namespace detailed
+    {
+        // Maximum requests of the same archive read together
+        constexpr std::size_t MAX_BATCH_SIZE = 16;
+
+        // Every handle owns a promise, so cancelling one of the coalesced
+        // handles does not affect the others
+        struct IoTicket
+        {
+            IoService::Callback callback;
+            std::promise<MappedData> promise;
+            std::shared_future<MappedData> future;
+            std::atomic_bool cancelled = false;
+            std::atomic_bool settled = false; // The promise has been satisfied
+
+            IoTicket()
+                : future(promise.get_future().share()) {}
+
+            void SetValue(const MappedData& data)
+            {
+                if(!settled.exchange(true))
+                    promise.set_value(data);
+            }
+            void SetError(std::exception_ptr error)
+            {
+                if(!settled.exchange(true))
+                    promise.set_exception(std::move(error));
+            }
+            void Cancel()
+            {
+                cancelled = true;
+                SetError(std::make_exception_ptr(IoCancelled()));
+            }
+        };
+
+        struct IoRequestState
+        {
+            std::string path;
+            IoPriority priority = IoPriority::NORMAL;
+            std::uint64_t seq = 0;
+            bool started = false;
+            // Search path element containing the file, looked up by the I/O
+            // threads. Guarded by the mutex of the service
+            std::string archive;
+            bool resolved = false;
+
+            // Guarded by the mutex of the service until completed
+            std::vector<std::shared_ptr<IoTicket>> tickets;
+
+            MappedData data;
+            std::exception_ptr error;
+
+            [[nodiscard]]
+            bool IsCancelled() const noexcept
+            {
+                return std::all_of(
+                    tickets.begin(), tickets.end(),
+                    [](const auto& t) { return t->cancelled.load(); }
+                );
+            }
+
+            // Thread safety: No ticket can be added after the request has
+            // been removed from the map of the service
+            void SetResult()
+            {
+                for(auto& ticket : tickets)
+                {
+                    if(error)
+                        ticket->SetError(error);
+                    else
+                        ticket->SetValue(data);
+                }
+            }
+        };
+    }
+
+    IoCancelled::IoCancelled()
+        : runtime_error("I/O request cancelled") {}
+
+    IoHandle::IoHandle() noexcept = default;
+    IoHandle::IoHandle(std::shared_ptr<detailed::IoTicket> ticket) noexcept
+        : m_ticket(std::move(ticket)) {}
+
+    bool IoHandle::IsReady() const
+    {
+        if(!m_ticket)
+            return false;
+        return m_ticket->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+    std::shared_future<MappedData> IoHandle::GetFuture() const
+    {
+        if(!m_ticket)
+            throw std::logic_error("invalid I/O handle");
+        return m_ticket->future;
+    }
+    void IoHandle::Cancel() noexcept
+    {
+        if(m_ticket)
+            m_ticket->Cancel();
+    }
+
+    bool IoService::QueueOrder::operator()(const RequestPtr& lhs, const RequestPtr& rhs) const noexcept
+    {
+        if(lhs->priority != rhs->priority)
+            return lhs->priority > rhs->priority;
+        return lhs->seq < rhs->seq;
+    }
+
+    IoService::IoService(std::size_t threads)
+    {
+        threads = std::max<std::size_t>(threads, 1);
+        m_threads.reserve(threads);
+        for(std::size_t i = 0; i < threads; ++i)
+            m_threads.emplace_back(&IoService::Worker, this);
+    }
+
+    IoService::~IoService() noexcept
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+            for(auto& i : m_queue)
+            {
+                m_requests.erase(i->path);
+                for(auto& ticket : i->tickets)
+                    ticket->Cancel();
+            }
+            m_queue.clear();
+        }
+        m_cond.notify_all();
+        for(auto& i : m_threads)
+            i.join();
+    }
+
+    IoHandle IoService::Read(std::string path, IoPriority priority, Callback callback)
+    {
+        auto ticket = std::make_shared<detailed::IoTicket>();
+        ticket->callback = std::move(callback);
+
+        std::lock_guard lock(m_mutex);
+        auto it = m_requests.find(path);
+        if(it != m_requests.end())
+        { // Coalesce with the queued or active request of the same file
+            const RequestPtr& request = it->second;
+            request->tickets.push_back(ticket);
+            ++m_stats.coalesced;
+            if(!request->started && priority > request->priority)
+            {
+                m_queue.erase(request);
+                request->priority = priority;
+                m_queue.insert(request);
+            }
+            return IoHandle(std::move(ticket));
+        }
+
+        auto request = std::make_shared<detailed::IoRequestState>();
+        request->path = std::move(path);
+        request->priority = priority;
+        request->seq = m_seq++;
+        request->tickets.push_back(ticket);
+        if(m_stop)
+        {
+            ticket->Cancel();
+            return IoHandle(std::move(ticket));
+        }
+
+        m_requests.emplace(request->path, request);
+        m_queue.insert(std::move(request));
+        m_cond.notify_one();
+
+        return IoHandle(std::move(ticket));
+    }
+
+    std::size_t IoService::Poll()
+    {
+        std::vector<RequestPtr> completed;
+        {
+            std::lock_guard lock(m_mutex);
+            completed.swap(m_completed);
+        }
+
+        std::size_t count = 0;
+        for(auto& request : completed)
+        {
+            IoResult result{ request->path, request->data, request->error };
+            for(auto& ticket : request->tickets)
+            {
+                if(ticket->cancelled || !ticket->callback)
+                    continue;
+                ticket->callback(result);
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+    void IoService::CancelAll()
+    {
+        std::lock_guard lock(m_mutex);
+        for(auto& i : m_queue)
+        {
+            for(auto& ticket : i->tickets)
+                ticket->Cancel();
+        }
+    }
+
+    IoStats IoService::GetStats()
+    {
+        std::lock_guard lock(m_mutex);
+        IoStats stats = m_stats;
+        stats.pending = m_queue.size();
+        return stats;
+    }
+
+    void IoService::Worker()
+    {
+        while(true)
+        {
+            std::vector<RequestPtr> batch;
+            std::vector<RequestPtr> candidates;
+            std::vector<std::pair<RequestPtr, std::string>> lookups;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if(m_stop)
+                    return;
+
+                batch.push_back(*m_queue.begin());
+                m_queue.erase(m_queue.begin());
+                batch.front()->started = true;
+                ++m_stats.active;
+                // Queued requests of the same priority may be read together
+                for(auto it = m_queue.begin(); it != m_queue.end() && candidates.size() + 1 < detailed::MAX_BATCH_SIZE; ++it)
+                {
+                    if((*it)->priority != batch.front()->priority)
+                        break;
+                    candidates.push_back(*it);
+                }
+                if(!batch.front()->resolved)
+                    lookups.push_back({ batch.front(), std::string() });
+                for(auto& i : candidates)
+                {
+                    if(!i->resolved)
+                        lookups.push_back({ i, std::string() });
+                }
+            }
+
+            // Look up the archives in the I/O thread instead of the thread
+            // calling Read(), without holding the mutex of the service.
+            // The path of a request is never changed after queuing
+            for(auto& [request, archive] : lookups)
+                archive = GetRealDir(request->path).value_or(std::string());
+
+            const RequestPtr first = batch.front();
+            {
+                std::lock_guard lock(m_mutex);
+                for(auto& [request, archive] : lookups)
+                {
+                    if(request->resolved)
+                        continue;
+                    request->archive = std::move(archive);
+                    request->resolved = true;
+                }
+                // Read the queued files of the same archive with the same
+                // priority together, so the archive is accessed sequentially
+                for(auto& i : candidates)
+                {
+                    if(m_stop || first->archive.empty() || batch.size() >= detailed::MAX_BATCH_SIZE)
+                        break;
+                    // Taken by another thread or reprioritized meanwhile
+                    if(i->started || i->priority != first->priority || i->archive != first->archive)
+                        continue;
+                    m_queue.erase(i);
+                    i->started = true;
+                    batch.push_back(i);
+                }
+                m_stats.active += batch.size() - 1;
+                if(batch.size() > 1)
+                    ++m_stats.batches;
+            }
+
+            // Packages are written in the order of paths
+            std::sort(
+                batch.begin(), batch.end(),
+                [](const RequestPtr& lhs, const RequestPtr& rhs) { return lhs->path < rhs->path; }
+            );
+            for(auto& i : batch)
+                Process(i);
+        }
+    }
+    void IoService::Process(const RequestPtr& request)
+    {
+        bool cancelled = false;
+        {
+            std::lock_guard lock(m_mutex);
+            cancelled = request->IsCancelled();
+            if(cancelled) // Never coalesce with a cancelled request
+                m_requests.erase(request->path);
+        }
+
+        if(cancelled)
+            request->error = std::make_exception_ptr(IoCancelled());
+        else
+        {
+            try
+            {
+                request->data = MapData(request->path);
+            }
+            catch(...)
+            {
+                request->error = std::current_exception();
+            }
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            if(!cancelled)
+                m_requests.erase(request->path);
+            m_completed.push_back(request);
+            --m_stats.active;
+            if(cancelled)
+                ++m_stats.cancelled;
+            else
+                ++m_stats.completed;
+        }
+        // Tickets may still be added before the request is removed from
+        // the map, so set the result after that
+        request->SetResult();
+    }
+}
@@ -0,0 +1,154 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_RES_IOSERVICE_HPP
+#define TESTWORLD_RES_IOSERVICE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "vfs.hpp"
+
+
+namespace awe::vfs
+{
+    enum class IoPriority : int
+    {
+        LOW = 0,
+        NORMAL,
+        HIGH,
+        CRITICAL
+    };
+
+    class IoCancelled : public std::runtime_error
+    {
+    public:
+        IoCancelled();
+    };
+
+    struct IoResult
+    {
+        std::string path;
+        MappedData data;
+        std::exception_ptr error; // nullptr if succeeded
+
+        [[nodiscard]]
+        bool Succeeded() const noexcept { return !error; }
+    };
+
+    struct IoStats
+    {
+        std::size_t pending = 0; // Queued requests
+        std::size_t active = 0; // Requests being read
+        std::uint64_t completed = 0;
+        std::uint64_t coalesced = 0; // Requests merged into another request of the same file
+        std::uint64_t cancelled = 0;
+        std::uint64_t batches = 0; // Groups of requests of the same archive read together
+    };
+
+    namespace detailed
+    {
+        struct IoRequestState;
+        struct IoTicket;
+    }
+
+    // Handle of a read request
+    class IoHandle
+    {
+    public:
+        IoHandle() noexcept;
+        IoHandle(std::shared_ptr<detailed::IoTicket> ticket) noexcept;
+
+        [[nodiscard]]
+        bool IsValid() const noexcept { return m_ticket != nullptr; }
+        [[nodiscard]]
+        bool IsReady() const;
+        // The future throws IoCancelled if this handle has been cancelled
+        // before the file is read
+        [[nodiscard]]
+        std::shared_future<MappedData> GetFuture() const;
+
+        // The future of this handle is completed with IoCancelled and the
+        // callback will not be called. Other handles of the same file are
+        // not affected. The file is not read if all requests of the file
+        // are cancelled before reading
+        void Cancel() noexcept;
+
+    private:
+        std::shared_ptr<detailed::IoTicket> m_ticket;
+    };
+
+    /*
+     * Asynchronous reading service of the virtual filesystem
+     *
+     * Requests are read by a pool of I/O threads, the higher priority first.
+     * Requests of the same file are coalesced into a single read, and queued
+     * requests of the same archive are read together in a batch. The archives
+     * are looked up by the I/O threads, Read() never accesses the filesystem.
+     * Completion callbacks are called by Poll() in the polling thread.
+     */
+    class IoService
+    {
+    public:
+        typedef std::function<void(const IoResult& result)> Callback;
+
+        explicit IoService(std::size_t threads = 2);
+        IoService(const IoService&) = delete;
+
+        // Cancel all queued requests and wait for the I/O threads
+        ~IoService() noexcept;
+
+        // Thread safety: Can be called in any thread
+        IoHandle Read(
+            std::string path,
+            IoPriority priority = IoPriority::NORMAL,
+            Callback callback = Callback()
+        );
+
+        // Call the callbacks of completed requests. Return the number of callbacks called
+        // Thread safety: Should always be called in the same thread, usually the main thread
+        std::size_t Poll();
+
+        void CancelAll();
+
+        [[nodiscard]]
+        IoStats GetStats();
+
+    private:
+        typedef std::shared_ptr<detailed::IoRequestState> RequestPtr;
+        struct QueueOrder
+        {
+            bool operator()(const RequestPtr& lhs, const RequestPtr& rhs) const noexcept;
+        };
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::set<RequestPtr, QueueOrder> m_queue;
+        // Queued or active requests for coalescing
+        std::map<std::string, RequestPtr> m_requests;
+        std::vector<RequestPtr> m_completed;
+        std::uint64_t m_seq = 0;
+        bool m_stop = false;
+
+        IoStats m_stats;
+
+        std::vector<std::thread> m_threads;
+
+        void Worker();
+        void Process(const RequestPtr& request);
+    };
+}
+
+#endif
@@ -16,20 +16,12 @@ namespace awe
         bool Mount(const std::string& pakname)
         {
             namespace fs = std::filesystem;
-            auto pakpath = fs::current_path() / "lang" / (pakname + ".pak");
+            auto pakpath = fs::current_path() / "lang" / (pakname + ".twa");
+            if(!fs::exists(pakpath))
+                pakpath.replace_extension(".pak");
             if(!fs::exists(pakpath))
                 return false;
-            int r = PHYSFS_mount(
-                pakpath.u8string().c_str(),
-                ("lang/" + pakname).c_str(),
-                1
-            );
-            if(!r)
-            {
-                return false;
-            }
-
-            return true;
+            return vfs::Mount(pakpath.u8string(), "lang/" + pakname);
         }
 
         std::string GetString(rapidjson::Value& value)
@@ -75,12 +67,16 @@ namespace awe
     }
 
     void LangPak::AddFont()
+    {
+        AddFont(vfs::MapData(GetFontVfsPath()));
+    }
+    void LangPak::AddFont(vfs::MappedData data)
     {
         ImFontConfig cfg{};
         // Avoid double deletion
         cfg.FontDataOwnedByAtlas = false;
 
-        auto ftdata = vfs::GetData(GetFontVfsPath());
+        m_font_data = std::move(data);
         auto& fonts = ImGui::GetIO().Fonts;
 
         auto& lang_doc = m_doc["lang"];
@@ -98,8 +94,8 @@ namespace awe
         size = std::clamp(size, 13.0f, 40.0f);
         range_builder.BuildRanges(&m_glyph_range);
         fonts->AddFontFromMemoryTTF(
-            ftdata.data(),
-            (int)ftdata.size(),
+            const_cast<std::byte*>(m_font_data.Data()),
+            (int)m_font_data.Size(),
             size,
             &cfg,
             m_glyph_range.Data
@@ -8,6 +8,7 @@
 #include <string>
 #include <rapidjson/document.h>
 #include <imgui.h>
+#include "../vfs.hpp"
 
 
 namespace awe
@@ -27,6 +28,8 @@ namespace awe
         const std::string& GetFontVfsPath();
         // Add the font to ImGui
         void AddFont();
+        // Add the font from prefetched data
+        void AddFont(vfs::MappedData data);
 
     private:
         rapidjson::Document m_doc;
@@ -34,6 +37,8 @@ namespace awe
         std::string m_pakname;
         std::string m_id;
         std::optional<std::string> m_font;
+        // The font atlas doesn't own the data, keep it alive until the atlas is built
+        vfs::MappedData m_font_data;
 
         ImVector<ImWchar> m_glyph_range;
     };
@@ -0,0 +1,209 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "listing.hpp"
+#include <algorithm>
+#include "vfs.hpp"
+
+
+namespace awe::vfs
+{
+    namespace detailed
+    {
+        static bool GlobMatchImpl(std::string_view pattern, std::string_view text) noexcept
+        {
+            while(!pattern.empty())
+            {
+                if(pattern[0] == '*')
+                {
+                    const bool cross = pattern.size() > 1 && pattern[1] == '*';
+                    pattern.remove_prefix(cross ? 2 : 1);
+                    // "**/" also matches nothing, e.g. "**/*.png" matches "a.png"
+                    if(cross && !pattern.empty() && pattern[0] == '/' && GlobMatchImpl(pattern.substr(1), text))
+                        return true;
+                    for(std::size_t i = 0; i <= text.size(); ++i)
+                    {
+                        if(GlobMatchImpl(pattern, text.substr(i)))
+                            return true;
+                        if(i < text.size() && text[i] == '/' && !cross)
+                            break;
+                    }
+                    return false;
+                }
+
+                if(text.empty())
+                    return false;
+                if(pattern[0] == '?' ? text[0] == '/' : pattern[0] != text[0])
+                    return false;
+                pattern.remove_prefix(1);
+                text.remove_prefix(1);
+            }
+
+            return text.empty();
+        }
+
+        class ListingBuilder
+        {
+        public:
+            ListingBuilder(
+                std::string& pool,
+                std::vector<DirectoryListing::Entry>& entries,
+                const ListOptions& options,
+                std::size_t base_size
+            ) : m_pool(pool), m_entries(entries), m_options(options), m_base_size(base_size) {
+                m_match_path = m_options.pattern.find('/') != std::string::npos;
+            }
+
+            // Return the number of children
+            std::uint32_t Expand(std::uint32_t parent, std::string_view dir)
+            {
+                m_parent = parent;
+                m_dir.assign(dir);
+                const std::size_t begin = m_entries.size();
+                PHYSFS_enumerate(m_dir.c_str(), &ListingBuilder::Callback, this);
+
+                // Names may be duplicated by multiple search path elements
+                auto first = m_entries.begin() + begin;
+                auto less = [this](const DirectoryListing::Entry& lhs, const DirectoryListing::Entry& rhs)
+                {
+                    return GetName(lhs) < GetName(rhs);
+                };
+                std::sort(first, m_entries.end(), less);
+                auto last = std::unique(
+                    first, m_entries.end(),
+                    [this](const DirectoryListing::Entry& lhs, const DirectoryListing::Entry& rhs)
+                    {
+                        return GetName(lhs) == GetName(rhs);
+                    }
+                );
+                m_entries.erase(last, m_entries.end());
+
+                return static_cast<std::uint32_t>(m_entries.size() - begin);
+            }
+
+        private:
+            std::string& m_pool;
+            std::vector<DirectoryListing::Entry>& m_entries;
+            const ListOptions& m_options;
+            std::size_t m_base_size; // Size of the listed directory with the separator
+            bool m_match_path = false;
+
+            std::uint32_t m_parent = DirectoryListing::NONE;
+            // Reused buffers
+            std::string m_dir;
+            std::string m_path;
+
+            [[nodiscard]]
+            std::string_view GetName(const DirectoryListing::Entry& entry) const noexcept
+            {
+                return std::string_view(
+                    m_pool.data() + entry.path_offset + entry.name_offset,
+                    entry.path_size - entry.name_offset
+                );
+            }
+
+            static PHYSFS_EnumerateCallbackResult Callback(void* data, const char*, const char* fname)
+            {
+                auto* self = static_cast<ListingBuilder*>(data);
+                try
+                {
+                    self->Add(fname);
+                }
+                catch(...)
+                {
+                    return PHYSFS_ENUM_ERROR;
+                }
+                return PHYSFS_ENUM_OK;
+            }
+
+            void Add(std::string_view name)
+            {
+                const std::size_t offset = m_pool.size();
+                m_pool += m_dir;
+                if(!m_dir.empty())
+                    m_pool += '/';
+                const std::size_t name_offset = m_pool.size() - offset;
+                m_pool += name;
+                const std::string_view path(m_pool.data() + offset, m_pool.size() - offset);
+
+                DirectoryListing::Entry entry{};
+                m_path.assign(path);
+                if(!Stat(m_path, entry.stat))
+                { // Removed during enumeration
+                    m_pool.resize(offset);
+                    return;
+                }
+                if(!entry.IsDirectory() && !m_options.pattern.empty())
+                {
+                    const std::string_view subject = m_match_path ?
+                        path.substr(std::min(m_base_size, path.size())) :
+                        path.substr(name_offset);
+                    if(!GlobMatchImpl(m_options.pattern, subject))
+                    {
+                        m_pool.resize(offset);
+                        return;
+                    }
+                }
+
+                entry.path_offset = static_cast<std::uint32_t>(offset);
+                entry.path_size = static_cast<std::uint32_t>(m_pool.size() - offset);
+                entry.name_offset = static_cast<std::uint32_t>(name_offset);
+                entry.parent = m_parent;
+                entry.first_child = DirectoryListing::NONE;
+                entry.child_count = 0;
+                m_entries.push_back(entry);
+            }
+        };
+    }
+
+    bool GlobMatch(std::string_view pattern, std::string_view text) noexcept
+    {
+        return detailed::GlobMatchImpl(pattern, text);
+    }
+
+    DirectoryListing::DirectoryListing() noexcept = default;
+
+    DirectoryListing::DirectoryListing(const std::string& dir, const ListOptions& options)
+    {
+        std::string_view root = dir;
+        while(!root.empty() && root.front() == '/')
+            root.remove_prefix(1);
+        while(!root.empty() && root.back() == '/')
+            root.remove_suffix(1);
+
+        PHYSFS_Stat stat;
+        if(!root.empty() && (!Stat(std::string(root), stat) || stat.filetype != PHYSFS_FILETYPE_DIRECTORY))
+            throw VfsError(PHYSFS_ERR_NOT_FOUND);
+
+        detailed::ListingBuilder builder(m_pool, m_entries, options, root.empty() ? 0 : root.size() + 1);
+        m_root_count = builder.Expand(NONE, root);
+        if(options.recursive)
+        { // Breadth-first, so the children of a directory are appended together
+            std::string path;
+            for(std::size_t i = 0; i < m_entries.size(); ++i)
+            {
+                if(!m_entries[i].IsDirectory())
+                    continue;
+                const std::uint32_t first = static_cast<std::uint32_t>(m_entries.size());
+                path.assign(GetPath(m_entries[i]));
+                const std::uint32_t count = builder.Expand(static_cast<std::uint32_t>(i), path);
+                m_entries[i].first_child = count != 0 ? first : NONE;
+                m_entries[i].child_count = count;
+            }
+        }
+
+        if(!options.directories)
+        {
+            m_entries.erase(
+                std::remove_if(
+                    m_entries.begin(), m_entries.end(),
+                    [](const Entry& entry) { return entry.IsDirectory(); }
+                ),
+                m_entries.end()
+            );
+            for(auto& i : m_entries)
+                i.parent = NONE;
+            m_root_count = static_cast<std::uint32_t>(m_entries.size());
+        }
+    }
+}
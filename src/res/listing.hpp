@@ -0,0 +1,109 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_RES_LISTING_HPP
+#define TESTWORLD_RES_LISTING_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <physfs.h>
+
+
+namespace awe::vfs
+{
+    // Match a name against a glob pattern.
+    // "*" matches any sequence of characters except '/', "**" matches any
+    // sequence including '/', and "?" matches a single character except '/'
+    [[nodiscard]]
+    bool GlobMatch(std::string_view pattern, std::string_view text) noexcept;
+
+    struct ListOptions
+    {
+        // Patterns without '/' are matched against the names of files, other
+        // patterns are matched against the paths relative to the listed
+        // directory. Empty for all files. Directories are never filtered
+        std::string pattern;
+        bool recursive = true;
+        // Include directories in the listing. Directories are still
+        // traversed if false
+        bool directories = true;
+    };
+
+    /*
+     * Listing of a directory in the virtual filesystem
+     *
+     * Names and stat results are collected in a single pass into a flat
+     * arena, i.e. a string pool and an entry array. Entries are ordered by
+     * breadth-first traversal, so the children of a directory are contiguous
+     * and sorted by name. The top-level entries come first.
+     */
+    class DirectoryListing
+    {
+    public:
+        static constexpr std::uint32_t NONE = static_cast<std::uint32_t>(-1);
+
+        struct Entry
+        {
+            std::uint32_t path_offset; // Offset of the full path in the string pool
+            std::uint32_t path_size;
+            std::uint32_t name_offset; // Offset of the name in the full path
+            std::uint32_t parent; // NONE for top-level entries
+            // Children of directories, only valid if directories are included
+            std::uint32_t first_child;
+            std::uint32_t child_count;
+            PHYSFS_Stat stat;
+
+            [[nodiscard]]
+            bool IsDirectory() const noexcept { return stat.filetype == PHYSFS_FILETYPE_DIRECTORY; }
+        };
+
+        DirectoryListing() noexcept;
+
+        // Throw VfsError if the directory doesn't exist
+        DirectoryListing(const std::string& dir, const ListOptions& options = ListOptions());
+
+        [[nodiscard]]
+        std::size_t Size() const noexcept { return m_entries.size(); }
+        [[nodiscard]]
+        bool Empty() const noexcept { return m_entries.empty(); }
+        [[nodiscard]]
+        const Entry& operator[](std::size_t idx) const noexcept { return m_entries[idx]; }
+        [[nodiscard]]
+        auto begin() const noexcept { return m_entries.begin(); }
+        [[nodiscard]]
+        auto end() const noexcept { return m_entries.end(); }
+
+        // Number of the top-level entries, they are in [0, RootCount())
+        [[nodiscard]]
+        std::uint32_t RootCount() const noexcept { return m_root_count; }
+
+        // Full path in the virtual filesystem
+        [[nodiscard]]
+        std::string_view GetPath(const Entry& entry) const noexcept
+        {
+            return std::string_view(m_pool.data() + entry.path_offset, entry.path_size);
+        }
+        [[nodiscard]]
+        std::string_view GetName(const Entry& entry) const noexcept
+        {
+            return GetPath(entry).substr(entry.name_offset);
+        }
+
+        // Bytes used by the arena
+        [[nodiscard]]
+        std::size_t MemoryUsage() const noexcept
+        {
+            return m_pool.capacity() + m_entries.capacity() * sizeof(Entry);
+        }
+
+    private:
+        std::string m_pool;
+        std::vector<Entry> m_entries;
+        std::uint32_t m_root_count = 0;
+    };
+}
+
+#endif
@@ -3,7 +3,10 @@
 
 #include "res.hpp"
 #include <filesystem>
+#include <memory>
 #include <stb_image.h>
+#include "assetcache.hpp"
+#include "twa.hpp"
 
 
 namespace awe::res
@@ -31,9 +34,12 @@ namespace awe::res
                 physfs_ver_rt.major, physfs_ver_rt.major, physfs_ver_rt.patch
             );
         }
+        static std::unique_ptr<AssetCache> asset_cache;
+
         void QuitPhysfs() noexcept
         {
             PHYSFS_deinit();
+            vfs::InvalidatePathIndex();
         }
     }
 
@@ -45,11 +51,8 @@ namespace awe::res
         // Initialize virtual filesystem
         namespace fs = std::filesystem;
         detailed::InitPhysfs(initdata.argv[0]);
-        PHYSFS_mount(
-            fs::current_path().u8string().c_str(),
-            "app",
-            true
-        );
+        vfs::RegisterTwaArchiver();
+        vfs::Mount(fs::current_path().u8string(), "app");
         const std::string packages[] =
         {
             "resource",
@@ -58,15 +61,18 @@ namespace awe::res
         };
         for(auto& i : packages)
         {
-            auto name = i + ".pak";
+            // Loose directories take precedence over the packages, so the
+            // files can be edited and reloaded while running
+            if(fs::is_directory(i))
+                vfs::Mount(fs::absolute(i).u8string(), i);
+
+            // Block-compressed archives are preferred for random access
+            auto name = i + ".twa";
+            if(!fs::exists(name))
+                name = i + ".pak";
             if(fs::exists(name))
             {
-                int r = PHYSFS_mount(
-                    name.c_str(),
-                    i.c_str(),
-                    true
-                );
-                if(!r)
+                if(!vfs::Mount(name, i))
                 {
                     SDL_LogError(
                         SDL_LOG_CATEGORY_APPLICATION,
@@ -78,9 +84,26 @@ namespace awe::res
                 }
             }
         }
+
+        // Not fatal, assets are decoded every time without the cache
+        try
+        {
+            detailed::asset_cache = std::make_unique<AssetCache>(fs::current_path() / "cache");
+            SetAssetCache(detailed::asset_cache.get());
+        }
+        catch(const std::exception& e)
+        {
+            SDL_LogWarn(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Asset cache disabled: %s",
+                e.what()
+            );
+        }
     }
     void Deinitialize()
     {
+        SetAssetCache(nullptr);
+        detailed::asset_cache.reset();
         detailed::QuitPhysfs();
     }
 
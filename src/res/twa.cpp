@@ -0,0 +1,568 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "twa.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <SDL.h>
+#include <physfs.h>
+#include <zlib.h>
+#include "../util/hash.hpp"
+
+
+namespace awe::vfs
+{
+    namespace detailed
+    {
+        static bool ReadAll(PHYSFS_Io* io, void* buf, std::uint64_t size)
+        {
+            auto* dst = static_cast<std::byte*>(buf);
+            while(size > 0)
+            {
+                PHYSFS_sint64 result = io->read(io, dst, size);
+                if(result <= 0)
+                    return false;
+                dst += result;
+                size -= static_cast<std::uint64_t>(result);
+            }
+            return true;
+        }
+
+        class TwaArchive
+        {
+        public:
+            TwaHeader header{};
+
+            // Take the ownership of the I/O only if succeeded
+            bool Load(PHYSFS_Io* io)
+            {
+                m_io = io;
+                if(!io->seek(io, header.directory_offset))
+                    return false;
+                PHYSFS_sint64 length = io->length(io);
+                if(length < 0 || static_cast<std::uint64_t>(length) < header.directory_offset)
+                    return false;
+                const std::uint64_t dir_size = static_cast<std::uint64_t>(length) - header.directory_offset;
+                const std::uint64_t table_size =
+                    header.bucket_count * sizeof(std::uint32_t) +
+                    static_cast<std::uint64_t>(header.entry_count) * sizeof(TwaRecord);
+                if(table_size > dir_size)
+                    return false;
+
+                m_buckets.resize(header.bucket_count);
+                m_records.resize(header.entry_count);
+                m_names.resize(static_cast<std::size_t>(dir_size - table_size));
+                if(!ReadAll(io, m_buckets.data(), m_buckets.size() * sizeof(std::uint32_t)) ||
+                    !ReadAll(io, m_records.data(), m_records.size() * sizeof(TwaRecord)) ||
+                    !ReadAll(io, m_names.data(), m_names.size()))
+                    return false;
+
+                for(auto i : m_buckets)
+                {
+                    if(i > m_records.size())
+                        return false;
+                }
+                AddDirectory("");
+                for(auto& i : m_records)
+                {
+                    if(i.next > m_records.size() ||
+                        static_cast<std::uint64_t>(i.name_offset) + i.name_size > m_names.size())
+                        return false;
+                    AddAncestors(GetName(i));
+                }
+
+                return true;
+            }
+            void Close() noexcept
+            {
+                if(m_io)
+                    m_io->destroy(m_io);
+                m_io = nullptr;
+            }
+
+            [[nodiscard]]
+            PHYSFS_Io* GetIo() const noexcept { return m_io; }
+
+            // O(1) lookup by the hashed directory
+            [[nodiscard]]
+            const TwaRecord* Find(std::string_view name) const noexcept
+            {
+                const std::uint64_t hash = util::Hash64(name);
+                std::uint32_t i = m_buckets[hash & (header.bucket_count - 1)];
+                while(i != 0)
+                {
+                    const TwaRecord& record = m_records[i - 1];
+                    if(record.name_hash == hash && GetName(record) == name)
+                        return &record;
+                    i = record.next;
+                }
+
+                return nullptr;
+            }
+            [[nodiscard]]
+            const std::vector<std::string_view>* FindDirectory(std::string_view name) const
+            {
+                auto it = m_dirs.find(name);
+                return it == m_dirs.end() ? nullptr : &it->second;
+            }
+
+            [[nodiscard]]
+            std::string_view GetName(const TwaRecord& record) const noexcept
+            {
+                return std::string_view(m_names.data() + record.name_offset, record.name_size);
+            }
+
+        private:
+            PHYSFS_Io* m_io = nullptr;
+            std::vector<std::uint32_t> m_buckets;
+            std::vector<TwaRecord> m_records;
+            std::string m_names;
+            // Directory -> names of children. Keys and values refer to the name pool
+            std::unordered_map<std::string_view, std::vector<std::string_view>> m_dirs;
+
+            void AddDirectory(std::string_view dir)
+            {
+                m_dirs.try_emplace(dir);
+            }
+            void AddAncestors(std::string_view path)
+            {
+                std::size_t pos = path.rfind('/');
+                std::string_view parent = pos == path.npos ? std::string_view() : path.substr(0, pos);
+                std::string_view name = pos == path.npos ? path : path.substr(pos + 1);
+                auto [it, inserted] = m_dirs.try_emplace(parent);
+                it->second.push_back(name);
+                if(inserted && !parent.empty())
+                    AddAncestors(parent);
+            }
+        };
+
+        class TwaFile
+        {
+        public:
+            TwaFile(const TwaArchive& archive, const TwaRecord& record)
+                : m_archive(archive), m_record(record)
+            {
+                m_zs.zalloc = Z_NULL;
+                m_zs.zfree = Z_NULL;
+                m_zs.opaque = Z_NULL;
+                if(inflateInit2(&m_zs, -MAX_WBITS) != Z_OK)
+                    throw std::bad_alloc();
+            }
+            TwaFile(const TwaFile&) = delete;
+
+            ~TwaFile()
+            {
+                inflateEnd(&m_zs);
+                if(m_io)
+                    m_io->destroy(m_io);
+            }
+
+            bool Open(PHYSFS_Io* archive_io)
+            {
+                m_io = archive_io->duplicate(archive_io);
+                if(!m_io)
+                    return false;
+                const std::uint64_t count = TwaBlockCount(m_record.size, m_archive.header.block_size);
+                m_table.resize(static_cast<std::size_t>(count + 1));
+                return
+                    m_io->seek(m_io, m_record.block_table_offset) &&
+                    ReadAll(m_io, m_table.data(), m_table.size() * sizeof(std::uint64_t));
+            }
+            bool Duplicate(const TwaFile& other)
+            {
+                m_io = other.m_io->duplicate(other.m_io);
+                m_table = other.m_table;
+                return m_io != nullptr;
+            }
+
+            PHYSFS_sint64 Read(void* buf, std::uint64_t len)
+            {
+                const std::uint32_t block_size = m_archive.header.block_size;
+                auto* dst = static_cast<std::byte*>(buf);
+                len = std::min(len, m_record.size - m_pos);
+                std::uint64_t total = 0;
+                while(total < len)
+                {
+                    const std::uint64_t index = m_pos / block_size;
+                    const std::uint64_t offset = m_pos % block_size;
+                    const std::uint64_t raw_size = BlockRawSize(index);
+                    const std::uint64_t n = std::min(raw_size - offset, len - total);
+
+                    if(offset == 0 && n == raw_size && static_cast<std::int64_t>(index) != m_cached)
+                    { // Decode the whole block into the destination directly
+                        if(!DecodeBlock(index, dst + total))
+                            break;
+                    }
+                    else
+                    {
+                        if(!LoadBlock(index))
+                            break;
+                        std::copy_n(m_block.data() + offset, n, dst + total);
+                    }
+
+                    total += n;
+                    m_pos += n;
+                }
+
+                if(total == 0 && len != 0)
+                    return -1;
+                return static_cast<PHYSFS_sint64>(total);
+            }
+            bool Seek(std::uint64_t offset) noexcept
+            {
+                if(offset > m_record.size)
+                {
+                    PHYSFS_setErrorCode(PHYSFS_ERR_PAST_EOF);
+                    return false;
+                }
+                // Blocks are decoded lazily by the next read
+                m_pos = offset;
+                return true;
+            }
+
+            [[nodiscard]]
+            std::uint64_t Tell() const noexcept { return m_pos; }
+            [[nodiscard]]
+            std::uint64_t Length() const noexcept { return m_record.size; }
+            [[nodiscard]]
+            const TwaArchive& GetArchive() const noexcept { return m_archive; }
+            [[nodiscard]]
+            const TwaRecord& GetRecord() const noexcept { return m_record; }
+
+        private:
+            const TwaArchive& m_archive;
+            const TwaRecord& m_record;
+            PHYSFS_Io* m_io = nullptr;
+            std::vector<std::uint64_t> m_table;
+            std::uint64_t m_pos = 0;
+            z_stream m_zs{};
+
+            // The last decoded block, so small sequential reads decode each block once
+            std::vector<std::byte> m_block;
+            std::int64_t m_cached = -1;
+            std::vector<std::byte> m_compressed;
+
+            [[nodiscard]]
+            std::uint64_t BlockRawSize(std::uint64_t index) const noexcept
+            {
+                const std::uint64_t begin = index * m_archive.header.block_size;
+                return std::min<std::uint64_t>(m_archive.header.block_size, m_record.size - begin);
+            }
+
+            bool LoadBlock(std::uint64_t index)
+            {
+                if(static_cast<std::int64_t>(index) == m_cached)
+                    return true;
+                m_cached = -1;
+                m_block.resize(static_cast<std::size_t>(BlockRawSize(index)));
+                if(!DecodeBlock(index, m_block.data()))
+                    return false;
+                m_cached = static_cast<std::int64_t>(index);
+                return true;
+            }
+            bool DecodeBlock(std::uint64_t index, std::byte* dst)
+            {
+                const std::uint64_t raw_size = BlockRawSize(index);
+                const std::uint64_t begin = m_table[index];
+                const std::uint64_t end = m_table[index + 1];
+                if(end < begin || end - begin > raw_size || !m_io->seek(m_io, begin))
+                {
+                    PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+                    return false;
+                }
+                const std::uint64_t size = end - begin;
+                if(size == raw_size) // Stored block
+                    return ReadAll(m_io, dst, size);
+
+                m_compressed.resize(static_cast<std::size_t>(size));
+                if(!ReadAll(m_io, m_compressed.data(), size))
+                    return false;
+                inflateReset(&m_zs);
+                m_zs.next_in = reinterpret_cast<Bytef*>(m_compressed.data());
+                m_zs.avail_in = static_cast<uInt>(size);
+                m_zs.next_out = reinterpret_cast<Bytef*>(dst);
+                m_zs.avail_out = static_cast<uInt>(raw_size);
+                if(inflate(&m_zs, Z_FINISH) != Z_STREAM_END || m_zs.avail_out != 0)
+                {
+                    PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+                    return false;
+                }
+
+                return true;
+            }
+        };
+
+        static PHYSFS_Io* CreateFileIo(TwaFile* file);
+
+        static PHYSFS_sint64 TwaIoRead(PHYSFS_Io* io, void* buf, PHYSFS_uint64 len)
+        {
+            try
+            {
+                return static_cast<TwaFile*>(io->opaque)->Read(buf, len);
+            }
+            catch(const std::bad_alloc&)
+            {
+                PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+                return -1;
+            }
+        }
+        static PHYSFS_sint64 TwaIoWrite(PHYSFS_Io*, const void*, PHYSFS_uint64)
+        {
+            PHYSFS_setErrorCode(PHYSFS_ERR_READ_ONLY);
+            return -1;
+        }
+        static int TwaIoSeek(PHYSFS_Io* io, PHYSFS_uint64 offset)
+        {
+            return static_cast<TwaFile*>(io->opaque)->Seek(offset);
+        }
+        static PHYSFS_sint64 TwaIoTell(PHYSFS_Io* io)
+        {
+            return static_cast<PHYSFS_sint64>(static_cast<TwaFile*>(io->opaque)->Tell());
+        }
+        static PHYSFS_sint64 TwaIoLength(PHYSFS_Io* io)
+        {
+            return static_cast<PHYSFS_sint64>(static_cast<TwaFile*>(io->opaque)->Length());
+        }
+        static PHYSFS_Io* TwaIoDuplicate(PHYSFS_Io* io)
+        {
+            auto* origin = static_cast<TwaFile*>(io->opaque);
+            TwaFile* file = nullptr;
+            try
+            {
+                file = new TwaFile(origin->GetArchive(), origin->GetRecord());
+                if(!file->Duplicate(*origin))
+                {
+                    delete file;
+                    return nullptr;
+                }
+                return CreateFileIo(file);
+            }
+            catch(const std::bad_alloc&)
+            {
+                delete file;
+                PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+                return nullptr;
+            }
+        }
+        static int TwaIoFlush(PHYSFS_Io*)
+        {
+            return 1;
+        }
+        static void TwaIoDestroy(PHYSFS_Io* io)
+        {
+            delete static_cast<TwaFile*>(io->opaque);
+            delete io;
+        }
+
+        // Take the ownership of the file. Throw std::bad_alloc on failure
+        static PHYSFS_Io* CreateFileIo(TwaFile* file)
+        {
+            auto* io = new PHYSFS_Io{
+                0,
+                file,
+                &TwaIoRead,
+                &TwaIoWrite,
+                &TwaIoSeek,
+                &TwaIoTell,
+                &TwaIoLength,
+                &TwaIoDuplicate,
+                &TwaIoFlush,
+                &TwaIoDestroy
+            };
+            return io;
+        }
+
+        static void* TwaOpenArchive(PHYSFS_Io* io, const char* name, int for_write, int* claimed)
+        {
+            TwaHeader header;
+            if(!io->seek(io, 0) || !ReadAll(io, &header, sizeof(header)) ||
+                std::memcmp(header.magic, TwaHeader::MAGIC, sizeof(header.magic)) != 0)
+            {
+                PHYSFS_setErrorCode(PHYSFS_ERR_UNSUPPORTED);
+                return nullptr;
+            }
+            *claimed = 1;
+            if(for_write)
+            {
+                PHYSFS_setErrorCode(PHYSFS_ERR_READ_ONLY);
+                return nullptr;
+            }
+            if(!header.IsValid())
+            {
+                SDL_LogError(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Unsupported archive \"%s\" (version %u)",
+                    name,
+                    static_cast<unsigned int>(header.version)
+                );
+                PHYSFS_setErrorCode(PHYSFS_ERR_UNSUPPORTED);
+                return nullptr;
+            }
+
+            try
+            {
+                auto* archive = new TwaArchive;
+                archive->header = header;
+                if(!archive->Load(io))
+                {
+                    delete archive;
+                    PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+                    return nullptr;
+                }
+                return archive;
+            }
+            catch(const std::bad_alloc&)
+            {
+                PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+                return nullptr;
+            }
+        }
+        static PHYSFS_EnumerateCallbackResult TwaEnumerate(
+            void* opaque,
+            const char* dirname,
+            PHYSFS_EnumerateCallback cb,
+            const char* origdir,
+            void* callbackdata
+        ) {
+            auto* archive = static_cast<TwaArchive*>(opaque);
+            auto* children = archive->FindDirectory(dirname);
+            if(!children)
+            {
+                PHYSFS_setErrorCode(PHYSFS_ERR_NOT_FOUND);
+                return PHYSFS_ENUM_ERROR;
+            }
+
+            std::string name;
+            for(auto& i : *children)
+            {
+                name.assign(i);
+                auto result = cb(callbackdata, origdir, name.c_str());
+                if(result == PHYSFS_ENUM_ERROR)
+                {
+                    PHYSFS_setErrorCode(PHYSFS_ERR_APP_CALLBACK);
+                    return PHYSFS_ENUM_ERROR;
+                }
+                if(result == PHYSFS_ENUM_STOP)
+                    return PHYSFS_ENUM_STOP;
+            }
+
+            return PHYSFS_ENUM_OK;
+        }
+        static PHYSFS_Io* TwaOpenRead(void* opaque, const char* filename)
+        {
+            auto* archive = static_cast<TwaArchive*>(opaque);
+            const TwaRecord* record = archive->Find(filename);
+            if(!record)
+            {
+                PHYSFS_setErrorCode(
+                    archive->FindDirectory(filename) ? PHYSFS_ERR_NOT_A_FILE : PHYSFS_ERR_NOT_FOUND
+                );
+                return nullptr;
+            }
+
+            TwaFile* file = nullptr;
+            try
+            {
+                file = new TwaFile(*archive, *record);
+                if(!file->Open(archive->GetIo()))
+                {
+                    delete file;
+                    PHYSFS_setErrorCode(PHYSFS_ERR_CORRUPT);
+                    return nullptr;
+                }
+                return CreateFileIo(file);
+            }
+            catch(const std::bad_alloc&)
+            {
+                delete file;
+                PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+                return nullptr;
+            }
+        }
+        static PHYSFS_Io* TwaOpenWrite(void*, const char*)
+        {
+            PHYSFS_setErrorCode(PHYSFS_ERR_READ_ONLY);
+            return nullptr;
+        }
+        static int TwaModify(void*, const char*)
+        {
+            PHYSFS_setErrorCode(PHYSFS_ERR_READ_ONLY);
+            return 0;
+        }
+        static int TwaStat(void* opaque, const char* filename, PHYSFS_Stat* stat)
+        {
+            auto* archive = static_cast<TwaArchive*>(opaque);
+            if(const TwaRecord* record = archive->Find(filename))
+            {
+                stat->filesize = static_cast<PHYSFS_sint64>(record->size);
+                stat->modtime = record->modtime;
+                stat->createtime = record->modtime;
+                stat->accesstime = -1;
+                stat->filetype = PHYSFS_FILETYPE_REGULAR;
+                stat->readonly = 1;
+                return 1;
+            }
+            if(archive->FindDirectory(filename))
+            {
+                stat->filesize = 0;
+                stat->modtime = -1;
+                stat->createtime = -1;
+                stat->accesstime = -1;
+                stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+                stat->readonly = 1;
+                return 1;
+            }
+
+            PHYSFS_setErrorCode(PHYSFS_ERR_NOT_FOUND);
+            return 0;
+        }
+        static void TwaCloseArchive(void* opaque)
+        {
+            auto* archive = static_cast<TwaArchive*>(opaque);
+            archive->Close();
+            delete archive;
+        }
+    }
+
+    bool RegisterTwaArchiver()
+    {
+        static const PHYSFS_Archiver archiver =
+        {
+            0,
+            {
+                "TWA",
+                "Testworld block-compressed archive",
+                "HenryAWE",
+                "",
+                0
+            },
+            &detailed::TwaOpenArchive,
+            &detailed::TwaEnumerate,
+            &detailed::TwaOpenRead,
+            &detailed::TwaOpenWrite,
+            &detailed::TwaOpenWrite,
+            &detailed::TwaModify,
+            &detailed::TwaModify,
+            &detailed::TwaStat,
+            &detailed::TwaCloseArchive
+        };
+
+        if(PHYSFS_registerArchiver(&archiver) == 0)
+        {
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Failed to register the archiver of TWA: %s",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode())
+            );
+            return false;
+        }
+
+        return true;
+    }
+}
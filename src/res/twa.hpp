@@ -0,0 +1,82 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_RES_TWA_HPP
+#define TESTWORLD_RES_TWA_HPP
+
+#include <cstdint>
+#include <cstring>
+
+
+namespace awe::vfs
+{
+    /*
+     * Testworld archive (.twa)
+     *
+     * Block-compressed archive for random access. All integers are little-endian.
+     *
+     * Layout:
+     *   TwaHeader
+     *   Blocks of entries. The data of an entry is split into blocks of the
+     *   block size, each block is compressed independently by raw deflate,
+     *   or stored if compressing doesn't reduce the size
+     *   Block tables. The table of an entry has (block count + 1) absolute
+     *   offsets, block i occupies [offset[i], offset[i + 1])
+     *   Directory:
+     *     Bucket array (std::uint32_t[bucket_count]), one-based index of
+     *     the first record of the hash chain, zero for empty buckets
+     *     TwaRecord[entry_count]
+     *     Name pool (UTF-8 paths separated by '/', not null-terminated)
+     */
+    struct TwaHeader
+    {
+        static constexpr char MAGIC[4] = { 'T', 'W', 'A', 'R' };
+        static constexpr std::uint32_t VERSION = 1;
+        static constexpr std::uint32_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t block_size;
+        std::uint32_t entry_count;
+        std::uint32_t bucket_count; // Power of two
+        std::uint32_t reserved;
+        std::uint64_t directory_offset;
+
+        [[nodiscard]]
+        bool IsValid() const noexcept
+        {
+            return
+                std::memcmp(magic, MAGIC, sizeof(magic)) == 0 &&
+                version == VERSION &&
+                block_size != 0 &&
+                bucket_count != 0 &&
+                (bucket_count & (bucket_count - 1)) == 0;
+        }
+    };
+    static_assert(sizeof(TwaHeader) == 32);
+
+    struct TwaRecord
+    {
+        std::uint64_t name_hash; // util::Hash64() of the name
+        std::uint32_t name_offset; // Offset in the name pool
+        std::uint32_t name_size;
+        std::uint64_t size; // Uncompressed size
+        std::uint64_t block_table_offset;
+        std::int64_t modtime; // Seconds since the epoch
+        std::uint32_t next; // One-based index of the next record in the hash chain, zero for the end
+        std::uint32_t reserved;
+    };
+    static_assert(sizeof(TwaRecord) == 48);
+
+    // Number of blocks of an entry
+    [[nodiscard]]
+    constexpr std::uint64_t TwaBlockCount(std::uint64_t size, std::uint32_t block_size) noexcept
+    {
+        return (size + block_size - 1) / block_size;
+    }
+
+    // Register the archiver of .twa files to PhysFS
+    bool RegisterTwaArchiver();
+}
+
+#endif
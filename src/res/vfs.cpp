@@ -2,9 +2,20 @@
 // License: The 3-clause BSD License
 
 #include "vfs.hpp"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
 #include <stdexcept>
+#include <unordered_map>
+#include <utility>
 #include <physfs.h>
+#include <SDL.h>
 #include <fmt/format.h>
+#include "../sys/mmap.hpp"
+#include "zip.hpp"
 
 
 namespace awe::vfs
@@ -18,6 +29,337 @@ namespace awe::vfs
         }
     }
 
+    namespace detailed
+    {
+        struct MappedArchive
+        {
+            std::string native;
+            MemoryMappedFile file;
+            std::optional<ZipIndex> index;
+        };
+
+        // Size and modification time of the archive when it was mapped
+        struct ArchiveStamp
+        {
+            std::uintmax_t size = static_cast<std::uintmax_t>(-1);
+            std::filesystem::file_time_type mtime;
+
+            bool operator==(const ArchiveStamp& rhs) const noexcept
+            {
+                return size == rhs.size && mtime == rhs.mtime;
+            }
+            bool operator!=(const ArchiveStamp& rhs) const noexcept
+            {
+                return !(*this == rhs);
+            }
+        };
+        static ArchiveStamp GetArchiveStamp(const std::string& native)
+        {
+            ArchiveStamp stamp;
+            std::error_code ec;
+            auto path = std::filesystem::u8path(native);
+            stamp.size = std::filesystem::file_size(path, ec);
+            if(ec)
+                return ArchiveStamp();
+            stamp.mtime = std::filesystem::last_write_time(path, ec);
+            if(ec)
+                return ArchiveStamp();
+            return stamp;
+        }
+
+        struct CachedArchive
+        {
+            ArchiveStamp stamp;
+            std::shared_ptr<MappedArchive> archive;
+        };
+
+        // Archives are parsed once and stay mapped while the file is not
+        // changed, nullptr if the archive is not a readable zip file.
+        // Data mapped before a change keeps the old mapping alive
+        static std::mutex archive_mutex;
+        static std::map<std::string, CachedArchive> archives;
+
+        static std::shared_ptr<MappedArchive> GetArchive(const std::string& native)
+        {
+            ArchiveStamp stamp = GetArchiveStamp(native);
+            std::lock_guard lock(archive_mutex);
+            auto it = archives.find(native);
+            if(it != archives.end())
+            {
+                if(it->second.stamp == stamp)
+                    return it->second.archive;
+                archives.erase(it); // Patched in place
+            }
+
+            auto archive = std::make_shared<MappedArchive>();
+            archive->native = native;
+            try
+            {
+                if(!archive->file.Open(std::filesystem::u8path(native)))
+                    throw std::runtime_error("cannot be mapped");
+                archive->index.emplace(archive->file.Data(), archive->file.Size());
+            }
+            catch(const std::exception& e)
+            {
+                SDL_LogWarn(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Archive \"%s\" cannot be accessed directly: %s",
+                    native.c_str(),
+                    e.what()
+                );
+                archive.reset();
+            }
+            archives.emplace(native, CachedArchive{ stamp, archive });
+            return archive;
+        }
+
+        // TWA archives are read by the archiver registered to PhysFS
+        static bool IsTwaArchive(std::string_view native)
+        {
+            if(native.size() < 4)
+                return false;
+            std::string_view ext = native.substr(native.size() - 4);
+            return
+                ext[0] == '.' &&
+                (ext[1] == 't' || ext[1] == 'T') &&
+                (ext[2] == 'w' || ext[2] == 'W') &&
+                (ext[3] == 'a' || ext[3] == 'A');
+        }
+
+        // Path relative to the mount point of the search path element
+        static std::optional<std::string> GetRelativePath(const std::string& filename, const char* realdir)
+        {
+            std::string_view path = filename;
+            while(!path.empty() && path.front() == '/')
+                path.remove_prefix(1);
+            const char* mount_point = PHYSFS_getMountPoint(realdir);
+            if(!mount_point)
+                return std::nullopt;
+            std::string_view mount = mount_point;
+            while(!mount.empty() && mount.front() == '/')
+                mount.remove_prefix(1);
+            if(path.substr(0, mount.size()) != mount)
+                return std::nullopt;
+            return std::string(path.substr(mount.size()));
+        }
+
+        static std::optional<MappedData> MapArchiveEntry(std::shared_ptr<MappedArchive> archive, const ZipEntry& entry)
+        {
+            if(!entry.IsStored())
+                return std::nullopt;
+            auto offset = archive->index->DataOffset(entry);
+            if(!offset)
+                return std::nullopt;
+            const std::byte* data = archive->file.Data() + *offset;
+            return MappedData(std::move(archive), data, entry.size, true);
+        }
+    }
+
+    namespace detailed
+    {
+        struct IndexEntry
+        {
+            PHYSFS_Stat stat{};
+            std::shared_ptr<MappedArchive> archive; // nullptr for directories
+            const ZipEntry* entry = nullptr;
+        };
+
+        enum class IndexResult
+        {
+            FOUND,
+            NOT_FOUND,
+            NOT_INDEXED // Should be looked up by PhysFS
+        };
+
+        // Key of the path in the index. Paths PhysFS may sanitize differently
+        // (e.g. "a//b" or "a\b") are not indexed
+        static std::optional<std::string> GetIndexKey(std::string_view path)
+        {
+            while(!path.empty() && path.front() == '/')
+                path.remove_prefix(1);
+            while(!path.empty() && path.back() == '/')
+                path.remove_suffix(1);
+            if(path.find("//") != path.npos || path.find_first_of("\\:") != path.npos)
+                return std::nullopt;
+            return std::string(path);
+        }
+
+        class PathIndex
+        {
+        public:
+            void Invalidate() noexcept
+            {
+                std::unique_lock lock(m_mutex);
+                m_valid = false;
+                m_entries.clear();
+                m_bypass.clear();
+            }
+
+            IndexResult Lookup(std::string_view path, IndexEntry* out)
+            {
+                auto key = GetIndexKey(path);
+                if(!key)
+                {
+                    ++m_bypassed;
+                    return IndexResult::NOT_INDEXED;
+                }
+
+                {
+                    std::shared_lock lock(m_mutex);
+                    if(m_valid)
+                        return Find(*key, out);
+                }
+                std::unique_lock lock(m_mutex);
+                if(!m_valid)
+                    Build();
+                return Find(*key, out);
+            }
+
+            PathIndexStats GetStats()
+            {
+                PathIndexStats stats;
+                {
+                    std::shared_lock lock(m_mutex);
+                    stats.entries = m_entries.size();
+                }
+                stats.hits = m_hits;
+                stats.misses = m_misses;
+                stats.bypassed = m_bypassed;
+                stats.rebuilds = m_rebuilds;
+                return stats;
+            }
+
+        private:
+            std::shared_mutex m_mutex;
+            bool m_valid = false;
+            std::unordered_map<std::string, IndexEntry> m_entries;
+            // Mount points of the search path elements not indexed, e.g. directories
+            std::vector<std::string> m_bypass;
+
+            std::atomic<std::uint64_t> m_hits = 0;
+            std::atomic<std::uint64_t> m_misses = 0;
+            std::atomic<std::uint64_t> m_bypassed = 0;
+            std::atomic<std::uint64_t> m_rebuilds = 0;
+
+            IndexResult Find(const std::string& key, IndexEntry* out)
+            {
+                for(auto& i : m_bypass)
+                {
+                    bool covered =
+                        i.empty() ||
+                        (key.compare(0, i.size(), i) == 0 && (key.size() == i.size() || key[i.size()] == '/'));
+                    if(covered)
+                    {
+                        ++m_bypassed;
+                        return IndexResult::NOT_INDEXED;
+                    }
+                }
+
+                auto it = m_entries.find(key);
+                if(it == m_entries.end())
+                {
+                    ++m_misses;
+                    return IndexResult::NOT_FOUND;
+                }
+                if(out)
+                    *out = it->second;
+                ++m_hits;
+                return IndexResult::FOUND;
+            }
+
+            void AddDirectory(const std::string& path)
+            {
+                IndexEntry dir;
+                dir.stat.filesize = 0;
+                dir.stat.modtime = -1;
+                dir.stat.createtime = -1;
+                dir.stat.accesstime = -1;
+                dir.stat.filetype = PHYSFS_FILETYPE_DIRECTORY;
+                dir.stat.readonly = 1;
+                m_entries.try_emplace(path, std::move(dir));
+            }
+            // Add the ancestor directories of a path, excluding the path itself
+            void AddAncestors(const std::string& path)
+            {
+                for(std::size_t pos = path.find('/'); pos != path.npos; pos = path.find('/', pos + 1))
+                    AddDirectory(path.substr(0, pos));
+            }
+
+            void Build()
+            {
+                m_entries.clear();
+                m_bypass.clear();
+                AddDirectory("");
+
+                namespace fs = std::filesystem;
+                char** search_path = PHYSFS_getSearchPath();
+                if(!search_path)
+                {
+                    m_bypass.emplace_back();
+                    m_valid = true;
+                    return;
+                }
+                // The first element containing a path takes precedence
+                for(char** i = search_path; *i; ++i)
+                {
+                    const char* mount_point = PHYSFS_getMountPoint(*i);
+                    auto mount = GetIndexKey(mount_point ? mount_point : "");
+                    if(!mount)
+                    { // Unexpected mount point, don't trust the index at all
+                        m_bypass.emplace_back();
+                        continue;
+                    }
+
+                    std::error_code ec;
+                    std::shared_ptr<MappedArchive> archive;
+                    if(!fs::is_directory(fs::u8path(*i), ec) && !IsTwaArchive(*i))
+                        archive = GetArchive(*i);
+                    if(!archive)
+                    { // The mount point itself is answered by PhysFS
+                        AddAncestors(*mount);
+                        m_bypass.push_back(std::move(*mount));
+                        continue;
+                    }
+
+                    const std::string prefix = mount->empty() ? std::string() : *mount + '/';
+                    for(auto& [name, entry] : archive->index->GetEntries())
+                    {
+                        std::string path = prefix + name;
+                        AddAncestors(path);
+
+                        IndexEntry file;
+                        file.stat.filesize = static_cast<PHYSFS_sint64>(entry.size);
+                        file.stat.modtime = entry.modtime;
+                        file.stat.createtime = entry.modtime;
+                        file.stat.accesstime = -1;
+                        file.stat.filetype = PHYSFS_FILETYPE_REGULAR;
+                        file.stat.readonly = 1;
+                        file.archive = archive;
+                        file.entry = &entry;
+                        m_entries.try_emplace(std::move(path), std::move(file));
+                    }
+                    for(auto& i : archive->index->GetDirectories())
+                    {
+                        std::string path = prefix + i;
+                        AddAncestors(path);
+                        AddDirectory(path);
+                    }
+                    if(!mount->empty())
+                    {
+                        AddAncestors(*mount);
+                        AddDirectory(*mount);
+                    }
+                }
+                PHYSFS_freeList(search_path);
+
+                m_valid = true;
+                ++m_rebuilds;
+            }
+        };
+
+        static PathIndex path_index;
+    }
+
     VfsError::VfsError(PHYSFS_ErrorCode code)
         : runtime_error(detailed::GetError(code)) {}
 
@@ -30,7 +372,7 @@ namespace awe::vfs
         std::vector<std::byte> buf;
         buf.resize(size);
         is.read((char*)buf.data(), size);
-        return std::move(buf);
+        return buf;
     }
     std::string GetString(const std::string& filename)
     {
@@ -41,20 +383,249 @@ namespace awe::vfs
         std::string buf;
         buf.resize(size);
         is.read((char*)buf.data(), size);
-        return std::move(buf);
+        return buf;
+    }
+
+    MappedData::MappedData() noexcept = default;
+    MappedData::MappedData(std::shared_ptr<const void> owner, const std::byte* data, std::size_t size, bool mapped) noexcept
+        : m_owner(std::move(owner)), m_data(data), m_size(size), m_mapped(mapped) {}
+
+    std::optional<MappedData> TryMapData(const std::string& filename)
+    {
+        detailed::IndexEntry indexed;
+        switch(detailed::path_index.Lookup(filename, &indexed))
+        {
+        case detailed::IndexResult::FOUND:
+            if(!indexed.entry)
+                return std::nullopt;
+            return detailed::MapArchiveEntry(std::move(indexed.archive), *indexed.entry);
+        case detailed::IndexResult::NOT_FOUND:
+            return std::nullopt;
+        case detailed::IndexResult::NOT_INDEXED:
+            break;
+        }
+
+        const char* realdir = PHYSFS_getRealDir(filename.c_str());
+        if(!realdir)
+            return std::nullopt;
+        auto relpath = detailed::GetRelativePath(filename, realdir);
+        if(!relpath)
+            return std::nullopt;
+
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        if(fs::is_directory(fs::u8path(realdir), ec))
+        { // Loose file
+            auto file = std::make_shared<MemoryMappedFile>();
+            if(!file->Open(fs::u8path(realdir) / fs::u8path(*relpath)))
+                return std::nullopt;
+            const std::byte* data = file->Data();
+            std::size_t size = file->Size();
+            return MappedData(std::move(file), data, size, true);
+        }
+
+        if(detailed::IsTwaArchive(realdir))
+            return std::nullopt;
+        auto archive = detailed::GetArchive(realdir);
+        if(!archive)
+            return std::nullopt;
+        const ZipEntry* entry = archive->index->Find(*relpath);
+        if(!entry)
+            return std::nullopt;
+        return detailed::MapArchiveEntry(std::move(archive), *entry);
+    }
+    MappedData MapData(const std::string& filename)
+    {
+        if(auto mapped = TryMapData(filename))
+            return std::move(*mapped);
+        auto buf = std::make_shared<std::vector<std::byte>>(GetData(filename));
+        const std::byte* data = buf->data();
+        std::size_t size = buf->size();
+        return MappedData(std::move(buf), data, size, false);
     }
 
     bool Exists(const std::string& path)
     {
-        return PHYSFS_exists(path.c_str());
+        switch(detailed::path_index.Lookup(path, nullptr))
+        {
+        case detailed::IndexResult::FOUND:
+            return true;
+        case detailed::IndexResult::NOT_FOUND:
+            return false;
+        default:
+            return PHYSFS_exists(path.c_str());
+        }
+    }
+    bool Stat(const std::string& path, PHYSFS_Stat& stat)
+    {
+        detailed::IndexEntry indexed;
+        switch(detailed::path_index.Lookup(path, &indexed))
+        {
+        case detailed::IndexResult::FOUND:
+            stat = indexed.stat;
+            return true;
+        case detailed::IndexResult::NOT_FOUND:
+            return false;
+        default:
+            return PHYSFS_stat(path.c_str(), &stat) != 0;
+        }
+    }
+    std::optional<std::string> GetRealDir(const std::string& path)
+    {
+        detailed::IndexEntry indexed;
+        switch(detailed::path_index.Lookup(path, &indexed))
+        {
+        case detailed::IndexResult::FOUND:
+            if(indexed.archive)
+                return indexed.archive->native;
+            break; // Directories may be merged from several elements
+        case detailed::IndexResult::NOT_FOUND:
+            return std::nullopt;
+        default:
+            break;
+        }
+        const char* realdir = PHYSFS_getRealDir(path.c_str());
+        if(!realdir)
+            return std::nullopt;
+        return realdir;
+    }
+
+    bool Mount(const std::string& native, const std::string& mount_point, bool append)
+    {
+        int r = PHYSFS_mount(native.c_str(), mount_point.c_str(), append);
+        {
+            // The archive may have been replaced since it was unmounted
+            std::lock_guard lock(detailed::archive_mutex);
+            detailed::archives.erase(native);
+        }
+        InvalidatePathIndex();
+        return r != 0;
+    }
+    bool Unmount(const std::string& native)
+    {
+        int r = PHYSFS_unmount(native.c_str());
+        {
+            std::lock_guard lock(detailed::archive_mutex);
+            detailed::archives.erase(native);
+        }
+        InvalidatePathIndex();
+        return r != 0;
+    }
+
+    void InvalidatePathIndex()
+    {
+        detailed::path_index.Invalidate();
+    }
+    PathIndexStats GetPathIndexStats()
+    {
+        return detailed::path_index.GetStats();
+    }
+
+    File::File() noexcept = default;
+    File::File(File&& move) noexcept
+        : m_file(std::exchange(move.m_file, nullptr)) {}
+
+    File::~File() noexcept
+    {
+        Close();
+    }
+
+    File& File::operator=(File&& rhs) noexcept
+    {
+        if(this != &rhs)
+        {
+            Close();
+            m_file = std::exchange(rhs.m_file, nullptr);
+        }
+        return *this;
+    }
+
+    bool File::OpenRead(const std::string& filename, std::size_t read_ahead)
+    {
+        PHYSFS_File* f = PHYSFS_openRead(filename.c_str());
+        if(!f)
+            return false;
+        if(read_ahead != 0 && !PHYSFS_setBuffer(f, read_ahead))
+        { // Not fatal, the file is still readable without buffering
+            SDL_LogWarn(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Failed to set read-ahead buffer for \"%s\": %s",
+                filename.c_str(),
+                detailed::GetError(PHYSFS_getLastErrorCode())
+            );
+        }
+
+        Close();
+        m_file = f;
+        return true;
+    }
+    void File::Close() noexcept
+    {
+        if(!m_file)
+            return;
+        PHYSFS_close(m_file);
+        m_file = nullptr;
+    }
+
+    std::size_t File::Read(void* buf, std::size_t size)
+    {
+        if(!m_file || size == 0)
+            return 0;
+        PHYSFS_sint64 read = PHYSFS_readBytes(m_file, buf, size);
+        if(read == -1)
+            throw VfsError(PHYSFS_getLastErrorCode());
+        return static_cast<std::size_t>(read);
+    }
+    bool File::Seek(std::uint64_t pos) noexcept
+    {
+        if(!m_file)
+            return false;
+        return PHYSFS_seek(m_file, pos) != 0;
+    }
+    bool File::Skip(std::int64_t offset) noexcept
+    {
+        if(!m_file)
+            return false;
+        PHYSFS_sint64 pos = PHYSFS_tell(m_file);
+        if(pos == -1 || pos + offset < 0)
+            return false;
+        return PHYSFS_seek(m_file, pos + offset) != 0;
+    }
+
+    std::uint64_t File::Tell() const noexcept
+    {
+        if(!m_file)
+            return 0;
+        PHYSFS_sint64 pos = PHYSFS_tell(m_file);
+        return pos == -1 ? 0 : static_cast<std::uint64_t>(pos);
+    }
+    std::uint64_t File::Length() const noexcept
+    {
+        if(!m_file)
+            return 0;
+        PHYSFS_sint64 len = PHYSFS_fileLength(m_file);
+        return len == -1 ? 0 : static_cast<std::uint64_t>(len);
+    }
+    bool File::Eof() const noexcept
+    {
+        return !m_file || PHYSFS_eof(m_file);
     }
 
+    FileBuf::FileBuf(std::size_t buffer_size)
+        : m_buffer(std::max<std::size_t>(buffer_size, 1)) {}
+
     FileBuf* FileBuf::Open(const std::string& filename, FileMode mode)
     {
         PHYSFS_File* f = nullptr;
+        PHYSFS_Stat stat{};
+        bool has_stat = false;
         switch(mode)
         {
         case FileMode::READ:
+            // Missing files are rejected by the path index without searching
+            has_stat = vfs::Stat(filename, stat);
+            if(!has_stat)
+                return nullptr;
             f = PHYSFS_openRead(filename.c_str());
             break;
         case FileMode::WRITE:
@@ -69,15 +640,17 @@ namespace awe::vfs
         {
             return nullptr;
         }
-        
-        PHYSFS_Stat stat{};
-        int stat_result = PHYSFS_stat(filename.c_str(), &stat);
-        
+        if(mode != FileMode::READ)
+        { // The write directory may be in the search path
+            InvalidatePathIndex();
+            has_stat = PHYSFS_stat(filename.c_str(), &stat) != 0;
+        }
 
         Close();
         m_file = f;
         m_mode = mode;
-        if(stat_result)
+        setg(nullptr, nullptr, nullptr);
+        if(has_stat)
             std::memcpy(&m_stat, &stat, sizeof(PHYSFS_Stat));
         else
             std::memset(&m_stat, 0, sizeof(m_stat));
@@ -138,7 +711,7 @@ namespace awe::vfs
         }
         if (mode & std::ios_base::out)
         {
-            setp(m_buffer, m_buffer);
+            setp(m_buffer.data(), m_buffer.data());
         }
 
         return PHYSFS_tell(m_file);
@@ -157,25 +730,81 @@ namespace awe::vfs
         }
         if (mode & std::ios_base::out)
         {
-            setp(m_buffer, m_buffer);
+            setp(m_buffer.data(), m_buffer.data());
         }
 
         return PHYSFS_tell(m_file);
     }
+    void FileBuf::SetBufferSize(std::size_t size)
+    {
+        size = std::max<std::size_t>(size, 1);
+        if(size == m_buffer.size())
+            return;
+        if(m_file && gptr() != egptr())
+        { // Move the file position back to the first unread character
+            PHYSFS_seek(m_file, PHYSFS_tell(m_file) - (egptr() - gptr()));
+        }
+        setg(nullptr, nullptr, nullptr);
+        m_buffer.resize(size);
+        m_buffer.shrink_to_fit();
+    }
+
     FileBuf::int_type FileBuf::underflow()
     {
         if(!m_file)
             return traits_type::eof();
-        PHYSFS_sint64 read = PHYSFS_readBytes(m_file, m_buffer, BUFSIZ);
-        if(read < BUFSIZ)
+        PHYSFS_sint64 read = PHYSFS_readBytes(m_file, m_buffer.data(), m_buffer.size());
+        if(read == 0)
+            return traits_type::eof();
+        else if(read == -1)
+            throw std::runtime_error(PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + read);
+        return traits_type::to_int_type(*gptr());
+    }
+    std::streamsize FileBuf::xsgetn(char_type* s, std::streamsize count)
+    {
+        if(!m_file || count <= 0)
+            return 0;
+
+        // Consume the buffered data first
+        std::streamsize total = std::min<std::streamsize>(egptr() - gptr(), count);
+        if(total > 0)
         {
-            if(read == 0)
-                return traits_type::eof();
-            else if(read == -1)
-                throw std::runtime_error(PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+            traits_type::copy(s, gptr(), static_cast<std::size_t>(total));
+            gbump(static_cast<int>(total));
         }
-        setg(m_buffer, m_buffer, m_buffer + read);
-        return traits_type::to_int_type(*gptr());
+
+        while(total < count)
+        {
+            std::streamsize remaining = count - total;
+            if(static_cast<std::size_t>(remaining) >= m_buffer.size())
+            {
+                PHYSFS_sint64 read = PHYSFS_readBytes(m_file, s + total, static_cast<PHYSFS_uint64>(remaining));
+                if(read == -1)
+                    throw std::runtime_error(PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+                total += read;
+                break;
+            }
+
+            if(traits_type::eq_int_type(underflow(), traits_type::eof()))
+                break;
+            std::streamsize n = std::min<std::streamsize>(egptr() - gptr(), remaining);
+            traits_type::copy(s + total, gptr(), static_cast<std::size_t>(n));
+            gbump(static_cast<int>(n));
+            total += n;
+        }
+
+        return total;
+    }
+    std::streamsize FileBuf::showmanyc()
+    {
+        if(!m_file)
+            return -1;
+        PHYSFS_sint64 length = PHYSFS_fileLength(m_file);
+        PHYSFS_sint64 pos = PHYSFS_tell(m_file);
+        if(length == -1 || pos == -1)
+            return 0; // Unknown
+        return length > pos ? static_cast<std::streamsize>(length - pos) : -1;
     }
 
     InputStream::InputStream()
@@ -208,4 +837,9 @@ namespace awe::vfs
     {
         return m_buf.FileSize();
     }
+
+    void InputStream::SetBufferSize(std::size_t size)
+    {
+        m_buf.SetBufferSize(size);
+    }
 }
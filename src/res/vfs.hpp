@@ -4,9 +4,14 @@
 #ifndef TESTWORLD_RES_VFS_HPP
 #define TESTWORLD_RES_VFS_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <physfs.h>
 
@@ -29,6 +34,45 @@ namespace awe::vfs
     std::vector<std::byte> GetData(const std::string& filename);
     std::string GetString(const std::string& filename);
 
+    // Read-only file content. The memory stays valid while the handle (or a
+    // copy of it) is alive
+    class MappedData
+    {
+    public:
+        MappedData() noexcept;
+        MappedData(std::shared_ptr<const void> owner, const std::byte* data, std::size_t size, bool mapped) noexcept;
+
+        [[nodiscard]]
+        const std::byte* Data() const noexcept { return m_data; }
+        [[nodiscard]]
+        std::size_t Size() const noexcept { return m_size; }
+        [[nodiscard]]
+        bool Empty() const noexcept { return m_size == 0; }
+        // True if the data is mapped from a loose file or a stored archive
+        // entry without copying
+        [[nodiscard]]
+        bool IsMapped() const noexcept { return m_mapped; }
+
+        [[nodiscard]]
+        std::string_view View() const noexcept
+        {
+            return std::string_view(reinterpret_cast<const char*>(m_data), m_size);
+        }
+
+    private:
+        std::shared_ptr<const void> m_owner;
+        const std::byte* m_data = nullptr;
+        std::size_t m_size = 0;
+        bool m_mapped = false;
+    };
+
+    // Map a loose file or a stored (uncompressed) entry of a zip archive.
+    // Return std::nullopt if the file cannot be mapped
+    std::optional<MappedData> TryMapData(const std::string& filename);
+    // Map the file if possible, otherwise read the whole file into memory.
+    // Throw std::runtime_error if the file cannot be read
+    MappedData MapData(const std::string& filename);
+
     template <typename OutputIt>
     void EnumFiles(const std::string& path, OutputIt iter)
     {
@@ -41,10 +85,86 @@ namespace awe::vfs
     }
 
     bool Exists(const std::string& path);
+    // Return false if the file doesn't exist
+    bool Stat(const std::string& path, PHYSFS_Stat& stat);
+    // Search path element containing the file, std::nullopt if not found
+    std::optional<std::string> GetRealDir(const std::string& path);
+
+    // Mount and unmount through these functions to keep the path index up to date
+    bool Mount(const std::string& native, const std::string& mount_point, bool append = true);
+    bool Unmount(const std::string& native);
+
+    struct PathIndexStats
+    {
+        std::size_t entries = 0; // Indexed files and directories
+        std::uint64_t hits = 0; // Lookups of existing paths answered by the index
+        std::uint64_t misses = 0; // Lookups of missing paths answered by the index
+        std::uint64_t bypassed = 0; // Lookups outside the indexed archives, answered by PhysFS
+        std::uint64_t rebuilds = 0;
+    };
+
+    /*
+     * The path index maps the paths in the zip archives of the search path to
+     * their entries, so lookups don't walk the search path of PhysFS. It is
+     * dropped by Mount() and Unmount(), and rebuilt on the next lookup.
+     * Paths under a mounted directory are always looked up by PhysFS.
+     */
+    void InvalidatePathIndex();
+    [[nodiscard]]
+    PathIndexStats GetPathIndexStats();
+
+    // RAII handle of a PhysFS file for reading
+    class File
+    {
+    public:
+        // Read-ahead buffer size used by OpenRead() if not specified
+        static constexpr std::size_t DEFAULT_READ_AHEAD = 256 * 1024;
+
+        File() noexcept;
+        File(File&& move) noexcept;
+        File(const File&) = delete;
+
+        ~File() noexcept;
+
+        File& operator=(File&& rhs) noexcept;
+
+        // Let PhysFS buffer read_ahead bytes internally, zero disables buffering
+        bool OpenRead(const std::string& filename, std::size_t read_ahead = DEFAULT_READ_AHEAD);
+        void Close() noexcept;
+
+        [[nodiscard]]
+        bool IsOpen() const noexcept { return m_file != nullptr; }
+        [[nodiscard]]
+        explicit operator bool() const noexcept { return IsOpen(); }
+
+        // Return the bytes actually read, less than size only at the end of file.
+        // Throw VfsError on failure
+        std::size_t Read(void* buf, std::size_t size);
+        bool Seek(std::uint64_t pos) noexcept;
+        // Move relatively to the current position
+        bool Skip(std::int64_t offset) noexcept;
+
+        [[nodiscard]]
+        std::uint64_t Tell() const noexcept;
+        [[nodiscard]]
+        std::uint64_t Length() const noexcept;
+        [[nodiscard]]
+        bool Eof() const noexcept;
+
+        [[nodiscard]]
+        PHYSFS_File* GetHandle() const noexcept { return m_file; }
+
+    private:
+        PHYSFS_File* m_file = nullptr;
+    };
 
     class FileBuf : public std::streambuf
     {
     public:
+        static constexpr std::size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+        FileBuf(std::size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
         FileBuf* Open(const std::string& filename, FileMode mode = FileMode::READ);
         FileBuf* Close();
 
@@ -53,6 +173,11 @@ namespace awe::vfs
         [[nodiscard]]
         const PHYSFS_Stat& Stat() const noexcept;
 
+        // Buffered data is discarded without changing the reading position
+        void SetBufferSize(std::size_t size);
+        [[nodiscard]]
+        std::size_t GetBufferSize() const noexcept { return m_buffer.size(); }
+
     protected:
         pos_type seekoff(
             off_type off,
@@ -64,12 +189,15 @@ namespace awe::vfs
             std::ios_base::openmode mode
         ) override;
         int_type underflow() override;
+        // Requests not smaller than the buffer are read into the destination directly
+        std::streamsize xsgetn(char_type* s, std::streamsize count) override;
+        std::streamsize showmanyc() override;
 
     private:
         PHYSFS_File* m_file = nullptr;
         PHYSFS_Stat m_stat{};
         FileMode m_mode = static_cast<FileMode>(0);
-        char_type m_buffer[BUFSIZ];
+        std::vector<char_type> m_buffer;
     };
 
     class InputStream : public std::istream
@@ -84,6 +212,8 @@ namespace awe::vfs
         [[nodiscard]]
         std::size_t FileSize() noexcept;
 
+        void SetBufferSize(std::size_t size);
+
     private:
         FileBuf m_buf;
     };
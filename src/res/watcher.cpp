@@ -0,0 +1,377 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "watcher.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <utility>
+#include <SDL.h>
+#include <physfs.h>
+#include "vfs.hpp"
+#ifdef __linux__
+#   include <cerrno>
+#   include <fcntl.h>
+#   include <sys/inotify.h>
+#   include <unistd.h>
+#endif
+
+
+namespace awe::vfs
+{
+    namespace detailed
+    {
+        struct WatchSubscribers
+        {
+            std::map<std::uint64_t, std::pair<std::string, FileWatcher::Callback>> callbacks;
+            std::uint64_t next_id = 1;
+        };
+
+        static std::string JoinVfsPath(const std::string& dir, std::string_view name)
+        {
+            if(dir.empty())
+                return std::string(name);
+            std::string result;
+            result.reserve(dir.size() + 1 + name.size());
+            result += dir;
+            result += '/';
+            result += name;
+            return result;
+        }
+
+#ifdef __linux__
+        constexpr std::uint32_t WATCH_MASK =
+            IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+            IN_DELETE_SELF | IN_ONLYDIR;
+
+        struct WatchState
+        {
+            struct Directory
+            {
+                std::string native;
+                // The same directory may be mounted more than once, e.g. as
+                // a subdirectory of another mounted directory
+                std::vector<std::string> vfs_paths;
+            };
+
+            int fd = -1;
+            std::map<int, Directory> dirs;
+
+            WatchState()
+            {
+                fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                if(fd < 0)
+                {
+                    SDL_LogWarn(
+                        SDL_LOG_CATEGORY_APPLICATION,
+                        "Failed to initialize inotify: %s",
+                        std::strerror(errno)
+                    );
+                }
+            }
+            ~WatchState()
+            {
+                if(fd >= 0)
+                    close(fd);
+            }
+
+            // Return the paths of files found in new directories, which may
+            // have been created before the directories are watched
+            bool Add(const std::string& native, const std::string& vfs_path, std::vector<std::string>* found)
+            {
+                namespace fs = std::filesystem;
+
+                if(fd < 0)
+                    return false;
+                int wd = inotify_add_watch(fd, native.c_str(), WATCH_MASK);
+                if(wd < 0)
+                {
+                    SDL_LogWarn(
+                        SDL_LOG_CATEGORY_APPLICATION,
+                        "Failed to watch \"%s\": %s",
+                        native.c_str(),
+                        std::strerror(errno)
+                    );
+                    return false;
+                }
+                Directory& dir = dirs[wd];
+                dir.native = native;
+                if(std::find(dir.vfs_paths.begin(), dir.vfs_paths.end(), vfs_path) != dir.vfs_paths.end())
+                    return true; // Already watched
+                dir.vfs_paths.push_back(vfs_path);
+
+                std::error_code ec;
+                for(fs::directory_iterator it(fs::u8path(native), ec), end; !ec && it != end; it.increment(ec))
+                {
+                    std::error_code entry_ec;
+                    std::string name = it->path().filename().u8string();
+                    std::string child = JoinVfsPath(vfs_path, name);
+                    if(it->is_directory(entry_ec))
+                        Add(it->path().u8string(), child, found);
+                    else if(found)
+                        found->push_back(std::move(child));
+                }
+
+                return true;
+            }
+            void Remove(const std::string& native)
+            {
+                for(auto it = dirs.begin(); it != dirs.end();)
+                {
+                    const std::string& dir = it->second.native;
+                    bool inside =
+                        dir.compare(0, native.size(), native) == 0 &&
+                        (dir.size() == native.size() || dir[native.size()] == '/');
+                    if(inside)
+                    {
+                        inotify_rm_watch(fd, it->first);
+                        it = dirs.erase(it);
+                    }
+                    else
+                        ++it;
+                }
+            }
+        };
+#else
+        struct WatchState {};
+#endif
+    }
+
+    WatchSubscription::WatchSubscription() noexcept = default;
+    WatchSubscription::WatchSubscription(std::weak_ptr<detailed::WatchSubscribers> subscribers, std::uint64_t id) noexcept
+        : m_subscribers(std::move(subscribers)), m_id(id) {}
+    WatchSubscription::WatchSubscription(WatchSubscription&& move) noexcept
+        : m_subscribers(std::move(move.m_subscribers)), m_id(std::exchange(move.m_id, 0)) {}
+
+    WatchSubscription::~WatchSubscription() noexcept
+    {
+        Reset();
+    }
+
+    WatchSubscription& WatchSubscription::operator=(WatchSubscription&& rhs) noexcept
+    {
+        if(this != &rhs)
+        {
+            Reset();
+            m_subscribers = std::move(rhs.m_subscribers);
+            m_id = std::exchange(rhs.m_id, 0);
+        }
+        return *this;
+    }
+
+    void WatchSubscription::Reset() noexcept
+    {
+        if(auto subscribers = m_subscribers.lock())
+            subscribers->callbacks.erase(m_id);
+        m_subscribers.reset();
+        m_id = 0;
+    }
+
+    FileWatcher::FileWatcher(std::chrono::milliseconds debounce)
+        : m_state(std::make_unique<detailed::WatchState>()),
+        m_subscribers(std::make_shared<detailed::WatchSubscribers>()),
+        m_debounce(debounce) {}
+
+    FileWatcher::~FileWatcher() noexcept = default;
+
+    bool FileWatcher::IsSupported() noexcept
+    {
+#ifdef __linux__
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool FileWatcher::Watch(const std::string& native, const std::string& mount_point)
+    {
+#ifdef __linux__
+        std::string vfs_path = mount_point;
+        while(!vfs_path.empty() && vfs_path.front() == '/')
+            vfs_path.erase(vfs_path.begin());
+        while(!vfs_path.empty() && vfs_path.back() == '/')
+            vfs_path.pop_back();
+        return m_state->Add(native, vfs_path, nullptr);
+#else
+        (void)native;
+        (void)mount_point;
+        return false;
+#endif
+    }
+    std::size_t FileWatcher::WatchSearchPath()
+    {
+        namespace fs = std::filesystem;
+
+        char** search_path = PHYSFS_getSearchPath();
+        if(!search_path)
+            return 0;
+        std::size_t count = 0;
+        for(char** i = search_path; *i; ++i)
+        {
+            std::error_code ec;
+            if(!fs::is_directory(fs::u8path(*i), ec))
+                continue;
+            const char* mount_point = PHYSFS_getMountPoint(*i);
+            if(Watch(*i, mount_point ? mount_point : ""))
+                ++count;
+        }
+        PHYSFS_freeList(search_path);
+
+        return count;
+    }
+    void FileWatcher::Unwatch(const std::string& native)
+    {
+#ifdef __linux__
+        m_state->Remove(native);
+#else
+        (void)native;
+#endif
+    }
+
+    WatchSubscription FileWatcher::Subscribe(std::string prefix, Callback callback)
+    {
+        std::uint64_t id = m_subscribers->next_id++;
+        m_subscribers->callbacks.emplace(id, std::make_pair(std::move(prefix), std::move(callback)));
+        return WatchSubscription(m_subscribers, id);
+    }
+
+    std::size_t FileWatcher::Poll()
+    {
+        ReadEvents();
+        if(m_pending.empty())
+            return 0;
+
+        const auto now = std::chrono::steady_clock::now();
+        std::vector<FileChange> settled;
+        for(auto it = m_pending.begin(); it != m_pending.end();)
+        {
+            if(it->second.deadline <= now)
+            {
+                settled.push_back(FileChange{ it->first, it->second.type });
+                it = m_pending.erase(it);
+            }
+            else
+                ++it;
+        }
+        if(settled.empty())
+            return 0;
+
+        // Lookups in the callbacks must see the changes
+        InvalidatePathIndex();
+        for(auto& i : settled)
+            Publish(i);
+
+        return settled.size();
+    }
+
+    void FileWatcher::ReadEvents()
+    {
+#ifdef __linux__
+        if(m_state->fd < 0)
+            return;
+
+        alignas(inotify_event) char buf[4096];
+        while(true)
+        {
+            ssize_t len = read(m_state->fd, buf, sizeof(buf));
+            if(len <= 0)
+                break;
+
+            for(ssize_t pos = 0; pos < len;)
+            {
+                const auto* event = reinterpret_cast<const inotify_event*>(buf + pos);
+                pos += sizeof(inotify_event) + event->len;
+
+                if(event->mask & IN_Q_OVERFLOW)
+                {
+                    SDL_LogWarn(
+                        SDL_LOG_CATEGORY_APPLICATION,
+                        "Events of the file watcher overflowed, some changes are lost"
+                    );
+                    continue;
+                }
+                auto it = m_state->dirs.find(event->wd);
+                if(it == m_state->dirs.end())
+                    continue;
+                if(event->mask & (IN_DELETE_SELF | IN_IGNORED))
+                {
+                    m_state->dirs.erase(it);
+                    continue;
+                }
+                if(event->len == 0)
+                    continue;
+
+                const std::string native = it->second.native + '/' + event->name;
+                // Adding watches may invalidate the iterator
+                const std::vector<std::string> vfs_paths = it->second.vfs_paths;
+                if(event->mask & IN_ISDIR)
+                {
+                    if(event->mask & (IN_CREATE | IN_MOVED_TO))
+                    {
+                        std::vector<std::string> found;
+                        for(auto& i : vfs_paths)
+                            m_state->Add(native, detailed::JoinVfsPath(i, event->name), &found);
+                        for(auto& i : found)
+                            AddPending(std::move(i), FileChangeType::MODIFIED);
+                    }
+                    else if(event->mask & (IN_DELETE | IN_MOVED_FROM))
+                        m_state->Remove(native);
+                    continue;
+                }
+
+                for(auto& i : vfs_paths)
+                {
+                    std::string path = detailed::JoinVfsPath(i, event->name);
+                    if(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                        AddPending(std::move(path), FileChangeType::MODIFIED);
+                    else if(event->mask & (IN_DELETE | IN_MOVED_FROM))
+                        AddPending(std::move(path), FileChangeType::REMOVED);
+                    else if(event->mask & IN_CREATE)
+                    { // Delay the pending change until the file is closed
+                        auto pending = m_pending.find(path);
+                        if(pending != m_pending.end())
+                            pending->second.deadline = std::chrono::steady_clock::now() + m_debounce;
+                    }
+                }
+            }
+        }
+#endif
+    }
+    void FileWatcher::AddPending(std::string path, FileChangeType type)
+    {
+        Pending& pending = m_pending[std::move(path)];
+        pending.type = type;
+        pending.deadline = std::chrono::steady_clock::now() + m_debounce;
+    }
+    void FileWatcher::Publish(const FileChange& change)
+    {
+        // Callbacks may subscribe or unsubscribe
+        std::vector<std::uint64_t> matched;
+        for(auto& [id, subscriber] : m_subscribers->callbacks)
+        {
+            const std::string& prefix = subscriber.first;
+            if(change.path.compare(0, prefix.size(), prefix) == 0)
+                matched.push_back(id);
+        }
+        for(auto id : matched)
+        {
+            auto it = m_subscribers->callbacks.find(id);
+            if(it == m_subscribers->callbacks.end())
+                continue;
+            Callback callback = it->second.second;
+            try
+            {
+                callback(change);
+            }
+            catch(const std::exception& e)
+            {
+                SDL_LogError(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to handle the change of \"%s\": %s",
+                    change.path.c_str(),
+                    e.what()
+                );
+            }
+        }
+    }
+}
@@ -0,0 +1,119 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_RES_WATCHER_HPP
+#define TESTWORLD_RES_WATCHER_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace awe::vfs
+{
+    namespace detailed
+    {
+        struct WatchSubscribers;
+        struct WatchState;
+    }
+
+    enum class FileChangeType
+    {
+        MODIFIED = 1, // Created, written or moved into the directory
+        REMOVED
+    };
+
+    struct FileChange
+    {
+        std::string path; // Path in the virtual filesystem
+        FileChangeType type;
+    };
+
+    // The callback is removed when the subscription is destroyed or reset
+    class WatchSubscription
+    {
+    public:
+        WatchSubscription() noexcept;
+        WatchSubscription(std::weak_ptr<detailed::WatchSubscribers> subscribers, std::uint64_t id) noexcept;
+        WatchSubscription(WatchSubscription&& move) noexcept;
+        WatchSubscription(const WatchSubscription&) = delete;
+
+        ~WatchSubscription() noexcept;
+
+        WatchSubscription& operator=(WatchSubscription&& rhs) noexcept;
+
+        void Reset() noexcept;
+
+    private:
+        std::weak_ptr<detailed::WatchSubscribers> m_subscribers;
+        std::uint64_t m_id = 0;
+    };
+
+    /*
+     * Watcher of native directories mounted to the virtual filesystem
+     *
+     * Changes are collected from inotify on Linux. Other platforms are not
+     * supported yet, where watching always fails and nothing is published.
+     * A file is published after no event of it has arrived for the debounce
+     * interval, so the burst of events caused by saving a file results in a
+     * single change. The path index of the virtual filesystem is invalidated
+     * before the changes are published.
+     */
+    class FileWatcher
+    {
+    public:
+        typedef std::function<void(const FileChange&)> Callback;
+
+        static constexpr std::chrono::milliseconds DEFAULT_DEBOUNCE{ 100 };
+
+        explicit FileWatcher(std::chrono::milliseconds debounce = DEFAULT_DEBOUNCE);
+        FileWatcher(const FileWatcher&) = delete;
+
+        ~FileWatcher() noexcept;
+
+        [[nodiscard]]
+        static bool IsSupported() noexcept;
+
+        // Watch a native directory and its subdirectories recursively.
+        // Return false on failure
+        bool Watch(const std::string& native, const std::string& mount_point);
+        // Watch every directory in the search path of PhysFS.
+        // Return the number of watched directories
+        std::size_t WatchSearchPath();
+        void Unwatch(const std::string& native);
+
+        // The callback is called by Poll() for every change whose path starts
+        // with the prefix, e.g. "script/" for everything in the script directory
+        [[nodiscard]]
+        WatchSubscription Subscribe(std::string prefix, Callback callback);
+
+        // Read pending events and publish the settled changes.
+        // Return the number of published changes
+        // Thread safety: Can only be called in the main thread
+        std::size_t Poll();
+
+    private:
+        std::unique_ptr<detailed::WatchState> m_state;
+        std::shared_ptr<detailed::WatchSubscribers> m_subscribers;
+        std::chrono::milliseconds m_debounce;
+
+        struct Pending
+        {
+            FileChangeType type;
+            std::chrono::steady_clock::time_point deadline;
+        };
+        std::map<std::string, Pending> m_pending;
+
+        void ReadEvents();
+        void AddPending(std::string path, FileChangeType type);
+        void Publish(const FileChange& change);
+    };
+}
+
+#endif
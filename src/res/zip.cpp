@@ -0,0 +1,180 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "zip.hpp"
+#include <ctime>
+#include <stdexcept>
+
+
+namespace awe::vfs
+{
+    namespace detailed
+    {
+        constexpr std::uint32_t LOCAL_HEADER_SIG = 0x04034b50;
+        constexpr std::uint32_t CENTRAL_HEADER_SIG = 0x02014b50;
+        constexpr std::uint32_t END_OF_CD_SIG = 0x06054b50;
+        constexpr std::uint32_t ZIP64_END_OF_CD_SIG = 0x06064b50;
+        constexpr std::uint32_t ZIP64_LOCATOR_SIG = 0x07064b50;
+        constexpr std::size_t LOCAL_HEADER_SIZE = 30;
+        constexpr std::size_t CENTRAL_HEADER_SIZE = 46;
+        constexpr std::size_t END_OF_CD_SIZE = 22;
+        constexpr std::size_t ZIP64_END_OF_CD_SIZE = 56;
+        constexpr std::size_t ZIP64_LOCATOR_SIZE = 20;
+
+        // Little-endian reading without alignment requirement
+        template <typename T>
+        T Read(const std::byte* p) noexcept
+        {
+            T value = 0;
+            for(std::size_t i = 0; i < sizeof(T); ++i)
+                value |= static_cast<T>(std::to_integer<std::uint8_t>(p[i])) << (i * 8);
+            return value;
+        }
+
+        std::int64_t DosTimeToTime(std::uint16_t time, std::uint16_t date) noexcept
+        {
+            std::tm tm{};
+            tm.tm_sec = (time & 0x1F) * 2;
+            tm.tm_min = (time >> 5) & 0x3F;
+            tm.tm_hour = time >> 11;
+            tm.tm_mday = date & 0x1F;
+            tm.tm_mon = ((date >> 5) & 0x0F) - 1;
+            tm.tm_year = (date >> 9) + 80;
+            tm.tm_isdst = -1;
+            return static_cast<std::int64_t>(std::mktime(&tm));
+        }
+
+        [[noreturn]]
+        void Malformed(const char* what)
+        {
+            throw std::runtime_error(std::string("malformed zip archive: ") + what);
+        }
+    }
+
+    ZipIndex::ZipIndex(const std::byte* data, std::size_t size)
+        : m_data(data), m_size(size)
+    {
+        using namespace detailed;
+
+        if(size < END_OF_CD_SIZE)
+            Malformed("too small");
+        // The end of central directory record is followed by a comment of at most 65535 bytes
+        std::size_t eocd = size - END_OF_CD_SIZE;
+        const std::size_t min_eocd = size > END_OF_CD_SIZE + 0xFFFF ? size - END_OF_CD_SIZE - 0xFFFF : 0;
+        while(Read<std::uint32_t>(data + eocd) != END_OF_CD_SIG)
+        {
+            if(eocd == min_eocd)
+                Malformed("end of central directory not found");
+            --eocd;
+        }
+
+        std::uint64_t count = Read<std::uint16_t>(data + eocd + 10);
+        std::uint64_t cd_size = Read<std::uint32_t>(data + eocd + 12);
+        std::uint64_t cd_offset = Read<std::uint32_t>(data + eocd + 16);
+        if(count == 0xFFFF || cd_size == 0xFFFFFFFF || cd_offset == 0xFFFFFFFF)
+        { // Zip64
+            if(eocd < ZIP64_LOCATOR_SIZE)
+                Malformed("zip64 locator not found");
+            const std::byte* locator = data + eocd - ZIP64_LOCATOR_SIZE;
+            if(Read<std::uint32_t>(locator) != ZIP64_LOCATOR_SIG)
+                Malformed("zip64 locator not found");
+            std::uint64_t offset = Read<std::uint64_t>(locator + 8);
+            if(size < ZIP64_END_OF_CD_SIZE || offset > size - ZIP64_END_OF_CD_SIZE)
+                Malformed("invalid zip64 end of central directory");
+            const std::byte* record = data + offset;
+            if(Read<std::uint32_t>(record) != ZIP64_END_OF_CD_SIG)
+                Malformed("invalid zip64 end of central directory");
+            count = Read<std::uint64_t>(record + 32);
+            cd_size = Read<std::uint64_t>(record + 40);
+            cd_offset = Read<std::uint64_t>(record + 48);
+        }
+        if(cd_offset > size || cd_size > size - cd_offset)
+            Malformed("invalid central directory");
+
+        m_entries.reserve(count);
+        const std::byte* p = data + cd_offset;
+        const std::byte* end = p + cd_size;
+        for(std::uint64_t i = 0; i < count; ++i)
+        {
+            if(static_cast<std::size_t>(end - p) < CENTRAL_HEADER_SIZE || Read<std::uint32_t>(p) != CENTRAL_HEADER_SIG)
+                Malformed("invalid central directory entry");
+            const std::uint16_t name_len = Read<std::uint16_t>(p + 28);
+            const std::uint16_t extra_len = Read<std::uint16_t>(p + 30);
+            const std::uint16_t comment_len = Read<std::uint16_t>(p + 32);
+            const std::size_t entry_size = CENTRAL_HEADER_SIZE + name_len + extra_len + comment_len;
+            if(static_cast<std::size_t>(end - p) < entry_size)
+                Malformed("invalid central directory entry");
+
+            ZipEntry entry;
+            entry.encrypted = Read<std::uint16_t>(p + 8) & 0x1;
+            entry.method = Read<std::uint16_t>(p + 10);
+            entry.crc32 = Read<std::uint32_t>(p + 16);
+            entry.modtime = detailed::DosTimeToTime(Read<std::uint16_t>(p + 12), Read<std::uint16_t>(p + 14));
+            entry.compressed_size = Read<std::uint32_t>(p + 20);
+            entry.size = Read<std::uint32_t>(p + 24);
+            entry.header_offset = Read<std::uint32_t>(p + 42);
+
+            // Zip64 extended information
+            const std::byte* extra = p + CENTRAL_HEADER_SIZE + name_len;
+            const std::byte* extra_end = extra + extra_len;
+            while(extra_end - extra >= 4)
+            {
+                const std::uint16_t id = Read<std::uint16_t>(extra);
+                const std::uint16_t len = Read<std::uint16_t>(extra + 2);
+                const std::byte* field = extra + 4;
+                if(extra_end - field < len)
+                    break;
+                if(id == 0x0001)
+                {
+                    const std::byte* field_end = field + len;
+                    auto read_u64 = [&](std::uint64_t& value)
+                    {
+                        if(value != 0xFFFFFFFF || field_end - field < 8)
+                            return;
+                        value = Read<std::uint64_t>(field);
+                        field += 8;
+                    };
+                    read_u64(entry.size);
+                    read_u64(entry.compressed_size);
+                    read_u64(entry.header_offset);
+                    break;
+                }
+                extra = field + len;
+            }
+
+            std::string name(reinterpret_cast<const char*>(p + CENTRAL_HEADER_SIZE), name_len);
+            if(!name.empty() && name.back() != '/')
+                m_entries.insert_or_assign(std::move(name), entry);
+            else if(name.size() > 1)
+            {
+                name.pop_back();
+                m_directories.push_back(std::move(name));
+            }
+            p += entry_size;
+        }
+    }
+
+    const ZipEntry* ZipIndex::Find(std::string_view name) const
+    {
+        auto it = m_entries.find(std::string(name));
+        return it != m_entries.end() ? &it->second : nullptr;
+    }
+    std::optional<std::uint64_t> ZipIndex::DataOffset(const ZipEntry& entry) const noexcept
+    {
+        using namespace detailed;
+
+        if(entry.header_offset > m_size || m_size - entry.header_offset < LOCAL_HEADER_SIZE)
+            return std::nullopt;
+        const std::byte* header = m_data + entry.header_offset;
+        if(Read<std::uint32_t>(header) != LOCAL_HEADER_SIG)
+            return std::nullopt;
+        std::uint64_t offset =
+            entry.header_offset +
+            LOCAL_HEADER_SIZE +
+            Read<std::uint16_t>(header + 26) +
+            Read<std::uint16_t>(header + 28);
+        if(offset > m_size || m_size - offset < entry.compressed_size)
+            return std::nullopt;
+        return offset;
+    }
+}
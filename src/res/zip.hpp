@@ -0,0 +1,72 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_RES_ZIP_HPP
+#define TESTWORLD_RES_ZIP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace awe::vfs
+{
+    struct ZipEntry
+    {
+        std::uint64_t header_offset = 0; // Offset of the local file header
+        std::uint64_t compressed_size = 0;
+        std::uint64_t size = 0;
+        std::uint32_t crc32 = 0;
+        std::int64_t modtime = -1; // Local time converted from the DOS timestamp
+        std::uint16_t method = 0; // 0 means stored
+        bool encrypted = false;
+
+        [[nodiscard]]
+        bool IsStored() const noexcept
+        {
+            return method == 0 && !encrypted && compressed_size == size;
+        }
+    };
+
+    // Index of the central directory of a zip archive in memory.
+    // The archive data must outlive the index
+    class ZipIndex
+    {
+    public:
+        // Throw std::runtime_error if the archive is malformed
+        ZipIndex(const std::byte* data, std::size_t size);
+        ZipIndex(const ZipIndex&) = delete;
+
+        // Entries of directories are not indexed
+        [[nodiscard]]
+        const ZipEntry* Find(std::string_view name) const;
+        // Offset of the entry data from the beginning of the archive
+        [[nodiscard]]
+        std::optional<std::uint64_t> DataOffset(const ZipEntry& entry) const noexcept;
+
+        [[nodiscard]]
+        const std::unordered_map<std::string, ZipEntry>& GetEntries() const noexcept
+        {
+            return m_entries;
+        }
+        // Explicit directory entries without the trailing slash
+        [[nodiscard]]
+        const std::vector<std::string>& GetDirectories() const noexcept
+        {
+            return m_directories;
+        }
+
+    private:
+        const std::byte* m_data;
+        std::size_t m_size;
+        std::unordered_map<std::string, ZipEntry> m_entries;
+        std::vector<std::string> m_directories;
+    };
+}
+
+
+#endif
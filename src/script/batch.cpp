@@ -0,0 +1,90 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "batch.hpp"
+#include <cstring>
+#include <fmt/core.h>
+
+
+namespace awe::script
+{
+    BatchStats& BatchStats::operator+=(const BatchStats& rhs)
+    {
+        calls += rhs.calls;
+        failed += rhs.failed;
+        elapsed += rhs.elapsed;
+        dispatch += rhs.dispatch;
+        if(first_error.empty())
+            first_error = rhs.first_error;
+
+        return *this;
+    }
+
+    namespace detailed
+    {
+        static constexpr int HANDLE_FLAGS = asTYPEID_OBJHANDLE | asTYPEID_HANDLETOCONST;
+
+        template <typename T>
+        static T LoadPrimitive(const void* ptr) noexcept
+        {
+            T val;
+            std::memcpy(&val, ptr, sizeof(T));
+            return val;
+        }
+
+        int SetArgFromMemory(asIScriptContext* ctx, asUINT idx, int elem_type_id, void* ptr)
+        {
+            int type_id = 0;
+            asDWORD flags = 0;
+            int r = ctx->GetFunction()->GetParam(idx, &type_id, &flags);
+            if(r < 0)
+                return r;
+
+            if(type_id & asTYPEID_MASK_OBJECT)
+            {
+                // Handles in the array are stored as pointers to the objects
+                void* obj = (elem_type_id & asTYPEID_OBJHANDLE) ? *static_cast<void**>(ptr) : ptr;
+                return ctx->SetArgObject(idx, obj);
+            }
+            if(flags & asTM_INOUTREF)
+                return ctx->SetArgAddress(idx, ptr);
+
+            switch(ctx->GetEngine()->GetSizeOfPrimitiveType(type_id))
+            {
+            case 1: return ctx->SetArgByte(idx, LoadPrimitive<asBYTE>(ptr));
+            case 2: return ctx->SetArgWord(idx, LoadPrimitive<asWORD>(ptr));
+            case 4: return ctx->SetArgDWord(idx, LoadPrimitive<asDWORD>(ptr));
+            case 8: return ctx->SetArgQWord(idx, LoadPrimitive<asQWORD>(ptr));
+            default: return asINVALID_TYPE;
+            }
+        }
+
+        void CheckBatchArray(asIScriptFunction* func, const CScriptArray* arr)
+        {
+            int type_id = 0;
+            asDWORD flags = 0;
+            if(func->GetParamCount() == 0 || func->GetParam(0, &type_id, &flags) < 0)
+            {
+                throw std::invalid_argument(fmt::format(
+                    "Function {} has no parameter for the items",
+                    func->GetDeclaration()
+                ));
+            }
+
+            const int elem_type_id = arr->GetElementTypeId();
+            bool compatible = (type_id & ~HANDLE_FLAGS) == (elem_type_id & ~HANDLE_FLAGS);
+            // Passing the address of a handle in the array is not supported
+            if((type_id & asTYPEID_OBJHANDLE) && (flags & asTM_INOUTREF))
+                compatible = false;
+            if(!compatible)
+            {
+                asIScriptEngine* engine = func->GetEngine();
+                throw std::invalid_argument(fmt::format(
+                    "Cannot pass the elements of {}[] to the first parameter of {}",
+                    engine->GetTypeDeclaration(elem_type_id, true),
+                    func->GetDeclaration()
+                ));
+            }
+        }
+    }
+}
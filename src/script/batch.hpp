@@ -0,0 +1,199 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_BATCH_HPP
+#define TESTWORLD_SCRIPT_BATCH_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <angelscript.h>
+#include <scriptarray/scriptarray.h>
+#include "context.hpp"
+#include "scriptutil.hpp"
+
+
+namespace awe::script
+{
+    struct BatchStats
+    {
+        std::size_t calls = 0;
+        std::size_t failed = 0;
+        // Wall time of the whole batch
+        std::chrono::nanoseconds elapsed{};
+        // Time spent outside of the script code, i.e. preparing the context
+        // and setting the arguments
+        std::chrono::nanoseconds dispatch{};
+        // Message of the first failed call
+        std::string first_error;
+
+        [[nodiscard]]
+        std::chrono::nanoseconds PerCall() const noexcept
+        {
+            return calls ? elapsed / static_cast<std::chrono::nanoseconds::rep>(calls) : std::chrono::nanoseconds(0);
+        }
+        [[nodiscard]]
+        std::chrono::nanoseconds OverheadPerCall() const noexcept
+        {
+            return calls ? dispatch / static_cast<std::chrono::nanoseconds::rep>(calls) : std::chrono::nanoseconds(0);
+        }
+
+        BatchStats& operator+=(const BatchStats& rhs);
+    };
+
+    namespace detailed
+    {
+        // Set the argument from the memory of an array element, the type of
+        // the element must match the parameter
+        int SetArgFromMemory(asIScriptContext* ctx, asUINT idx, int elem_type_id, void* ptr);
+        // Throw std::invalid_argument if the elements of the array cannot be
+        // passed to the first parameter of the function
+        void CheckBatchArray(asIScriptFunction* func, const CScriptArray* arr);
+    }
+
+    template <typename Func>
+    class BatchCaller;
+
+    /*
+     * Calls a script function once per item of a batch
+     *
+     * A single context is taken from the ContextPool for the whole batch.
+     * Preparing a context for the function it has just finished only resets
+     * the arguments, so the cost per item is close to setting the arguments
+     * and running the script. The first parameter receives the item, the
+     * remaining parameters are the same for every call, e.g.
+     * "void Update(Entity@, float)" with BatchCaller<void(Entity*, float)>.
+     * Pointers are passed as handles and std::reference_wrapper as
+     * references.
+     *
+     * A failed call does not stop the batch; failures are counted and the
+     * first error message is kept in the returned BatchStats.
+     *
+     * Thread safety: Batches can be run from several threads with their own
+     * BatchCaller
+     */
+    template <typename Item, typename... Extra>
+    class BatchCaller<void(Item, Extra...)>
+    {
+    public:
+        BatchCaller() noexcept = default;
+        explicit BatchCaller(asIScriptFunction* func) noexcept
+            : m_caller(func) {}
+        explicit BatchCaller(Caller<void(Item, Extra...)> caller) noexcept
+            : m_caller(std::move(caller)) {}
+
+        explicit operator bool() const noexcept { return static_cast<bool>(m_caller); }
+
+        [[nodiscard]]
+        asIScriptFunction* GetFunction() const noexcept { return m_caller.GetFunction(); }
+
+        // Call the function for every item of the range
+        template <typename Range>
+        BatchStats operator()(Range&& items, Extra... extra)
+        {
+            auto it = std::begin(items);
+            // The context may only keep the address of the argument, so the
+            // item must live until the call returns. It is replaced by the
+            // next item after that
+            std::optional<Item> item;
+            return Run(
+                static_cast<std::size_t>(std::distance(std::begin(items), std::end(items))),
+                [&it, &item](asIScriptContext* ctx)
+                {
+                    item.emplace(*it++);
+                    return detailed::SetArg(ctx, 0, *item);
+                },
+                extra...
+            );
+        }
+        // Call the function for every element of a script array, which may
+        // hold handles or values
+        BatchStats operator()(CScriptArray* arr, Extra... extra)
+        {
+            if(!arr || !*this)
+                return BatchStats();
+            detailed::CheckBatchArray(GetFunction(), arr);
+            const int elem_type_id = arr->GetElementTypeId();
+            asUINT i = 0;
+            return Run(
+                arr->GetSize(),
+                [arr, elem_type_id, &i](asIScriptContext* ctx)
+                {
+                    return detailed::SetArgFromMemory(ctx, 0, elem_type_id, arr->At(i++));
+                },
+                extra...
+            );
+        }
+
+        // Accumulated statistics of all batches
+        [[nodiscard]]
+        const BatchStats& GetTotal() const noexcept { return m_total; }
+        void ResetTotal() { m_total = BatchStats(); }
+
+    private:
+        Caller<void(Item, Extra...)> m_caller;
+        BatchStats m_total;
+
+        template <typename SetItem>
+        BatchStats Run(std::size_t count, SetItem&& set_item, Extra&... extra)
+        {
+            using clock = std::chrono::steady_clock;
+
+            BatchStats stats;
+            asIScriptFunction* func = GetFunction();
+            if(!func || count == 0)
+                return stats;
+
+            ContextPool* pool = ContextPool::Get(func->GetEngine());
+            asIScriptContext* ctx = pool ?
+                pool->Acquire(func) :
+                func->GetEngine()->RequestContext();
+            if(!ctx)
+                throw std::runtime_error("Failed to prepare calling script function");
+            detailed::ContextGuard guard(ctx, pool);
+
+            std::chrono::nanoseconds executing{};
+            const auto start = clock::now();
+            for(std::size_t i = 0; i < count; ++i)
+            {
+                // The pool returns a prepared context
+                if((i != 0 || !pool) && ctx->Prepare(func) < 0)
+                    throw std::runtime_error("Failed to prepare calling script function");
+                int r = set_item(ctx);
+                if(r < 0)
+                {
+                    throw std::invalid_argument(fmt::format(
+                        "Invalid item of the batch at index {}\n"
+                        "Error code: {}",
+                        i,
+                        r
+                    ));
+                }
+                detailed::ProcArg(ctx, 1, extra...);
+
+                const auto before = clock::now();
+                r = ctx->Execute();
+                executing += clock::now() - before;
+
+                ++stats.calls;
+                if(r != asEXECUTION_FINISHED)
+                {
+                    ++stats.failed;
+                    if(stats.first_error.empty())
+                        stats.first_error = detailed::DescribeExecutionError(ctx, r);
+                }
+            }
+            stats.elapsed = clock::now() - start;
+            stats.dispatch = stats.elapsed - executing;
+
+            m_total += stats;
+            return stats;
+        }
+    };
+}
+
+#endif
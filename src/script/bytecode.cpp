@@ -0,0 +1,199 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "bytecode.hpp"
+#include <cstring>
+#include <SDL.h>
+#include <scriptbuilder/scriptbuilder.h>
+#include "scriptutil.hpp"
+#include "../res/assetcache.hpp"
+#include "../util/hash.hpp"
+
+
+namespace awe::script
+{
+    namespace detailed
+    {
+        // Increase when the layout of cached entries changes
+        constexpr std::uint32_t BYTECODE_CACHE_VERSION = 1;
+
+        class InterfaceHasher
+        {
+        public:
+            void Add(const char* str) noexcept
+            {
+                m_hash = util::HashCombine(m_hash, util::Hash64(str ? str : ""));
+            }
+            void Add(std::uint64_t value) noexcept
+            {
+                m_hash = util::HashCombine(m_hash, value);
+            }
+            void Add(const asIScriptFunction* func) noexcept
+            {
+                Add(func ? func->GetDeclaration(true, true, false) : "");
+            }
+            void Add(const asITypeInfo* type) noexcept
+            {
+                Add(type->GetNamespace());
+                Add(type->GetName());
+                Add(static_cast<std::uint64_t>(type->GetFlags()));
+            }
+
+            [[nodiscard]]
+            std::uint64_t Get() const noexcept { return m_hash; }
+
+        private:
+            std::uint64_t m_hash = 0;
+        };
+    }
+
+    MemoryBinaryStream::MemoryBinaryStream() noexcept = default;
+    MemoryBinaryStream::MemoryBinaryStream(const void* data, std::size_t size) noexcept
+        : m_data(static_cast<const std::byte*>(data)), m_size(size) {}
+
+    int MemoryBinaryStream::Read(void* ptr, asUINT size)
+    {
+        if(size > m_size - m_pos)
+            return asERROR;
+        std::memcpy(ptr, m_data + m_pos, size);
+        m_pos += size;
+        return asSUCCESS;
+    }
+    int MemoryBinaryStream::Write(const void* ptr, asUINT size)
+    {
+        const auto* p = static_cast<const std::byte*>(ptr);
+        m_buf.insert(m_buf.end(), p, p + size);
+        return asSUCCESS;
+    }
+
+    std::uint64_t HashEngineInterface(asIScriptEngine* engine)
+    {
+        detailed::InterfaceHasher hasher;
+        hasher.Add(asGetLibraryVersion());
+        hasher.Add(asGetLibraryOptions());
+        hasher.Add(static_cast<std::uint64_t>(sizeof(void*)));
+
+        // Type ids are assigned in the order of registration, so the order matters
+        for(asUINT i = 0; i < engine->GetObjectTypeCount(); ++i)
+        {
+            const asITypeInfo* type = engine->GetObjectTypeByIndex(i);
+            hasher.Add(type);
+            hasher.Add(static_cast<std::uint64_t>(type->GetSize()));
+            for(asUINT j = 0; j < type->GetBehaviourCount(); ++j)
+            {
+                asEBehaviours behaviour;
+                const asIScriptFunction* func = type->GetBehaviourByIndex(j, &behaviour);
+                hasher.Add(static_cast<std::uint64_t>(behaviour));
+                hasher.Add(func);
+            }
+            for(asUINT j = 0; j < type->GetFactoryCount(); ++j)
+                hasher.Add(type->GetFactoryByIndex(j));
+            for(asUINT j = 0; j < type->GetMethodCount(); ++j)
+                hasher.Add(type->GetMethodByIndex(j));
+            for(asUINT j = 0; j < type->GetPropertyCount(); ++j)
+                hasher.Add(type->GetPropertyDeclaration(j, true));
+        }
+        for(asUINT i = 0; i < engine->GetFuncdefCount(); ++i)
+        {
+            const asITypeInfo* type = engine->GetFuncdefByIndex(i);
+            hasher.Add(type);
+            hasher.Add(type->GetFuncdefSignature());
+        }
+        for(asUINT i = 0; i < engine->GetEnumCount(); ++i)
+        {
+            const asITypeInfo* type = engine->GetEnumByIndex(i);
+            hasher.Add(type);
+            for(asUINT j = 0; j < type->GetEnumValueCount(); ++j)
+            {
+                int value = 0;
+                hasher.Add(type->GetEnumValueByIndex(j, &value));
+                hasher.Add(static_cast<std::uint64_t>(static_cast<std::int64_t>(value)));
+            }
+        }
+        for(asUINT i = 0; i < engine->GetTypedefCount(); ++i)
+        {
+            const asITypeInfo* type = engine->GetTypedefByIndex(i);
+            hasher.Add(type);
+            hasher.Add(engine->GetTypeDeclaration(type->GetTypedefTypeId(), true));
+        }
+        for(asUINT i = 0; i < engine->GetGlobalFunctionCount(); ++i)
+            hasher.Add(engine->GetGlobalFunctionByIndex(i));
+        for(asUINT i = 0; i < engine->GetGlobalPropertyCount(); ++i)
+        {
+            const char* name = nullptr;
+            const char* ns = nullptr;
+            int type_id = 0;
+            bool is_const = false;
+            engine->GetGlobalPropertyByIndex(i, &name, &ns, &type_id, &is_const);
+            hasher.Add(ns);
+            hasher.Add(name);
+            hasher.Add(engine->GetTypeDeclaration(type_id, true));
+            hasher.Add(static_cast<std::uint64_t>(is_const));
+        }
+
+        return hasher.Get();
+    }
+
+    ModuleBuildResult BuildModuleCached(
+        asIScriptEngine* engine,
+        const char* module,
+        const ScriptSources& sources,
+        res::AssetCache* cache
+    ) {
+        ModuleBuildResult result;
+
+        res::AssetCache::Key key = 0;
+        if(cache)
+        {
+            // Not keyed by the name of module, so reloading into a temporary
+            // module can reuse the bytecode
+            std::uint64_t hash = HashEngineInterface(engine);
+            for(auto& [name, data] : sources)
+            {
+                hash = util::HashCombine(hash, util::Hash64(name));
+                hash = util::HashCombine(hash, util::Hash64(data.Data(), data.Size()));
+            }
+            key = res::AssetCache::MakeKey("as-bytecode", detailed::BYTECODE_CACHE_VERSION, hash);
+
+            if(auto bytecode = cache->Load(key))
+            {
+                asIScriptModule* mod = engine->GetModule(module, asGM_ALWAYS_CREATE);
+                MemoryBinaryStream in(bytecode->Data(), bytecode->Size());
+                result.r = mod ? mod->LoadByteCode(&in) : asNO_MODULE;
+                if(result.r >= 0)
+                {
+                    result.from_cache = true;
+                    return result;
+                }
+
+                SDL_LogWarn(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to load cached bytecode of module \"%s\" (%d), compiling from sources",
+                    module,
+                    result.r
+                );
+                if(mod)
+                    mod->Discard();
+            }
+        }
+
+        CScriptBuilder builder;
+        result.r = builder.StartNewModule(engine, module);
+        for(std::size_t i = 0; result.r >= 0 && i < sources.size(); ++i)
+            result.r = AddSectionFromVfs(&builder, sources[i].first, sources[i].second);
+        if(result.r >= 0)
+            result.r = builder.BuildModule();
+        if(result.r < 0)
+            return result;
+
+        if(cache)
+        {
+            // Debug information is kept for line numbers of exceptions
+            MemoryBinaryStream out;
+            if(builder.GetModule()->SaveByteCode(&out) >= 0)
+                cache->Store(key, out.GetBuffer().data(), out.GetBuffer().size());
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,75 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_BYTECODE_HPP
+#define TESTWORLD_SCRIPT_BYTECODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <angelscript.h>
+#include "../res/vfs.hpp"
+
+
+namespace awe::res
+{
+    class AssetCache;
+}
+
+namespace awe::script
+{
+    class MemoryBinaryStream final : public asIBinaryStream
+    {
+    public:
+        // Write into an internal buffer
+        MemoryBinaryStream() noexcept;
+        // Read from the memory, which must outlive the stream
+        MemoryBinaryStream(const void* data, std::size_t size) noexcept;
+
+        int Read(void* ptr, asUINT size) override;
+        int Write(const void* ptr, asUINT size) override;
+
+        [[nodiscard]]
+        const std::vector<std::byte>& GetBuffer() const noexcept { return m_buf; }
+
+    private:
+        std::vector<std::byte> m_buf;
+        const std::byte* m_data = nullptr;
+        std::size_t m_size = 0;
+        std::size_t m_pos = 0;
+    };
+
+    // Hash of everything registered by the application, including the
+    // version of the library. Bytecode can only be loaded by an engine with
+    // the same interface
+    [[nodiscard]]
+    std::uint64_t HashEngineInterface(asIScriptEngine* engine);
+
+    typedef std::vector<std::pair<std::string, vfs::MappedData>> ScriptSources;
+
+    struct ModuleBuildResult
+    {
+        int r = 0; // Negative on failure
+        bool from_cache = false;
+    };
+
+    /*
+     * Build a module from the sections, or load the bytecode from the cache
+     * when the sources and the application interface are unchanged. Newly
+     * compiled bytecode is stored into the cache. The existing module of the
+     * same name is discarded.
+     *
+     * Sections are added to CScriptBuilder only on cache misses, so metadata
+     * of the builder is not available for modules loaded from the cache
+     */
+    ModuleBuildResult BuildModuleCached(
+        asIScriptEngine* engine,
+        const char* module,
+        const ScriptSources& sources,
+        res::AssetCache* cache
+    );
+}
+
+#endif
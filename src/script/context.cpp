@@ -0,0 +1,211 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "context.hpp"
+#include <cassert>
+#include <iterator>
+
+
+namespace awe::script
+{
+    namespace detailed
+    {
+        static std::atomic<std::uint64_t> next_pool_id = 1;
+
+        // The free list of the pool used last by this thread, so the map of
+        // free lists is only locked when switching between pools
+        struct FreeListCache
+        {
+            std::uint64_t pool_id = 0;
+            void* list = nullptr;
+        };
+        thread_local FreeListCache free_list_cache;
+    }
+
+    ContextPool::ContextPool(asIScriptEngine* engine, std::size_t max_idle)
+        : m_engine(engine), m_max_idle(max_idle), m_id(detailed::next_pool_id++)
+    {
+        assert(m_engine);
+        m_engine->SetUserData(this, CONTEXT_POOL_UDATA);
+        m_engine->SetContextCallbacks(&ContextPool::RequestCallback, &ContextPool::ReturnCallback, this);
+    }
+
+    ContextPool::~ContextPool() noexcept
+    {
+        m_engine->SetContextCallbacks(nullptr, nullptr, nullptr);
+        m_engine->SetUserData(nullptr, CONTEXT_POOL_UDATA);
+
+        std::lock_guard lock(m_lists_mutex);
+        for(auto& [id, list] : m_lists)
+        {
+            for(auto* ctx : list->contexts)
+                ctx->Release();
+        }
+        m_lists.clear();
+    }
+
+    ContextPool* ContextPool::Get(asIScriptEngine* engine) noexcept
+    {
+        return static_cast<ContextPool*>(engine->GetUserData(CONTEXT_POOL_UDATA));
+    }
+
+    asIScriptContext* ContextPool::Acquire(asIScriptFunction* func)
+    {
+        FreeList& list = GetFreeList();
+
+        asIScriptContext* ctx = nullptr;
+        {
+            std::lock_guard lock(list.mutex);
+            auto& contexts = list.contexts;
+            if(!contexts.empty())
+            {
+                auto it = contexts.end() - 1;
+                if(func)
+                {
+                    for(auto i = contexts.rbegin(); i != contexts.rend(); ++i)
+                    {
+                        if((*i)->GetUserData(CONTEXT_POOL_UDATA) == func)
+                        {
+                            it = std::prev(i.base());
+                            ++list.stats.reused_prepared;
+                            break;
+                        }
+                    }
+                }
+                ctx = *it;
+                contexts.erase(it);
+                ++list.stats.reused;
+            }
+            else
+                ++list.stats.created;
+        }
+
+        if(!ctx)
+        {
+            ctx = m_engine->CreateContext();
+            if(!ctx)
+                return nullptr;
+        }
+
+        ctx->SetUserData(func, CONTEXT_POOL_UDATA);
+        if(func && ctx->Prepare(func) < 0)
+        {
+            ctx->SetUserData(nullptr, CONTEXT_POOL_UDATA);
+            Release(ctx);
+            return nullptr;
+        }
+
+        if(ContextHook* hook = GetHook())
+        {
+            ctx->SetLineCallback(asFUNCTION(ContextPool::HookLineCallback), hook, asCALL_CDECL);
+            hook->OnBegin(ctx);
+        }
+
+        return ctx;
+    }
+    void ContextPool::Release(asIScriptContext* ctx) noexcept
+    {
+        if(!ctx)
+            return;
+
+        ctx->ClearLineCallback();
+        switch(ctx->GetState())
+        {
+        case asEXECUTION_FINISHED:
+        case asEXECUTION_PREPARED:
+        case asEXECUTION_UNINITIALIZED:
+            break; // Keep prepared for the next call
+
+        case asEXECUTION_SUSPENDED:
+            ctx->Abort();
+            [[fallthrough]];
+        default:
+            ctx->Unprepare();
+            ctx->SetUserData(nullptr, CONTEXT_POOL_UDATA);
+            break;
+        }
+
+        try
+        {
+            FreeList& list = GetFreeList();
+            std::lock_guard lock(list.mutex);
+            if(list.contexts.size() < m_max_idle)
+            {
+                list.contexts.push_back(ctx);
+                return;
+            }
+        }
+        catch(...) {}
+        ctx->Release();
+    }
+
+    void ContextPool::UnprepareIdle() noexcept
+    {
+        std::lock_guard lock(m_lists_mutex);
+        for(auto& [id, list] : m_lists)
+        {
+            std::lock_guard list_lock(list->mutex);
+            for(auto* ctx : list->contexts)
+            {
+                ctx->Unprepare();
+                ctx->SetUserData(nullptr, CONTEXT_POOL_UDATA);
+            }
+        }
+    }
+
+    void ContextPool::SetHook(ContextHook* hook) noexcept
+    {
+        m_hook.store(hook, std::memory_order_release);
+    }
+
+    ContextPoolStats ContextPool::GetStats() const
+    {
+        ContextPoolStats result;
+        std::lock_guard lock(m_lists_mutex);
+        for(auto& [id, list] : m_lists)
+        {
+            std::lock_guard list_lock(list->mutex);
+            result.created += list->stats.created;
+            result.reused += list->stats.reused;
+            result.reused_prepared += list->stats.reused_prepared;
+        }
+
+        return result;
+    }
+
+    ContextPool::FreeList& ContextPool::GetFreeList()
+    {
+        auto& cache = detailed::free_list_cache;
+        if(cache.pool_id == m_id)
+            return *static_cast<FreeList*>(cache.list);
+
+        std::lock_guard lock(m_lists_mutex);
+        auto& list = m_lists[std::this_thread::get_id()];
+        if(!list)
+            list = std::make_unique<FreeList>();
+        cache.pool_id = m_id;
+        cache.list = list.get();
+
+        return *list;
+    }
+
+    void ContextPool::HookLineCallback(asIScriptContext* ctx, ContextHook* hook)
+    {
+        hook->OnLine(ctx);
+    }
+    asIScriptContext* ContextPool::RequestCallback(asIScriptEngine*, void* param)
+    {
+        try
+        {
+            return static_cast<ContextPool*>(param)->Acquire();
+        }
+        catch(...)
+        {
+            return nullptr;
+        }
+    }
+    void ContextPool::ReturnCallback(asIScriptEngine*, asIScriptContext* ctx, void* param)
+    {
+        static_cast<ContextPool*>(param)->Release(ctx);
+    }
+}
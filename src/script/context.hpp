@@ -0,0 +1,119 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_CONTEXT_HPP
+#define TESTWORLD_SCRIPT_CONTEXT_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <angelscript.h>
+
+
+namespace awe::script
+{
+    // User data types of engines and contexts reserved by the pool
+    constexpr asPWORD CONTEXT_POOL_UDATA = 0x5457'0001;
+
+    // Observer of script execution, e.g. a profiler
+    class ContextHook
+    {
+    public:
+        virtual ~ContextHook() = default;
+
+        // Called before a context starts or resumes running
+        virtual void OnBegin(asIScriptContext* ctx) = 0;
+        // Called by the line callback of the context
+        virtual void OnLine(asIScriptContext* ctx) = 0;
+    };
+
+    struct ContextPoolStats
+    {
+        std::uint64_t created = 0;
+        std::uint64_t reused = 0;
+        // Reused contexts which were prepared for the same function
+        std::uint64_t reused_prepared = 0;
+    };
+
+    /*
+     * Pool of script contexts
+     *
+     * The pool is installed as the context callbacks of the engine, so
+     * asIScriptEngine::RequestContext() and add-ons also take contexts from
+     * it. Every thread has its own free list. Finished contexts are returned
+     * without being unprepared, and Acquire(func) prefers a context which was
+     * last prepared for the same function, so calling a function repeatedly
+     * takes the fast path of asIScriptContext::Prepare().
+     *
+     * Contexts idle in free lists keep references to the functions they were
+     * prepared for. Call UnprepareIdle() after discarding modules.
+     *
+     * Thread safety: Acquire() and Release() are thread-safe. The pool must
+     * outlive all acquired contexts and callers created from its engine.
+     */
+    class ContextPool
+    {
+    public:
+        explicit ContextPool(asIScriptEngine* engine, std::size_t max_idle = 16);
+        ContextPool(const ContextPool&) = delete;
+
+        ~ContextPool() noexcept;
+
+        ContextPool& operator=(const ContextPool&) = delete;
+
+        // Return the pool installed to the engine, or nullptr
+        [[nodiscard]]
+        static ContextPool* Get(asIScriptEngine* engine) noexcept;
+
+        // Return a context prepared for the function, or an unprepared
+        // context if func is nullptr. Return nullptr on failure
+        [[nodiscard]]
+        asIScriptContext* Acquire(asIScriptFunction* func = nullptr);
+        void Release(asIScriptContext* ctx) noexcept;
+
+        // Unprepare the idle contexts of all threads
+        void UnprepareIdle() noexcept;
+
+        // Install the line callback of the hook to contexts acquired later.
+        // Contexts replacing the line callback, e.g. coroutines, should
+        // forward to GetHook(). The hook must outlive the contexts acquired
+        // while it is installed. Nullptr to remove
+        void SetHook(ContextHook* hook) noexcept;
+        [[nodiscard]]
+        ContextHook* GetHook() const noexcept { return m_hook.load(std::memory_order_acquire); }
+
+        [[nodiscard]]
+        asIScriptEngine* GetEngine() const noexcept { return m_engine; }
+        [[nodiscard]]
+        ContextPoolStats GetStats() const;
+
+    private:
+        struct FreeList
+        {
+            std::mutex mutex;
+            std::vector<asIScriptContext*> contexts;
+            ContextPoolStats stats;
+        };
+
+        asIScriptEngine* m_engine;
+        std::size_t m_max_idle;
+        std::uint64_t m_id; // Identifies the pool in caches of threads
+        std::atomic<ContextHook*> m_hook = nullptr;
+
+        mutable std::mutex m_lists_mutex;
+        std::map<std::thread::id, std::unique_ptr<FreeList>> m_lists;
+
+        FreeList& GetFreeList();
+
+        static void HookLineCallback(asIScriptContext* ctx, ContextHook* hook);
+        static asIScriptContext* RequestCallback(asIScriptEngine* engine, void* param);
+        static void ReturnCallback(asIScriptEngine* engine, asIScriptContext* ctx, void* param);
+    };
+}
+
+#endif
@@ -0,0 +1,161 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "job.hpp"
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <SDL.h>
+
+
+namespace awe::script
+{
+    JobSystem::JobSystem(asIScriptEngine* engine, std::size_t threads)
+        : m_engine(engine)
+    {
+        if(threads == 0)
+        {
+            unsigned int hardware = std::thread::hardware_concurrency();
+            threads = hardware > 1 ? hardware - 1 : 1;
+        }
+
+        m_stats.threads = threads;
+        m_workers.reserve(threads);
+        for(std::size_t i = 0; i < threads; ++i)
+            m_workers.emplace_back(&JobSystem::Worker, this);
+    }
+
+    JobSystem::~JobSystem() noexcept
+    {
+        Wait();
+        {
+            std::lock_guard lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for(auto& i : m_workers)
+            i.join();
+    }
+
+    void JobSystem::Submit(Job job)
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_queue.push_back(std::move(job));
+        }
+        m_cond.notify_one();
+    }
+    void JobSystem::Submit(asIScriptFunction* func)
+    {
+        if(!func)
+            return;
+        // The caller adds its own reference
+        Caller<void()> caller(func);
+        func->Release();
+        Submit(std::move(caller));
+    }
+
+    std::size_t JobSystem::Wait()
+    {
+        std::unique_lock lock(m_mutex);
+        while(!m_queue.empty())
+        {
+            Job job = std::move(m_queue.front());
+            m_queue.pop_front();
+            Run(lock, std::move(job));
+        }
+        m_idle_cond.wait(lock, [this] { return m_queue.empty() && m_active == 0; });
+
+        return std::exchange(m_failed, 0);
+    }
+
+    JobStats JobSystem::GetStats()
+    {
+        std::lock_guard lock(m_mutex);
+        return m_stats;
+    }
+
+    void JobSystem::Worker()
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            while(true)
+            {
+                m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if(m_queue.empty())
+                    break; // Stopped
+                Job job = std::move(m_queue.front());
+                m_queue.pop_front();
+                Run(lock, std::move(job));
+            }
+        }
+
+        // Free the thread-local data of AngelScript
+        asThreadCleanup();
+    }
+    void JobSystem::Run(std::unique_lock<std::mutex>& lock, Job job)
+    {
+        ++m_active;
+        lock.unlock();
+
+        bool succeeded = true;
+        try
+        {
+            job();
+        }
+        catch(const std::exception& e)
+        {
+            succeeded = false;
+            SDL_LogError(
+                SDL_LOG_CATEGORY_APPLICATION,
+                "Script job failed: %s",
+                e.what()
+            );
+        }
+        // Release the captures before relocking
+        job = Job();
+
+        lock.lock();
+        --m_active;
+        ++m_stats.completed;
+        if(!succeeded)
+        {
+            ++m_stats.failed;
+            ++m_failed;
+        }
+        if(m_active == 0 && m_queue.empty())
+            m_idle_cond.notify_all();
+    }
+
+    namespace detailed
+    {
+        [[noreturn]]
+        static void ThrowRegisterError(int r)
+        {
+            throw std::runtime_error("Angelscript error: " + std::to_string(r));
+        }
+
+        static void SubmitJob(asIScriptFunction* func, JobSystem* jobs)
+        {
+            jobs->Submit(func);
+        }
+    }
+
+    // Jobs are joined by the application before rendering. Waiting is not
+    // exposed to scripts, because waiting in a job would never return
+    void RegisterJobSystem(asIScriptEngine* engine, JobSystem* jobs)
+    {
+        int r = 0;
+        r = engine->RegisterFuncdef("void JobCallback()");
+        if(r < 0) detailed::ThrowRegisterError(r);
+        r = engine->RegisterObjectType("JobSystem", 0, asOBJ_REF | asOBJ_NOHANDLE);
+        if(r < 0) detailed::ThrowRegisterError(r);
+        r = engine->RegisterObjectMethod(
+            "JobSystem", "void Submit(JobCallback@ callback)",
+            asFUNCTION(detailed::SubmitJob), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowRegisterError(r);
+        r = engine->RegisterGlobalProperty("JobSystem jobs", jobs);
+        if(r < 0) detailed::ThrowRegisterError(r);
+    }
+}
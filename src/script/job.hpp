@@ -0,0 +1,101 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_JOB_HPP
+#define TESTWORLD_SCRIPT_JOB_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <angelscript.h>
+#include "scriptutil.hpp"
+
+
+namespace awe::script
+{
+    struct JobStats
+    {
+        std::size_t threads = 0;
+        std::uint64_t completed = 0;
+        std::uint64_t failed = 0;
+    };
+
+    /*
+     * Runs independent script functions on a pool of worker threads
+     *
+     * Every worker takes contexts from its own free list of the ContextPool.
+     * Wait() is the join point of a frame, the calling thread also runs the
+     * queued jobs while waiting.
+     *
+     * asPrepareMultithread() must have been called before the engine was
+     * created. Jobs run concurrently, so they must not call functions which
+     * are not thread-safe, e.g. the bindings of ImGui and the editor.
+     *
+     * Thread safety: Submit() can be called in any thread, including from
+     * jobs. Wait() should be called in the main thread.
+     */
+    class JobSystem
+    {
+    public:
+        typedef std::function<void()> Job;
+
+        // Zero for the number of hardware threads minus one
+        explicit JobSystem(asIScriptEngine* engine, std::size_t threads = 0);
+        JobSystem(const JobSystem&) = delete;
+
+        // Wait for all jobs and stop the workers
+        ~JobSystem() noexcept;
+
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        void Submit(Job job);
+        // Call the script function or delegate without arguments. Take over
+        // the reference of the function
+        void Submit(asIScriptFunction* func);
+        template <typename... Args>
+        void Submit(Caller<void(Args...)> caller, Args... args)
+        {
+            Submit([caller = std::move(caller), args...]() mutable
+            {
+                caller(std::move(args)...);
+            });
+        }
+
+        // Run queued jobs and wait until all jobs are finished. Errors of
+        // jobs are logged. Return the number of failed jobs since the last
+        // call
+        std::size_t Wait();
+
+        [[nodiscard]]
+        asIScriptEngine* GetEngine() const noexcept { return m_engine; }
+        [[nodiscard]]
+        JobStats GetStats();
+
+    private:
+        asIScriptEngine* m_engine;
+
+        std::mutex m_mutex;
+        std::condition_variable m_cond; // Notified on new jobs and stopping
+        std::condition_variable m_idle_cond; // Notified when all jobs are finished
+        std::deque<Job> m_queue;
+        std::size_t m_active = 0; // Jobs being run
+        std::size_t m_failed = 0; // Since the last Wait()
+        JobStats m_stats;
+        bool m_stop = false;
+
+        std::vector<std::thread> m_workers;
+
+        void Worker();
+        // Run the job with the lock released, then relock
+        void Run(std::unique_lock<std::mutex>& lock, Job job);
+    };
+
+    void RegisterJobSystem(asIScriptEngine* engine, JobSystem* jobs);
+}
+
+#endif
@@ -0,0 +1,289 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "memory.hpp"
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <utility>
+#include <fmt/core.h>
+
+
+namespace awe::script
+{
+    namespace detailed
+    {
+        constexpr std::size_t SIZE_CLASSES[] = {
+            16, 32, 48, 64, 80, 96, 112, 128,
+            160, 192, 224, 256, 320, 384, 448, 512,
+            640, 768, 896, 1024
+        };
+        constexpr std::size_t CLASS_COUNT = std::size(SIZE_CLASSES);
+        constexpr std::size_t MAX_POOLED_SIZE = SIZE_CLASSES[CLASS_COUNT - 1];
+        constexpr std::uint32_t LARGE_CLASS = static_cast<std::uint32_t>(CLASS_COUNT);
+        constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+        // Size class of every 16 bytes
+        constexpr auto MakeClassTable() noexcept
+        {
+            std::array<std::uint8_t, MAX_POOLED_SIZE / 16 + 1> table{};
+            std::size_t cls = 0;
+            for(std::size_t i = 0; i < table.size(); ++i)
+            {
+                while(SIZE_CLASSES[cls] < i * 16)
+                    ++cls;
+                table[i] = static_cast<std::uint8_t>(cls);
+            }
+            return table;
+        }
+        constexpr auto CLASS_TABLE = MakeClassTable();
+
+        // Keeps the returned memory aligned as malloc() does
+        struct alignas(16) BlockHeader
+        {
+            std::size_t size; // Requested size
+            std::uint32_t size_class;
+        };
+        static_assert(sizeof(BlockHeader) == 16);
+
+        static std::atomic<std::size_t> live_allocs = 0;
+        static std::atomic<std::size_t> live_bytes = 0;
+        static std::atomic<std::size_t> peak_bytes = 0;
+        static std::atomic<std::uint64_t> total_allocs = 0;
+        static std::atomic<std::size_t> reserved_bytes = 0;
+
+        class SizeClassPool
+        {
+        public:
+            void* Allocate(std::size_t block_size)
+            {
+                std::lock_guard lock(m_mutex);
+                if(m_free)
+                    return std::exchange(m_free, m_free->next);
+
+                if(static_cast<std::size_t>(m_end - m_bump) < block_size)
+                {
+                    // The tail of the previous chunk is left unused
+                    char* chunk = static_cast<char*>(std::malloc(CHUNK_SIZE));
+                    if(!chunk)
+                        return nullptr;
+                    reserved_bytes.fetch_add(CHUNK_SIZE, std::memory_order_relaxed);
+                    m_bump = chunk;
+                    m_end = chunk + CHUNK_SIZE;
+                }
+                void* block = m_bump;
+                m_bump += block_size;
+                return block;
+            }
+            void Free(void* block) noexcept
+            {
+                std::lock_guard lock(m_mutex);
+                m_free = new(block) FreeBlock{ m_free };
+            }
+
+        private:
+            struct FreeBlock
+            {
+                FreeBlock* next;
+            };
+
+            std::mutex m_mutex;
+            FreeBlock* m_free = nullptr;
+            char* m_bump = nullptr;
+            char* m_end = nullptr;
+        };
+
+        static SizeClassPool* GetPools()
+        {
+            // Never destroyed, the library may free memory during static destruction
+            static SizeClassPool* pools = new SizeClassPool[CLASS_COUNT];
+            return pools;
+        }
+
+        static void* ScriptAlloc(std::size_t size)
+        {
+            const std::uint32_t cls = size <= MAX_POOLED_SIZE ?
+                CLASS_TABLE[(size + 15) / 16] :
+                LARGE_CLASS;
+            void* mem = cls == LARGE_CLASS ?
+                std::malloc(sizeof(BlockHeader) + size) :
+                GetPools()[cls].Allocate(sizeof(BlockHeader) + SIZE_CLASSES[cls]);
+            if(!mem)
+                return nullptr;
+            BlockHeader* header = new(mem) BlockHeader{ size, cls };
+
+            live_allocs.fetch_add(1, std::memory_order_relaxed);
+            total_allocs.fetch_add(1, std::memory_order_relaxed);
+            const std::size_t bytes = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+            std::size_t peak = peak_bytes.load(std::memory_order_relaxed);
+            while(bytes > peak && !peak_bytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {}
+
+            return header + 1;
+        }
+        static void ScriptFree(void* ptr)
+        {
+            if(!ptr)
+                return;
+            BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+            live_allocs.fetch_sub(1, std::memory_order_relaxed);
+            live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+
+            if(header->size_class == LARGE_CLASS)
+                std::free(header);
+            else
+                GetPools()[header->size_class].Free(header);
+        }
+
+        static double ToKiB(std::size_t bytes) noexcept
+        {
+            return static_cast<double>(bytes) / 1024.0;
+        }
+        static double ToMilliseconds(std::chrono::nanoseconds ns) noexcept
+        {
+            return std::chrono::duration<double, std::milli>(ns).count();
+        }
+    }
+
+    void InstallScriptAllocator()
+    {
+        static std::once_flag once;
+        std::call_once(once, []
+        {
+            int r = asSetGlobalMemoryFunctions(detailed::ScriptAlloc, detailed::ScriptFree);
+            if(r < 0)
+                throw std::runtime_error("Failed to install the script allocator: " + std::to_string(r));
+        });
+    }
+
+    ScriptMemoryStats GetScriptMemoryStats() noexcept
+    {
+        ScriptMemoryStats stats;
+        stats.live_allocs = detailed::live_allocs.load(std::memory_order_relaxed);
+        stats.live_bytes = detailed::live_bytes.load(std::memory_order_relaxed);
+        stats.peak_bytes = detailed::peak_bytes.load(std::memory_order_relaxed);
+        stats.total_allocs = detailed::total_allocs.load(std::memory_order_relaxed);
+        stats.reserved_bytes = detailed::reserved_bytes.load(std::memory_order_relaxed);
+
+        return stats;
+    }
+
+    GarbageCollector::GarbageCollector(asIScriptEngine* engine)
+        : m_engine(engine)
+    {
+        m_engine->SetEngineProperty(asEP_AUTO_GARBAGE_COLLECT, false);
+    }
+
+    GarbageCollector::~GarbageCollector() noexcept
+    {
+        m_engine->SetEngineProperty(asEP_AUTO_GARBAGE_COLLECT, true);
+    }
+
+    void GarbageCollector::Update(std::chrono::microseconds budget)
+    {
+        using clock = std::chrono::steady_clock;
+
+        const auto start = clock::now();
+        const auto deadline = start + budget;
+        do
+        {
+            ++m_steps;
+            // Zero when a cycle is finished
+            if(m_engine->GarbageCollect(asGC_ONE_STEP) == 0)
+            {
+                ++m_cycles;
+                break;
+            }
+        } while(clock::now() < deadline);
+
+        m_last_update = clock::now() - start;
+        if(m_last_update > m_max_update)
+            m_max_update = m_last_update;
+    }
+
+    void GarbageCollector::Collect()
+    {
+        m_engine->GarbageCollect(asGC_FULL_CYCLE);
+        ++m_cycles;
+    }
+
+    GcStats GarbageCollector::GetStats() const
+    {
+        GcStats stats;
+        m_engine->GetGCStatistics(
+            &stats.current_size,
+            &stats.total_destroyed,
+            &stats.total_detected,
+            &stats.new_objects,
+            &stats.total_new_destroyed
+        );
+        stats.steps = m_steps;
+        stats.cycles = m_cycles;
+        stats.last_update = m_last_update;
+        stats.max_update = m_max_update;
+
+        return stats;
+    }
+
+    std::string GarbageCollector::FormatStats() const
+    {
+        GcStats gc = GetStats();
+        ScriptMemoryStats mem = GetScriptMemoryStats();
+        return fmt::format(
+            "GC: {} object(s) ({} new), {} destroyed, {} detected, {} cycle(s)\n"
+            "GC time: {:.3f} ms last frame, {:.3f} ms max\n"
+            "Memory: {} block(s), {:.1f} KiB live, {:.1f} KiB peak, {:.1f} KiB pooled",
+            gc.current_size,
+            gc.new_objects,
+            gc.total_destroyed + gc.total_new_destroyed,
+            gc.total_detected,
+            gc.cycles,
+            detailed::ToMilliseconds(gc.last_update),
+            detailed::ToMilliseconds(gc.max_update),
+            mem.live_allocs,
+            detailed::ToKiB(mem.live_bytes),
+            detailed::ToKiB(mem.peak_bytes),
+            detailed::ToKiB(mem.reserved_bytes)
+        );
+    }
+
+    namespace detailed
+    {
+        [[noreturn]]
+        static void ThrowGcError(int r)
+        {
+            throw std::runtime_error("Angelscript error: " + std::to_string(r));
+        }
+
+        static void GcCollect(GarbageCollector* gc)
+        {
+            gc->Collect();
+        }
+        static std::string GcReport(GarbageCollector* gc)
+        {
+            return gc->FormatStats();
+        }
+    }
+
+    void RegisterGarbageCollector(asIScriptEngine* engine, GarbageCollector* gc)
+    {
+        int r = 0;
+        r = engine->RegisterObjectType("GarbageCollector", 0, asOBJ_REF | asOBJ_NOHANDLE);
+        if(r < 0) detailed::ThrowGcError(r);
+        r = engine->RegisterObjectMethod(
+            "GarbageCollector", "void Collect()",
+            asFUNCTION(detailed::GcCollect), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowGcError(r);
+        r = engine->RegisterObjectMethod(
+            "GarbageCollector", "string Report()",
+            asFUNCTION(detailed::GcReport), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowGcError(r);
+        r = engine->RegisterGlobalProperty("GarbageCollector gc", gc);
+        if(r < 0) detailed::ThrowGcError(r);
+    }
+}
@@ -0,0 +1,105 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_MEMORY_HPP
+#define TESTWORLD_SCRIPT_MEMORY_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <angelscript.h>
+
+
+namespace awe::script
+{
+    struct ScriptMemoryStats
+    {
+        std::size_t live_allocs = 0;
+        std::size_t live_bytes = 0; // Requested sizes of live allocations
+        std::size_t peak_bytes = 0;
+        std::uint64_t total_allocs = 0;
+        std::size_t reserved_bytes = 0; // Memory reserved by the pools
+    };
+
+    /*
+     * Install the allocator of AngelScript (asSetGlobalMemoryFunctions)
+     *
+     * Blocks up to 1 KiB are taken from pools of fixed size classes, which
+     * reserve memory in chunks and never return it to the system, so the
+     * memory of scripts stays flat once their working set is reached.
+     * Larger blocks are passed to malloc(). Engines, contexts, script objects
+     * and arrays are allocated by the library through these functions.
+     *
+     * Must be called before any engine is created. The allocator is never
+     * uninstalled, because the library may free memory after the last engine
+     * is released. Calling it again has no effect.
+     *
+     * Thread safety: The allocator is thread-safe, every size class has its
+     * own lock
+     */
+    void InstallScriptAllocator();
+
+    [[nodiscard]]
+    ScriptMemoryStats GetScriptMemoryStats() noexcept;
+
+    struct GcStats
+    {
+        // From asIScriptEngine::GetGCStatistics()
+        asUINT current_size = 0;
+        asUINT total_destroyed = 0;
+        asUINT total_detected = 0;
+        asUINT new_objects = 0;
+        asUINT total_new_destroyed = 0;
+
+        std::uint64_t steps = 0;
+        std::uint64_t cycles = 0;
+        std::chrono::nanoseconds last_update{}; // Time spent in the last Update()
+        std::chrono::nanoseconds max_update{};
+    };
+
+    /*
+     * Incremental garbage collection on a time budget
+     *
+     * Disables the automatic garbage collection of the engine, which may
+     * run a long step at any allocation. Instead, Update() runs a few
+     * incremental steps every frame.
+     *
+     * Thread safety: Update() and Collect() should be called in the main
+     * thread while no script job is running
+     */
+    class GarbageCollector
+    {
+    public:
+        explicit GarbageCollector(asIScriptEngine* engine);
+        GarbageCollector(const GarbageCollector&) = delete;
+
+        // Restore the automatic garbage collection
+        ~GarbageCollector() noexcept;
+
+        GarbageCollector& operator=(const GarbageCollector&) = delete;
+
+        // Run incremental steps until the budget is spent or a cycle is
+        // finished. At least one step is run
+        void Update(std::chrono::microseconds budget);
+        // Run a full cycle, e.g. at loading screens
+        void Collect();
+
+        [[nodiscard]]
+        GcStats GetStats() const;
+        // Statistics of the collector and the allocator
+        [[nodiscard]]
+        std::string FormatStats() const;
+
+    private:
+        asIScriptEngine* m_engine;
+        std::uint64_t m_steps = 0;
+        std::uint64_t m_cycles = 0;
+        std::chrono::nanoseconds m_last_update{};
+        std::chrono::nanoseconds m_max_update{};
+    };
+
+    void RegisterGarbageCollector(asIScriptEngine* engine, GarbageCollector* gc);
+}
+
+#endif
@@ -0,0 +1,515 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "module.hpp"
+#include <cstring>
+#include <SDL.h>
+#include <scriptarray/scriptarray.h>
+#include "../util/hash.hpp"
+
+
+namespace awe::script
+{
+    namespace detailed
+    {
+        static std::uint64_t HashSources(const ScriptSources& sources) noexcept
+        {
+            std::uint64_t hash = 0;
+            for(auto& [name, data] : sources)
+            {
+                hash = util::HashCombine(hash, util::Hash64(name));
+                hash = util::HashCombine(hash, util::Hash64(data.Data(), data.Size()));
+            }
+
+            return hash;
+        }
+
+        constexpr int HANDLE_FLAGS = asTYPEID_OBJHANDLE | asTYPEID_HANDLETOCONST;
+
+        static bool IsScriptArray(const asITypeInfo* ti) noexcept
+        {
+            return (ti->GetFlags() & asOBJ_TEMPLATE) && std::strcmp(ti->GetName(), "array") == 0;
+        }
+
+        // Return true if objects of the type can be created without arguments
+        static bool HasDefaultFactory(const asITypeInfo* ti) noexcept
+        {
+            for(asUINT i = 0; i < ti->GetFactoryCount(); ++i)
+            {
+                if(ti->GetFactoryByIndex(i)->GetParamCount() == 0)
+                    return true;
+            }
+            return false;
+        }
+        static asIScriptFunction* GetDefaultConstructor(const asITypeInfo* ti) noexcept
+        {
+            for(asUINT i = 0; i < ti->GetBehaviourCount(); ++i)
+            {
+                asEBehaviours beh;
+                asIScriptFunction* func = ti->GetBehaviourByIndex(i, &beh);
+                if(beh == asBEHAVE_CONSTRUCT && func && func->GetParamCount() == 0)
+                    return func;
+            }
+            return nullptr;
+        }
+
+        /*
+         * Copies the state of a module into the module rebuilt from changed
+         * sources, in the manner of the serializer add-on of AngelScript.
+         *
+         * Types are matched by their declarations, e.g. "ns::Foo" and
+         * "array<Foo@>". Objects of types declared by the module are created
+         * by the default factories of the types of the same names in the new
+         * module, so every member gets its initial value, and then copied
+         * property by property by name, arrays element by element. Classes
+         * without default constructors are created uninitialized and their
+         * members are default constructed before copying. Every
+         * object is copied once, and handles are pointed to the copies, so
+         * references between objects are kept. Objects of the types not
+         * owned by the module, e.g. registered types and shared classes, are
+         * referenced by the new module as they are.
+         */
+        class StateCopier
+        {
+        public:
+            explicit StateCopier(asIScriptModule* dst) noexcept
+                : m_engine(dst->GetEngine()), m_dst(dst) {}
+            StateCopier(const StateCopier&) = delete;
+
+            ~StateCopier() noexcept
+            {
+                for(auto& [src, copy] : m_copies)
+                    m_engine->ReleaseScriptObject(copy.obj, copy.type);
+            }
+
+            // Copy a variable of the source module into a variable of the
+            // destination module. Return false if the types are incompatible,
+            // then the destination is unchanged
+            bool Copy(void* dst, int dst_type_id, void* src, int src_type_id)
+            {
+                if(src_type_id & asTYPEID_OBJHANDLE)
+                {
+                    if(!(dst_type_id & asTYPEID_OBJHANDLE))
+                        return false;
+                    return CopyHandle(
+                        static_cast<void**>(dst), dst_type_id,
+                        *static_cast<void**>(src), src_type_id
+                    );
+                }
+                if(dst_type_id & asTYPEID_OBJHANDLE)
+                    return false;
+
+                if(src_type_id & asTYPEID_MASK_OBJECT)
+                {
+                    if(TranslateTypeId(src_type_id) != dst_type_id)
+                        return false;
+                    asITypeInfo* dst_type = m_engine->GetTypeInfoById(dst_type_id);
+                    asITypeInfo* src_type = m_engine->GetTypeInfoById(src_type_id);
+                    if(!dst_type || !src_type || (src_type->GetFlags() & asOBJ_FUNCDEF))
+                        return false;
+                    // Objects are stored by address. Handles to a reference
+                    // type object will point to the existing destination
+                    if(src_type->GetFlags() & asOBJ_REF)
+                        Remember(src, dst, dst_type);
+                    return CopyObject(dst, dst_type, src, src_type);
+                }
+                if(dst_type_id & asTYPEID_MASK_OBJECT)
+                    return false;
+
+                // Primitives and enums, which are matched by names
+                if(TranslateTypeId(src_type_id) != dst_type_id)
+                    return false;
+                int size = m_engine->GetSizeOfPrimitiveType(dst_type_id);
+                if(size <= 0 || size != m_engine->GetSizeOfPrimitiveType(src_type_id))
+                    return false;
+                std::memcpy(dst, src, static_cast<std::size_t>(size));
+
+                return true;
+            }
+
+        private:
+            struct Copied
+            {
+                void* obj; // Holds a reference
+                asITypeInfo* type;
+            };
+
+            asIScriptEngine* m_engine;
+            asIScriptModule* m_dst;
+            // Objects of the source module and their copies
+            std::unordered_map<const void*, Copied> m_copies;
+
+            // The type of the same declaration in the destination module
+            int TranslateTypeId(int src_type_id) const
+            {
+                const int base = src_type_id & ~HANDLE_FLAGS;
+                if(base <= asTYPEID_DOUBLE)
+                    return src_type_id;
+                const char* decl = m_engine->GetTypeDeclaration(base, true);
+                if(!decl)
+                    return asINVALID_TYPE;
+                int r = m_dst->GetTypeIdByDecl(decl);
+                if(r < 0)
+                    return r;
+                return r | (src_type_id & HANDLE_FLAGS);
+            }
+
+            void Remember(const void* src_obj, void* dst_obj, asITypeInfo* dst_type)
+            {
+                // Objects reached by handles earlier keep their copies
+                if(m_copies.count(src_obj) != 0)
+                    return;
+                m_engine->AddRefScriptObject(dst_obj, dst_type);
+                m_copies.emplace(src_obj, Copied{ dst_obj, dst_type });
+            }
+
+            // Return nullptr if the object cannot be copied
+            const Copied* GetCopy(void* src_obj, asITypeInfo* src_type)
+            {
+                auto it = m_copies.find(src_obj);
+                if(it != m_copies.end())
+                    return &it->second;
+
+                int dst_type_id = TranslateTypeId(src_type->GetTypeId());
+                asITypeInfo* dst_type = dst_type_id < 0 ? nullptr : m_engine->GetTypeInfoById(dst_type_id);
+                if(!dst_type)
+                    return nullptr;
+                if(dst_type == src_type)
+                { // Not owned by the module
+                    Remember(src_obj, src_obj, src_type);
+                    return &m_copies.find(src_obj)->second;
+                }
+
+                // The copied properties overwrite the initial values
+                void* obj = CreateObject(dst_type);
+                if(!obj)
+                    return nullptr;
+                // Remembered before copying for cyclic references
+                const Copied* copy = &m_copies.emplace(src_obj, Copied{ obj, dst_type }).first->second;
+                CopyObject(obj, dst_type, src_obj, src_type);
+
+                return copy;
+            }
+
+            // Create an object with every member constructed
+            void* CreateObject(asITypeInfo* type)
+            {
+                if(!(type->GetFlags() & asOBJ_SCRIPT_OBJECT) || HasDefaultFactory(type))
+                    return m_engine->CreateScriptObject(type);
+
+                // The constructors taking arguments cannot be called
+                void* obj = m_engine->CreateUninitializedScriptObject(type);
+                if(obj)
+                    ConstructMembers(static_cast<asIScriptObject*>(obj));
+                return obj;
+            }
+            // Construct the members of an uninitialized script object.
+            // Primitives and handles are left zeroed by the engine
+            void ConstructMembers(asIScriptObject* obj)
+            {
+                asITypeInfo* type = obj->GetObjectType();
+                for(asUINT i = 0; i < obj->GetPropertyCount(); ++i)
+                {
+                    const int type_id = obj->GetPropertyTypeId(i);
+                    if((type_id & asTYPEID_OBJHANDLE) || !(type_id & asTYPEID_MASK_OBJECT))
+                        continue;
+                    asITypeInfo* member_type = m_engine->GetTypeInfoById(type_id);
+                    if(!member_type || (member_type->GetFlags() & asOBJ_FUNCDEF))
+                        continue;
+
+                    bool constructed = false;
+                    void* member = obj->GetAddressOfProperty(i);
+                    if(!member)
+                    { // Not allocated, store a new object into the slot of the property
+                        int offset = 0;
+                        if(type->GetProperty(i, nullptr, nullptr, nullptr, nullptr, &offset) >= 0)
+                        {
+                            if(void* created = CreateObject(member_type))
+                            {
+                                *reinterpret_cast<void**>(reinterpret_cast<std::byte*>(obj) + offset) = created;
+                                constructed = true;
+                            }
+                        }
+                    }
+                    else if(member_type->GetFlags() & asOBJ_VALUE)
+                        constructed = ConstructValue(member, member_type);
+                    else // Allocated by the engine
+                        constructed = true;
+
+                    if(!constructed)
+                    {
+                        SDL_LogWarn(
+                            SDL_LOG_CATEGORY_APPLICATION,
+                            "Member \"%s\" of \"%s\" cannot be default constructed",
+                            obj->GetPropertyName(i),
+                            type->GetName()
+                        );
+                    }
+                }
+            }
+            // Construct a value type in place
+            bool ConstructValue(void* mem, asITypeInfo* type)
+            {
+                asIScriptFunction* ctor = GetDefaultConstructor(type);
+                if(!ctor)
+                {
+                    if(!(type->GetFlags() & asOBJ_POD))
+                        return false;
+                    std::memset(mem, 0, type->GetSize());
+                    return true;
+                }
+
+                asIScriptContext* ctx = m_engine->RequestContext();
+                if(!ctx)
+                    return false;
+                bool success =
+                    ctx->Prepare(ctor) >= 0 &&
+                    ctx->SetObject(mem) >= 0 &&
+                    ctx->Execute() == asEXECUTION_FINISHED;
+                m_engine->ReturnContext(ctx);
+                return success;
+            }
+
+            bool CopyHandle(void** dst, int dst_type_id, void* src_obj, int src_type_id)
+            {
+                asITypeInfo* dst_type = m_engine->GetTypeInfoById(dst_type_id & ~HANDLE_FLAGS);
+                asITypeInfo* src_type = m_engine->GetTypeInfoById(src_type_id & ~HANDLE_FLAGS);
+                if(!dst_type || !src_type || (src_type->GetFlags() & asOBJ_FUNCDEF))
+                    return false;
+
+                void* obj = nullptr;
+                if(src_obj)
+                {
+                    // The object may be of a derived class
+                    if(src_type->GetFlags() & asOBJ_SCRIPT_OBJECT)
+                        src_type = static_cast<asIScriptObject*>(src_obj)->GetObjectType();
+                    const Copied* copy = GetCopy(src_obj, src_type);
+                    if(!copy)
+                        return false;
+                    if(copy->type != dst_type && !copy->type->DerivesFrom(dst_type) && !copy->type->Implements(dst_type))
+                        return false;
+                    obj = copy->obj;
+                    m_engine->AddRefScriptObject(obj, copy->type);
+                }
+
+                if(*dst)
+                    m_engine->ReleaseScriptObject(*dst, dst_type);
+                *dst = obj;
+
+                return true;
+            }
+
+            bool CopyObject(void* dst_obj, asITypeInfo* dst_type, void* src_obj, asITypeInfo* src_type)
+            {
+                if(dst_type == src_type)
+                    return m_engine->AssignScriptObject(dst_obj, src_obj, dst_type) >= 0;
+
+                if(src_type->GetFlags() & asOBJ_SCRIPT_OBJECT)
+                {
+                    auto* dst = static_cast<asIScriptObject*>(dst_obj);
+                    auto* src = static_cast<asIScriptObject*>(src_obj);
+                    // Values before handles, so handles to the members of the
+                    // object are pointed to the copied members
+                    for(bool handles : { false, true })
+                    {
+                        for(asUINT i = 0; i < src->GetPropertyCount(); ++i)
+                        {
+                            const int src_type_id = src->GetPropertyTypeId(i);
+                            if(((src_type_id & asTYPEID_OBJHANDLE) != 0) != handles)
+                                continue;
+                            const char* name = src->GetPropertyName(i);
+                            for(asUINT j = 0; j < dst->GetPropertyCount(); ++j)
+                            {
+                                if(std::strcmp(dst->GetPropertyName(j), name) != 0)
+                                    continue;
+                                void* dst_prop = dst->GetAddressOfProperty(j);
+                                void* src_prop = src->GetAddressOfProperty(i);
+                                // Properties of changed types keep their initial values
+                                if(dst_prop && src_prop)
+                                    Copy(dst_prop, dst->GetPropertyTypeId(j), src_prop, src_type_id);
+                                break;
+                            }
+                        }
+                    }
+                    return true;
+                }
+
+                if(IsScriptArray(dst_type) && IsScriptArray(src_type))
+                {
+                    auto* dst = static_cast<CScriptArray*>(dst_obj);
+                    auto* src = static_cast<CScriptArray*>(src_obj);
+                    dst->Resize(src->GetSize());
+                    for(asUINT i = 0; i < src->GetSize(); ++i)
+                    {
+                        Copy(
+                            dst->At(i), dst->GetElementTypeId(),
+                            src->At(i), src->GetElementTypeId()
+                        );
+                    }
+                    return true;
+                }
+
+                return false;
+            }
+        };
+    }
+
+    ScriptModule::ScriptModule(asIScriptEngine* engine, std::string name, res::AssetCache* cache)
+        : m_engine(engine), m_name(std::move(name)), m_cache(cache) {}
+
+    ScriptModule::~ScriptModule() noexcept
+    {
+        ResolveSlots(nullptr);
+        m_engine->DiscardModule(m_name.c_str());
+    }
+
+    ModuleBuildInfo ScriptModule::Build(const ScriptSources& sources)
+    {
+        ModuleBuildInfo info;
+
+        const std::uint64_t hash = detailed::HashSources(sources);
+        if(m_built && hash == m_source_hash)
+            return info;
+
+        // Build beside the running module, which is kept on failure
+        asIScriptModule* prev = GetModule();
+        const std::string target = prev ? m_name + ".reload" : m_name;
+        auto result = BuildModuleCached(m_engine, target.c_str(), sources, m_cache);
+        info.r = result.r;
+        info.from_cache = result.from_cache;
+        asIScriptModule* mod = m_engine->GetModule(target.c_str(), asGM_ONLY_IF_EXISTS);
+        if(result.r < 0 || !mod)
+        {
+            if(prev && mod)
+                mod->Discard();
+            if(info.r >= 0)
+                info.r = asNO_MODULE;
+            return info;
+        }
+
+        info.rebuilt = true;
+        if(prev)
+        {
+            info.restored = CopyGlobalVars(mod, prev, &info.dropped);
+            // Release the functions of the previous module before discarding it
+            ResolveSlots(mod);
+            prev->Discard();
+            mod->SetName(m_name.c_str());
+        }
+        else
+            ResolveSlots(mod);
+
+        m_built = true;
+        m_source_hash = hash;
+
+        return info;
+    }
+
+    asIScriptModule* ScriptModule::GetModule() const noexcept
+    {
+        return m_built ? m_engine->GetModule(m_name.c_str(), asGM_ONLY_IF_EXISTS) : nullptr;
+    }
+
+    std::shared_ptr<detailed::FunctionSlot> ScriptModule::GetSlot(std::string_view decl)
+    {
+        std::string key(decl);
+        auto it = m_slots.find(key);
+        if(it != m_slots.end())
+            return it->second;
+
+        auto slot = std::make_shared<detailed::FunctionSlot>();
+        slot->decl = key;
+        slot->pool = ContextPool::Get(m_engine);
+        if(asIScriptModule* mod = GetModule())
+        {
+            slot->func = mod->GetFunctionByDecl(slot->decl.c_str());
+            if(slot->func)
+                slot->func->AddRef();
+        }
+        m_slots.emplace(std::move(key), slot);
+
+        return slot;
+    }
+
+    void ScriptModule::ResolveSlots(asIScriptModule* mod) noexcept
+    {
+        for(auto& [decl, slot] : m_slots)
+        {
+            asIScriptFunction* func = mod ? mod->GetFunctionByDecl(decl.c_str()) : nullptr;
+            if(func)
+                func->AddRef();
+            if(slot->func)
+                slot->func->Release();
+            slot->func = func;
+        }
+    }
+
+    std::size_t CopyGlobalVars(
+        asIScriptModule* dst,
+        asIScriptModule* src,
+        std::size_t* dropped
+    ) {
+        // Index of the variables of the source module by "namespace::name"
+        std::unordered_map<std::string, asUINT> src_vars;
+        const asUINT src_count = src->GetGlobalVarCount();
+        src_vars.reserve(src_count);
+        for(asUINT i = 0; i < src_count; ++i)
+        {
+            const char* name = nullptr;
+            const char* ns = nullptr;
+            if(src->GetGlobalVar(i, &name, &ns) < 0)
+                continue;
+            src_vars.emplace(std::string(ns ? ns : "") + "::" + name, i);
+        }
+
+        detailed::StateCopier copier(dst);
+        std::size_t copied = 0;
+        std::size_t failed = 0;
+        const asUINT dst_count = dst->GetGlobalVarCount();
+        // Values before handles, so handles to global objects are pointed
+        // to the objects of the new module
+        for(bool handles : { false, true })
+        {
+            for(asUINT i = 0; i < dst_count; ++i)
+            {
+                const char* name = nullptr;
+                const char* ns = nullptr;
+                int type_id = 0;
+                bool is_const = false;
+                if(dst->GetGlobalVar(i, &name, &ns, &type_id, &is_const) < 0)
+                    continue;
+                if(((type_id & asTYPEID_OBJHANDLE) != 0) != handles)
+                    continue;
+                auto it = src_vars.find(std::string(ns ? ns : "") + "::" + name);
+                if(it == src_vars.end())
+                    continue;
+                // Constants take the values of the new sources
+                if(is_const)
+                    continue;
+
+                int src_type_id = 0;
+                src->GetGlobalVar(it->second, nullptr, nullptr, &src_type_id);
+                bool success = copier.Copy(
+                    dst->GetAddressOfGlobalVar(i), type_id,
+                    src->GetAddressOfGlobalVar(it->second), src_type_id
+                );
+                if(success)
+                    ++copied;
+                else
+                {
+                    ++failed;
+                    SDL_LogWarn(
+                        SDL_LOG_CATEGORY_APPLICATION,
+                        "Global variable \"%s\" of module \"%s\" is reinitialized",
+                        dst->GetGlobalVarDeclaration(i, true),
+                        src->GetName()
+                    );
+                }
+            }
+        }
+
+        if(dropped)
+            *dropped = failed;
+        return copied;
+    }
+}
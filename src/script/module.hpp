@@ -0,0 +1,163 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_MODULE_HPP
+#define TESTWORLD_SCRIPT_MODULE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <angelscript.h>
+#include "bytecode.hpp"
+#include "context.hpp"
+#include "scriptutil.hpp"
+
+
+namespace awe::res
+{
+    class AssetCache;
+}
+
+namespace awe::script
+{
+    namespace detailed
+    {
+        // Shared by the FunctionRef of the same declaration
+        struct FunctionSlot
+        {
+            std::string decl;
+            asIScriptFunction* func = nullptr; // Strong reference
+            ContextPool* pool = nullptr;
+        };
+    }
+
+    template <typename Func>
+    class FunctionRef;
+
+    /*
+     * Typed caller of a function of a ScriptModule by declaration
+     *
+     * The function is looked up again every time the module is rebuilt, so
+     * a FunctionRef stays valid across reloading. It is empty while the
+     * module has no function of the declaration.
+     *
+     * Thread safety: Calls must not overlap with rebuilding the module
+     */
+    template <typename R, typename... Args>
+    class FunctionRef<R(Args...)>
+    {
+    public:
+        FunctionRef() noexcept = default;
+        explicit FunctionRef(std::shared_ptr<const detailed::FunctionSlot> slot) noexcept
+            : m_slot(std::move(slot)) {}
+
+        explicit operator bool() const noexcept { return m_slot && m_slot->func; }
+
+        [[nodiscard]]
+        asIScriptFunction* GetFunction() const noexcept { return m_slot ? m_slot->func : nullptr; }
+
+        R operator()(Args... args) const
+        {
+            if(!*this)
+            {
+                throw std::runtime_error(
+                    "Script function not found: " + (m_slot ? m_slot->decl : std::string())
+                );
+            }
+            return detailed::CallWithPool<R>(m_slot->func, m_slot->pool, std::forward<Args>(args)...);
+        }
+
+    private:
+        std::shared_ptr<const detailed::FunctionSlot> m_slot;
+    };
+
+    struct ModuleBuildInfo
+    {
+        int r = 0; // Negative on failure
+        // False if the sources are unchanged since the last build
+        bool rebuilt = false;
+        bool from_cache = false;
+        // Global variables carried over from the previous module, and the
+        // ones which were not (see CopyGlobalVars())
+        std::size_t restored = 0;
+        std::size_t dropped = 0;
+    };
+
+    /*
+     * Script module which can be rebuilt from its sources at runtime
+     *
+     * Rebuilding is skipped if the sources are unchanged. A new module is
+     * built beside the running one, so the running module is intact if the
+     * sources cannot be compiled. On success, global variables are copied
+     * from the previous module, the functions of FunctionRef are resolved
+     * again and the previous module is discarded.
+     *
+     * Thread safety: Not thread-safe. Build() should be called when no
+     * script of the module is running, e.g. between frames
+     */
+    class ScriptModule
+    {
+    public:
+        ScriptModule(asIScriptEngine* engine, std::string name, res::AssetCache* cache = nullptr);
+        ScriptModule(const ScriptModule&) = delete;
+
+        // Release the functions of FunctionRef and discard the module
+        ~ScriptModule() noexcept;
+
+        ScriptModule& operator=(const ScriptModule&) = delete;
+
+        ModuleBuildInfo Build(const ScriptSources& sources);
+
+        // Null before the first successful build
+        [[nodiscard]]
+        asIScriptModule* GetModule() const noexcept;
+        [[nodiscard]]
+        const std::string& GetName() const noexcept { return m_name; }
+
+        template <typename Func>
+        FunctionRef<Func> GetFunction(std::string_view decl)
+        {
+            return FunctionRef<Func>(GetSlot(decl));
+        }
+
+    private:
+        asIScriptEngine* m_engine;
+        std::string m_name;
+        res::AssetCache* m_cache;
+        bool m_built = false;
+        std::uint64_t m_source_hash = 0;
+        std::unordered_map<std::string, std::shared_ptr<detailed::FunctionSlot>> m_slots;
+
+        std::shared_ptr<detailed::FunctionSlot> GetSlot(std::string_view decl);
+        void ResolveSlots(asIScriptModule* mod) noexcept;
+    };
+
+    /*
+     * Copy the values of global variables from the src module to the variables
+     * of the same name and namespace in the dst module, in the manner of the
+     * serializer add-on of AngelScript. Objects of the classes declared by
+     * scripts are recreated by the default constructors of the classes of the
+     * same names in the dst module and copied property by property. Classes
+     * without default constructors are created without running constructors,
+     * then their members are default constructed before copying.
+     * Handles are pointed to the copies, so objects referenced from several
+     * places are copied once. Properties and variables whose types have been
+     * changed, constants and function handles keep the values initialized by
+     * the dst module.
+     *
+     * Return the number of copied variables. The number of variables found in
+     * both modules but not copied is stored into dropped if not null
+     */
+    std::size_t CopyGlobalVars(
+        asIScriptModule* dst,
+        asIScriptModule* src,
+        std::size_t* dropped = nullptr
+    );
+}
+
+#endif
@@ -0,0 +1,526 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "profiler.hpp"
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <stdexcept>
+#include <fmt/core.h>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/writer.h>
+#include <SDL.h>
+
+
+namespace awe::script
+{
+    namespace detailed
+    {
+        static std::atomic<std::uint64_t> next_profiler_id = 1;
+
+        struct ProfilerCache
+        {
+            std::uint64_t id = 0;
+            void* data = nullptr;
+        };
+        thread_local ProfilerCache profiler_cache;
+
+        static std::string GetFunctionName(const asIScriptFunction* func)
+        {
+            const char* decl = func->GetDeclaration(true, true, false);
+            return decl ? decl : "<unknown>";
+        }
+
+        static double ToMilliseconds(std::chrono::nanoseconds ns) noexcept
+        {
+            return std::chrono::duration<double, std::milli>(ns).count();
+        }
+        static double ToMicroseconds(std::chrono::nanoseconds ns) noexcept
+        {
+            return std::chrono::duration<double, std::micro>(ns).count();
+        }
+    }
+
+    Profiler::FunctionData& Profiler::ThreadData::Touch(asIScriptFunction* func)
+    {
+        auto [it, inserted] = functions.try_emplace(func);
+        if(inserted)
+            func->AddRef();
+        return it->second;
+    }
+    void Profiler::ThreadData::Clear()
+    {
+        timeline.clear();
+        stacks.clear();
+        for(auto& [func, data] : functions)
+            func->Release();
+        functions.clear();
+    }
+
+    Profiler::Profiler(ContextPool* pool)
+        : m_pool(pool), m_id(detailed::next_profiler_id++)
+    {
+        assert(m_pool);
+    }
+
+    Profiler::~Profiler() noexcept
+    {
+        Stop();
+        std::lock_guard lock(m_threads_mutex);
+        for(auto& [id, data] : m_threads)
+        {
+            std::lock_guard data_lock(data->mutex);
+            data->Clear();
+        }
+    }
+
+    void Profiler::Start(std::uint32_t interval)
+    {
+        m_interval.store(std::max<std::uint32_t>(interval, 1), std::memory_order_relaxed);
+        m_running.store(true, std::memory_order_relaxed);
+        m_pool->SetHook(this);
+    }
+    void Profiler::Stop() noexcept
+    {
+        // Contexts acquired before keep calling OnLine(), which returns
+        // immediately after stopping
+        m_pool->SetHook(nullptr);
+        m_running.store(false, std::memory_order_relaxed);
+    }
+    void Profiler::Reset()
+    {
+        std::lock_guard lock(m_threads_mutex);
+        for(auto& [id, data] : m_threads)
+        {
+            std::lock_guard data_lock(data->mutex);
+            data->Clear();
+        }
+    }
+
+    std::vector<ProfileFunction> Profiler::GetReport() const
+    {
+        std::unordered_map<asIScriptFunction*, ProfileFunction> merged;
+        std::unordered_map<asIScriptFunction*, std::map<int, ProfileLine>> lines;
+        {
+            std::lock_guard lock(m_threads_mutex);
+            for(auto& [id, data] : m_threads)
+            {
+                std::lock_guard data_lock(data->mutex);
+                for(auto& [func, i] : data->functions)
+                {
+                    auto [it, inserted] = merged.try_emplace(func);
+                    ProfileFunction& result = it->second;
+                    if(inserted)
+                    {
+                        result.decl = detailed::GetFunctionName(func);
+                        result.section = i.section;
+                    }
+                    result.calls += i.calls;
+                    result.samples += i.samples;
+                    result.self += i.self;
+                    result.total += i.total;
+                    auto& func_lines = lines[func];
+                    for(auto& [line, j] : i.lines)
+                    {
+                        ProfileLine& l = func_lines[line];
+                        l.line = line;
+                        l.samples += j.samples;
+                        l.time += j.time;
+                    }
+                }
+            }
+        }
+
+        std::vector<ProfileFunction> result;
+        result.reserve(merged.size());
+        for(auto& [func, i] : merged)
+        {
+            for(auto& [line, j] : lines[func])
+                i.lines.push_back(j);
+            std::sort(
+                i.lines.begin(), i.lines.end(),
+                [](const ProfileLine& lhs, const ProfileLine& rhs) { return lhs.time > rhs.time; }
+            );
+            result.push_back(std::move(i));
+        }
+        std::sort(
+            result.begin(), result.end(),
+            [](const ProfileFunction& lhs, const ProfileFunction& rhs) { return lhs.self > rhs.self; }
+        );
+
+        return result;
+    }
+    std::string Profiler::FormatReport(std::size_t count) const
+    {
+        auto report = GetReport();
+        std::string result = fmt::format(
+            "{:>10} {:>10} {:>8} {:>8}  function\n",
+            "self(ms)", "total(ms)", "calls", "samples"
+        );
+        for(std::size_t i = 0; i < report.size() && i < count; ++i)
+        {
+            const ProfileFunction& func = report[i];
+            result += fmt::format(
+                "{:>10.3f} {:>10.3f} {:>8} {:>8}  {}\n",
+                detailed::ToMilliseconds(func.self),
+                detailed::ToMilliseconds(func.total),
+                func.calls,
+                func.samples,
+                func.decl
+            );
+            // The hottest lines of the function
+            for(std::size_t j = 0; j < func.lines.size() && j < 3; ++j)
+            {
+                result += fmt::format(
+                    "{:>10.3f} {:>10} {:>8} {:>8}    {}:{}\n",
+                    detailed::ToMilliseconds(func.lines[j].time),
+                    "", "",
+                    func.lines[j].samples,
+                    func.section,
+                    func.lines[j].line
+                );
+            }
+        }
+        if(report.empty())
+            result += "No samples\n";
+
+        return result;
+    }
+
+    void Profiler::WriteFolded(std::ostream& os) const
+    {
+        std::map<std::string, std::chrono::nanoseconds> folded;
+        {
+            std::lock_guard lock(m_threads_mutex);
+            std::string line;
+            for(auto& [id, data] : m_threads)
+            {
+                std::lock_guard data_lock(data->mutex);
+                for(auto& [stack, i] : data->stacks)
+                {
+                    line.clear();
+                    for(auto* func : stack)
+                    {
+                        if(!line.empty())
+                            line += ';';
+                        line += detailed::GetFunctionName(func);
+                    }
+                    folded[line] += i.time;
+                }
+            }
+        }
+
+        for(auto& [stack, time] : folded)
+        {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+            if(us > 0)
+                os << stack << ' ' << us << '\n';
+        }
+    }
+    void Profiler::WriteChromeTrace(std::ostream& os) const
+    {
+        std::lock_guard lock(m_threads_mutex);
+
+        // Timestamps are relative to the earliest sample
+        clock::time_point origin = clock::time_point::max();
+        for(auto& [id, data] : m_threads)
+        {
+            std::lock_guard data_lock(data->mutex);
+            if(!data->timeline.empty())
+            {
+                const Sample& first = data->timeline.front();
+                origin = std::min(origin, first.time - first.elapsed);
+            }
+        }
+
+        rapidjson::OStreamWrapper wrapper(os);
+        rapidjson::Writer<rapidjson::OStreamWrapper> writer(wrapper);
+        writer.StartObject();
+        writer.Key("displayTimeUnit");
+        writer.String("ms");
+        writer.Key("traceEvents");
+        writer.StartArray();
+
+        std::unordered_map<const asIScriptFunction*, std::string> names;
+        auto write_event = [&](const asIScriptFunction* func, clock::time_point begin, clock::time_point end, std::uint32_t tid)
+        {
+            auto it = names.find(func);
+            if(it == names.end())
+                it = names.emplace(func, detailed::GetFunctionName(func)).first;
+            writer.StartObject();
+            writer.Key("name");
+            writer.String(it->second.c_str(), static_cast<rapidjson::SizeType>(it->second.size()));
+            writer.Key("cat");
+            writer.String("script");
+            writer.Key("ph");
+            writer.String("X");
+            writer.Key("ts");
+            writer.Double(detailed::ToMicroseconds(begin - origin));
+            writer.Key("dur");
+            writer.Double(detailed::ToMicroseconds(end - begin));
+            writer.Key("pid");
+            writer.Uint(1);
+            writer.Key("tid");
+            writer.Uint(tid);
+            writer.EndObject();
+        };
+
+        for(auto& [id, data] : m_threads)
+        {
+            std::lock_guard data_lock(data->mutex);
+            if(data->timeline.empty())
+                continue;
+
+            writer.StartObject();
+            writer.Key("name");
+            writer.String("thread_name");
+            writer.Key("ph");
+            writer.String("M");
+            writer.Key("pid");
+            writer.Uint(1);
+            writer.Key("tid");
+            writer.Uint(data->index);
+            writer.Key("args");
+            writer.StartObject();
+            writer.Key("name");
+            writer.String(fmt::format("Script thread {}", data->index).c_str());
+            writer.EndObject();
+            writer.EndObject();
+
+            // Merge the frames shared by consecutive samples into events
+            std::vector<std::pair<const asIScriptFunction*, clock::time_point>> open;
+            clock::time_point last_end;
+            for(const Sample& sample : data->timeline)
+            {
+                const clock::time_point begin = sample.time - sample.elapsed;
+                const Stack& stack = *sample.stack;
+                std::size_t common = 0;
+                if(!open.empty() && begin == last_end)
+                {
+                    while(common < open.size() && common < stack.size() && open[common].first == stack[common])
+                        ++common;
+                }
+                while(open.size() > common)
+                {
+                    write_event(open.back().first, open.back().second, last_end, data->index);
+                    open.pop_back();
+                }
+                for(std::size_t i = common; i < stack.size(); ++i)
+                    open.emplace_back(stack[i], begin);
+                last_end = sample.time;
+            }
+            while(!open.empty())
+            {
+                write_event(open.back().first, open.back().second, last_end, data->index);
+                open.pop_back();
+            }
+        }
+
+        writer.EndArray();
+        writer.EndObject();
+    }
+
+    void Profiler::OnBegin(asIScriptContext* ctx)
+    {
+        if(!IsRunning())
+            return;
+        ThreadData& data = GetThreadData();
+        data.ctx = ctx;
+        // The entry function of a prepared context is counted by its first line
+        data.depth = ctx->GetState() == asEXECUTION_PREPARED ? 0 : ctx->GetCallstackSize();
+        data.baseline = clock::now();
+        if(data.countdown == 0)
+            data.countdown = m_interval.load(std::memory_order_relaxed);
+    }
+    void Profiler::OnLine(asIScriptContext* ctx)
+    {
+        if(!IsRunning())
+            return;
+        ThreadData& data = GetThreadData();
+
+        const asUINT depth = ctx->GetCallstackSize();
+        if(ctx != data.ctx)
+        { // Returned from a nested context
+            data.ctx = ctx;
+        }
+        else if(depth > data.depth)
+        {
+            if(asIScriptFunction* func = ctx->GetFunction(0))
+            {
+                std::lock_guard lock(data.mutex);
+                ++data.Touch(func).calls;
+            }
+        }
+        data.depth = depth;
+
+        if(data.countdown > 1)
+        {
+            --data.countdown;
+            return;
+        }
+        data.countdown = m_interval.load(std::memory_order_relaxed);
+        TakeSample(ctx, data, depth);
+    }
+
+    Profiler::ThreadData& Profiler::GetThreadData()
+    {
+        auto& cache = detailed::profiler_cache;
+        if(cache.id == m_id)
+            return *static_cast<ThreadData*>(cache.data);
+
+        std::lock_guard lock(m_threads_mutex);
+        auto& data = m_threads[std::this_thread::get_id()];
+        if(!data)
+        {
+            data = std::make_unique<ThreadData>();
+            data->index = static_cast<std::uint32_t>(m_threads.size());
+            data->baseline = clock::now();
+        }
+        cache.id = m_id;
+        cache.data = data.get();
+
+        return *data;
+    }
+    void Profiler::TakeSample(asIScriptContext* ctx, ThreadData& data, asUINT depth)
+    {
+        // Keep the timeline within about 24 MiB per thread
+        constexpr std::size_t MAX_TIMELINE = 1 << 20;
+
+        const auto now = clock::now();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - data.baseline);
+        data.baseline = now;
+
+        data.leaf_first.clear();
+        for(asUINT i = 0; i < depth; ++i)
+        {
+            asIScriptFunction* func = ctx->GetFunction(i);
+            if(!func)
+                break; // Boundary of a nested call
+            data.leaf_first.push_back(func);
+        }
+        if(data.leaf_first.empty())
+            return;
+        data.key.assign(data.leaf_first.rbegin(), data.leaf_first.rend());
+
+        const char* section = nullptr;
+        const int line = ctx->GetLineNumber(0, nullptr, &section);
+
+        std::lock_guard lock(data.mutex);
+        FunctionData& leaf = data.Touch(data.leaf_first[0]);
+        if(leaf.section.empty() && section)
+            leaf.section = section;
+        ++leaf.samples;
+        leaf.self += elapsed;
+        ProfileLine& leaf_line = leaf.lines[line];
+        leaf_line.line = line;
+        ++leaf_line.samples;
+        leaf_line.time += elapsed;
+
+        for(std::size_t i = 0; i < data.leaf_first.size(); ++i)
+        {
+            auto* func = data.leaf_first[i];
+            // Recursive functions are charged once
+            auto first = data.leaf_first.begin();
+            if(std::find(first, first + i, func) != first + i)
+                continue;
+            data.Touch(func).total += elapsed;
+        }
+
+        auto it = data.stacks.try_emplace(data.key).first;
+        ++it->second.samples;
+        it->second.time += elapsed;
+        if(data.timeline.size() < MAX_TIMELINE)
+            data.timeline.push_back(Sample{ now, elapsed, &it->first });
+    }
+
+    namespace detailed
+    {
+        [[noreturn]]
+        static void ThrowProfilerError(int r)
+        {
+            throw std::runtime_error("Angelscript error: " + std::to_string(r));
+        }
+
+        static void ProfilerStart(asUINT interval, Profiler* profiler)
+        {
+            profiler->Start(interval);
+        }
+        static void ProfilerStop(Profiler* profiler)
+        {
+            profiler->Stop();
+        }
+        static void ProfilerReset(Profiler* profiler)
+        {
+            profiler->Reset();
+        }
+        static bool ProfilerIsRunning(Profiler* profiler)
+        {
+            return profiler->IsRunning();
+        }
+        static std::string ProfilerReport(asUINT count, Profiler* profiler)
+        {
+            return profiler->FormatReport(count);
+        }
+
+        template <void (Profiler::*Write)(std::ostream&) const>
+        static bool ProfilerSave(const std::string& path, Profiler* profiler)
+        {
+            std::ofstream ofs(path, std::ios_base::binary | std::ios_base::trunc);
+            if(!ofs)
+            {
+                SDL_LogError(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "Failed to open \"%s\" for the profile",
+                    path.c_str()
+                );
+                return false;
+            }
+            (profiler->*Write)(ofs);
+            return static_cast<bool>(ofs);
+        }
+    }
+
+    void RegisterProfiler(asIScriptEngine* engine, Profiler* profiler)
+    {
+        int r = 0;
+        r = engine->RegisterObjectType("Profiler", 0, asOBJ_REF | asOBJ_NOHANDLE);
+        if(r < 0) detailed::ThrowProfilerError(r);
+        r = engine->RegisterObjectMethod(
+            "Profiler", "void Start(uint interval = 64)",
+            asFUNCTION(detailed::ProfilerStart), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowProfilerError(r);
+        r = engine->RegisterObjectMethod(
+            "Profiler", "void Stop()",
+            asFUNCTION(detailed::ProfilerStop), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowProfilerError(r);
+        r = engine->RegisterObjectMethod(
+            "Profiler", "void Reset()",
+            asFUNCTION(detailed::ProfilerReset), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowProfilerError(r);
+        r = engine->RegisterObjectMethod(
+            "Profiler", "bool IsRunning()",
+            asFUNCTION(detailed::ProfilerIsRunning), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowProfilerError(r);
+        r = engine->RegisterObjectMethod(
+            "Profiler", "string Report(uint count = 10)",
+            asFUNCTION(detailed::ProfilerReport), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowProfilerError(r);
+        r = engine->RegisterObjectMethod(
+            "Profiler", "bool SaveFolded(const string &in path)",
+            asFUNCTION(detailed::ProfilerSave<&Profiler::WriteFolded>), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowProfilerError(r);
+        r = engine->RegisterObjectMethod(
+            "Profiler", "bool SaveTrace(const string &in path)",
+            asFUNCTION(detailed::ProfilerSave<&Profiler::WriteChromeTrace>), asCALL_CDECL_OBJLAST
+        );
+        if(r < 0) detailed::ThrowProfilerError(r);
+        r = engine->RegisterGlobalProperty("Profiler profiler", profiler);
+        if(r < 0) detailed::ThrowProfilerError(r);
+    }
+}
@@ -0,0 +1,157 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_PROFILER_HPP
+#define TESTWORLD_SCRIPT_PROFILER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <angelscript.h>
+#include "context.hpp"
+
+
+namespace awe::script
+{
+    struct ProfileLine
+    {
+        int line = 0;
+        std::uint64_t samples = 0;
+        std::chrono::nanoseconds time{};
+    };
+
+    struct ProfileFunction
+    {
+        std::string decl;
+        std::string section;
+        std::uint64_t calls = 0;
+        std::uint64_t samples = 0;
+        std::chrono::nanoseconds self{}; // Spent in the function itself
+        std::chrono::nanoseconds total{}; // Including the callees
+        std::vector<ProfileLine> lines; // Sorted by time, the highest first
+    };
+
+    /*
+     * Sampling profiler of scripts
+     *
+     * Installed as the hook of the ContextPool while running. Every line
+     * callback only checks whether the call stack has grown, for the call
+     * counts, and a sample is taken every "interval" lines. A sample walks
+     * the call stack and charges the time since the previous sample of the
+     * thread to the current line, the leaf function, and all functions on
+     * the stack. The time is restarted when a context begins or resumes, so
+     * the time between calls is not charged. The last lines of a call before
+     * its context is returned may be missed.
+     *
+     * Results can be exported as folded stacks for flame graphs, or as a
+     * Chrome trace (chrome://tracing, Perfetto) rebuilt from the samples.
+     *
+     * Thread safety: Start(), Stop(), Reset() and the exports should be
+     * called in the main thread. Samples are collected in any thread.
+     */
+    class Profiler final : public ContextHook
+    {
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        explicit Profiler(ContextPool* pool);
+        Profiler(const Profiler&) = delete;
+
+        ~Profiler() noexcept;
+
+        Profiler& operator=(const Profiler&) = delete;
+
+        // Profile contexts acquired from now on
+        void Start(std::uint32_t interval = 64);
+        void Stop() noexcept;
+        [[nodiscard]]
+        bool IsRunning() const noexcept { return m_running.load(std::memory_order_relaxed); }
+        // Discard the collected data
+        void Reset();
+
+        // Merged results of all threads, sorted by self time
+        [[nodiscard]]
+        std::vector<ProfileFunction> GetReport() const;
+        // Summary of the hottest functions and lines for the console
+        [[nodiscard]]
+        std::string FormatReport(std::size_t count = 10) const;
+
+        // Lines of "root;...;leaf <microseconds>", as read by flamegraph.pl
+        void WriteFolded(std::ostream& os) const;
+        void WriteChromeTrace(std::ostream& os) const;
+
+        void OnBegin(asIScriptContext* ctx) override;
+        void OnLine(asIScriptContext* ctx) override;
+
+    private:
+        typedef std::vector<asIScriptFunction*> Stack; // Root first
+
+        struct FunctionData
+        {
+            std::string section;
+            std::uint64_t calls = 0;
+            std::uint64_t samples = 0;
+            std::chrono::nanoseconds self{};
+            std::chrono::nanoseconds total{};
+            std::map<int, ProfileLine> lines;
+        };
+        struct StackData
+        {
+            std::uint64_t samples = 0;
+            std::chrono::nanoseconds time{};
+        };
+        struct Sample
+        {
+            clock::time_point time; // End of the sampled period
+            std::chrono::nanoseconds elapsed;
+            const Stack* stack;
+        };
+
+        struct ThreadData
+        {
+            std::uint32_t index = 0;
+
+            // Collected data, guarded by the mutex
+            mutable std::mutex mutex;
+            // Functions are referenced until reset
+            std::unordered_map<asIScriptFunction*, FunctionData> functions;
+            std::map<Stack, StackData> stacks;
+            std::vector<Sample> timeline;
+
+            // Only used by the owner thread
+            asIScriptContext* ctx = nullptr;
+            asUINT depth = 0;
+            std::uint32_t countdown = 0;
+            clock::time_point baseline;
+            std::vector<asIScriptFunction*> leaf_first;
+            Stack key;
+
+            FunctionData& Touch(asIScriptFunction* func);
+            void Clear();
+        };
+
+        ContextPool* m_pool;
+        std::uint64_t m_id;
+        std::atomic<bool> m_running = false;
+        std::atomic<std::uint32_t> m_interval = 64;
+
+        mutable std::mutex m_threads_mutex;
+        std::map<std::thread::id, std::unique_ptr<ThreadData>> m_threads;
+
+        ThreadData& GetThreadData();
+        void TakeSample(asIScriptContext* ctx, ThreadData& data, asUINT depth);
+    };
+
+    void RegisterProfiler(asIScriptEngine* engine, Profiler* profiler);
+}
+
+#endif
@@ -0,0 +1,311 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "scheduler.hpp"
+#include <stdexcept>
+#include <SDL.h>
+
+
+namespace awe::script
+{
+    ScriptFuture::ScriptFuture(vfs::IoHandle handle) noexcept
+        : m_handle(std::move(handle)) {}
+
+    void ScriptFuture::AddRef() const noexcept
+    {
+        m_refcount.fetch_add(1, std::memory_order_relaxed);
+    }
+    void ScriptFuture::Release() const noexcept
+    {
+        if(m_refcount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    bool ScriptFuture::IsReady() const
+    {
+        return !m_handle.IsValid() || m_handle.IsReady();
+    }
+    std::string ScriptFuture::GetString() const
+    {
+        try
+        {
+            if(!m_handle.IsValid())
+                throw std::runtime_error("invalid future");
+            return std::string(m_handle.GetFuture().get().View());
+        }
+        catch(const std::exception& e)
+        {
+            if(asIScriptContext* ctx = asGetActiveContext())
+                ctx->SetException(e.what());
+            return std::string();
+        }
+    }
+
+    void Scheduler::Coroutine::Suspend(WaitKind kind)
+    {
+        wait = kind;
+        ctx->Suspend();
+    }
+    void Scheduler::Coroutine::ClearWait() noexcept
+    {
+        wait = WaitKind::NONE;
+        if(future)
+        {
+            future->Release();
+            future = nullptr;
+        }
+    }
+    bool Scheduler::Coroutine::IsReady(clock::time_point now) const
+    {
+        switch(wait)
+        {
+        case WaitKind::TIME:
+            return deadline <= now;
+        case WaitKind::FUTURE:
+            return future->IsReady();
+        default:
+            return true;
+        }
+    }
+
+    Scheduler::Scheduler(asIScriptEngine* engine, vfs::IoService* io)
+        : m_engine(engine), m_pool(ContextPool::Get(engine)), m_io(io) {}
+
+    Scheduler::~Scheduler() noexcept
+    {
+        Clear();
+    }
+
+    bool Scheduler::Start(asIScriptFunction* func)
+    {
+        if(!func)
+            return false;
+
+        asIScriptContext* ctx = m_engine->RequestContext();
+        if(!ctx)
+            return false;
+        if(ctx->Prepare(func) < 0)
+        {
+            m_engine->ReturnContext(ctx);
+            return false;
+        }
+
+        auto co = std::make_unique<Coroutine>();
+        co->ctx = ctx;
+        ctx->SetUserData(co.get(), SCHEDULER_UDATA);
+        ctx->SetLineCallback(asMETHOD(Scheduler, LineCallback), this, asCALL_THISCALL);
+        m_coroutines.push_back(std::move(co));
+
+        return true;
+    }
+
+    std::size_t Scheduler::Update(std::chrono::microseconds budget)
+    {
+        const auto start = clock::now();
+        m_deadline = start + budget;
+
+        std::size_t finished = 0;
+        std::size_t resumed = 0;
+        // Coroutines started during the update run in the next update
+        const std::size_t count = m_coroutines.size();
+        for(std::size_t visited = 0; visited < count && !m_coroutines.empty(); ++visited)
+        {
+            if(m_cursor >= m_coroutines.size())
+                m_cursor = 0;
+            Coroutine& co = *m_coroutines[m_cursor];
+            const auto now = clock::now();
+            if(!co.IsReady(now))
+            {
+                ++m_cursor;
+                continue;
+            }
+            // At least one coroutine is resumed for progress
+            if(resumed != 0 && now >= m_deadline)
+                break;
+
+            co.ClearWait();
+            if(ContextHook* hook = m_pool ? m_pool->GetHook() : nullptr)
+                hook->OnBegin(co.ctx);
+            int r = co.ctx->Execute();
+            ++resumed;
+            if(r == asEXECUTION_SUSPENDED)
+            { // Yielded, waiting or preempted
+                ++m_cursor;
+                continue;
+            }
+
+            if(r == asEXECUTION_EXCEPTION)
+            {
+                const char* section = nullptr;
+                int line = co.ctx->GetExceptionLineNumber(nullptr, &section);
+                SDL_LogError(
+                    SDL_LOG_CATEGORY_APPLICATION,
+                    "[angelscript] Coroutine exception: %s\n%s (%d)",
+                    co.ctx->GetExceptionString(),
+                    section ? section : "",
+                    line
+                );
+            }
+            Finish(m_cursor);
+            ++finished;
+        }
+
+        m_stats.coroutines = m_coroutines.size();
+        m_stats.resumed = resumed;
+        m_stats.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start);
+
+        return finished;
+    }
+
+    void Scheduler::Clear() noexcept
+    {
+        while(!m_coroutines.empty())
+            Finish(m_coroutines.size() - 1);
+        m_cursor = 0;
+    }
+
+    void Scheduler::StartScript(asIScriptFunction* func)
+    {
+        if(!func)
+            return;
+        bool started = Start(func);
+        func->Release();
+        if(!started)
+        {
+            if(asIScriptContext* ctx = asGetActiveContext())
+                ctx->SetException("Failed to start the coroutine");
+        }
+    }
+    ScriptFuture* Scheduler::ReadFileAsync(const std::string& path)
+    {
+        return new ScriptFuture(m_io->Read(path));
+    }
+
+    void Scheduler::Finish(std::size_t idx) noexcept
+    {
+        Coroutine& co = *m_coroutines[idx];
+        co.ClearWait();
+        // Suspended contexts are aborted by ReturnContext()
+        co.ctx->ClearLineCallback();
+        co.ctx->SetUserData(nullptr, SCHEDULER_UDATA);
+        m_engine->ReturnContext(co.ctx);
+        m_coroutines.erase(m_coroutines.begin() + idx);
+    }
+
+    void Scheduler::LineCallback(asIScriptContext* ctx)
+    {
+        if(ContextHook* hook = m_pool ? m_pool->GetHook() : nullptr)
+            hook->OnLine(ctx);
+        if(clock::now() >= m_deadline)
+            ctx->Suspend();
+    }
+
+    void Scheduler::Yield()
+    {
+        if(Coroutine* co = GetActiveCoroutine())
+            co->Suspend(WaitKind::NONE);
+    }
+    void Scheduler::Wait(float seconds)
+    {
+        if(Coroutine* co = GetActiveCoroutine())
+        {
+            co->deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<float>(seconds > 0.0f ? seconds : 0.0f)
+            );
+            co->Suspend(WaitKind::TIME);
+        }
+    }
+    void Scheduler::Await(ScriptFuture* future)
+    {
+        Coroutine* co = GetActiveCoroutine();
+        if(!future)
+        {
+            if(co)
+                co->ctx->SetException("Null future");
+            return;
+        }
+        if(!co)
+        {
+            future->Release();
+            return;
+        }
+        co->future = future; // Take over the reference
+        co->Suspend(WaitKind::FUTURE);
+    }
+    Scheduler::Coroutine* Scheduler::GetActiveCoroutine()
+    {
+        asIScriptContext* ctx = asGetActiveContext();
+        if(!ctx)
+            return nullptr;
+        auto* co = static_cast<Coroutine*>(ctx->GetUserData(SCHEDULER_UDATA));
+        if(!co)
+            ctx->SetException("Only coroutines can be suspended");
+        return co;
+    }
+
+    namespace detailed
+    {
+        [[noreturn]]
+        static void ThrowSchedulerError(int r)
+        {
+            throw std::runtime_error("Angelscript error: " + std::to_string(r));
+        }
+    }
+
+    void RegisterScheduler(asIScriptEngine* engine, Scheduler* scheduler)
+    {
+        int r = 0;
+        r = engine->RegisterObjectType("Future", 0, asOBJ_REF);
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterObjectBehaviour(
+            "Future", asBEHAVE_ADDREF, "void f()",
+            asMETHOD(ScriptFuture, AddRef), asCALL_THISCALL
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterObjectBehaviour(
+            "Future", asBEHAVE_RELEASE, "void f()",
+            asMETHOD(ScriptFuture, Release), asCALL_THISCALL
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterObjectMethod(
+            "Future", "bool IsReady() const",
+            asMETHOD(ScriptFuture, IsReady), asCALL_THISCALL
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterObjectMethod(
+            "Future", "string GetString() const",
+            asMETHOD(ScriptFuture, GetString), asCALL_THISCALL
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterGlobalFunction(
+            "Future@ ReadFileAsync(const string &in path)",
+            asMETHOD(Scheduler, ReadFileAsync), asCALL_THISCALL_ASGLOBAL,
+            scheduler
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+
+        r = engine->RegisterFuncdef("void CoroutineCallback()");
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterGlobalFunction(
+            "void StartCoroutine(CoroutineCallback@ callback)",
+            asMETHOD(Scheduler, StartScript), asCALL_THISCALL_ASGLOBAL,
+            scheduler
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterGlobalFunction(
+            "void yield()",
+            asFUNCTION(Scheduler::Yield), asCALL_CDECL
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterGlobalFunction(
+            "void wait(float seconds)",
+            asFUNCTION(Scheduler::Wait), asCALL_CDECL
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+        r = engine->RegisterGlobalFunction(
+            "void await(Future@ future)",
+            asFUNCTION(Scheduler::Await), asCALL_CDECL
+        );
+        if(r < 0) detailed::ThrowSchedulerError(r);
+    }
+}
@@ -0,0 +1,139 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_SCHEDULER_HPP
+#define TESTWORLD_SCRIPT_SCHEDULER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <angelscript.h>
+#include "context.hpp"
+#include "../res/ioservice.hpp"
+
+
+namespace awe::script
+{
+    // User data type of contexts running coroutines
+    constexpr asPWORD SCHEDULER_UDATA = 0x5457'0002;
+
+    // Result of an asynchronous read, registered as "Future"
+    class ScriptFuture
+    {
+    public:
+        explicit ScriptFuture(vfs::IoHandle handle) noexcept;
+
+        void AddRef() const noexcept;
+        void Release() const noexcept;
+
+        [[nodiscard]]
+        bool IsReady() const;
+        // Set a script exception if the reading failed
+        [[nodiscard]]
+        std::string GetString() const;
+
+    private:
+        mutable std::atomic<int> m_refcount = 1;
+        vfs::IoHandle m_handle;
+    };
+
+    struct SchedulerStats
+    {
+        std::size_t coroutines = 0;
+        std::size_t resumed = 0; // In the last update
+        std::chrono::microseconds elapsed{}; // Of the last update
+    };
+
+    /*
+     * Frame scheduler of script coroutines
+     *
+     * A coroutine is a script function run by its own context. The scripts
+     * give up the frame by yield(), wait(seconds) or await(future), which
+     * suspend the context. Update() resumes the coroutines in round-robin
+     * order until the time budget of the frame is used up, and contexts
+     * running over the budget are suspended by the line callback, so long
+     * running work is spread over frames.
+     *
+     * Thread safety: Must be used in the main thread
+     */
+    class Scheduler
+    {
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        Scheduler(asIScriptEngine* engine, vfs::IoService* io);
+        Scheduler(const Scheduler&) = delete;
+
+        // Abort all coroutines
+        ~Scheduler() noexcept;
+
+        Scheduler& operator=(const Scheduler&) = delete;
+
+        // Start a coroutine from the next update. Return false on failure
+        bool Start(asIScriptFunction* func);
+        // Resume coroutines for about the budget. Return the number of
+        // finished coroutines
+        std::size_t Update(std::chrono::microseconds budget);
+        // Abort all coroutines, e.g. before the module is discarded
+        void Clear() noexcept;
+
+        [[nodiscard]]
+        std::size_t Size() const noexcept { return m_coroutines.size(); }
+        [[nodiscard]]
+        const SchedulerStats& GetStats() const noexcept { return m_stats; }
+
+        // Script interface
+        void StartScript(asIScriptFunction* func);
+        ScriptFuture* ReadFileAsync(const std::string& path);
+
+    private:
+        enum class WaitKind
+        {
+            NONE = 0,
+            TIME,
+            FUTURE
+        };
+
+        struct Coroutine
+        {
+            asIScriptContext* ctx = nullptr;
+            WaitKind wait = WaitKind::NONE;
+            clock::time_point deadline;
+            ScriptFuture* future = nullptr;
+
+            // Resume the context on the next update
+            void Suspend(WaitKind kind);
+            void ClearWait() noexcept;
+            [[nodiscard]]
+            bool IsReady(clock::time_point now) const;
+        };
+
+        asIScriptEngine* m_engine;
+        ContextPool* m_pool; // For the hook, may be nullptr
+        vfs::IoService* m_io;
+        std::vector<std::unique_ptr<Coroutine>> m_coroutines;
+        std::size_t m_cursor = 0; // Resumed first in the next update
+        clock::time_point m_deadline; // Of the current update
+        SchedulerStats m_stats;
+
+        void Finish(std::size_t idx) noexcept;
+        void LineCallback(asIScriptContext* ctx);
+
+        // yield(), wait(seconds) and await(future)
+        static void Yield();
+        static void Wait(float seconds);
+        static void Await(ScriptFuture* future);
+        [[nodiscard]]
+        static Coroutine* GetActiveCoroutine();
+
+        friend void RegisterScheduler(asIScriptEngine* engine, Scheduler* scheduler);
+    };
+
+    void RegisterScheduler(asIScriptEngine* engine, Scheduler* scheduler);
+}
+
+#endif
@@ -4,6 +4,7 @@
 #include "script.hpp"
 #include <scriptarray/scriptarray.h>
 #include <scriptstdstring/scriptstdstring.h>
+#include "strview.hpp"
 
 
 namespace awe::script
@@ -15,6 +16,7 @@ namespace awe::script
         RegisterScriptArray(engine, true);
         RegisterStdString(engine);
         RegisterStdStringUtils(engine);
+        RegisterStringView(engine);
 
         return r;
     }
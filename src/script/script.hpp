@@ -9,6 +9,7 @@
 #include "mask.hpp"
 #include "register.hpp"
 #include "scriptutil.hpp"
+#include "strview.hpp"
 
 
 namespace awe::script
@@ -7,15 +7,40 @@
 
 namespace awe::script
 {
+    namespace detailed
+    {
+        std::string DescribeExecutionError(asIScriptContext* ctx, int r)
+        {
+            if(r == asEXECUTION_EXCEPTION)
+            {
+                return fmt::format(
+                    "Angelscript exception: {}",
+                    ctx->GetExceptionString()
+                );
+            }
+            return "Script not finished";
+        }
+        void ThrowExecutionError(asIScriptContext* ctx, int r)
+        {
+            throw std::runtime_error(DescribeExecutionError(ctx, r));
+        }
+    }
+
     int AddSectionFromVfs(
         CScriptBuilder* builder,
         const std::string& filename
     ) {
-        auto data = vfs::GetData(filename);
+        return AddSectionFromVfs(builder, filename, vfs::MapData(filename));
+    }
+    int AddSectionFromVfs(
+        CScriptBuilder* builder,
+        const std::string& filename,
+        const vfs::MappedData& data
+    ) {
         return builder->AddSectionFromMemory(
             filename.c_str(),
-            (const char*)data.data(),
-            (unsigned int)data.size()
+            (const char*)data.Data(),
+            (unsigned int)data.Size()
         );
     }
 }
\ No newline at end of file
@@ -6,11 +6,15 @@
 
 #include <functional>
 #include <stdexcept>
+#include <string>
 #include <type_traits>
+#include <utility>
 #include <fmt/core.h>
 #include <angelscript.h>
 #include <scriptbuilder/scriptbuilder.h>
 #include "callconv.hpp"
+#include "context.hpp"
+#include "../res/vfs.hpp"
 
 
 namespace awe::script
@@ -59,7 +63,16 @@ namespace awe::script
             else
                 return ctx->SetArgAddress(idx, &arg.get());
         }
+        // Handle
+        template <typename T>
+        std::enable_if_t<std::is_class_v<T>, int>
+        SetArg(asIScriptContext* ctx, int idx, T* arg)
+        {
+            return ctx->SetArgObject(idx, const_cast<std::remove_cv_t<T>*>(arg));
+        }
 
+        // Terminal
+        inline void ProcArg(asIScriptContext*, int) {}
         template <typename T, typename... Args>
         void ProcArg(asIScriptContext* ctx, int idx, T&& arg, Args&&... args)
         {
@@ -77,8 +90,6 @@ namespace awe::script
             }
             ProcArg(ctx, ++idx, std::forward<Args>(args)...);
         }
-        // Terminal
-        inline void ProcArg(asIScriptContext* ctx, int idx) {}
 
         template <typename Ret>
         Ret GetRet(asIScriptContext* ctx)
@@ -110,6 +121,14 @@ namespace awe::script
         }
     }
 
+    namespace detailed
+    {
+        // Message of an execution result which is not asEXECUTION_FINISHED
+        std::string DescribeExecutionError(asIScriptContext* ctx, int r);
+        [[noreturn]]
+        void ThrowExecutionError(asIScriptContext* ctx, int r);
+    }
+
     template <typename Ret = void, typename... Args>
     Ret Call(
         asIScriptFunction* func,
@@ -123,16 +142,7 @@ namespace awe::script
         detailed::ProcArg(ctx, 0, std::forward<Args>(args)...);
         r = ctx->Execute();
         if(r != asEXECUTION_FINISHED)
-        {
-            if(r == asEXECUTION_EXCEPTION)
-            {
-                throw std::runtime_error(fmt::format(
-                    "Angelscript exception: {}",
-                    ctx->GetExceptionString()
-                ));
-            }
-            throw std::runtime_error("Script not finished");
-        }
+            detailed::ThrowExecutionError(ctx, r);
 
         return detailed::GetRet<Ret>(ctx);
     }
@@ -141,50 +151,133 @@ namespace awe::script
         CScriptBuilder* builder,
         const std::string& filename
     );
+    // Add a section from prefetched data
+    int AddSectionFromVfs(
+        CScriptBuilder* builder,
+        const std::string& filename,
+        const vfs::MappedData& data
+    );
 
     namespace detailed
     {
-        template <typename T>
-        class function_traits;
-
-        template <typename R, typename... Args>
-        struct function_traits<std::function<R(Args...)>>
+        // Return the context to the pool or the engine on scope exit
+        class ContextGuard
         {
-            static constexpr std::size_t nargs = sizeof...(Args);
+        public:
+            ContextGuard(asIScriptContext* ctx, ContextPool* pool) noexcept
+                : m_ctx(ctx), m_pool(pool) {}
+            ContextGuard(const ContextGuard&) = delete;
 
-            typedef R result_type;
+            ~ContextGuard() noexcept
+            {
+                if(m_pool)
+                    m_pool->Release(m_ctx);
+                else
+                    m_ctx->GetEngine()->ReturnContext(m_ctx);
+            }
+
+        private:
+            asIScriptContext* m_ctx;
+            ContextPool* m_pool;
+        };
 
-            struct Caller
+        // Call the function with a context from the pool, or from the engine
+        // if the pool is null
+        template <typename R, typename... Args>
+        R CallWithPool(asIScriptFunction* func, ContextPool* pool, Args&&... args)
+        {
+            asIScriptContext* ctx = nullptr;
+            if(pool)
+                ctx = pool->Acquire(func);
+            else if((ctx = func->GetEngine()->RequestContext()))
             {
-                asIScriptFunction* func;
-                asIScriptContext* ctx;
-
-                Caller(
-                    asIScriptFunction* func_,
-                    asIScriptContext* ctx_
-                ) noexcept : func(func_), ctx(ctx_) {}
-
-                R operator()(
-                    Args&&... args
-                ) {
-                    return Call<result_type>(func, ctx, std::forward<Args>(args)...);
+                if(ctx->Prepare(func) < 0)
+                {
+                    func->GetEngine()->ReturnContext(ctx);
+                    ctx = nullptr;
                 }
-            };
-        };
+            }
+            if(!ctx)
+                throw std::runtime_error("Failed to prepare calling script function");
+
+            ContextGuard guard(ctx, pool);
+            ProcArg(ctx, 0, std::forward<Args>(args)...);
+            int r = ctx->Execute();
+            if(r != asEXECUTION_FINISHED)
+                ThrowExecutionError(ctx, r);
+
+            if constexpr(!std::is_void_v<R>)
+                return GetRet<R>(ctx);
+        }
     }
 
     template <typename Func>
-    std::function<Func> GenCallerByDecl(
+    class Caller;
+
+    /*
+     * Typed caller of a script function
+     *
+     * Every call takes a context from the ContextPool of the engine, which is
+     * looked up once on construction, so calls may be nested or made from
+     * several threads. Falls back to asIScriptEngine::RequestContext() if no
+     * pool is installed. Throw std::runtime_error if the function cannot be
+     * executed.
+     */
+    template <typename R, typename... Args>
+    class Caller<R(Args...)>
+    {
+    public:
+        Caller() noexcept = default;
+        explicit Caller(asIScriptFunction* func) noexcept
+            : m_func(func), m_pool(func ? ContextPool::Get(func->GetEngine()) : nullptr)
+        {
+            if(m_func)
+                m_func->AddRef();
+        }
+        Caller(const Caller& other) noexcept
+            : m_func(other.m_func), m_pool(other.m_pool)
+        {
+            if(m_func)
+                m_func->AddRef();
+        }
+        Caller(Caller&& move) noexcept
+            : m_func(std::exchange(move.m_func, nullptr)), m_pool(std::exchange(move.m_pool, nullptr)) {}
+
+        ~Caller() noexcept
+        {
+            if(m_func)
+                m_func->Release();
+        }
+
+        Caller& operator=(Caller rhs) noexcept
+        {
+            std::swap(m_func, rhs.m_func);
+            std::swap(m_pool, rhs.m_pool);
+            return *this;
+        }
+
+        explicit operator bool() const noexcept { return m_func != nullptr; }
+
+        [[nodiscard]]
+        asIScriptFunction* GetFunction() const noexcept { return m_func; }
+
+        R operator()(Args... args) const
+        {
+            return detailed::CallWithPool<R>(m_func, m_pool, std::forward<Args>(args)...);
+        }
+
+    private:
+        asIScriptFunction* m_func = nullptr;
+        ContextPool* m_pool = nullptr;
+    };
+
+    // Return an empty caller if the function is not found
+    template <typename Func>
+    Caller<Func> GenCallerByDecl(
         asIScriptModule* mod,
-        const char* decl,
-        asIScriptContext* ctx
+        const char* decl
     ) {
-        auto* func = mod->GetFunctionByDecl(decl);
-        if(!func)
-            return std::function<Func>();
-
-        using T = detailed::function_traits<std::function<Func>>;
-        return typename T::Caller(func, ctx);
+        return Caller<Func>(mod->GetFunctionByDecl(decl));
     }
 }
 
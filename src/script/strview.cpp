@@ -0,0 +1,261 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "strview.hpp"
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "callconv.hpp"
+#include "../util/intern.hpp"
+
+
+namespace awe::script
+{
+    namespace detailed
+    {
+        using util::IString;
+
+        // Interned strings are never freed, scripts cannot intern new
+        // strings once the table reaches this size
+        constexpr std::size_t SCRIPT_INTERN_LIMIT = 16 * 1024 * 1024;
+
+        [[noreturn]]
+        static void ThrowStringViewError(int r)
+        {
+            throw std::runtime_error("Angelscript error: " + std::to_string(r));
+        }
+
+        // istring
+        static void TW_AS_API IStringConstruct(IString* mem)
+        {
+            new(mem) IString();
+        }
+        static void TW_AS_API IStringConstructString(const std::string& str, IString* mem)
+        {
+            auto result = IString::TryIntern(str, SCRIPT_INTERN_LIMIT);
+            new(mem) IString(result.value_or(IString()));
+            if(!result)
+            {
+                if(asIScriptContext* ctx = asGetActiveContext())
+                    ctx->SetException("Too many interned strings, istring should only be created from constants");
+            }
+        }
+        static bool TW_AS_API IStringEquals(const IString& rhs, const IString* self)
+        {
+            return *self == rhs;
+        }
+        static asUINT TW_AS_API IStringLength(const IString* self)
+        {
+            return static_cast<asUINT>(self->Size());
+        }
+        static bool TW_AS_API IStringIsEmpty(const IString* self)
+        {
+            return self->Empty();
+        }
+        static std::string TW_AS_API IStringStr(const IString* self)
+        {
+            return std::string(self->View());
+        }
+        static std::string_view TW_AS_API IStringView(const IString* self)
+        {
+            return self->View();
+        }
+        static asQWORD TW_AS_API IStringHash(const IString* self)
+        {
+            return self->Hash();
+        }
+
+        // string_view
+        static void TW_AS_API ViewConstruct(std::string_view* mem)
+        {
+            new(mem) std::string_view();
+        }
+        static void TW_AS_API ViewConstructIString(const IString& str, std::string_view* mem)
+        {
+            new(mem) std::string_view(str.View());
+        }
+        static asUINT TW_AS_API ViewLength(const std::string_view* self)
+        {
+            return static_cast<asUINT>(self->size());
+        }
+        static bool TW_AS_API ViewIsEmpty(const std::string_view* self)
+        {
+            return self->empty();
+        }
+        static std::string TW_AS_API ViewStr(const std::string_view* self)
+        {
+            return std::string(*self);
+        }
+        static bool TW_AS_API ViewEquals(std::string_view rhs, const std::string_view* self)
+        {
+            return *self == rhs;
+        }
+        static bool TW_AS_API ViewEqualsString(const std::string& rhs, const std::string_view* self)
+        {
+            return *self == rhs;
+        }
+        static int TW_AS_API ViewCmp(std::string_view rhs, const std::string_view* self)
+        {
+            int r = self->compare(rhs);
+            return r < 0 ? -1 : (r > 0 ? 1 : 0);
+        }
+        static asBYTE TW_AS_API ViewAt(asUINT idx, const std::string_view* self)
+        {
+            if(idx >= self->size())
+            {
+                if(asIScriptContext* ctx = asGetActiveContext())
+                    ctx->SetException("Out of range");
+                return 0;
+            }
+            return static_cast<asBYTE>((*self)[idx]);
+        }
+        static std::string_view TW_AS_API ViewSubstr(asUINT start, int count, const std::string_view* self)
+        {
+            if(start >= self->size())
+                return std::string_view();
+            return self->substr(start, count < 0 ? std::string_view::npos : static_cast<std::size_t>(count));
+        }
+        static int TW_AS_API ViewFindFirst(std::string_view sv, asUINT start, const std::string_view* self)
+        {
+            std::size_t pos = self->find(sv, start);
+            return pos == std::string_view::npos ? -1 : static_cast<int>(pos);
+        }
+        static bool TW_AS_API ViewStartsWith(std::string_view sv, const std::string_view* self)
+        {
+            return self->substr(0, sv.size()) == sv;
+        }
+        static bool TW_AS_API ViewEndsWith(std::string_view sv, const std::string_view* self)
+        {
+            return self->size() >= sv.size() && self->substr(self->size() - sv.size()) == sv;
+        }
+    }
+
+#   define CHECK_R(r) if(r < 0) { detailed::ThrowStringViewError(r); }
+    void RegisterStringView(asIScriptEngine* engine)
+    {
+        using util::IString;
+
+        int r = 0;
+        r = engine->RegisterObjectType(
+            "istring", sizeof(IString),
+            asOBJ_VALUE | asOBJ_POD | asOBJ_APP_CLASS_ALLINTS | asGetTypeTraits<IString>()
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectType(
+            "string_view", sizeof(std::string_view),
+            asOBJ_VALUE | asOBJ_POD | asOBJ_APP_CLASS_ALLINTS | asGetTypeTraits<std::string_view>()
+        );
+        CHECK_R(r);
+
+        // istring
+        r = engine->RegisterObjectBehaviour(
+            "istring", asBEHAVE_CONSTRUCT, "void f()",
+            asFUNCTION(detailed::IStringConstruct), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectBehaviour(
+            "istring", asBEHAVE_CONSTRUCT, "void f(const string &in)",
+            asFUNCTION(detailed::IStringConstructString), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "istring", "bool opEquals(const istring &in) const",
+            asFUNCTION(detailed::IStringEquals), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "istring", "uint length() const",
+            asFUNCTION(detailed::IStringLength), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "istring", "bool isEmpty() const",
+            asFUNCTION(detailed::IStringIsEmpty), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "istring", "string str() const",
+            asFUNCTION(detailed::IStringStr), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "istring", "string_view opImplConv() const",
+            asFUNCTION(detailed::IStringView), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "istring", "uint64 hash() const",
+            asFUNCTION(detailed::IStringHash), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+
+        // string_view
+        r = engine->RegisterObjectBehaviour(
+            "string_view", asBEHAVE_CONSTRUCT, "void f()",
+            asFUNCTION(detailed::ViewConstruct), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectBehaviour(
+            "string_view", asBEHAVE_CONSTRUCT, "void f(const istring &in)",
+            asFUNCTION(detailed::ViewConstructIString), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "uint length() const",
+            asFUNCTION(detailed::ViewLength), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "bool isEmpty() const",
+            asFUNCTION(detailed::ViewIsEmpty), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "string str() const",
+            asFUNCTION(detailed::ViewStr), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "bool opEquals(string_view) const",
+            asFUNCTION(detailed::ViewEquals), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "bool opEquals(const string &in) const",
+            asFUNCTION(detailed::ViewEqualsString), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "int opCmp(string_view) const",
+            asFUNCTION(detailed::ViewCmp), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "uint8 opIndex(uint) const",
+            asFUNCTION(detailed::ViewAt), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "string_view substr(uint start = 0, int count = -1) const",
+            asFUNCTION(detailed::ViewSubstr), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "int findFirst(string_view, uint start = 0) const",
+            asFUNCTION(detailed::ViewFindFirst), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "bool startsWith(string_view) const",
+            asFUNCTION(detailed::ViewStartsWith), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+        r = engine->RegisterObjectMethod(
+            "string_view", "bool endsWith(string_view) const",
+            asFUNCTION(detailed::ViewEndsWith), asCALL_CDECL_OBJLAST
+        );
+        CHECK_R(r);
+    }
+#   undef CHECK_R
+}
@@ -0,0 +1,26 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SCRIPT_STRVIEW_HPP
+#define TESTWORLD_SCRIPT_STRVIEW_HPP
+
+#include <angelscript.h>
+
+
+namespace awe::script
+{
+    /*
+     * Register "istring", an interned immutable string (util::IString), and
+     * "string_view", a non-owning view (std::string_view), as value types.
+     *
+     * Views can only be created from interned strings, whose contents are
+     * never freed, so a view in a script never dangles. Application
+     * functions may take and return both types without allocating.
+     * Scripts should only create istrings from constants. Creating new ones
+     * raises a script exception once the intern table has grown too large.
+     * Requires the "string" type to be registered.
+     */
+    void RegisterStringView(asIScriptEngine* engine);
+}
+
+#endif
@@ -0,0 +1,162 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "mmap.hpp"
+#include <utility>
+#ifdef _WIN32
+#   define WIN32_LEAN_AND_MEAN 1
+#   include <Windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+
+namespace awe
+{
+    MemoryMappedFile::MemoryMappedFile() noexcept = default;
+    MemoryMappedFile::MemoryMappedFile(MemoryMappedFile&& move) noexcept
+    {
+        Swap(move);
+    }
+
+    MemoryMappedFile::~MemoryMappedFile() noexcept
+    {
+        Close();
+    }
+
+    MemoryMappedFile& MemoryMappedFile::operator=(MemoryMappedFile&& rhs) noexcept
+    {
+        MemoryMappedFile(std::move(rhs)).Swap(*this);
+        return *this;
+    }
+
+#ifdef _WIN32
+    bool MemoryMappedFile::Open(const std::filesystem::path& file, bool copy_on_write)
+    {
+        HANDLE f = CreateFileW(
+            file.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ,
+            NULL,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            NULL
+        );
+        if(f == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if(!GetFileSizeEx(f, &size))
+        {
+            CloseHandle(f);
+            return false;
+        }
+
+        HANDLE mapping = NULL;
+        const void* data = nullptr;
+        if(size.QuadPart != 0)
+        {
+            mapping = CreateFileMappingW(f, NULL, copy_on_write ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+            if(!mapping)
+            {
+                CloseHandle(f);
+                return false;
+            }
+            data = MapViewOfFile(mapping, copy_on_write ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+            if(!data)
+            {
+                CloseHandle(mapping);
+                CloseHandle(f);
+                return false;
+            }
+        }
+
+        Close();
+        m_file = f;
+        m_mapping = mapping;
+        m_data = static_cast<const std::byte*>(data);
+        m_size = static_cast<std::size_t>(size.QuadPart);
+        m_open = true;
+        m_copy_on_write = copy_on_write;
+
+        return true;
+    }
+    void MemoryMappedFile::Close() noexcept
+    {
+        if(!m_open)
+            return;
+        if(m_data)
+            UnmapViewOfFile(m_data);
+        if(m_mapping)
+            CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        m_file = nullptr;
+        m_mapping = nullptr;
+        m_data = nullptr;
+        m_size = 0;
+        m_open = false;
+        m_copy_on_write = false;
+    }
+#else
+    bool MemoryMappedFile::Open(const std::filesystem::path& file, bool copy_on_write)
+    {
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd == -1)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+        {
+            close(fd);
+            return false;
+        }
+
+        void* data = nullptr;
+        std::size_t size = static_cast<std::size_t>(st.st_size);
+        if(size != 0)
+        {
+            int prot = copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+            data = mmap(nullptr, size, prot, MAP_PRIVATE, fd, 0);
+            if(data == MAP_FAILED)
+            {
+                close(fd);
+                return false;
+            }
+        }
+        // The mapping stays valid after closing the descriptor
+        close(fd);
+
+        Close();
+        m_data = static_cast<const std::byte*>(data);
+        m_size = size;
+        m_open = true;
+        m_copy_on_write = copy_on_write;
+
+        return true;
+    }
+    void MemoryMappedFile::Close() noexcept
+    {
+        if(!m_open)
+            return;
+        if(m_data)
+            munmap(const_cast<std::byte*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+        m_open = false;
+        m_copy_on_write = false;
+    }
+#endif
+
+    void MemoryMappedFile::Swap(MemoryMappedFile& other) noexcept
+    {
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_open, other.m_open);
+        std::swap(m_copy_on_write, other.m_copy_on_write);
+#ifdef _WIN32
+        std::swap(m_file, other.m_file);
+        std::swap(m_mapping, other.m_mapping);
+#endif
+    }
+}
@@ -0,0 +1,58 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_SYS_MMAP_HPP
+#define TESTWORLD_SYS_MMAP_HPP
+
+#include <cstddef>
+#include <filesystem>
+
+
+namespace awe
+{
+    // Read-only memory mapping of a whole file
+    class MemoryMappedFile
+    {
+    public:
+        MemoryMappedFile() noexcept;
+        MemoryMappedFile(MemoryMappedFile&& move) noexcept;
+        MemoryMappedFile(const MemoryMappedFile&) = delete;
+
+        ~MemoryMappedFile() noexcept;
+
+        MemoryMappedFile& operator=(MemoryMappedFile&& rhs) noexcept;
+
+        // Return false on failure. Empty files are opened without mapping.
+        // Pages of a copy-on-write mapping can be modified without changing the file
+        bool Open(const std::filesystem::path& file, bool copy_on_write = false);
+        void Close() noexcept;
+
+        [[nodiscard]]
+        bool IsOpen() const noexcept { return m_open; }
+        [[nodiscard]]
+        const std::byte* Data() const noexcept { return m_data; }
+        [[nodiscard]]
+        std::size_t Size() const noexcept { return m_size; }
+        // Writable pointer of a copy-on-write mapping, nullptr otherwise
+        [[nodiscard]]
+        std::byte* MutableData() const noexcept
+        {
+            return m_copy_on_write ? const_cast<std::byte*>(m_data) : nullptr;
+        }
+
+    private:
+        const std::byte* m_data = nullptr;
+        std::size_t m_size = 0;
+        bool m_open = false;
+        bool m_copy_on_write = false;
+#ifdef _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#endif
+
+        void Swap(MemoryMappedFile& other) noexcept;
+    };
+}
+
+
+#endif
@@ -3,8 +3,10 @@
 
 #include "console.hpp"
 #include <SDL.h>
-#include <scripthelper/scripthelper.h>
+#include <fmt/core.h>
 #include "../script/callconv.hpp"
+#include "../script/context.hpp"
+#include "../util/intern.hpp"
 
 
 namespace awe::imgui
@@ -13,12 +15,30 @@ namespace awe::imgui
     {
         static Console* instance = nullptr;
 
+        // Time of a frame given to the running command
+        constexpr std::chrono::milliseconds COMMAND_SLICE(4);
+        constexpr std::chrono::seconds COMMAND_TIMEOUT(10);
+        constexpr std::size_t MAX_CACHED_COMMANDS = 64;
+
         void TW_AS_API Echo(const std::string& str)
         {
             if(!instance)
                 return;
             instance->Write(str);
         }
+        // Views in scripts always refer to interned strings
+        void TW_AS_API EchoView(std::string_view sv)
+        {
+            if(!instance)
+                return;
+            instance->WriteStatic(sv);
+        }
+        void TW_AS_API EchoInterned(const util::IString& str)
+        {
+            if(!instance)
+                return;
+            instance->WriteStatic(str.View());
+        }
 
         void TW_AS_API Exit()
         {
@@ -31,6 +51,10 @@ namespace awe::imgui
             int r = 0;
             r = engine->RegisterGlobalFunction("void Echo(const string& in)", asFUNCTION(Echo), TW_AS_APICALL);
             if(r < 0) return r;
+            r = engine->RegisterGlobalFunction("void Echo(string_view)", asFUNCTION(EchoView), TW_AS_APICALL);
+            if(r < 0) return r;
+            r = engine->RegisterGlobalFunction("void Echo(const istring& in)", asFUNCTION(EchoInterned), TW_AS_APICALL);
+            if(r < 0) return r;
             r = engine->RegisterGlobalFunction("void Exit()", asFUNCTION(Exit), TW_AS_APICALL);
             if(r < 0) return r;
 
@@ -88,18 +112,52 @@ namespace awe::imgui
             ImGui::SameLine();
             if(ImGui::Button("Enter"))
                 enter = true;
-            if(enter)
+            if(enter && m_input_buf[0] != '\0')
             {
-                ExecuteString(m_as_engine, m_input_buf, m_mod, m_console_ctx);
+                Execute(m_input_buf);
                 m_input_buf[0] = '\0';
             }
+
+            if(m_running_ctx)
+            {
+                const auto elapsed = std::chrono::duration<float>(clock::now() - m_running_start);
+                ImGui::Text(
+                    "Running (%.1f s, %zu queued): %s",
+                    elapsed.count(),
+                    m_pending.size(),
+                    m_running_code.c_str()
+                );
+                ImGui::SameLine();
+                if(ImGui::Button("Abort"))
+                    AbortAll();
+            }
         }
         ImGui::End();
+
+        RunCommands();
+    }
+
+    void Console::Execute(std::string code)
+    {
+        m_pending.push_back(std::move(code));
+    }
+    void Console::AbortAll()
+    {
+        m_pending.clear();
+        if(m_running_ctx)
+        {
+            Write("Aborted: " + m_running_code);
+            FinishCommand();
+        }
     }
 
     void Console::Write(std::string_view sv)
     {
-        m_outputs.emplace_back(sv);
+        m_outputs.emplace_back(std::in_place_type<std::string>, sv);
+    }
+    void Console::WriteStatic(std::string_view sv)
+    {
+        m_outputs.emplace_back(std::in_place_type<std::string_view>, sv);
     }
 
     int Console::SetScriptEngine(asIScriptEngine* engine, CScriptBuilder* builder)
@@ -116,14 +174,131 @@ namespace awe::imgui
 
         m_mod = engine->GetModule("Console");
         assert(m_mod);
+        m_pool = script::ContextPool::Get(engine);
 
-        m_console_ctx = engine->CreateContext();
         return asSUCCESS;
     }
     void Console::ReleaseScriptEngine()
     {
-        m_console_ctx->Release();
-        m_console_ctx = nullptr;
+        AbortAll();
+        ClearCache();
+        m_pool = nullptr;
+        m_mod = nullptr;
+        m_as_engine = nullptr;
+    }
+
+    asIScriptFunction* Console::Compile(const std::string& code)
+    {
+        auto it = m_cache.find(code);
+        if(it != m_cache.end())
+            return it->second;
+
+        // Same wrapping as ExecuteString() of the script helper
+        std::string wrapped = "void ExecuteString() {\n" + code + "\n;}";
+        asIScriptFunction* func = nullptr;
+        int r = m_mod->CompileFunction("ExecuteString", wrapped.c_str(), -1, 0, &func);
+        if(r < 0)
+            return nullptr;
+
+        if(m_cache.size() >= detailed::MAX_CACHED_COMMANDS)
+        {
+            auto oldest = m_cache.find(m_cache_order.front());
+            oldest->second->Release();
+            m_cache.erase(oldest);
+            m_cache_order.pop_front();
+        }
+        m_cache.emplace(code, func);
+        m_cache_order.push_back(code);
+
+        return func;
+    }
+    void Console::ClearCache() noexcept
+    {
+        for(auto& [code, func] : m_cache)
+            func->Release();
+        m_cache.clear();
+        m_cache_order.clear();
+    }
+
+    void Console::RunCommands()
+    {
+        if(!m_as_engine)
+            return;
+
+        m_slice_end = clock::now() + detailed::COMMAND_SLICE;
+        while(clock::now() < m_slice_end)
+        {
+            if(!m_running_ctx)
+            {
+                if(m_pending.empty())
+                    break;
+                m_running_code = std::move(m_pending.front());
+                m_pending.pop_front();
+
+                asIScriptFunction* func = Compile(m_running_code);
+                if(!func)
+                {
+                    Write("Failed to compile: " + m_running_code);
+                    continue;
+                }
+                m_running_ctx = m_as_engine->RequestContext();
+                if(!m_running_ctx || m_running_ctx->Prepare(func) < 0)
+                {
+                    Write("Failed to prepare: " + m_running_code);
+                    FinishCommand();
+                    continue;
+                }
+                m_running_ctx->SetLineCallback(asMETHOD(Console, LineCallback), this, asCALL_THISCALL);
+                m_running_start = clock::now();
+            }
+
+            if(auto* hook = m_pool ? m_pool->GetHook() : nullptr)
+                hook->OnBegin(m_running_ctx);
+            int r = m_running_ctx->Execute();
+            if(r == asEXECUTION_SUSPENDED)
+            {
+                if(clock::now() - m_running_start >= detailed::COMMAND_TIMEOUT)
+                {
+                    Write(fmt::format(
+                        "Timeout after {} s: {}",
+                        detailed::COMMAND_TIMEOUT.count(),
+                        m_running_code
+                    ));
+                    FinishCommand();
+                    continue;
+                }
+                break; // Resumed in the next frame
+            }
+
+            if(r == asEXECUTION_EXCEPTION)
+            {
+                Write(fmt::format(
+                    "Exception: {} (line {})",
+                    m_running_ctx->GetExceptionString(),
+                    // The first line is the wrapper
+                    m_running_ctx->GetExceptionLineNumber() - 1
+                ));
+            }
+            FinishCommand();
+        }
+    }
+    void Console::FinishCommand() noexcept
+    {
+        if(m_running_ctx)
+        {
+            m_running_ctx->ClearLineCallback();
+            // Suspended contexts are aborted when returned
+            m_as_engine->ReturnContext(m_running_ctx);
+            m_running_ctx = nullptr;
+        }
+        m_running_code.clear();
+    }
+    void Console::LineCallback(asIScriptContext* ctx)
+    {
+        if(auto* hook = m_pool ? m_pool->GetHook() : nullptr)
+            hook->OnLine(ctx);
+        if(clock::now() >= m_slice_end)
+            ctx->Suspend();
     }
 
     void Console::OutputRegion()
@@ -134,9 +309,13 @@ namespace awe::imgui
 
     void Console::DrawLine(const ConsoleOutputLine& line)
     {
+        std::string_view text = std::visit(
+            [](const auto& i) { return std::string_view(i); },
+            line
+        );
         ImGui::TextUnformatted(
-            line.c_str(),
-            line.c_str() + line.size()
+            text.data(),
+            text.data() + text.size()
         );
     }
 }
@@ -4,13 +4,22 @@
 #ifndef TESTWORLD_UI_CONSOLE_HPP
 #define TESTWORLD_UI_CONSOLE_HPP
 
+#include <chrono>
 #include <deque>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
 #include <imgui.h>
 #include <angelscript.h>
 #include <scriptbuilder/scriptbuilder.h>
 
 
+namespace awe::script
+{
+    class ContextPool;
+}
+
 namespace awe::imgui
 {
     class Console
@@ -22,10 +31,20 @@ namespace awe::imgui
         void NewFrame();
 
         void Write(std::string_view sv);
+        // Write without copying. The memory must outlive the console, e.g.
+        // interned strings and string literals
+        void WriteStatic(std::string_view sv);
 
         int SetScriptEngine(asIScriptEngine* engine, CScriptBuilder* builder);
         void ReleaseScriptEngine();
 
+        // Commands are queued and run in the following frames. Long running
+        // commands are suspended at the end of the time slice of each frame
+        // and aborted after the timeout
+        void Execute(std::string code);
+        // Abort the running command and discard the queued commands
+        void AbortAll();
+
     private:
         bool m_show = true;
         bool m_fixed_mode = true; // false for windowed mode
@@ -34,14 +53,34 @@ namespace awe::imgui
 
         void OutputRegion();
 
-        typedef std::string ConsoleOutputLine;
+        typedef std::variant<std::string, std::string_view> ConsoleOutputLine;
         std::deque<ConsoleOutputLine> m_outputs;
 
         void DrawLine(const ConsoleOutputLine& line);
 
-        asIScriptEngine* m_as_engine;
-        asIScriptContext* m_console_ctx;
-        asIScriptModule* m_mod;
+        typedef std::chrono::steady_clock clock;
+
+        // Compiled commands by source text, evicted in insertion order
+        std::unordered_map<std::string, asIScriptFunction*> m_cache;
+        std::deque<std::string> m_cache_order;
+        [[nodiscard]]
+        asIScriptFunction* Compile(const std::string& code);
+        void ClearCache() noexcept;
+
+        std::deque<std::string> m_pending;
+        asIScriptContext* m_running_ctx = nullptr;
+        std::string m_running_code;
+        clock::time_point m_running_start;
+        clock::time_point m_slice_end;
+
+        // Start and resume commands
+        void RunCommands();
+        void FinishCommand() noexcept;
+        void LineCallback(asIScriptContext* ctx);
+
+        asIScriptEngine* m_as_engine = nullptr;
+        asIScriptModule* m_mod = nullptr;
+        script::ContextPool* m_pool = nullptr; // For the hook, may be nullptr
     };
 }
 
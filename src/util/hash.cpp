@@ -0,0 +1,58 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "hash.hpp"
+
+
+namespace awe::util
+{
+    namespace detailed
+    {
+        std::uint64_t ReadU64(const unsigned char* p) noexcept
+        {
+            std::uint64_t value = 0;
+            for(int i = 0; i < 8; ++i)
+                value |= static_cast<std::uint64_t>(p[i]) << (i * 8);
+            return value;
+        }
+    }
+
+    std::uint64_t Hash64(const void* data, std::size_t size, std::uint64_t seed) noexcept
+    {
+        constexpr std::uint64_t m = 0xC6A4A7935BD1E995ull;
+        constexpr int r = 47;
+
+        const auto* p = static_cast<const unsigned char*>(data);
+        std::uint64_t h = seed ^ (size * m);
+
+        const auto* end = p + (size & ~static_cast<std::size_t>(7));
+        for(; p != end; p += 8)
+        {
+            std::uint64_t k = detailed::ReadU64(p);
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+
+        switch(size & 7)
+        {
+        case 7: h ^= static_cast<std::uint64_t>(p[6]) << 48; [[fallthrough]];
+        case 6: h ^= static_cast<std::uint64_t>(p[5]) << 40; [[fallthrough]];
+        case 5: h ^= static_cast<std::uint64_t>(p[4]) << 32; [[fallthrough]];
+        case 4: h ^= static_cast<std::uint64_t>(p[3]) << 24; [[fallthrough]];
+        case 3: h ^= static_cast<std::uint64_t>(p[2]) << 16; [[fallthrough]];
+        case 2: h ^= static_cast<std::uint64_t>(p[1]) << 8; [[fallthrough]];
+        case 1:
+            h ^= static_cast<std::uint64_t>(p[0]);
+            h *= m;
+            break;
+        }
+
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+}
@@ -0,0 +1,31 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_UTIL_HASH_HPP
+#define TESTWORLD_UTIL_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+
+namespace awe::util
+{
+    // Fast non-cryptographic 64-bit hash (MurmurHash64A).
+    // The result doesn't depend on the endianness of the platform
+    [[nodiscard]]
+    std::uint64_t Hash64(const void* data, std::size_t size, std::uint64_t seed = 0) noexcept;
+    [[nodiscard]]
+    inline std::uint64_t Hash64(std::string_view str, std::uint64_t seed = 0) noexcept
+    {
+        return Hash64(str.data(), str.size(), seed);
+    }
+
+    [[nodiscard]]
+    constexpr std::uint64_t HashCombine(std::uint64_t seed, std::uint64_t value) noexcept
+    {
+        return seed ^ (value + 0x9E3779B97F4A7C15ull + (seed << 12) + (seed >> 4));
+    }
+}
+
+#endif
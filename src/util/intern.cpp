@@ -0,0 +1,164 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#include "intern.hpp"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+#include "hash.hpp"
+
+
+namespace awe::util
+{
+    namespace detailed
+    {
+        class InternTable
+        {
+        public:
+            InternTable()
+            {
+                m_empty = Insert(std::string_view(), Hash64(std::string_view()));
+            }
+
+            [[nodiscard]]
+            const InternEntry* GetEmpty() const noexcept { return m_empty; }
+
+            // Return nullptr if the string is new and the contents of the
+            // table have reached the limit
+            const InternEntry* Intern(std::string_view str, std::size_t limit = SIZE_MAX)
+            {
+                const std::uint64_t hash = Hash64(str);
+                {
+                    std::shared_lock lock(m_mutex);
+                    auto it = m_entries.find(Key{ str, hash });
+                    if(it != m_entries.end())
+                        return it->second;
+                }
+
+                std::unique_lock lock(m_mutex);
+                // Inserted by another thread between the locks
+                auto it = m_entries.find(Key{ str, hash });
+                if(it != m_entries.end())
+                    return it->second;
+                if(m_stats.bytes >= limit)
+                    return nullptr;
+                return Insert(str, hash);
+            }
+
+            [[nodiscard]]
+            InternStats GetStats() const
+            {
+                std::shared_lock lock(m_mutex);
+                return m_stats;
+            }
+
+        private:
+            // Contents are allocated from blocks, which are never freed
+            static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+            static constexpr std::size_t ENTRIES_PER_BLOCK = 1024;
+
+            struct Key
+            {
+                std::string_view str;
+                std::uint64_t hash;
+
+                bool operator==(const Key& rhs) const noexcept { return str == rhs.str; }
+            };
+            struct KeyHash
+            {
+                std::size_t operator()(const Key& key) const noexcept
+                {
+                    return static_cast<std::size_t>(key.hash);
+                }
+            };
+
+            mutable std::shared_mutex m_mutex;
+            std::unordered_map<Key, const InternEntry*, KeyHash> m_entries;
+            std::vector<std::unique_ptr<char[]>> m_blocks;
+            std::vector<std::unique_ptr<InternEntry[]>> m_entry_blocks;
+            std::size_t m_block_used = BLOCK_SIZE;
+            std::size_t m_entry_used = 0;
+            const InternEntry* m_empty = nullptr;
+            InternStats m_stats;
+
+            char* Allocate(std::size_t size)
+            {
+                if(size > BLOCK_SIZE / 4)
+                { // Large strings have their own blocks
+                    m_blocks.push_back(std::make_unique<char[]>(size));
+                    char* result = m_blocks.back().get();
+                    // Keep the current block at the end
+                    if(m_blocks.size() > 1)
+                        std::swap(m_blocks[m_blocks.size() - 1], m_blocks[m_blocks.size() - 2]);
+                    return result;
+                }
+                if(m_block_used + size > BLOCK_SIZE)
+                {
+                    m_blocks.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+                    m_block_used = 0;
+                }
+                char* result = m_blocks.back().get() + m_block_used;
+                m_block_used += size;
+                return result;
+            }
+            InternEntry* AllocateEntry()
+            {
+                if(m_entry_blocks.empty() || m_entry_used == ENTRIES_PER_BLOCK)
+                {
+                    m_entry_blocks.push_back(std::make_unique<InternEntry[]>(ENTRIES_PER_BLOCK));
+                    m_entry_used = 0;
+                }
+                return &m_entry_blocks.back()[m_entry_used++];
+            }
+
+            const InternEntry* Insert(std::string_view str, std::uint64_t hash)
+            {
+                char* data = Allocate(str.size() + 1);
+                if(!str.empty())
+                    std::memcpy(data, str.data(), str.size());
+                data[str.size()] = '\0';
+
+                InternEntry* entry = AllocateEntry();
+                entry->hash = hash;
+                entry->size = str.size();
+                entry->data = data;
+                m_entries.emplace(Key{ std::string_view(data, str.size()), hash }, entry);
+
+                ++m_stats.count;
+                m_stats.bytes += str.size() + 1;
+
+                return entry;
+            }
+        };
+
+        static InternTable& GetInternTable()
+        {
+            // Never destroyed, so interned strings outlive static objects
+            static InternTable* table = new InternTable();
+            return *table;
+        }
+    }
+
+    IString::IString() noexcept
+        : m_entry(detailed::GetInternTable().GetEmpty()) {}
+    IString::IString(std::string_view str)
+        : m_entry(detailed::GetInternTable().Intern(str)) {}
+
+    std::optional<IString> IString::TryIntern(std::string_view str, std::size_t limit)
+    {
+        const detailed::InternEntry* entry = detailed::GetInternTable().Intern(str, limit);
+        if(!entry)
+            return std::nullopt;
+        return IString(entry);
+    }
+
+    InternStats GetInternStats()
+    {
+        return detailed::GetInternTable().GetStats();
+    }
+}
@@ -0,0 +1,91 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+#ifndef TESTWORLD_UTIL_INTERN_HPP
+#define TESTWORLD_UTIL_INTERN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+
+
+namespace awe::util
+{
+    namespace detailed
+    {
+        struct InternEntry
+        {
+            std::uint64_t hash;
+            std::size_t size;
+            const char* data; // Null-terminated
+        };
+    }
+
+    /*
+     * Interned immutable string
+     *
+     * Equal strings share a single copy in a global table, so copying,
+     * comparing and hashing are done on a pointer. The contents are never
+     * freed, which makes views of them valid until the program exits. Only
+     * intern strings from a bounded set, e.g. identifiers and UI text, and
+     * use TryIntern() for strings from untrusted sources like scripts.
+     *
+     * Thread safety: Interning is thread-safe
+     */
+    class IString
+    {
+    public:
+        // Empty string
+        IString() noexcept;
+        explicit IString(std::string_view str);
+
+        // Intern the string unless it is new and the contents of the table
+        // have reached the limit in bytes. Return std::nullopt if refused
+        [[nodiscard]]
+        static std::optional<IString> TryIntern(std::string_view str, std::size_t limit);
+
+        [[nodiscard]]
+        std::string_view View() const noexcept { return std::string_view(m_entry->data, m_entry->size); }
+        [[nodiscard]]
+        const char* c_str() const noexcept { return m_entry->data; }
+        [[nodiscard]]
+        std::size_t Size() const noexcept { return m_entry->size; }
+        [[nodiscard]]
+        bool Empty() const noexcept { return m_entry->size == 0; }
+        [[nodiscard]]
+        std::uint64_t Hash() const noexcept { return m_entry->hash; }
+
+        operator std::string_view() const noexcept { return View(); }
+
+        bool operator==(const IString& rhs) const noexcept { return m_entry == rhs.m_entry; }
+        bool operator!=(const IString& rhs) const noexcept { return m_entry != rhs.m_entry; }
+
+    private:
+        const detailed::InternEntry* m_entry;
+
+        explicit IString(const detailed::InternEntry* entry) noexcept
+            : m_entry(entry) {}
+    };
+
+    // Number of interned strings and bytes used by their contents
+    struct InternStats
+    {
+        std::size_t count = 0;
+        std::size_t bytes = 0;
+    };
+    [[nodiscard]]
+    InternStats GetInternStats();
+}
+
+template <>
+struct std::hash<awe::util::IString>
+{
+    std::size_t operator()(const awe::util::IString& str) const noexcept
+    {
+        return static_cast<std::size_t>(str.Hash());
+    }
+};
+
+#endif
@@ -0,0 +1,203 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+// Benchmark of the image processing kernels, scalar code versus the
+// instruction set selected at runtime
+// Usage: twimgbench [-w <width>] [-r <rows>] [-t <milliseconds per kernel>]
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <graphic/common/imgproc.hpp>
+
+
+namespace awe::tool
+{
+    namespace common = graphic::common;
+
+    struct Kernel
+    {
+        const char* name;
+        std::size_t pixels; // Source pixels processed by a single run
+        // Restore the input before every run, not measured
+        std::function<void()> prepare;
+        std::function<void()> scalar;
+        std::function<void()> dispatched;
+        // Output of the last run for comparison
+        const std::vector<std::byte>* output;
+    };
+
+    // Return the processed pixels per second
+    double Measure(const Kernel& kernel, const std::function<void()>& run, std::chrono::milliseconds duration)
+    {
+        using clock = std::chrono::steady_clock;
+        clock::duration elapsed{};
+        std::size_t pixels = 0;
+        do
+        {
+            if(kernel.prepare)
+                kernel.prepare();
+            auto start = clock::now();
+            run();
+            elapsed += clock::now() - start;
+            pixels += kernel.pixels;
+        } while(elapsed < duration);
+
+        return static_cast<double>(pixels) / std::chrono::duration<double>(elapsed).count();
+    }
+
+    int Main(int argc, char* argv[])
+    {
+        int width = 4096;
+        int rows = 256;
+        int milliseconds = 500;
+        for(int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt = argv[i];
+            if(opt == "-w" || opt == "--width")
+                width = std::atoi(argv[i + 1]);
+            else if(opt == "-r" || opt == "--rows")
+                rows = std::atoi(argv[i + 1]);
+            else if(opt == "-t" || opt == "--time")
+                milliseconds = std::atoi(argv[i + 1]);
+            else
+            {
+                std::cerr << "Unknown option: " << opt << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if(width <= 1 || rows <= 1 || milliseconds <= 0)
+        {
+            std::cerr << "Usage: " << argv[0] << " [-w <width>] [-r <rows>] [-t <milliseconds per kernel>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        const std::size_t count = static_cast<std::size_t>(width) * rows;
+        std::vector<std::byte> rgb(count * 3);
+        std::vector<std::byte> rgba(count * 4);
+        std::mt19937 gen(42);
+        std::uniform_int_distribution<int> dist(0, 255);
+        for(auto& i : rgb)
+            i = static_cast<std::byte>(dist(gen));
+        for(auto& i : rgba)
+            i = static_cast<std::byte>(dist(gen));
+
+        std::vector<std::byte> expanded(count * 4);
+        std::vector<std::byte> premultiplied(count * 4);
+        const int half_width = width / 2;
+        const int half_rows = rows / 2;
+        std::vector<std::byte> box4(static_cast<std::size_t>(half_width) * half_rows * 4);
+        std::vector<std::byte> box3(static_cast<std::size_t>(half_width) * half_rows * 3);
+
+        using ExpandFunc = void(*)(std::byte*, const std::byte*, std::size_t, std::uint8_t) noexcept;
+        using PremultiplyFunc = void(*)(std::byte*, std::size_t) noexcept;
+        using BoxFunc = void(*)(std::byte*, const std::byte*, const std::byte*, int, int) noexcept;
+        auto expand = [&](ExpandFunc func)
+        {
+            return [&, func]() { func(expanded.data(), rgb.data(), count, 255); };
+        };
+        auto premultiply = [&](PremultiplyFunc func)
+        {
+            return [&, func]() { func(premultiplied.data(), count); };
+        };
+        auto box = [&](BoxFunc func, int channel)
+        {
+            return [&, func, channel]()
+            {
+                const std::byte* src = channel == 4 ? rgba.data() : rgb.data();
+                std::byte* dst = channel == 4 ? box4.data() : box3.data();
+                const std::size_t src_stride = static_cast<std::size_t>(width) * channel;
+                const std::size_t dst_stride = static_cast<std::size_t>(half_width) * channel;
+                for(int y = 0; y < half_rows; ++y)
+                {
+                    func(
+                        dst + y * dst_stride,
+                        src + y * 2 * src_stride,
+                        src + (y * 2 + 1) * src_stride,
+                        width,
+                        channel
+                    );
+                }
+            };
+        };
+
+        const Kernel kernels[] =
+        {
+            {
+                "ExpandRGBToRGBA", count, nullptr,
+                expand(&common::scalar::ExpandRGBToRGBA),
+                expand(&common::ExpandRGBToRGBA),
+                &expanded
+            },
+            {
+                "PremultiplyAlpha", count,
+                [&]() { premultiplied = rgba; },
+                premultiply(&common::scalar::PremultiplyAlpha),
+                premultiply(&common::PremultiplyAlpha),
+                &premultiplied
+            },
+            {
+                "DownsampleBoxRow (RGBA)", static_cast<std::size_t>(width) * half_rows * 2, nullptr,
+                box(&common::scalar::DownsampleBoxRow, 4),
+                box(&common::DownsampleBoxRow, 4),
+                &box4
+            },
+            {
+                "DownsampleBoxRow (RGB)", static_cast<std::size_t>(width) * half_rows * 2, nullptr,
+                box(&common::scalar::DownsampleBoxRow, 3),
+                box(&common::DownsampleBoxRow, 3),
+                &box3
+            }
+        };
+
+        const char* isa = common::GetKernelIsa();
+        const std::chrono::milliseconds duration(milliseconds);
+        std::cout
+            << width << "x" << rows << " pixels, kernels: " << isa << "\n"
+            << std::left << std::setw(26) << "kernel"
+            << std::right << std::setw(14) << "scalar MP/s"
+            << std::setw(14) << (std::string(isa) + " MP/s")
+            << std::setw(10) << "speedup" << "\n";
+
+        bool mismatch = false;
+        for(const auto& kernel : kernels)
+        {
+            // Both implementations should produce the same output
+            if(kernel.prepare)
+                kernel.prepare();
+            kernel.scalar();
+            std::vector<std::byte> expected = *kernel.output;
+            if(kernel.prepare)
+                kernel.prepare();
+            kernel.dispatched();
+            bool same = expected == *kernel.output;
+            mismatch |= !same;
+
+            double scalar = Measure(kernel, kernel.scalar, duration);
+            double dispatched = Measure(kernel, kernel.dispatched, duration);
+            std::cout
+                << std::left << std::setw(26) << kernel.name
+                << std::right << std::fixed << std::setprecision(1)
+                << std::setw(14) << scalar / 1e6
+                << std::setw(14) << dispatched / 1e6
+                << std::setprecision(2) << std::setw(9) << dispatched / scalar << "x"
+                << (same ? "" : "  (output mismatch)") << "\n";
+        }
+        std::cout.flush();
+
+        return mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    return awe::tool::Main(argc, argv);
+}
@@ -0,0 +1,1092 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+// The packaging tool of Testworld Project
+// Usage: twpack -o <output> [-b <base path>] [-j <threads>] [-l <level>] [-a <alignment>]
+//               [--full] [--compact] -i <files...>
+//
+// Entries are sorted by name. Already compressed formats and files read by
+// random access are stored with aligned data, so they can be mapped into
+// memory directly. Other files are deflated in parallel, and stored without
+// alignment if deflating doesn't reduce the size.
+//
+// Builds are incremental. The content hash of every entry is recorded in a
+// manifest next to the package (<output>.manifest). Unchanged entries are
+// kept, changed entries are patched in place if they fit, otherwise they are
+// appended with the central directory rewritten. The package is compacted
+// when more than half of its data is unused. --full ignores the previous
+// package, and --compact always rewrites the whole package.
+//
+// Outputs with the extension of ".twa" are written as block-compressed
+// archives (see src/res/twa.hpp) instead. Every entry is split into blocks
+// deflated independently, so seeking only decompresses the touched blocks.
+// Such archives are always built from scratch.
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#include <res/twa.hpp>
+#include <res/zip.hpp>
+#include <sys/mmap.hpp>
+#include <util/hash.hpp>
+
+
+namespace awe::tool
+{
+    namespace fs = std::filesystem;
+    using vfs::ZipEntry;
+    using vfs::ZipIndex;
+
+    constexpr std::uint32_t LOCAL_HEADER_SIG = 0x04034b50;
+    constexpr std::uint32_t CENTRAL_HEADER_SIG = 0x02014b50;
+    constexpr std::uint32_t END_OF_CD_SIG = 0x06054b50;
+    constexpr std::uint32_t ZIP64_END_OF_CD_SIG = 0x06064b50;
+    constexpr std::uint32_t ZIP64_LOCATOR_SIG = 0x07064b50;
+    constexpr std::uint16_t ZIP64_EXTRA_ID = 0x0001;
+    // Extra field used by zipalign of Android for the same purpose
+    constexpr std::uint16_t ALIGNMENT_EXTRA_ID = 0xD935;
+    constexpr std::uint16_t METHOD_STORE = 0;
+    constexpr std::uint16_t METHOD_DEFLATE = 8;
+    constexpr std::uint16_t FLAG_UTF8 = 1 << 11;
+    constexpr std::uint64_t U32_MAX = 0xFFFFFFFF;
+    constexpr const char* MANIFEST_MAGIC = "twpack-manifest";
+    constexpr int MANIFEST_VERSION = 1;
+
+    // Stored entries with these extensions
+    const char* const STORED_EXTENSIONS[] =
+    {
+        // Already compressed
+        ".png", ".jpg", ".jpeg", ".ogg", ".mp3", ".zip", ".pak",
+        // Read by random access or mapped at runtime
+        ".vt", ".ttf", ".otf"
+    };
+
+    // Entry of the previous package
+    struct PreviousEntry
+    {
+        std::uint64_t hash = 0;
+        std::uint16_t method = METHOD_STORE;
+        std::uint16_t dos_time = 0;
+        std::uint16_t dos_date = 0;
+        std::uint32_t crc32 = 0;
+        std::uint64_t size = 0;
+        std::uint64_t compressed_size = 0;
+        std::uint64_t header_offset = 0;
+        std::uint64_t data_offset = 0;
+
+        // Bytes from the local header to the end of the data
+        [[nodiscard]]
+        std::uint64_t Span() const noexcept
+        {
+            return data_offset + compressed_size - header_offset;
+        }
+    };
+
+    struct Previous
+    {
+        MemoryMappedFile file;
+        std::map<std::string, PreviousEntry> entries;
+        std::uint64_t data_end = 0; // End of the data of the last entry
+    };
+
+    struct Entry
+    {
+        fs::path file;
+        std::string name; // Name in the archive
+        std::uint16_t method = METHOD_STORE;
+        bool aligned = false; // Stored by type, so the data is aligned
+        std::uint16_t dos_time = 0;
+        std::uint16_t dos_date = 0;
+        std::uint32_t crc32 = 0;
+        std::uint64_t size = 0;
+        std::uint64_t header_offset = 0;
+        std::vector<unsigned char> data; // Compressed or stored data, released after writing
+        std::uint64_t compressed_size = 0;
+        std::uint64_t hash = 0; // Hash of the uncompressed content
+        // Unchanged entry of the previous package, data is empty if not nullptr
+        const PreviousEntry* previous = nullptr;
+        // End offsets of the blocks in the data of TWA
+        std::vector<std::uint64_t> blocks;
+        std::int64_t modtime = 0;
+        std::string error;
+    };
+
+    struct Options
+    {
+        fs::path output;
+        fs::path basepath = fs::current_path();
+        std::vector<fs::path> inputs;
+        unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+        int level = Z_BEST_COMPRESSION;
+        std::uint32_t alignment = 4096;
+        bool full = false;
+        bool compact = false;
+        bool twa = false;
+    };
+
+    class Writer
+    {
+    public:
+        // Overwrite the existing file if in place, otherwise create a new file
+        Writer(const fs::path& path, bool in_place)
+            : m_fs(
+                path,
+                in_place ?
+                    std::ios_base::binary | std::ios_base::in | std::ios_base::out :
+                    std::ios_base::binary | std::ios_base::out | std::ios_base::trunc
+            ) {}
+
+        [[nodiscard]]
+        bool Good() const { return static_cast<bool>(m_fs); }
+        [[nodiscard]]
+        std::uint64_t Offset() const noexcept { return m_offset; }
+
+        void Seek(std::uint64_t offset)
+        {
+            m_fs.seekp(static_cast<std::streamoff>(offset));
+            m_offset = offset;
+        }
+        void Close() { m_fs.close(); }
+
+        void U16(std::uint16_t value) { Integer(value, 2); }
+        void U32(std::uint32_t value) { Integer(value, 4); }
+        void U64(std::uint64_t value) { Integer(value, 8); }
+        void Bytes(const void* data, std::size_t size)
+        {
+            m_fs.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            m_offset += size;
+        }
+        void Zeros(std::size_t count)
+        {
+            for(std::size_t i = 0; i < count; ++i)
+                m_fs.put('\0');
+            m_offset += count;
+        }
+
+    private:
+        std::fstream m_fs;
+        std::uint64_t m_offset = 0;
+
+        void Integer(std::uint64_t value, int size)
+        { // Little-endian
+            char buf[8];
+            for(int i = 0; i < size; ++i)
+                buf[i] = static_cast<char>((value >> (i * 8)) & 0xFF);
+            Bytes(buf, size);
+        }
+    };
+
+    bool IsStoredType(const fs::path& file)
+    {
+        std::string ext = file.extension().u8string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        return std::find(std::begin(STORED_EXTENSIONS), std::end(STORED_EXTENSIONS), ext) != std::end(STORED_EXTENSIONS);
+    }
+
+    std::time_t GetModifiedTime(const fs::path& file)
+    {
+        std::error_code ec;
+        auto ftime = fs::last_write_time(file, ec);
+        if(ec)
+            return 0;
+        // No portable clock conversion in C++17
+        auto sys = std::chrono::system_clock::now() + std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            ftime - fs::file_time_type::clock::now()
+        );
+        return std::chrono::system_clock::to_time_t(sys);
+    }
+
+    void SetDosTime(Entry& entry)
+    {
+        std::time_t t = GetModifiedTime(entry.file);
+        std::tm* tm = std::localtime(&t);
+        if(!tm || tm->tm_year < 80)
+        { // 1980-01-01 00:00:00, the earliest DOS time
+            entry.dos_time = 0;
+            entry.dos_date = (1 << 5) | 1;
+            return;
+        }
+        entry.dos_time = static_cast<std::uint16_t>((tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2));
+        entry.dos_date = static_cast<std::uint16_t>(((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday);
+    }
+
+    // Read and compress a file if it's not an unchanged entry of the previous
+    // package. Errors are reported by the error string
+    std::optional<std::vector<unsigned char>> ReadFile(Entry& entry)
+    {
+        std::ifstream ifs(entry.file, std::ios_base::binary);
+        if(!ifs)
+        {
+            entry.error = "cannot be opened";
+            return std::nullopt;
+        }
+        std::vector<unsigned char> raw(
+            (std::istreambuf_iterator<char>(ifs)),
+            std::istreambuf_iterator<char>()
+        );
+        if(ifs.bad())
+        {
+            entry.error = "cannot be read";
+            return std::nullopt;
+        }
+        return raw;
+    }
+
+    void Process(Entry& entry, int level, const Previous* prev)
+    {
+        auto file = ReadFile(entry);
+        if(!file)
+            return;
+        std::vector<unsigned char>& raw = *file;
+
+        entry.hash = util::Hash64(raw.data(), raw.size());
+        if(prev)
+        {
+            auto it = prev->entries.find(entry.name);
+            if(it != prev->entries.end() && it->second.hash == entry.hash && it->second.size == raw.size())
+            {
+                const PreviousEntry& pe = it->second;
+                entry.method = pe.method;
+                entry.aligned = pe.method == METHOD_STORE && IsStoredType(entry.file);
+                entry.dos_time = pe.dos_time;
+                entry.dos_date = pe.dos_date;
+                entry.crc32 = pe.crc32;
+                entry.size = pe.size;
+                entry.compressed_size = pe.compressed_size;
+                entry.previous = &pe;
+                return;
+            }
+        }
+
+        SetDosTime(entry);
+        entry.size = raw.size();
+        uLong crc = crc32(0L, Z_NULL, 0);
+        for(std::size_t pos = 0; pos < raw.size();)
+        { // The length parameter of zlib is 32-bit
+            uInt len = static_cast<uInt>(std::min<std::size_t>(raw.size() - pos, 1u << 30));
+            crc = crc32(crc, raw.data() + pos, len);
+            pos += len;
+        }
+        entry.crc32 = static_cast<std::uint32_t>(crc);
+
+        if(!IsStoredType(entry.file) && !raw.empty() && raw.size() < U32_MAX && level != 0)
+        {
+            z_stream zs{};
+            // Negative window bits for raw deflate data without zlib header
+            if(deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                entry.error = "failed to initialize zlib";
+                return;
+            }
+            std::vector<unsigned char> out(deflateBound(&zs, static_cast<uLong>(raw.size())));
+            zs.next_in = raw.data();
+            zs.avail_in = static_cast<uInt>(raw.size());
+            zs.next_out = out.data();
+            zs.avail_out = static_cast<uInt>(out.size());
+            int r = deflate(&zs, Z_FINISH);
+            std::size_t compressed = zs.total_out;
+            deflateEnd(&zs);
+            if(r != Z_STREAM_END)
+            {
+                entry.error = "failed to compress";
+                return;
+            }
+            if(compressed < raw.size())
+            {
+                out.resize(compressed);
+                entry.method = METHOD_DEFLATE;
+                entry.data = std::move(out);
+                entry.compressed_size = entry.data.size();
+                return;
+            }
+        }
+
+        entry.method = METHOD_STORE;
+        entry.aligned = IsStoredType(entry.file);
+        entry.data = std::move(raw);
+        entry.compressed_size = entry.data.size();
+    }
+
+    // Compress the blocks of a TWA entry independently. A block is stored if
+    // deflating doesn't reduce its size
+    void ProcessTwa(Entry& entry, int level)
+    {
+        auto file = ReadFile(entry);
+        if(!file)
+            return;
+        const std::vector<unsigned char>& raw = *file;
+        const std::uint32_t block_size = vfs::TwaHeader::DEFAULT_BLOCK_SIZE;
+
+        entry.hash = util::Hash64(raw.data(), raw.size());
+        entry.modtime = static_cast<std::int64_t>(GetModifiedTime(entry.file));
+        entry.size = raw.size();
+        const bool compress = !IsStoredType(entry.file) && level != 0;
+
+        z_stream zs{};
+        if(compress && deflateInit2(&zs, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            entry.error = "failed to initialize zlib";
+            return;
+        }
+        std::vector<unsigned char> out(compress ? deflateBound(&zs, block_size) : 0);
+        entry.blocks.reserve(static_cast<std::size_t>(vfs::TwaBlockCount(raw.size(), block_size)));
+        for(std::size_t pos = 0; pos < raw.size(); pos += block_size)
+        {
+            const std::size_t len = std::min<std::size_t>(block_size, raw.size() - pos);
+            std::size_t compressed = len;
+            if(compress)
+            {
+                deflateReset(&zs);
+                zs.next_in = const_cast<unsigned char*>(raw.data() + pos);
+                zs.avail_in = static_cast<uInt>(len);
+                zs.next_out = out.data();
+                zs.avail_out = static_cast<uInt>(out.size());
+                if(deflate(&zs, Z_FINISH) != Z_STREAM_END)
+                {
+                    deflateEnd(&zs);
+                    entry.error = "failed to compress";
+                    return;
+                }
+                compressed = zs.total_out;
+            }
+
+            if(compressed < len)
+                entry.data.insert(entry.data.end(), out.data(), out.data() + compressed);
+            else
+                entry.data.insert(entry.data.end(), raw.data() + pos, raw.data() + pos + len);
+            entry.blocks.push_back(entry.data.size());
+        }
+        if(compress)
+            deflateEnd(&zs);
+
+        entry.method = entry.data.size() < raw.size() ? METHOD_DEFLATE : METHOD_STORE;
+        entry.compressed_size = entry.data.size();
+    }
+
+    void WriteLocalHeader(Writer& w, Entry& entry, std::uint32_t alignment)
+    {
+        entry.header_offset = w.Offset();
+        const bool zip64 = entry.size >= U32_MAX || entry.compressed_size >= U32_MAX;
+        std::size_t extra_len = zip64 ? 20 : 0;
+        std::size_t padding = 0;
+        const bool align = entry.aligned && alignment > 1;
+        if(align)
+        {
+            std::uint64_t data_offset = entry.header_offset + 30 + entry.name.size() + extra_len + 6;
+            padding = static_cast<std::size_t>((alignment - data_offset % alignment) % alignment);
+            extra_len += 6 + padding;
+        }
+
+        w.U32(LOCAL_HEADER_SIG);
+        w.U16(zip64 ? 45 : 20); // Version needed to extract
+        w.U16(FLAG_UTF8);
+        w.U16(entry.method);
+        w.U16(entry.dos_time);
+        w.U16(entry.dos_date);
+        w.U32(entry.crc32);
+        w.U32(zip64 ? U32_MAX : static_cast<std::uint32_t>(entry.compressed_size));
+        w.U32(zip64 ? U32_MAX : static_cast<std::uint32_t>(entry.size));
+        w.U16(static_cast<std::uint16_t>(entry.name.size()));
+        w.U16(static_cast<std::uint16_t>(extra_len));
+        w.Bytes(entry.name.data(), entry.name.size());
+        if(zip64)
+        {
+            w.U16(ZIP64_EXTRA_ID);
+            w.U16(16);
+            w.U64(entry.size);
+            w.U64(entry.compressed_size);
+        }
+        if(align)
+        {
+            w.U16(ALIGNMENT_EXTRA_ID);
+            w.U16(static_cast<std::uint16_t>(2 + padding));
+            w.U16(static_cast<std::uint16_t>(std::min<std::uint32_t>(alignment, 0xFFFF)));
+            w.Zeros(padding);
+        }
+    }
+
+    void WriteCentralHeader(Writer& w, const Entry& entry)
+    {
+        const bool size64 = entry.size >= U32_MAX || entry.compressed_size >= U32_MAX;
+        const bool offset64 = entry.header_offset >= U32_MAX;
+        std::uint16_t extra_len = 0;
+        if(size64)
+            extra_len += 16;
+        if(offset64)
+            extra_len += 8;
+        if(extra_len != 0)
+            extra_len += 4;
+
+        w.U32(CENTRAL_HEADER_SIG);
+        w.U16((3 << 8) | 45); // Made by Unix, version 4.5
+        w.U16(extra_len != 0 ? 45 : 20);
+        w.U16(FLAG_UTF8);
+        w.U16(entry.method);
+        w.U16(entry.dos_time);
+        w.U16(entry.dos_date);
+        w.U32(entry.crc32);
+        w.U32(size64 ? U32_MAX : static_cast<std::uint32_t>(entry.compressed_size));
+        w.U32(size64 ? U32_MAX : static_cast<std::uint32_t>(entry.size));
+        w.U16(static_cast<std::uint16_t>(entry.name.size()));
+        w.U16(extra_len);
+        w.U16(0); // Comment length
+        w.U16(0); // Disk number
+        w.U16(0); // Internal attributes
+        w.U32(0100644u << 16); // External attributes, regular file with rw-r--r--
+        w.U32(offset64 ? U32_MAX : static_cast<std::uint32_t>(entry.header_offset));
+        w.Bytes(entry.name.data(), entry.name.size());
+        if(extra_len != 0)
+        {
+            w.U16(ZIP64_EXTRA_ID);
+            w.U16(static_cast<std::uint16_t>(extra_len - 4));
+            if(size64)
+            {
+                w.U64(entry.size);
+                w.U64(entry.compressed_size);
+            }
+            if(offset64)
+                w.U64(entry.header_offset);
+        }
+    }
+
+    void WriteEndOfCentralDirectory(Writer& w, std::uint64_t count, std::uint64_t cd_offset, std::uint64_t cd_size)
+    {
+        const bool zip64 = count >= 0xFFFF || cd_offset >= U32_MAX || cd_size >= U32_MAX;
+        if(zip64)
+        {
+            const std::uint64_t zip64_eocd = w.Offset();
+            w.U32(ZIP64_END_OF_CD_SIG);
+            w.U64(44); // Size of the remaining record
+            w.U16((3 << 8) | 45);
+            w.U16(45);
+            w.U32(0); // Number of this disk
+            w.U32(0); // Disk of the central directory
+            w.U64(count);
+            w.U64(count);
+            w.U64(cd_size);
+            w.U64(cd_offset);
+
+            w.U32(ZIP64_LOCATOR_SIG);
+            w.U32(0);
+            w.U64(zip64_eocd);
+            w.U32(1); // Total number of disks
+        }
+
+        w.U32(END_OF_CD_SIG);
+        w.U16(0);
+        w.U16(0);
+        w.U16(zip64 ? 0xFFFF : static_cast<std::uint16_t>(count));
+        w.U16(zip64 ? 0xFFFF : static_cast<std::uint16_t>(count));
+        w.U32(zip64 ? U32_MAX : static_cast<std::uint32_t>(cd_size));
+        w.U32(zip64 ? U32_MAX : static_cast<std::uint32_t>(cd_offset));
+        w.U16(0); // Comment length
+    }
+
+    fs::path ManifestPath(const Options& opt)
+    {
+        fs::path path = opt.output;
+        path += ".manifest";
+        return path;
+    }
+
+    // Return std::nullopt if the previous package cannot be reused
+    std::optional<Previous> LoadPrevious(const Options& opt)
+    {
+        std::ifstream ifs(ManifestPath(opt));
+        if(!ifs)
+            return std::nullopt;
+
+        // Entries are not reusable after changing the options
+        std::string magic;
+        int version = 0;
+        int level = -1;
+        std::uint32_t alignment = 0;
+        ifs >> magic >> version >> level >> alignment;
+        if(!ifs || magic != MANIFEST_MAGIC || version != MANIFEST_VERSION || level != opt.level || alignment != opt.alignment)
+            return std::nullopt;
+        std::map<std::string, std::uint64_t> hashes;
+        std::string line;
+        std::getline(ifs, line);
+        while(std::getline(ifs, line))
+        { // <hash> <name>
+            if(line.size() < 18 || line[16] != ' ')
+                return std::nullopt;
+            hashes.emplace(line.substr(17), std::stoull(line.substr(0, 16), nullptr, 16));
+        }
+
+        Previous prev;
+        if(!prev.file.Open(opt.output))
+            return std::nullopt;
+        try
+        {
+            ZipIndex index(prev.file.Data(), prev.file.Size());
+            if(index.GetEntries().size() != hashes.size())
+                return std::nullopt;
+            for(auto& [name, hash] : hashes)
+            {
+                const ZipEntry* entry = index.Find(name);
+                if(!entry)
+                    return std::nullopt;
+                auto data_offset = index.DataOffset(*entry);
+                if(!data_offset)
+                    return std::nullopt;
+
+                // Timestamps in the DOS format are only available in the headers
+                const std::byte* header = prev.file.Data() + entry->header_offset;
+                auto read_u16 = [](const std::byte* p)
+                {
+                    return static_cast<std::uint16_t>(std::to_integer<unsigned>(p[0]) | (std::to_integer<unsigned>(p[1]) << 8));
+                };
+
+                PreviousEntry pe;
+                pe.hash = hash;
+                pe.method = entry->method;
+                pe.dos_time = read_u16(header + 10);
+                pe.dos_date = read_u16(header + 12);
+                pe.crc32 = entry->crc32;
+                pe.size = entry->size;
+                pe.compressed_size = entry->compressed_size;
+                pe.header_offset = entry->header_offset;
+                pe.data_offset = *data_offset;
+                prev.data_end = std::max(prev.data_end, pe.data_offset + pe.compressed_size);
+                prev.entries.emplace(name, pe);
+            }
+        }
+        catch(const std::exception&)
+        {
+            return std::nullopt;
+        }
+
+        return prev;
+    }
+
+    bool WriteManifest(const Options& opt, const std::vector<Entry>& entries)
+    {
+        std::ofstream ofs(ManifestPath(opt), std::ios_base::trunc);
+        ofs << MANIFEST_MAGIC << ' ' << MANIFEST_VERSION << ' ' << opt.level << ' ' << opt.alignment << '\n';
+        for(auto& i : entries)
+        {
+            char hash[17];
+            std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(i.hash));
+            ofs << hash << ' ' << i.name << '\n';
+        }
+        return static_cast<bool>(ofs);
+    }
+
+    void ProcessRange(std::vector<Entry>& entries, std::size_t begin, std::size_t end, const Options& opt, const Previous* prev)
+    {
+        std::atomic_size_t next = begin;
+        auto worker = [&]()
+        {
+            for(std::size_t i = next++; i < end; i = next++)
+            {
+                if(opt.twa)
+                    ProcessTwa(entries[i], opt.level);
+                else
+                    Process(entries[i], opt.level, prev);
+            }
+        };
+        std::vector<std::thread> threads;
+        for(unsigned i = 1; i < opt.threads && begin + i < end; ++i)
+            threads.emplace_back(worker);
+        worker();
+        for(auto& t : threads)
+            t.join();
+    }
+    bool CheckErrors(const std::vector<Entry>& entries, std::size_t begin, std::size_t end)
+    {
+        for(std::size_t i = begin; i < end; ++i)
+        {
+            if(!entries[i].error.empty())
+            {
+                std::cerr << "\"" << entries[i].file.u8string() << "\" " << entries[i].error << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void WriteEntry(Writer& w, Entry& entry, const Options& opt, const Previous* prev)
+    {
+        WriteLocalHeader(w, entry, opt.alignment);
+        if(entry.previous)
+        { // Copy the compressed data of the previous package
+            w.Bytes(prev->file.Data() + entry.previous->data_offset, entry.previous->compressed_size);
+        }
+        else
+        {
+            w.Bytes(entry.data.data(), entry.data.size());
+            entry.data = std::vector<unsigned char>();
+        }
+    }
+    void WriteDirectory(Writer& w, const std::vector<Entry>& entries)
+    {
+        const std::uint64_t cd_offset = w.Offset();
+        for(auto& i : entries)
+            WriteCentralHeader(w, i);
+        const std::uint64_t cd_size = w.Offset() - cd_offset;
+        WriteEndOfCentralDirectory(w, entries.size(), cd_offset, cd_size);
+    }
+
+    // Write the whole package into a new file. Entries are processed in a
+    // window at a time if not processed yet, so memory usage is bounded
+    bool Rebuild(const Options& opt, std::vector<Entry>& entries, std::optional<Previous>& prev, bool processed)
+    {
+        fs::path tmp = opt.output;
+        tmp += ".tmp";
+        Writer w(tmp, false);
+        if(!w.Good())
+        {
+            std::cerr << "Failed to open \"" << tmp.u8string() << "\"" << std::endl;
+            return false;
+        }
+
+        const Previous* p = prev ? &*prev : nullptr;
+        const std::size_t window = processed ? entries.size() : static_cast<std::size_t>(opt.threads) * 4;
+        for(std::size_t begin = 0; begin < entries.size(); begin += window)
+        {
+            const std::size_t end = std::min(begin + window, entries.size());
+            if(!processed)
+                ProcessRange(entries, begin, end, opt, p);
+            if(!CheckErrors(entries, begin, end))
+                return false;
+            for(std::size_t i = begin; i < end; ++i)
+                WriteEntry(w, entries[i], opt, p);
+        }
+        WriteDirectory(w, entries);
+        w.Close();
+        if(!w.Good())
+        {
+            std::cerr << "Failed to write \"" << tmp.u8string() << "\"" << std::endl;
+            return false;
+        }
+
+        // The previous package must be unmapped before replacing it
+        prev.reset();
+        std::error_code ec;
+        fs::rename(tmp, opt.output, ec);
+        if(ec)
+        {
+            std::cerr << "Failed to replace \"" << opt.output.u8string() << "\": " << ec.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Write a block-compressed archive into a new file. The block table of
+    // each entry follows its data, and the directory is written at last
+    bool RebuildTwa(const Options& opt, std::vector<Entry>& entries)
+    {
+        fs::path tmp = opt.output;
+        tmp += ".tmp";
+        Writer w(tmp, false);
+        if(!w.Good())
+        {
+            std::cerr << "Failed to open \"" << tmp.u8string() << "\"" << std::endl;
+            return false;
+        }
+
+        vfs::TwaHeader header{};
+        std::memcpy(header.magic, vfs::TwaHeader::MAGIC, sizeof(header.magic));
+        header.version = vfs::TwaHeader::VERSION;
+        header.block_size = vfs::TwaHeader::DEFAULT_BLOCK_SIZE;
+        header.entry_count = static_cast<std::uint32_t>(entries.size());
+        header.bucket_count = 1;
+        while(header.bucket_count < entries.size())
+            header.bucket_count *= 2;
+        w.Zeros(sizeof(header));
+
+        std::vector<vfs::TwaRecord> records(entries.size());
+        std::string names;
+        const std::size_t window = static_cast<std::size_t>(opt.threads) * 4;
+        for(std::size_t begin = 0; begin < entries.size(); begin += window)
+        {
+            const std::size_t end = std::min(begin + window, entries.size());
+            ProcessRange(entries, begin, end, opt, nullptr);
+            if(!CheckErrors(entries, begin, end))
+                return false;
+            for(std::size_t i = begin; i < end; ++i)
+            {
+                Entry& entry = entries[i];
+                const std::uint64_t data_offset = w.Offset();
+                w.Bytes(entry.data.data(), entry.data.size());
+                entry.data = std::vector<unsigned char>();
+
+                vfs::TwaRecord& record = records[i];
+                record.name_hash = util::Hash64(entry.name);
+                record.name_offset = static_cast<std::uint32_t>(names.size());
+                record.name_size = static_cast<std::uint32_t>(entry.name.size());
+                record.size = entry.size;
+                record.modtime = entry.modtime;
+                record.block_table_offset = w.Offset();
+                w.U64(data_offset);
+                for(auto end_offset : entry.blocks)
+                    w.U64(data_offset + end_offset);
+                entry.blocks = std::vector<std::uint64_t>();
+                names += entry.name;
+            }
+        }
+
+        // Chain the records of the same bucket
+        std::vector<std::uint32_t> buckets(header.bucket_count, 0);
+        for(std::size_t i = records.size(); i-- > 0;)
+        {
+            auto& bucket = buckets[records[i].name_hash & (header.bucket_count - 1)];
+            records[i].next = bucket;
+            bucket = static_cast<std::uint32_t>(i + 1);
+        }
+
+        header.directory_offset = w.Offset();
+        for(auto i : buckets)
+            w.U32(i);
+        for(auto& i : records)
+        {
+            w.U64(i.name_hash);
+            w.U32(i.name_offset);
+            w.U32(i.name_size);
+            w.U64(i.size);
+            w.U64(i.block_table_offset);
+            w.U64(static_cast<std::uint64_t>(i.modtime));
+            w.U32(i.next);
+            w.U32(0);
+        }
+        w.Bytes(names.data(), names.size());
+
+        w.Seek(0);
+        w.Bytes(header.magic, sizeof(header.magic));
+        w.U32(header.version);
+        w.U32(header.block_size);
+        w.U32(header.entry_count);
+        w.U32(header.bucket_count);
+        w.U32(0);
+        w.U64(header.directory_offset);
+        w.Close();
+        if(!w.Good())
+        {
+            std::cerr << "Failed to write \"" << tmp.u8string() << "\"" << std::endl;
+            return false;
+        }
+
+        std::error_code ec;
+        fs::rename(tmp, opt.output, ec);
+        if(ec)
+        {
+            std::cerr << "Failed to replace \"" << opt.output.u8string() << "\": " << ec.message() << std::endl;
+            return false;
+        }
+        // Not reusable by incremental builds of zip packages
+        fs::remove(ManifestPath(opt), ec);
+        return true;
+    }
+
+    // Patch changed entries in place if they fit, otherwise append them
+    // after the data of the previous package, then rewrite the directory
+    bool Update(const Options& opt, std::vector<Entry>& entries, Previous& prev)
+    {
+        // The package is invalid until finished, so a broken update causes a full rebuild next time
+        std::error_code ec;
+        fs::remove(ManifestPath(opt), ec);
+        std::map<std::string, PreviousEntry> old_entries = std::move(prev.entries);
+        const std::uint64_t data_end = prev.data_end;
+        prev.file.Close();
+
+        Writer w(opt.output, true);
+        if(!w.Good())
+        {
+            std::cerr << "Failed to open \"" << opt.output.u8string() << "\"" << std::endl;
+            return false;
+        }
+
+        std::uint64_t append = data_end;
+        for(auto& entry : entries)
+        {
+            if(entry.previous)
+            {
+                entry.header_offset = entry.previous->header_offset;
+                continue;
+            }
+
+            auto it = old_entries.find(entry.name);
+            if(it != old_entries.end())
+            {
+                const PreviousEntry& pe = it->second;
+                const bool fits =
+                    entry.compressed_size <= pe.compressed_size &&
+                    pe.size < U32_MAX && pe.compressed_size < U32_MAX &&
+                    entry.size < U32_MAX &&
+                    (!entry.aligned || pe.data_offset % opt.alignment == 0);
+                if(fits)
+                { // Overwrite the fields of the local header after the version
+                    entry.header_offset = pe.header_offset;
+                    w.Seek(pe.header_offset + 6);
+                    w.U16(FLAG_UTF8);
+                    w.U16(entry.method);
+                    w.U16(entry.dos_time);
+                    w.U16(entry.dos_date);
+                    w.U32(entry.crc32);
+                    w.U32(static_cast<std::uint32_t>(entry.compressed_size));
+                    w.U32(static_cast<std::uint32_t>(entry.size));
+                    w.Seek(pe.data_offset);
+                    w.Bytes(entry.data.data(), entry.data.size());
+                    entry.data = std::vector<unsigned char>();
+                    continue;
+                }
+            }
+
+            w.Seek(append);
+            WriteEntry(w, entry, opt, nullptr);
+            append = w.Offset();
+        }
+
+        w.Seek(append);
+        WriteDirectory(w, entries);
+        const std::uint64_t size = w.Offset();
+        w.Close();
+        if(!w.Good())
+        {
+            std::cerr << "Failed to write \"" << opt.output.u8string() << "\"" << std::endl;
+            return false;
+        }
+        fs::resize_file(opt.output, size, ec);
+        if(ec)
+        {
+            std::cerr << "Failed to resize \"" << opt.output.u8string() << "\": " << ec.message() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    int Pack(const Options& opt)
+    {
+        std::vector<Entry> entries;
+        entries.reserve(opt.inputs.size());
+        for(auto& i : opt.inputs)
+        {
+            Entry entry;
+            entry.file = i;
+            entry.name = fs::relative(i, opt.basepath).generic_u8string();
+            if(entry.name.empty() || entry.name.compare(0, 2, "..") == 0)
+            {
+                std::cerr << "\"" << i.u8string() << "\" is not inside the base path" << std::endl;
+                return EXIT_FAILURE;
+            }
+            entries.push_back(std::move(entry));
+        }
+        std::sort(
+            entries.begin(), entries.end(),
+            [](const Entry& lhs, const Entry& rhs) { return lhs.name < rhs.name; }
+        );
+        auto dup = std::adjacent_find(
+            entries.begin(), entries.end(),
+            [](const Entry& lhs, const Entry& rhs) { return lhs.name == rhs.name; }
+        );
+        if(dup != entries.end())
+        {
+            std::cerr << "Duplicated entry \"" << dup->name << "\"" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if(entries.size() >= std::numeric_limits<std::uint32_t>::max())
+        {
+            std::cerr << "Too many entries" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::optional<Previous> prev;
+        if(!opt.full && !opt.twa)
+            prev = LoadPrevious(opt);
+
+        const char* mode = opt.twa ? "twa" : "full";
+        if(opt.twa)
+        {
+            if(!RebuildTwa(opt, entries))
+                return EXIT_FAILURE;
+        }
+        else if(!prev)
+        {
+            if(!Rebuild(opt, entries, prev, false))
+                return EXIT_FAILURE;
+        }
+        else
+        {
+            ProcessRange(entries, 0, entries.size(), opt, &*prev);
+            if(!CheckErrors(entries, 0, entries.size()))
+                return EXIT_FAILURE;
+
+            // Unused bytes after updating: gaps of the previous package, data
+            // of removed and replaced entries
+            std::uint64_t live = 0;
+            for(auto& [name, pe] : prev->entries)
+                live += pe.Span();
+            std::uint64_t unused = prev->data_end - std::min(prev->data_end, live);
+            std::uint64_t appended = 0;
+            std::size_t changed = 0;
+            std::size_t kept = 0;
+            std::size_t removed = 0;
+            for(auto& i : entries)
+            {
+                if(i.previous)
+                {
+                    ++kept;
+                    continue;
+                }
+                ++changed;
+                auto it = prev->entries.find(i.name);
+                if(it != prev->entries.end())
+                    unused += it->second.compressed_size - std::min(it->second.compressed_size, i.compressed_size);
+                appended += 30 + i.name.size() + i.compressed_size;
+            }
+            for(auto& [name, pe] : prev->entries)
+            {
+                auto it = std::lower_bound(
+                    entries.begin(), entries.end(), name,
+                    [](const Entry& lhs, const std::string& rhs) { return lhs.name < rhs; }
+                );
+                if(it == entries.end() || it->name != name)
+                {
+                    unused += pe.Span();
+                    ++removed;
+                }
+            }
+
+            if(changed == 0 && removed == 0 && !opt.compact)
+            { // Only update the timestamp for the build system
+                prev.reset();
+                std::error_code ec;
+                fs::last_write_time(opt.output, fs::file_time_type::clock::now(), ec);
+                std::cout << opt.output.u8string() << ": up to date" << std::endl;
+                return EXIT_SUCCESS;
+            }
+
+            if(opt.compact || unused * 2 > prev->data_end + appended)
+            {
+                mode = "compacted";
+                if(!Rebuild(opt, entries, prev, true))
+                    return EXIT_FAILURE;
+            }
+            else
+            {
+                mode = "updated";
+                if(!Update(opt, entries, *prev))
+                    return EXIT_FAILURE;
+            }
+            std::cout
+                << opt.output.u8string() << ": "
+                << changed << " changed, "
+                << removed << " removed, "
+                << kept << " kept" << std::endl;
+        }
+
+        if(!opt.twa && !WriteManifest(opt, entries))
+        {
+            std::cerr << "Failed to write the manifest of \"" << opt.output.u8string() << "\"" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::uint64_t stored = 0;
+        std::uint64_t input_size = 0;
+        for(auto& i : entries)
+        {
+            if(i.method == METHOD_STORE)
+                ++stored;
+            input_size += i.size;
+        }
+        std::error_code ec;
+        std::cout
+            << opt.output.u8string() << " (" << mode << "): "
+            << entries.size() << " file(s), "
+            << stored << " stored, "
+            << input_size << " -> " << fs::file_size(opt.output, ec) << " bytes" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    int Main(int argc, char* argv[])
+    {
+        Options opt;
+        for(int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if(arg == "--full")
+            {
+                opt.full = true;
+                continue;
+            }
+            if(arg == "--compact")
+            {
+                opt.compact = true;
+                continue;
+            }
+            if(arg == "-i" || arg == "--input")
+            { // All remaining arguments are input files
+                for(++i; i < argc; ++i)
+                    opt.inputs.push_back(fs::u8path(argv[i]));
+                break;
+            }
+            if(i + 1 >= argc)
+            {
+                std::cerr << "Missing value of option: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+            std::string value = argv[++i];
+            if(arg == "-o" || arg == "--output")
+                opt.output = fs::u8path(value);
+            else if(arg == "-b" || arg == "--basepath")
+                opt.basepath = fs::u8path(value);
+            else if(arg == "-j" || arg == "--threads")
+                opt.threads = static_cast<unsigned>(std::max(std::atoi(value.c_str()), 1));
+            else if(arg == "-l" || arg == "--level")
+                opt.level = std::clamp(std::atoi(value.c_str()), 0, 9);
+            else if(arg == "-a" || arg == "--alignment")
+                opt.alignment = static_cast<std::uint32_t>(std::clamp(std::atoi(value.c_str()), 1, 0xFFFF));
+            else
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        opt.twa = opt.output.extension() == ".twa";
+        if(opt.output.empty() || opt.inputs.empty())
+        {
+            std::cerr
+                << "Usage: " << argv[0]
+                << " -o <output> [-b <base path>] [-j <threads>] [-l <level>] [-a <alignment>]"
+                << " [--full] [--compact] -i <files...>"
+                << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        try
+        {
+            return Pack(opt);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    return awe::tool::Main(argc, argv);
+}
@@ -0,0 +1,253 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+// Read throughput benchmark of vfs::FileBuf on a generated pak
+// Usage: twvfsbench [-s <size in MiB>] [-o <temporary pak>]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include <res/vfs.hpp>
+
+
+namespace awe::tool
+{
+    constexpr char ENTRY_NAME[] = "bench.bin";
+
+    template <typename T>
+    void WriteLE(std::ostream& os, T value)
+    {
+        char bytes[sizeof(T)];
+        for(std::size_t i = 0; i < sizeof(T); ++i)
+            bytes[i] = static_cast<char>((static_cast<std::uint64_t>(value) >> (i * 8)) & 0xFF);
+        os.write(bytes, sizeof(T));
+    }
+
+    // Write a zip archive with a single stored entry
+    bool WritePak(const std::string& path, const std::vector<char>& data)
+    {
+        const auto crc = static_cast<std::uint32_t>(crc32_z(
+            crc32_z(0, Z_NULL, 0),
+            reinterpret_cast<const Bytef*>(data.data()),
+            data.size()
+        ));
+        const auto size = static_cast<std::uint32_t>(data.size());
+        const auto name_size = static_cast<std::uint16_t>(sizeof(ENTRY_NAME) - 1);
+        constexpr std::uint16_t DOS_DATE = 0x21; // 1980-01-01
+
+        std::ofstream ofs(path, std::ios_base::binary);
+        // Local file header
+        WriteLE<std::uint32_t>(ofs, 0x04034B50);
+        WriteLE<std::uint16_t>(ofs, 20); // Version needed
+        WriteLE<std::uint16_t>(ofs, 0); // Flags
+        WriteLE<std::uint16_t>(ofs, 0); // Stored
+        WriteLE<std::uint16_t>(ofs, 0); // Time
+        WriteLE<std::uint16_t>(ofs, DOS_DATE);
+        WriteLE<std::uint32_t>(ofs, crc);
+        WriteLE<std::uint32_t>(ofs, size);
+        WriteLE<std::uint32_t>(ofs, size);
+        WriteLE<std::uint16_t>(ofs, name_size);
+        WriteLE<std::uint16_t>(ofs, 0); // Extra field
+        ofs.write(ENTRY_NAME, name_size);
+        ofs.write(data.data(), data.size());
+
+        // Central directory
+        const auto cd_offset = static_cast<std::uint32_t>(ofs.tellp());
+        WriteLE<std::uint32_t>(ofs, 0x02014B50);
+        WriteLE<std::uint16_t>(ofs, 20); // Version made by
+        WriteLE<std::uint16_t>(ofs, 20); // Version needed
+        WriteLE<std::uint16_t>(ofs, 0);
+        WriteLE<std::uint16_t>(ofs, 0);
+        WriteLE<std::uint16_t>(ofs, 0);
+        WriteLE<std::uint16_t>(ofs, DOS_DATE);
+        WriteLE<std::uint32_t>(ofs, crc);
+        WriteLE<std::uint32_t>(ofs, size);
+        WriteLE<std::uint32_t>(ofs, size);
+        WriteLE<std::uint16_t>(ofs, name_size);
+        WriteLE<std::uint16_t>(ofs, 0); // Extra field
+        WriteLE<std::uint16_t>(ofs, 0); // Comment
+        WriteLE<std::uint16_t>(ofs, 0); // Disk number
+        WriteLE<std::uint16_t>(ofs, 0); // Internal attributes
+        WriteLE<std::uint32_t>(ofs, 0); // External attributes
+        WriteLE<std::uint32_t>(ofs, 0); // Offset of the local header
+        ofs.write(ENTRY_NAME, name_size);
+        const auto cd_size = static_cast<std::uint32_t>(ofs.tellp()) - cd_offset;
+
+        // End of central directory
+        WriteLE<std::uint32_t>(ofs, 0x06054B50);
+        WriteLE<std::uint16_t>(ofs, 0);
+        WriteLE<std::uint16_t>(ofs, 0);
+        WriteLE<std::uint16_t>(ofs, 1);
+        WriteLE<std::uint16_t>(ofs, 1);
+        WriteLE<std::uint32_t>(ofs, cd_size);
+        WriteLE<std::uint32_t>(ofs, cd_offset);
+        WriteLE<std::uint16_t>(ofs, 0);
+
+        return static_cast<bool>(ofs);
+    }
+
+    struct Result
+    {
+        double seconds = 0.0;
+        std::uint64_t bytes = 0;
+        std::uint32_t checksum = 0; // Keep the reads from being optimized out
+    };
+
+    // Read the whole entry with istream::read() in chunks, the best of three runs
+    Result ReadStream(std::size_t buffer_size, std::size_t chunk_size)
+    {
+        using clock = std::chrono::steady_clock;
+        std::vector<char> chunk(chunk_size);
+        Result best;
+        for(int run = 0; run < 3; ++run)
+        {
+            Result result;
+            auto start = clock::now();
+            vfs::InputStream is;
+            is.SetBufferSize(buffer_size);
+            if(!is.Open(ENTRY_NAME))
+                return Result();
+            while(is.read(chunk.data(), chunk.size()) || is.gcount() > 0)
+            {
+                result.bytes += static_cast<std::uint64_t>(is.gcount());
+                result.checksum ^= static_cast<unsigned char>(chunk[0]);
+            }
+            result.seconds = std::chrono::duration<double>(clock::now() - start).count();
+            if(run == 0 || result.seconds < best.seconds)
+                best = result;
+        }
+        return best;
+    }
+    // Map the entry and touch every byte, the best of three runs
+    Result ReadMapped()
+    {
+        using clock = std::chrono::steady_clock;
+        Result best;
+        for(int run = 0; run < 3; ++run)
+        {
+            Result result;
+            auto start = clock::now();
+            vfs::MappedData data = vfs::MapData(ENTRY_NAME);
+            std::uint32_t checksum = 0;
+            for(std::size_t i = 0; i < data.Size(); ++i)
+                checksum += std::to_integer<std::uint32_t>(data.Data()[i]);
+            result.bytes = data.Size();
+            result.checksum = checksum;
+            result.seconds = std::chrono::duration<double>(clock::now() - start).count();
+            if(run == 0 || result.seconds < best.seconds)
+                best = result;
+        }
+        return best;
+    }
+
+    void Print(const std::string& name, const Result& result)
+    {
+        double mib = static_cast<double>(result.bytes) / (1024.0 * 1024.0);
+        std::cout
+            << std::left << std::setw(36) << name
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << (result.seconds > 0.0 ? mib / result.seconds : 0.0) << " MiB/s"
+            << std::setw(10) << result.seconds * 1000.0 << " ms"
+            << "  (checksum " << result.checksum << ")\n";
+    }
+
+    std::string SizeName(std::size_t bytes)
+    {
+        if(bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0)
+            return std::to_string(bytes / (1024 * 1024)) + "M";
+        if(bytes >= 1024 && bytes % 1024 == 0)
+            return std::to_string(bytes / 1024) + "K";
+        return std::to_string(bytes);
+    }
+
+    int Main(int argc, char* argv[])
+    {
+        int size_mib = 100;
+        std::string output = "twvfsbench.pak";
+        for(int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt = argv[i];
+            if(opt == "-s" || opt == "--size")
+                size_mib = std::atoi(argv[i + 1]);
+            else if(opt == "-o" || opt == "--output")
+                output = argv[i + 1];
+            else
+            {
+                std::cerr << "Unknown option: " << opt << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if(size_mib <= 0 || size_mib >= 4096 || output.empty())
+        {
+            std::cerr << "Usage: " << argv[0] << " [-s <size in MiB>] [-o <temporary pak>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        {
+            std::vector<char> data(static_cast<std::size_t>(size_mib) * 1024 * 1024);
+            std::mt19937 gen(42);
+            std::generate(data.begin(), data.end(), [&gen]() { return static_cast<char>(gen()); });
+            if(!WritePak(output, data))
+            {
+                std::cerr << "Failed to write \"" << output << "\"" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        if(PHYSFS_init(argv[0]) == 0)
+        {
+            std::cerr << "Failed to initialize PhysFS" << std::endl;
+            return EXIT_FAILURE;
+        }
+        int ret = EXIT_SUCCESS;
+        if(!vfs::Mount(output, "/"))
+        {
+            std::cerr << "Failed to mount \"" << output << "\"" << std::endl;
+            ret = EXIT_FAILURE;
+        }
+        else
+        {
+            std::cout << size_mib << " MiB stored entry in " << output << "\n";
+            // Warm up the page cache
+            ReadMapped();
+
+            // BUFSIZ is the size of the fixed buffer used before
+            const std::size_t buffer_sizes[] = { BUFSIZ, vfs::FileBuf::DEFAULT_BUFFER_SIZE, 1024 * 1024 };
+            const std::size_t chunk_sizes[] = { 256, 4 * 1024, 1024 * 1024 };
+            for(std::size_t chunk : chunk_sizes)
+            {
+                for(std::size_t buffer : buffer_sizes)
+                {
+                    Print(
+                        "FileBuf " + SizeName(buffer) + " buffer, " + SizeName(chunk) + " reads",
+                        ReadStream(buffer, chunk)
+                    );
+                }
+            }
+            Print("MapData", ReadMapped());
+            std::cout.flush();
+
+            vfs::Unmount(output);
+        }
+        PHYSFS_deinit();
+
+        std::error_code ec;
+        std::filesystem::remove(output, ec);
+        return ret;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    return awe::tool::Main(argc, argv);
+}
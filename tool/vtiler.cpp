@@ -0,0 +1,170 @@
+// Author: HenryAWE
+// License: The 3-clause BSD License
+
+// The virtual texture tiling tool of Testworld Project
+// Usage: twvtiler -i <input image> -o <output> [-t <tile size>] [-b <border>]
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stb_image.h>
+#include <graphic/common/vtformat.hpp>
+
+
+namespace awe::tool
+{
+    using graphic::common::VirtualTextureHeader;
+
+    struct Level
+    {
+        glm::ivec2 size;
+        std::vector<std::uint8_t> data; // RGBA8888
+
+        [[nodiscard]]
+        const std::uint8_t* Pixel(glm::ivec2 pos) const noexcept
+        { // Clamp to the edge
+            pos = glm::clamp(pos, glm::ivec2(0), size - 1);
+            return &data[(static_cast<std::size_t>(pos[1]) * size[0] + pos[0]) * 4];
+        }
+    };
+
+    Level Downsample(const Level& src)
+    {
+        Level dst;
+        dst.size = glm::max(src.size / 2, glm::ivec2(1));
+        dst.data.resize(static_cast<std::size_t>(dst.size[0]) * dst.size[1] * 4);
+        for(int y = 0; y < dst.size[1]; ++y)
+        {
+            for(int x = 0; x < dst.size[0]; ++x)
+            {
+                const std::uint8_t* p[4] =
+                {
+                    src.Pixel({ x * 2, y * 2 }),
+                    src.Pixel({ x * 2 + 1, y * 2 }),
+                    src.Pixel({ x * 2, y * 2 + 1 }),
+                    src.Pixel({ x * 2 + 1, y * 2 + 1 })
+                };
+                std::uint8_t* out = &dst.data[(static_cast<std::size_t>(y) * dst.size[0] + x) * 4];
+                for(int c = 0; c < 4; ++c)
+                    out[c] = static_cast<std::uint8_t>((p[0][c] + p[1][c] + p[2][c] + p[3][c] + 2) / 4);
+            }
+        }
+        return dst;
+    }
+
+    void WriteTiles(std::ostream& os, const Level& level, const VirtualTextureHeader& header)
+    {
+        const int ts = static_cast<int>(header.tile_size);
+        const int border = static_cast<int>(header.border);
+        const int padded = header.PaddedTileSize();
+        const glm::ivec2 count = (level.size + ts - 1) / ts;
+
+        std::vector<std::uint8_t> tile(header.TileBytes());
+        for(int ty = 0; ty < count[1]; ++ty)
+        {
+            for(int tx = 0; tx < count[0]; ++tx)
+            {
+                const glm::ivec2 origin = glm::ivec2(tx, ty) * ts - border;
+                for(int y = 0; y < padded; ++y)
+                {
+                    for(int x = 0; x < padded; ++x)
+                    {
+                        std::memcpy(
+                            &tile[(static_cast<std::size_t>(y) * padded + x) * 4],
+                            level.Pixel(origin + glm::ivec2(x, y)),
+                            4
+                        );
+                    }
+                }
+                os.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+            }
+        }
+    }
+
+    int Main(int argc, char* argv[])
+    {
+        std::string input;
+        std::string output;
+        int tile_size = 128;
+        int border = 4;
+        for(int i = 1; i + 1 < argc; i += 2)
+        {
+            std::string opt = argv[i];
+            if(opt == "-i" || opt == "--input")
+                input = argv[i + 1];
+            else if(opt == "-o" || opt == "--output")
+                output = argv[i + 1];
+            else if(opt == "-t" || opt == "--tile-size")
+                tile_size = std::atoi(argv[i + 1]);
+            else if(opt == "-b" || opt == "--border")
+                border = std::atoi(argv[i + 1]);
+            else
+            {
+                std::cerr << "Unknown option: " << opt << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        if(input.empty() || output.empty() || tile_size <= 0 || border < 0)
+        {
+            std::cerr << "Usage: " << argv[0] << " -i <input image> -o <output> [-t <tile size>] [-b <border>]" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        // Keep the same orientation as the runtime image loader
+        stbi_set_flip_vertically_on_load(true);
+        Level level;
+        stbi_uc* pixels = stbi_load(input.c_str(), &level.size[0], &level.size[1], nullptr, 4);
+        if(!pixels)
+        {
+            std::cerr << "Failed to load \"" << input << "\": " << stbi_failure_reason() << std::endl;
+            return EXIT_FAILURE;
+        }
+        level.data.assign(pixels, pixels + static_cast<std::size_t>(level.size[0]) * level.size[1] * 4);
+        stbi_image_free(pixels);
+
+        VirtualTextureHeader header{};
+        std::memcpy(header.magic, VirtualTextureHeader::MAGIC, sizeof(header.magic));
+        header.version = VirtualTextureHeader::VERSION;
+        header.width = level.size[0];
+        header.height = level.size[1];
+        header.tile_size = tile_size;
+        header.border = border;
+        header.levels = graphic::common::VirtualTextureLevels(level.size, tile_size);
+        header.channel = 4;
+
+        std::ofstream ofs(output, std::ios_base::binary);
+        if(!ofs)
+        {
+            std::cerr << "Failed to open \"" << output << "\"" << std::endl;
+            return EXIT_FAILURE;
+        }
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        for(std::uint32_t i = 0; i < header.levels; ++i)
+        {
+            if(i != 0)
+                level = Downsample(level);
+            WriteTiles(ofs, level, header);
+        }
+        if(!ofs)
+        {
+            std::cerr << "Failed to write \"" << output << "\"" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        std::cout
+            << output << ": "
+            << header.width << "x" << header.height << ", "
+            << header.levels << " level(s) of " << tile_size << "px tiles" << std::endl;
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    return awe::tool::Main(argc, argv);
+}